@@ -0,0 +1,88 @@
+/**
+ * @file bench.c
+ * @brief Shared helpers for the benchmark programs
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "bench.h"
+
+jmp_buf decaf_error;
+
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    ErrorTrap_throw_va(format, args);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Statement templates (the function body cycles through these)
+ */
+static const char* const statements[] = {
+    "    a = a + 1;\n",
+    "    f(a, b);\n",
+    "    if (a < b) { b = a; } else { a = b; }\n",
+    "    while (a > 0) { a = a - 1; continue; }\n",
+    "    x[a] = b * 2;\n",
+    "    b = f(a, 3) % 7;\n",
+    "    if (a == b) { return a; }\n",
+    "    g();\n",
+};
+
+char* generate_program (int nfuncs, int nstmts)
+{
+    size_t capacity = 1024;
+    size_t length = 0;
+    char* text = (char*)malloc(capacity);
+    CHECK_MALLOC_PTR(text)
+    text[0] = '\0';
+
+    char line[256];
+    int nlines = sizeof(statements) / sizeof(statements[0]);
+    for (int f = 0; f < nfuncs; f++) {
+        for (int s = -2; s <= nstmts; s++) {
+            if (s == -2) {
+                snprintf(line, sizeof(line), "def int f%d(int a, int b) {\n    int i;\n    bool done;\n", f);
+            } else if (s == -1) {
+                snprintf(line, sizeof(line), "    int x[10];\n");
+            } else if (s == nstmts) {
+                snprintf(line, sizeof(line), "    return a;\n}\n");
+            } else {
+                snprintf(line, sizeof(line), "%s", statements[(s + f) % nlines]);
+            }
+            size_t n = strlen(line);
+            while (length + n + 1 > capacity) {
+                capacity *= 2;
+                text = (char*)realloc(text, capacity);
+                CHECK_MALLOC_PTR(text)
+            }
+            memcpy(text + length, line, n + 1);
+            length += n;
+        }
+    }
+    return text;
+}
+
+TokenQueue* copy_tokens (TokenQueue* tokens)
+{
+    TokenQueue* copy = TokenQueue_new();
+    for (Token* t = tokens->head; t != NULL; t = t->next) {
+        Token* c = Token_new(t->type, t->text, t->line);
+        c->offset = t->offset;
+        TokenQueue_add(copy, c);
+    }
+    return copy;
+}
+
+double bench_now ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + now.tv_nsec / 1e9;
+}
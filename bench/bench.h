@@ -0,0 +1,39 @@
+/**
+ * @file bench.h
+ * @brief Shared helpers for the benchmark programs
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include "p1-lexer.h"
+#include "p2-parser.h"
+
+/**
+ * @brief Generate a synthetic Decaf program
+ *
+ * The program consists of statement-dense functions (a mix of assignments,
+ * calls, returns, loops and conditionals, with a few local declarations).
+ *
+ * @param nfuncs Number of functions
+ * @param nstmts Number of statements per function (plus the final return)
+ * @returns Newly-allocated source text
+ */
+char* generate_program (int nfuncs, int nstmts);
+
+/**
+ * @brief Make a deep copy of a token queue (so it can be parsed repeatedly)
+ *
+ * @param tokens Queue to copy
+ * @returns Newly-allocated copy
+ */
+TokenQueue* copy_tokens (TokenQueue* tokens);
+
+/**
+ * @brief Read a monotonic clock
+ *
+ * @returns Current time in seconds
+ */
+double bench_now ();
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file emit_bench.c
+ * @brief AST output format benchmark
+ *
+ * Parses a large generated program once, then writes it (to @c /dev/null) in
+ * each output format: the indented text of @ref PrintVisitor_traverse, JSON
+ * and S-expressions. Reports the best of several runs and the throughput in
+ * nodes per second.
+ *
+ * Usage: emit_bench [functions] [statements-per-function] [iterations]
+ */
+
+#include "bench.h"
+#include "emit.h"
+
+static long count_nodes (ASTNode* node);
+
+#define STATIC_VISITOR_TRAVERSE         count_traverse
+#define STATIC_VISITOR_STATE            long*
+#define STATIC_PREVISIT_default(S,N)    ((*(S))++)
+#include "static-visitor.h"
+
+static long count_nodes (ASTNode* tree)
+{
+    long count = 0;
+    count_traverse(&count, tree);
+    return count;
+}
+
+static void print_text (FILE* output, ASTNode* tree)
+{
+    PrintVisitor_traverse(output, tree);
+}
+
+static void measure (const char* what, void (*emit)(FILE*, ASTNode*), ASTNode* tree,
+                     long nodes, int iterations)
+{
+    double best = 1e9;
+    for (int i = 0; i < iterations; i++) {
+        FILE* sink = fopen("/dev/null", "w");
+        double start = bench_now();
+        emit(sink, tree);
+        fflush(sink);
+        double elapsed = bench_now() - start;
+        fclose(sink);
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("%-6s %8.3f s   %6.1f M nodes/s\n", what, best, nodes / best / 1e6);
+}
+
+int main (int argc, char** argv)
+{
+    int nfuncs = (argc > 1 ? atoi(argv[1]) : 2000);
+    int nstmts = (argc > 2 ? atoi(argv[2]) : 95);
+    int iterations = (argc > 3 ? atoi(argv[3]) : 3);
+
+    char* text = generate_program(nfuncs, nstmts);
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+    free(text);
+    SetParentVisitor_traverse(tree);
+    CalcDepthVisitor_traverse(tree);
+
+    long nodes = count_nodes(tree);
+    printf("%ld nodes\n", nodes);
+    measure("text", print_text, tree, nodes, iterations);
+    measure("json", JsonVisitor_traverse, tree, nodes, iterations);
+    measure("sexp", SExprVisitor_traverse, tree, nodes, iterations);
+
+    ASTNode_free(tree);
+    return EXIT_SUCCESS;
+}
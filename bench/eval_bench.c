@@ -0,0 +1,104 @@
+/**
+ * @file eval_bench.c
+ * @brief Memoization benchmark for the AST interpreter
+ *
+ * Runs a program that computes <tt>fib(n)</tt> with the naive doubly
+ * recursive function (see interp.h), with and without caching the calls to
+ * pure functions. For each @c n, reports the function bodies run and the time
+ * taken both ways, and the cache hit rate: without the cache, calls and time
+ * grow exponentially (about 1.6 times per step of @c n); with it, there are
+ * @c n + 2 calls (counting @c main) and the hit rate approaches 50%. With
+ * @c -m, only the cached runs are timed, so @c n can be large.
+ *
+ * Usage: eval_bench [-r runs] [-m] [n...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "interp.h"
+
+/**
+ * @brief Time one interpreter configuration (the best of several runs)
+ */
+static double time_run (ASTNode* tree, bool memoize, int runs, InterpStats* stats)
+{
+    InterpConfig config;
+    InterpConfig_init(&config);
+    config.memoize = memoize;
+    config.max_steps = 0;
+    FILE* sink = fopen("/dev/null", "w");
+    double best = 1e9;
+    for (int i = 0; i < runs; i++) {
+        double start = bench_now();
+        Interp_run(tree, &config, sink, stats);
+        double elapsed = bench_now() - start;
+        best = (elapsed < best ? elapsed : best);
+    }
+    fclose(sink);
+    return best;
+}
+
+static void run_size (int n, int runs, bool memo_only)
+{
+    char text[256];
+    snprintf(text, sizeof(text),
+            "def int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n"
+            "def int main() { return fib(%d); }\n", n);
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+
+    InterpStats plain, memoized;
+    double memo_time = time_run(tree, true, runs, &memoized);
+    if (memo_only) {
+        printf("%4d %12s %10s %8ld %10.3f %6.1f%%\n", n, "-", "-", memoized.calls, memo_time * 1e3,
+                100.0 * memoized.memo_hits / (memoized.memo_lookups > 0 ? memoized.memo_lookups : 1));
+        ASTNode_free(tree);
+        TokenQueue_free(tokens);
+        return;
+    }
+    double plain_time = time_run(tree, false, runs, &plain);
+    printf("%4d %12ld %10.3f %8ld %10.3f %6.1f%% %9.0fx%s\n",
+            n, plain.calls, plain_time * 1e3, memoized.calls, memo_time * 1e3,
+            100.0 * memoized.memo_hits / (memoized.memo_lookups > 0 ? memoized.memo_lookups : 1),
+            plain_time / memo_time,
+            (plain.result == memoized.result ? "" : "  RESULT DIFFERS"));
+
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+}
+
+int main (int argc, char** argv)
+{
+    int runs = 3;
+    bool memo_only = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:m")) != -1) {
+        switch (opt) {
+            case 'r': runs = atoi(optarg); break;
+            case 'm': memo_only = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r runs] [-m] [n...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (runs < 1) {
+        fprintf(stderr, "Usage: %s [-r runs] [-m] [n...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%4s %12s %10s %8s %10s %7s %10s\n", "n", "calls", "plain ms",
+            "memo", "memo ms", "hits", "speedup");
+    if (optind == argc) {
+        int sizes[] = { 10, 15, 20, 25, 30 };
+        for (int i = 0; i < 5; i++) {
+            run_size(sizes[i], runs, memo_only);
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        run_size(atoi(argv[i]), runs, memo_only);
+    }
+    return EXIT_SUCCESS;
+}
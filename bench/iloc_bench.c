@@ -0,0 +1,122 @@
+/**
+ * @file iloc_bench.c
+ * @brief ILOC kernel benchmark
+ *
+ * Runs each ILOC kernel (see the @c kernels directory) on the simulator in
+ * ilocsim.h and reports what the code did (dynamic instructions, cycles,
+ * instructions per cycle, loads and stores, and cache misses if a cache is
+ * configured) along with how fast the simulator ran it (the best of several
+ * runs, in millions of simulated instructions per second). Output from
+ * @c print instructions is discarded.
+ *
+ * The counts are deterministic, so they can be compared directly before and
+ * after a code generation or optimization change.
+ *
+ * Usage: iloc_bench [-r runs] [-c cache-lines] [-s] [-p] file...
+ *
+ * With @c -s, the machine is not pipelined (every instruction takes its full
+ * latency). With @c -p, each kernel goes through the peephole optimizer
+ * (see peephole.h) first, and the optimizer's own time is reported too.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "ilocsim.h"
+#include "peephole.h"
+
+/**
+ * @brief Simulate one kernel and print a line of results
+ *
+ * @returns True if the kernel parsed and ran
+ */
+static bool run_kernel (const char* filename, const ILOCMachineConfig* config, int runs,
+                        bool optimize)
+{
+    char* text = read_file(filename);
+    if (text == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
+        return false;
+    }
+    FILE* sink = fopen("/dev/null", "w");
+    ILOCInsnList* volatile program = NULL;
+    ILOCStats stats;
+    double best = 1e9;
+    double optimize_time = 0.0;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        program = ILOCInsnList_parse(text);
+        if (optimize) {
+            double start = bench_now();
+            Peephole_optimize(program, peephole_rules, peephole_rule_count, NULL);
+            optimize_time = bench_now() - start;
+        }
+        for (int i = 0; i < runs; i++) {
+            double start = bench_now();
+            ILOCMachine_run(program, config, sink, &stats);
+            double elapsed = bench_now() - start;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+    } else {
+        ErrorTrap_pop(&trap);
+        fprintf(stderr, "%s: %s", filename, trap.message);
+        if (program != NULL) ILOCInsnList_free(program);
+        fclose(sink);
+        free(text);
+        return false;
+    }
+    ErrorTrap_pop(&trap);
+
+    const char* name = strrchr(filename, '/');
+    name = (name != NULL ? name + 1 : filename);
+    printf("%-14s %10ld %10ld %6.2f %9ld %9ld %9ld %8.3f %8.1f\n", name,
+            stats.instructions, stats.cycles, (double)stats.instructions / stats.cycles,
+            stats.loads, stats.stores, stats.cache_misses,
+            best, stats.instructions / best / 1e6);
+    if (optimize) {
+        printf("%-14s peephole pass took %.3f ms\n", "", optimize_time * 1e3);
+    }
+
+    ILOCInsnList_free(program);
+    fclose(sink);
+    free(text);
+    return true;
+}
+
+int main (int argc, char** argv)
+{
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    int runs = 5;
+
+    int opt;
+    bool optimize = false;
+    while ((opt = getopt(argc, argv, "r:c:sp")) != -1) {
+        switch (opt) {
+            case 'r': runs = atoi(optarg); break;
+            case 'c': config.cache_lines = atoi(optarg); break;
+            case 's': config.pipelined = false; break;
+            case 'p': optimize = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r runs] [-c cache-lines] [-s] [-p] file...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (runs < 1 || config.cache_lines < 0 || optind == argc) {
+        fprintf(stderr, "Usage: %s [-r runs] [-c cache-lines] [-s] [-p] file...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-14s %10s %10s %6s %9s %9s %9s %8s %8s\n", "kernel", "insns", "cycles",
+            "ipc", "loads", "stores", "misses", "sim s", "mips");
+    bool ok = true;
+    for (int i = optind; i < argc; i++) {
+        ok = run_kernel(argv[i], &config, runs, optimize) && ok;
+    }
+    return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,135 @@
+/**
+ * @file lsp_bench.c
+ * @brief Language server edit latency benchmark
+ *
+ * Generates a large program, opens it in a @ref LanguageServer and then acts
+ * as a scripted editor: each iteration sends an incremental
+ * @c textDocument/didChange that types a character into a function in the
+ * middle of the file (and the next one deletes it again), followed by a
+ * @c textDocument/definition request. The edits are then repeated while
+ * that function is missing its closing brace, so that every one of them
+ * leaves the file with a parse error. The time for each message includes
+ * JSON parsing, the incremental reparse and writing the response and
+ * diagnostics (to @c /dev/null).
+ *
+ * Usage: lsp_bench [functions] [statements-per-function] [iterations]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+#include "lsp.h"
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Send one message and return how long the server took (in seconds)
+ */
+static double timed_message (LanguageServer* server, const char* message)
+{
+    double start = bench_now();
+    LanguageServer_handle(server, message, strlen(message));
+    return bench_now() - start;
+}
+
+/**
+ * @brief Format a @c textDocument/didChange that replaces @p length
+ * characters at a position with @p text
+ */
+static const char* change (char* message, size_t size, int line, int character, int length,
+                           const char* text)
+{
+    snprintf(message, size, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\","
+             "\"params\":{\"textDocument\":{\"uri\":\"file:///bench.decaf\"},\"contentChanges\":"
+             "[{\"range\":{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,"
+             "\"character\":%d}},\"text\":\"%s\"}]}}", line, character, line, character + length, text);
+    return message;
+}
+
+static void report (const char* what, double* times, int n)
+{
+    qsort(times, n, sizeof(double), compare_doubles);
+    printf("%-12s median %.3f ms   p90 %.3f ms   max %.3f ms\n", what,
+            times[n / 2] * 1e3, times[n * 9 / 10] * 1e3, times[n - 1] * 1e3);
+}
+
+int main (int argc, char** argv)
+{
+    int nfuncs = (argc > 1 ? atoi(argv[1]) : 500);
+    int nstmts = (argc > 2 ? atoi(argv[2]) : 95);
+    int iterations = (argc > 3 ? atoi(argv[3]) : 200);
+
+    char* text = generate_program(nfuncs, nstmts);
+    int nlines = 0;
+    for (const char* p = text; *p != '\0'; p++) {
+        nlines += (*p == '\n');
+    }
+
+    /* escape the program as a JSON string for didOpen */
+    char* escaped = NULL;
+    size_t escaped_length = 0;
+    FILE* out = open_memstream(&escaped, &escaped_length);
+    fputc('"', out);
+    for (const char* p = text; *p != '\0'; p++) {
+        if (*p == '\n') {
+            fputs("\\n", out);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+    fclose(out);
+    char* open = (char*)malloc(escaped_length + 256);
+    sprintf(open, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":"
+                  "{\"textDocument\":{\"uri\":\"file:///bench.decaf\",\"text\":%s}}}", escaped);
+
+    FILE* sink = fopen("/dev/null", "w");
+    LanguageServer* server = LanguageServer_new(sink);
+    double open_time = timed_message(server, open);
+
+    /* the first statement of the middle function ("    a = a + 1;" or similar) */
+    int line = (nfuncs / 2) * (nstmts + 6) + 4;
+    double* edits = (double*)malloc(iterations * sizeof(double));
+    double* broken = (double*)malloc(iterations * sizeof(double));
+    double* lookups = (double*)malloc(iterations * sizeof(double));
+    char message[512];
+    for (int i = 0; i < iterations; i++) {
+        edits[i] = timed_message(server, change(message, sizeof(message), line, 4, (i % 2), (i % 2 ? "" : " ")));
+
+        snprintf(message, sizeof(message), "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":"
+                 "\"textDocument/definition\",\"params\":{\"textDocument\":{\"uri\":"
+                 "\"file:///bench.decaf\"},\"position\":{\"line\":%d,\"character\":5}}}", i, line);
+        lookups[i] = timed_message(server, message);
+    }
+
+    /* the same edits while the function is missing its closing brace */
+    int close = line + nstmts + 1;
+    timed_message(server, change(message, sizeof(message), close, 0, 1, ""));
+    for (int i = 0; i < iterations; i++) {
+        broken[i] = timed_message(server, change(message, sizeof(message), line, 4, (i % 2), (i % 2 ? "" : " ")));
+    }
+    timed_message(server, change(message, sizeof(message), close, 0, 0, "}"));
+
+    Document* doc = LanguageServer_document(server, "file:///bench.decaf");
+    printf("%d lines, %d bytes, %s\n", nlines, doc->length,
+            (doc->tree != NULL ? "parses" : "DOES NOT PARSE"));
+    printf("didOpen      %.3f ms\n", open_time * 1e3);
+    report("didChange", edits, iterations);
+    report("(broken)", broken, iterations);
+    report("definition", lookups, iterations);
+
+    LanguageServer_free(server);
+    fclose(sink);
+    free(edits);
+    free(broken);
+    free(lookups);
+    free(open);
+    free(escaped);
+    free(text);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,495 @@
+/**
+ * @file micro_bench.c
+ * @brief Microbenchmarks for the core data structures
+ *
+ * Times the individual operations that everything else is built from:
+ *
+ * - @ref TokenQueue_add, @ref TokenQueue_peek, @ref TokenQueue_remove and
+ *   @ref TokenQueue_size (on a short and a long queue, since it walks the list)
+ * - @ref NodeList_add and iteration with @ref FOR_EACH
+ * - @ref ASTNode_set_attribute, @ref ASTNode_get_attribute and
+ *   @ref ASTNode_has_attribute (on nodes with the usual handful of attributes:
+ *   @c parent, @c depth, @c type and @c reg)
+ * - @ref ASTNode_new and @ref ASTNode_free
+ * - @ref NodeVisitor_traverse dispatch (a visitor whose only callback counts
+ *   nodes, on a generated program)
+ *
+ * Each benchmark times a batch of operations per repetition, with allocation
+ * and other setup kept outside the timed region. After some untimed warmup
+ * repetitions, it reports the minimum, median and other percentiles of the
+ * per-operation times, as a table or (with @c -c) as CSV for comparing runs.
+ *
+ * Usage: micro_bench [-r repetitions] [-w warmup] [-n operations] [-c] [name...]
+ *
+ * Names select benchmarks by prefix (e.g. @c tokenqueue or @c attr_get).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
+#include "bench.h"
+
+/**
+ * @brief Sink for values read by the benchmarks (so they are not optimized out)
+ */
+static volatile long sink;
+
+/**
+ * @brief Attribute keys, in the order a compiler pass would add them
+ */
+static const char* const keys[] = { "parent", "depth", "type", "reg" };
+#define NKEYS ((int)(sizeof(keys) / sizeof(keys[0])))
+
+/**
+ * @brief State shared by the repetitions of one benchmark
+ *
+ * Setup allocates whatever the timed region needs, and teardown frees it, so
+ * neither is part of the measurement.
+ */
+typedef struct Fixture
+{
+    int n;                  /**< @brief Number of operations per repetition */
+    Token** tokens;         /**< @brief Preallocated tokens */
+    TokenQueue* queue;      /**< @brief Token queue */
+    ASTNode** nodes;        /**< @brief Preallocated nodes */
+    NodeList* list;         /**< @brief Node list */
+    ASTNode* tree;          /**< @brief Parsed program */
+} Fixture;
+
+/**
+ * @brief One microbenchmark
+ */
+typedef struct Benchmark
+{
+    const char* name;                   /**< @brief Name (for selecting and reporting) */
+    void (*setup)(Fixture*);            /**< @brief Prepare one repetition (not timed; may be @c NULL) */
+    long (*run)(Fixture*);              /**< @brief Timed region; returns the number of operations */
+    void (*teardown)(Fixture*);         /**< @brief Clean up one repetition (not timed; may be @c NULL) */
+} Benchmark;
+
+
+/*
+ * TOKEN QUEUE
+ */
+
+static void tokens_setup (Fixture* f)
+{
+    f->tokens = (Token**)malloc(f->n * sizeof(Token*));
+    CHECK_MALLOC_PTR(f->tokens)
+    for (int i = 0; i < f->n; i++) {
+        f->tokens[i] = Token_new(ID, "a", i);
+    }
+    f->queue = TokenQueue_new();
+}
+
+static void queue_setup (Fixture* f)
+{
+    tokens_setup(f);
+    for (int i = 0; i < f->n; i++) {
+        TokenQueue_add(f->queue, f->tokens[i]);
+    }
+}
+
+/**
+ * @brief Free the queue and any tokens that are no longer in it
+ */
+static void queue_teardown (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        if (f->tokens[i] != NULL) {
+            Token_free(f->tokens[i]);
+        }
+    }
+    free(f->tokens);
+    free(f->queue);
+}
+
+static long tokenqueue_add (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        TokenQueue_add(f->queue, f->tokens[i]);
+    }
+    return f->n;
+}
+
+static long tokenqueue_peek (Fixture* f)
+{
+    long lines = 0;
+    for (int i = 0; i < f->n; i++) {
+        lines += TokenQueue_peek(f->queue)->line;
+    }
+    sink = lines;
+    return f->n;
+}
+
+static long tokenqueue_remove (Fixture* f)
+{
+    long lines = 0;
+    for (int i = 0; i < f->n; i++) {
+        lines += TokenQueue_remove(f->queue)->line;
+    }
+    sink = lines;
+    return f->n;
+}
+
+/**
+ * @brief Ask for the size of a queue of @p length tokens @p n times
+ */
+static long tokenqueue_size (Fixture* f, int length)
+{
+    TokenQueue* queue = TokenQueue_new();
+    for (int i = 0; i < length; i++) {
+        TokenQueue_add(queue, f->tokens[i]);
+    }
+    f->tokens[length-1]->next = NULL;
+    long total = 0;
+    for (int i = 0; i < f->n; i++) {
+        total += (long)TokenQueue_size(queue);
+    }
+    sink = total;
+    free(queue);
+    return f->n;
+}
+
+static long tokenqueue_size_16 (Fixture* f)
+{
+    return tokenqueue_size(f, 16);
+}
+
+static long tokenqueue_size_1024 (Fixture* f)
+{
+    return tokenqueue_size(f, 1024);
+}
+
+static void size_setup (Fixture* f)
+{
+    int n = f->n;
+    f->n = (n < 1024 ? 1024 : n);
+    tokens_setup(f);
+    f->n = n;
+}
+
+static void size_teardown (Fixture* f)
+{
+    int n = f->n;
+    f->n = (n < 1024 ? 1024 : n);
+    queue_teardown(f);
+    f->n = n;
+}
+
+
+/*
+ * NODE LIST
+ */
+
+static void nodes_setup (Fixture* f)
+{
+    f->nodes = (ASTNode**)malloc(f->n * sizeof(ASTNode*));
+    CHECK_MALLOC_PTR(f->nodes)
+    for (int i = 0; i < f->n; i++) {
+        f->nodes[i] = ASTNode_new(BREAKSTMT, i);
+    }
+    f->list = NodeList_new();
+}
+
+static void list_setup (Fixture* f)
+{
+    nodes_setup(f);
+    for (int i = 0; i < f->n; i++) {
+        NodeList_add(f->list, f->nodes[i]);
+    }
+}
+
+static void list_teardown (Fixture* f)
+{
+    /* frees the nodes as well (they are all in the list) */
+    NodeList_free(f->list);
+    free(f->nodes);
+}
+
+static long nodelist_add (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        NodeList_add(f->list, f->nodes[i]);
+    }
+    return f->n;
+}
+
+static long nodelist_iterate (Fixture* f)
+{
+    long lines = 0;
+    FOR_EACH (ASTNode*, node, f->list) {
+        lines += node->source_line;
+    }
+    sink = lines;
+    return f->n;
+}
+
+
+/*
+ * ATTRIBUTES
+ */
+
+static void attributes_setup (Fixture* f)
+{
+    list_setup(f);
+    for (int i = 0; i < f->n; i++) {
+        for (int k = 0; k < NKEYS; k++) {
+            ASTNode_set_int_attribute(f->nodes[i], keys[k], i);
+        }
+    }
+}
+
+static long attr_set (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        for (int k = 0; k < NKEYS; k++) {
+            ASTNode_set_int_attribute(f->nodes[i], keys[k], i);
+        }
+    }
+    return (long)f->n * NKEYS;
+}
+
+static long attr_get (Fixture* f)
+{
+    long total = 0;
+    for (int i = 0; i < f->n; i++) {
+        for (int k = 0; k < NKEYS; k++) {
+            total += ASTNode_get_int_attribute(f->nodes[i], keys[k]);
+        }
+    }
+    sink = total;
+    return (long)f->n * NKEYS;
+}
+
+/**
+ * @brief Look up each present key and one missing key (the usual way passes
+ * check for an attribute before computing it)
+ */
+static long attr_has (Fixture* f)
+{
+    long found = 0;
+    for (int i = 0; i < f->n; i++) {
+        for (int k = 0; k < NKEYS; k++) {
+            found += ASTNode_has_attribute(f->nodes[i], keys[k]);
+        }
+        found += ASTNode_has_attribute(f->nodes[i], "symbolTable");
+    }
+    sink = found;
+    return (long)f->n * (NKEYS + 1);
+}
+
+
+/*
+ * NODE ALLOCATION
+ */
+
+static void alloc_setup (Fixture* f)
+{
+    f->nodes = (ASTNode**)malloc(f->n * sizeof(ASTNode*));
+    CHECK_MALLOC_PTR(f->nodes)
+}
+
+static void alloc_teardown (Fixture* f)
+{
+    free(f->nodes);
+}
+
+static long astnode_new (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        f->nodes[i] = ASTNode_new(BREAKSTMT, i);
+    }
+    return f->n;
+}
+
+static void astnode_new_teardown (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        ASTNode_free(f->nodes[i]);
+    }
+    alloc_teardown(f);
+}
+
+static void astnode_free_setup (Fixture* f)
+{
+    alloc_setup(f);
+    astnode_new(f);
+}
+
+static long astnode_free (Fixture* f)
+{
+    for (int i = 0; i < f->n; i++) {
+        ASTNode_free(f->nodes[i]);
+    }
+    return f->n;
+}
+
+
+/*
+ * VISITOR DISPATCH
+ */
+
+static void count_node (NodeVisitor* visitor, ASTNode* node)
+{
+    (*(long*)visitor->data)++;
+}
+
+/**
+ * @brief Parse a program with roughly @c n nodes (about 6 per statement)
+ */
+static void tree_setup (Fixture* f)
+{
+    int nstmts = f->n / 6 / 10;
+    char* text = generate_program(10, (nstmts < 1 ? 1 : nstmts));
+    TokenQueue* tokens = lex(text);
+    f->tree = parse(tokens);
+    TokenQueue_free(tokens);
+    free(text);
+}
+
+static void tree_teardown (Fixture* f)
+{
+    ASTNode_free(f->tree);
+}
+
+static long visitor_dispatch (Fixture* f)
+{
+    long count = 0;
+    NodeVisitor* visitor = NodeVisitor_new();
+    visitor->data = &count;
+    visitor->previsit_default = count_node;
+    NodeVisitor_traverse(visitor, f->tree);
+    NodeVisitor_free(visitor);
+    sink = count;
+    return count;
+}
+
+
+static const Benchmark benchmarks[] = {
+    { "tokenqueue_add",         tokens_setup,       tokenqueue_add,         queue_teardown },
+    { "tokenqueue_peek",        queue_setup,        tokenqueue_peek,        queue_teardown },
+    { "tokenqueue_remove",      queue_setup,        tokenqueue_remove,      queue_teardown },
+    { "tokenqueue_size_16",     size_setup,         tokenqueue_size_16,     size_teardown },
+    { "tokenqueue_size_1024",   size_setup,         tokenqueue_size_1024,   size_teardown },
+    { "nodelist_add",           nodes_setup,        nodelist_add,           list_teardown },
+    { "nodelist_iterate",       list_setup,         nodelist_iterate,       list_teardown },
+    { "attr_set",               attributes_setup,   attr_set,               list_teardown },
+    { "attr_get",               attributes_setup,   attr_get,               list_teardown },
+    { "attr_has",               attributes_setup,   attr_has,               list_teardown },
+    { "astnode_new",            alloc_setup,        astnode_new,            astnode_new_teardown },
+    { "astnode_free",           astnode_free_setup, astnode_free,           alloc_teardown },
+    { "visitor_dispatch",       tree_setup,         visitor_dispatch,       tree_teardown },
+};
+
+static int compare_doubles (const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/**
+ * @brief Nearest-rank percentile of sorted samples
+ */
+static double percentile (const double* sorted, int count, double p)
+{
+    int rank = (int)(p / 100.0 * count + 0.999999);
+    rank = (rank < 1 ? 1 : (rank > count ? count : rank));
+    return sorted[rank-1];
+}
+
+/**
+ * @brief Run one benchmark and report its per-operation times (in ns)
+ */
+static void measure (const Benchmark* bench, int n, int repetitions, int warmup, bool csv)
+{
+    double* samples = (double*)malloc(repetitions * sizeof(double));
+    CHECK_MALLOC_PTR(samples)
+    long ops = 0;
+    for (int rep = -warmup; rep < repetitions; rep++) {
+        Fixture fixture = { .n = n };
+        if (bench->setup != NULL) {
+            bench->setup(&fixture);
+        }
+        double start = bench_now();
+        ops = bench->run(&fixture);
+        double elapsed = bench_now() - start;
+        if (bench->teardown != NULL) {
+            bench->teardown(&fixture);
+        }
+        if (rep >= 0) {
+            samples[rep] = elapsed * 1e9 / (ops > 0 ? ops : 1);
+        }
+    }
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+
+    double p5 = percentile(samples, repetitions, 5);
+    double p50 = percentile(samples, repetitions, 50);
+    double p95 = percentile(samples, repetitions, 95);
+    double p99 = percentile(samples, repetitions, 99);
+    if (csv) {
+        printf("%s,%ld,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", bench->name, ops, repetitions,
+                samples[0], p5, p50, p95, p99, samples[repetitions-1]);
+    } else {
+        printf("%-22s %9ld %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n", bench->name, ops,
+                samples[0], p5, p50, p95, p99, samples[repetitions-1]);
+    }
+    free(samples);
+}
+
+/**
+ * @brief Whether a benchmark was selected on the command line
+ */
+static bool selected (const char* name, char** patterns, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (strncmp(name, patterns[i], strlen(patterns[i])) == 0) {
+            return true;
+        }
+    }
+    return (count == 0);
+}
+
+int main (int argc, char** argv)
+{
+    int repetitions = 31;
+    int warmup = 3;
+    int n = 100000;
+    bool csv = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:w:n:c")) != -1) {
+        switch (opt) {
+            case 'r': repetitions = atoi(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'n': n = atoi(optarg); break;
+            case 'c': csv = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r repetitions] [-w warmup] [-n operations] [-c] [name...]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (repetitions < 1 || warmup < 0 || n < 1) {
+        fprintf(stderr, "Repetitions and operations must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (csv) {
+        printf("benchmark,operations,repetitions,min_ns,p5_ns,median_ns,p95_ns,p99_ns,max_ns\n");
+    } else {
+        printf("%d repetitions (after %d warmup) of %d operations; times in ns per operation\n",
+                repetitions, warmup, n);
+        printf("%-22s %9s %8s %8s %8s %8s %8s %8s\n", "benchmark", "ops",
+                "min", "p5", "median", "p95", "p99", "max");
+    }
+    int nbenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    for (int i = 0; i < nbenchmarks; i++) {
+        if (selected(benchmarks[i].name, argv + optind, argc - optind)) {
+            measure(&benchmarks[i], n, repetitions, warmup, csv);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file par_bench.c
+ * @brief Parallel traversal scaling benchmark
+ *
+ * Runs the same per-node analysis (a node count plus an FNV-1a hash of every
+ * identifier, standing in for a real per-function analysis) sequentially with
+ * @ref NodeVisitor_traverse and in parallel with
+ * @ref NodeVisitor_traverse_parallel using 1, 2, 4, ... threads, and reports
+ * the best time and speedup for each thread count.
+ *
+ * Usage: par_bench [functions] [statements-per-function] [iterations] [max-threads] [block-split]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "partrav.h"
+
+/**
+ * @brief Per-worker analysis results
+ */
+typedef struct Summary
+{
+    long nodes;
+    unsigned long hash;
+} Summary;
+
+static void hash_name (Summary* summary, const char* name)
+{
+    /* order-independent combination so that results do not depend on scheduling */
+    unsigned long h = 14695981039346656037UL;
+    for (const char* p = name; *p != '\0'; p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211UL;
+    }
+    summary->hash += h;
+}
+
+static void summarize (NodeVisitor* visitor, ASTNode* node)
+{
+    Summary* summary = (Summary*)visitor->data;
+    summary->nodes++;
+    switch (node->type) {
+        case VARDECL:  hash_name(summary, node->vardecl.name);  break;
+        case FUNCDECL: hash_name(summary, node->funcdecl.name); break;
+        case LOCATION: hash_name(summary, node->location.name); break;
+        case FUNCCALL: hash_name(summary, node->funccall.name); break;
+        default: break;
+    }
+}
+
+static NodeVisitor* Summary_new (void* context, int worker)
+{
+    NodeVisitor* v = NodeVisitor_new();
+    v->data = calloc(1, sizeof(Summary));
+    CHECK_MALLOC_PTR(v->data)
+    v->dtor = free;
+    v->previsit_default = summarize;
+    return v;
+}
+
+static void Summary_reduce (void* context, NodeVisitor* visitor)
+{
+    Summary* total = (Summary*)context;
+    Summary* part = (Summary*)visitor->data;
+    total->nodes += part->nodes;
+    total->hash += part->hash;
+}
+
+int main (int argc, char** argv)
+{
+    int nfuncs = (argc > 1 ? atoi(argv[1]) : 200);
+    int nstmts = (argc > 2 ? atoi(argv[2]) : 100);
+    int iterations = (argc > 3 ? atoi(argv[3]) : 20);
+    int max_threads = (argc > 4 ? atoi(argv[4]) : 8);
+    int block_split = (argc > 5 ? atoi(argv[5]) : 0);
+
+    char* text = generate_program(nfuncs, nstmts);
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+
+    Summary expected = { 0 };
+    double sequential = 0.0;
+    for (int i = 0; i < iterations; i++) {
+        NodeVisitor* v = Summary_new(NULL, 0);
+        double start = bench_now();
+        NodeVisitor_traverse(v, tree);
+        double t = bench_now() - start;
+        if (i == 0 || t < sequential) {
+            sequential = t;
+        }
+        expected = *(Summary*)v->data;
+        NodeVisitor_free(v);
+    }
+    printf("%d functions, %ld nodes, %ld online CPUs, best of %d\n", nfuncs, expected.nodes,
+            sysconf(_SC_NPROCESSORS_ONLN), iterations);
+    printf("sequential     %8.3f ms\n", sequential * 1e3);
+
+    for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        double best = 0.0;
+        for (int i = 0; i < iterations; i++) {
+            Summary total = { 0 };
+            ParallelTraversal traversal = { Summary_new, Summary_reduce, &total, nthreads, block_split };
+            double start = bench_now();
+            NodeVisitor_traverse_parallel(&traversal, tree);
+            double t = bench_now() - start;
+            if (i == 0 || t < best) {
+                best = t;
+            }
+            if (total.nodes != expected.nodes || total.hash != expected.hash) {
+                fprintf(stderr, "result mismatch with %d threads\n", nthreads);
+                return EXIT_FAILURE;
+            }
+        }
+        printf("%2d thread%s     %8.3f ms  (%.2fx)\n", nthreads, (nthreads == 1 ? " " : "s"),
+                best * 1e3, sequential / best);
+    }
+
+    ASTNode_free(tree);
+    free(text);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file parse_bench.c
+ * @brief Parser throughput benchmark
+ *
+ * Generates a program made of statement-dense functions (a mix of
+ * assignments, calls, returns, loops and conditionals, with a few local
+ * declarations), lexes it once, and then times @ref parse alone on fresh
+ * copies of the token queue.
+ *
+ * Usage: parse_bench [functions] [statements-per-function] [iterations]
+ */
+
+#include "bench.h"
+
+int main (int argc, char** argv)
+{
+    int nfuncs = (argc > 1 ? atoi(argv[1]) : 200);
+    int nstmts = (argc > 2 ? atoi(argv[2]) : 100);
+    int iterations = (argc > 3 ? atoi(argv[3]) : 20);
+
+    char* text = generate_program(nfuncs, nstmts);
+    TokenQueue* tokens = lex(text);
+    size_t ntokens = TokenQueue_size(tokens);
+
+    double best = 0.0;
+    for (int i = 0; i < iterations; i++) {
+        TokenQueue* input = copy_tokens(tokens);
+        double start = bench_now();
+        ASTNode* tree = parse(input);
+        double t = bench_now() - start;
+        if (i == 0 || t < best) {
+            best = t;
+        }
+        ASTNode_free(tree);
+        TokenQueue_free(input);
+    }
+
+    long nstatements = (long)nfuncs * (nstmts + 1);
+    printf("%d functions, %ld statements, %zu tokens\n", nfuncs, nstatements, ntokens);
+    printf("best of %d: %.3f ms  (%.1f ns/statement, %.1f ns/token)\n", iterations,
+            best * 1e3, best * 1e9 / nstatements, best * 1e9 / ntokens);
+
+    TokenQueue_free(tokens);
+    free(text);
+    return EXIT_SUCCESS;
+}
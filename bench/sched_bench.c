@@ -0,0 +1,182 @@
+/**
+ * @file sched_bench.c
+ * @brief Instruction scheduling benchmark
+ *
+ * Generates Decaf programs whose @c main is one huge straight-line block (like
+ * fully unrolled loop code: arithmetic on a few locals and a global array),
+ * compiles them to ILOC (see codegen.h) and schedules them (see schedule.h).
+ * For each size, reports the time for code generation and for scheduling (the
+ * best of several runs, and per instruction, which should stay roughly flat
+ * as the block grows), the size of the dependence DAG, and the cycles the
+ * simulator counts before and after scheduling (which must compute the same
+ * result).
+ *
+ * Usage: sched_bench [-r runs] [statements...]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+
+#include "bench.h"
+#include "codegen.h"
+#include "schedule.h"
+
+/**
+ * @brief Number of local variables in the generated function
+ */
+#define NUM_LOCALS 16
+
+/**
+ * @brief Elements in the generated global array
+ */
+#define ARRAY_SIZE 64
+
+static void append (char** text, size_t* length, size_t* capacity, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char line[256];
+    size_t n = (size_t)vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (*length + n + 1 > *capacity) {
+        *capacity = (*capacity + n + 1) * 2;
+        *text = (char*)realloc(*text, *capacity);
+        CHECK_MALLOC_PTR(*text)
+    }
+    memcpy(*text + *length, line, n + 1);
+    *length += n;
+}
+
+/**
+ * @brief Next number from a deterministic generator, in [0, n)
+ */
+static int next_random (unsigned long* seed, int n)
+{
+    *seed = *seed * 6364136223846793005UL + 1442695040888963407UL;
+    return (int)((*seed >> 33) % (unsigned long)n);
+}
+
+/**
+ * @brief Generate a program with @c nstmts straight-line statements
+ */
+static char* generate_unrolled (int nstmts)
+{
+    char* text = NULL;
+    size_t length = 0, capacity = 0;
+    unsigned long seed = 12345;
+
+    append(&text, &length, &capacity, "int a[%d];\ndef int main()\n{\n", ARRAY_SIZE);
+    for (int i = 0; i < NUM_LOCALS; i++) {
+        append(&text, &length, &capacity, "    int x%d;\n", i);
+    }
+    for (int i = 0; i < NUM_LOCALS; i++) {
+        append(&text, &length, &capacity, "    x%d = %d;\n", i, i + 1);
+    }
+    for (int i = 0; i < nstmts; i++) {
+        int d = next_random(&seed, NUM_LOCALS);
+        int b = next_random(&seed, NUM_LOCALS);
+        int c = next_random(&seed, NUM_LOCALS);
+        int i1 = next_random(&seed, ARRAY_SIZE);
+        int i2 = next_random(&seed, ARRAY_SIZE);
+        switch (next_random(&seed, 4)) {
+            case 0:
+                append(&text, &length, &capacity, "    x%d = x%d * x%d + a[%d];\n", d, b, c, i1);
+                break;
+            case 1:
+                append(&text, &length, &capacity, "    a[%d] = x%d - x%d * %d;\n", i1, b, c, i2 + 1);
+                break;
+            case 2:
+                append(&text, &length, &capacity, "    x%d = (x%d + x%d) %% 1000;\n", d, b, c);
+                break;
+            default:
+                append(&text, &length, &capacity, "    x%d = a[%d] * a[%d] - x%d;\n", d, i1, i2, b);
+                break;
+        }
+    }
+    append(&text, &length, &capacity, "    return x0 + x1 + a[0];\n}\n");
+    return text;
+}
+
+static void run_size (int nstmts, int runs)
+{
+    char* text = generate_unrolled(nstmts);
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+    free(text);
+
+    double codegen_time = 1e9;
+    double schedule_time = 1e9;
+    ILOCInsnList* original = NULL;
+    ILOCInsnList* scheduled = NULL;
+    ScheduleStats stats;
+    for (int i = 0; i <= runs; i++) {     /* the first copy stays unscheduled */
+        double start = bench_now();
+        ILOCInsnList* code = generate_code(tree);
+        double elapsed = bench_now() - start;
+        codegen_time = (elapsed < codegen_time ? elapsed : codegen_time);
+        if (original == NULL) {
+            original = code;
+            continue;
+        }
+
+        start = bench_now();
+        Schedule_blocks(code, NULL, &stats);
+        elapsed = bench_now() - start;
+        schedule_time = (elapsed < schedule_time ? elapsed : schedule_time);
+        if (scheduled != NULL) {
+            ILOCInsnList_free(scheduled);
+        }
+        scheduled = code;
+    }
+
+    FILE* sink = fopen("/dev/null", "w");
+    ILOCStats before, after;
+    ILOCMachine_run(original, NULL, sink, &before);
+    ILOCMachine_run(scheduled, NULL, sink, &after);
+    fclose(sink);
+
+    printf("%9d %9d %9ld %9.3f %9.3f %7.1f %9ld %9ld %6.1f%%%s\n",
+            nstmts, stats.largest_block, stats.edges,
+            codegen_time * 1e3, schedule_time * 1e3,
+            schedule_time / stats.instructions * 1e9,
+            before.cycles, after.cycles,
+            100.0 * (before.cycles - after.cycles) / before.cycles,
+            (before.result == after.result ? "" : "  RESULT DIFFERS"));
+
+    ILOCInsnList_free(original);
+    ILOCInsnList_free(scheduled);
+    ASTNode_free(tree);
+}
+
+int main (int argc, char** argv)
+{
+    int runs = 3;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r': runs = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-r runs] [statements...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (runs < 1) {
+        fprintf(stderr, "Usage: %s [-r runs] [statements...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%9s %9s %9s %9s %9s %7s %9s %9s %7s\n", "stmts", "block", "edges",
+            "gen ms", "sched ms", "ns/insn", "cycles", "sched", "saved");
+    if (optind == argc) {
+        int sizes[] = { 1000, 10000, 100000 };
+        for (int i = 0; i < 3; i++) {
+            run_size(sizes[i], runs);
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        run_size(atoi(argv[i]), runs);
+    }
+    return EXIT_SUCCESS;
+}
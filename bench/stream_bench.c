@@ -0,0 +1,88 @@
+/**
+ * @file stream_bench.c
+ * @brief Streaming versus whole-tree printing benchmark
+ *
+ * Writes a large generated program to a temporary file and prints its AST
+ * (to @c /dev/null) twice, each time in a separate child process: once the
+ * usual way (lex everything, parse everything, set up parents and depths,
+ * then print) and once with @ref PrintVisitor_stream. Reports the time and
+ * the peak resident set size of each child.
+ *
+ * Usage: stream_bench [functions] [statements-per-function]
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "stream.h"
+
+static void print_whole_tree (const char* path, FILE* output)
+{
+    char* text = read_file(path);
+    TokenQueue* tokens = lex(text);
+    free(text);
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+    SetParentVisitor_traverse(tree);
+    CalcDepthVisitor_traverse(tree);
+    PrintVisitor_traverse(output, tree);
+    ASTNode_free(tree);
+}
+
+static void print_streaming (const char* path, FILE* output)
+{
+    FILE* input = fopen(path, "r");
+    PrintVisitor_stream(input, output);
+    fclose(input);
+}
+
+/**
+ * @brief Run one way of printing in a child process and report on it
+ */
+static void measure (const char* what, void (*print)(const char*, FILE*), const char* path)
+{
+    double start = bench_now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        FILE* sink = fopen("/dev/null", "w");
+        print(path, sink);
+        fclose(sink);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || status != 0) {
+        printf("%-8s failed\n", what);
+        return;
+    }
+    printf("%-8s %8.3f s   peak RSS %8.1f MB\n", what, bench_now() - start, usage.ru_maxrss / 1024.0);
+}
+
+int main (int argc, char** argv)
+{
+    int nfuncs = (argc > 1 ? atoi(argv[1]) : 2000);
+    int nstmts = (argc > 2 ? atoi(argv[2]) : 95);
+
+    char path[] = "/tmp/stream_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    char* text = generate_program(nfuncs, nstmts);
+    FILE* file = fdopen(fd, "w");
+    fputs(text, file);
+    fclose(file);
+    printf("%d functions, %zu bytes\n", nfuncs, strlen(text));
+    free(text);
+
+    measure("tree", print_whole_tree, path);
+    measure("stream", print_streaming, path);
+
+    unlink(path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file visit_bench.c
+ * @brief Visitor dispatch benchmark
+ *
+ * Compares general visitors (@ref NodeVisitor, called through function
+ * pointers) with the statically dispatched traversals generated by
+ * static-visitor.h on the same generated program:
+ *
+ * - count: a visitor whose only callback increments a counter, which isolates
+ *   the cost of the dispatch itself
+ * - parent+depth: @ref SetParentVisitor_new and @ref CalcDepthVisitor_new vs.
+ *   @ref SetParentVisitor_traverse and @ref CalcDepthVisitor_traverse (each
+ *   iteration uses a freshly-parsed tree so attributes are always new)
+ * - print: @ref PrintVisitor_new vs. @ref PrintVisitor_traverse, writing to
+ *   /dev/null
+ *
+ * Usage: visit_bench [functions] [statements-per-function] [iterations]
+ */
+
+#include "bench.h"
+
+static void count_node (long* count, ASTNode* node)
+{
+    (*count)++;
+}
+
+static void count_node_dynamic (NodeVisitor* visitor, ASTNode* node)
+{
+    count_node((long*)visitor->data, node);
+}
+
+#define STATIC_VISITOR_TRAVERSE     count_nodes
+#define STATIC_VISITOR_STATE        long*
+#define STATIC_PREVISIT_default     count_node
+#include "static-visitor.h"
+
+/**
+ * @brief Best times (in seconds) for one comparison
+ */
+typedef struct Result
+{
+    double dynamic;
+    double fixed;
+} Result;
+
+static void record (double* best, double t, int i)
+{
+    if (i == 0 || t < *best) {
+        *best = t;
+    }
+}
+
+static void report (const char* name, Result r, long nnodes)
+{
+    printf("%-14s dynamic %8.3f ms (%5.1f ns/node)   static %8.3f ms (%5.1f ns/node)   %.2fx\n",
+            name, r.dynamic * 1e3, r.dynamic * 1e9 / nnodes,
+            r.fixed * 1e3, r.fixed * 1e9 / nnodes, r.dynamic / r.fixed);
+}
+
+int main (int argc, char** argv)
+{
+    int nfuncs = (argc > 1 ? atoi(argv[1]) : 200);
+    int nstmts = (argc > 2 ? atoi(argv[2]) : 100);
+    int iterations = (argc > 3 ? atoi(argv[3]) : 20);
+
+    char* text = generate_program(nfuncs, nstmts);
+    TokenQueue* tokens = lex(text);
+    FILE* devnull = fopen("/dev/null", "w");
+    if (devnull == NULL) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+
+    Result count = { 0 }, attrs = { 0 }, print = { 0 };
+    long nnodes = 0;
+    for (int i = 0; i < iterations; i++) {
+        TokenQueue* input = copy_tokens(tokens);
+        ASTNode* tree = parse(input);
+        TokenQueue_free(input);
+        input = copy_tokens(tokens);
+        ASTNode* tree2 = parse(input);
+        TokenQueue_free(input);
+
+        /*
+         * Each comparison alternates which variant runs first (and, for the
+         * visitors that add attributes, which tree it runs on) so that cache
+         * and allocator state do not favor either one.
+         */
+        bool static_first = (i % 2 == 0);
+        count_nodes(&nnodes, tree2);
+
+        /* node counting */
+        for (int pass = 0; pass < 2; pass++) {
+            if (static_first == (pass == 0)) {
+                nnodes = 0;
+                double start = bench_now();
+                count_nodes(&nnodes, tree);
+                record(&count.fixed, bench_now() - start, i);
+            } else {
+                long n = 0;
+                NodeVisitor* counter = NodeVisitor_new();
+                counter->data = &n;
+                counter->previsit_default = count_node_dynamic;
+                double start = bench_now();
+                NodeVisitor_traverse(counter, tree);
+                record(&count.dynamic, bench_now() - start, i);
+                NodeVisitor_free(counter);
+            }
+        }
+
+        /* parent pointers and depths */
+        for (int pass = 0; pass < 2; pass++) {
+            if (static_first == (pass == 0)) {
+                double start = bench_now();
+                SetParentVisitor_traverse(pass == 0 ? tree : tree2);
+                CalcDepthVisitor_traverse(pass == 0 ? tree : tree2);
+                record(&attrs.fixed, bench_now() - start, i);
+            } else {
+                double start = bench_now();
+                NodeVisitor_traverse_and_free(SetParentVisitor_new(), pass == 0 ? tree : tree2);
+                NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), pass == 0 ? tree : tree2);
+                record(&attrs.dynamic, bench_now() - start, i);
+            }
+        }
+
+        /* debug output */
+        for (int pass = 0; pass < 2; pass++) {
+            if (static_first == (pass == 0)) {
+                double start = bench_now();
+                PrintVisitor_traverse(devnull, tree);
+                record(&print.fixed, bench_now() - start, i);
+            } else {
+                double start = bench_now();
+                NodeVisitor_traverse_and_free(PrintVisitor_new(devnull), tree);
+                record(&print.dynamic, bench_now() - start, i);
+            }
+        }
+
+        ASTNode_free(tree);
+        ASTNode_free(tree2);
+    }
+
+    printf("%d functions, %ld nodes, best of %d\n", nfuncs, nnodes, iterations);
+    report("count", count, nnodes);
+    report("parent+depth", attrs, nnodes);
+    report("print", print, nnodes);
+
+    fclose(devnull);
+    TokenQueue_free(tokens);
+    free(text);
+    return EXIT_SUCCESS;
+}
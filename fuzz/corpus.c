@@ -0,0 +1,232 @@
+/**
+ * @file corpus.c
+ * @brief Seed inputs for the fuzzing harness
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "fuzz.h"
+
+bool FuzzCorpus_add (FuzzCorpus* corpus, const char* data, size_t size)
+{
+    for (size_t i = 0; i < corpus->count; i++) {
+        if (corpus->sizes[i] == size && memcmp(corpus->inputs[i], data, size) == 0) {
+            return false;
+        }
+    }
+    if (corpus->count == corpus->capacity) {
+        corpus->capacity = (corpus->capacity == 0 ? 64 : corpus->capacity * 2);
+        corpus->inputs = (char**)realloc(corpus->inputs, corpus->capacity * sizeof(char*));
+        CHECK_MALLOC_PTR(corpus->inputs)
+        corpus->sizes = (size_t*)realloc(corpus->sizes, corpus->capacity * sizeof(size_t));
+        CHECK_MALLOC_PTR(corpus->sizes)
+    }
+    char* copy = (char*)malloc(size + 1);
+    CHECK_MALLOC_PTR(copy)
+    memcpy(copy, data, size);
+    copy[size] = '\0';
+    corpus->inputs[corpus->count] = copy;
+    corpus->sizes[corpus->count] = size;
+    corpus->count++;
+    return true;
+}
+
+void FuzzCorpus_free (FuzzCorpus* corpus)
+{
+    for (size_t i = 0; i < corpus->count; i++) {
+        free(corpus->inputs[i]);
+    }
+    free(corpus->inputs);
+    free(corpus->sizes);
+    corpus->inputs = NULL;
+    corpus->sizes = NULL;
+    corpus->count = corpus->capacity = 0;
+}
+
+/**
+ * @brief How a test helper turns its string argument into a program
+ */
+typedef struct TestHelper
+{
+    const char* name;       /**< @brief Macro or function name */
+    const char* before;     /**< @brief Text before the argument */
+    const char* after;      /**< @brief Text after the argument */
+} TestHelper;
+
+static const TestHelper helpers[] = {
+    { "TEST_VALID",         "", "" },
+    { "TEST_INVALID",       "", "" },
+    { "TEST_VALID_MAIN",    "def int main () { ", " }" },
+    { "TEST_INVALID_MAIN",  "def int main () { ", " }" },
+    { "TEST_VALID_EXPR",    "def int main () { return ", " ; }" },
+    { "TEST_INVALID_EXPR",  "def int main () { return ", " ; }" },
+    { "TEST_INT_LITERAL",   "def int main() { return ", " ; }" },
+    { "TEST_STR_LITERAL",   "def int main() { return ", " ; }" },
+    { "run_parser",         "", "" },
+};
+
+/**
+ * @brief Decode one C string literal (starting after its opening quote)
+ *
+ * @returns Pointer just past the closing quote
+ */
+static const char* decode_literal (const char* p, char* out, size_t* length, size_t capacity)
+{
+    while (*p != '\0' && *p != '"') {
+        char c = *p++;
+        if (c == '\\' && *p != '\0') {
+            c = *p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                default: break;     /* \\, \", \' */
+            }
+        }
+        if (*length + 1 < capacity) {
+            out[(*length)++] = c;
+        }
+    }
+    return (*p == '"' ? p + 1 : p);
+}
+
+/**
+ * @brief Add the Decaf programs in a C test file
+ */
+static int load_tests (FuzzCorpus* corpus, const char* text)
+{
+    /* innermost enclosing call, and how many string arguments it has had */
+    const TestHelper* calls[64];
+    int strings_seen[64];
+    int depth = 0;
+    const char* name = NULL;
+    size_t name_length = 0;
+
+    size_t capacity = strlen(text) + 1;
+    char* literal = (char*)malloc(capacity);
+    CHECK_MALLOC_PTR(literal)
+    size_t before = corpus->count;
+    const char* p = text;
+    while (*p != '\0') {
+        if (p[0] == '/' && p[1] == '/') {
+            p = strchr(p, '\n');
+            p = (p != NULL ? p : text + capacity - 1);
+        } else if (p[0] == '/' && p[1] == '*') {
+            p = strstr(p + 2, "*/");
+            p = (p != NULL ? p + 2 : text + capacity - 1);
+        } else if (*p == '\'') {
+            p += (p[1] == '\\' ? 4 : 3);
+        } else if (*p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+            name = p;
+            while (*p == '_' || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                   (*p >= '0' && *p <= '9')) {
+                p++;
+            }
+            name_length = p - name;
+        } else if (*p == '(') {
+            if (depth < 64) {
+                calls[depth] = NULL;
+                for (size_t i = 0; name != NULL && i < sizeof(helpers) / sizeof(helpers[0]); i++) {
+                    if (strlen(helpers[i].name) == name_length &&
+                            strncmp(helpers[i].name, name, name_length) == 0) {
+                        calls[depth] = &helpers[i];
+                    }
+                }
+                strings_seen[depth] = 0;
+            }
+            depth++;
+            name = NULL;
+            p++;
+        } else if (*p == ')') {
+            depth = (depth > 0 ? depth - 1 : 0);
+            name = NULL;
+            p++;
+        } else if (*p == '"') {
+            /* adjacent literals are one string */
+            size_t length = 0;
+            while (*p == '"') {
+                p = decode_literal(p + 1, literal, &length, capacity);
+                while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+                    p++;
+                }
+            }
+            literal[length] = '\0';
+            const TestHelper* helper = (depth > 0 && depth <= 64 ? calls[depth-1] : NULL);
+            bool first = (depth > 0 && depth <= 64 && strings_seen[depth-1]++ == 0);
+            if (helper != NULL && first) {
+                size_t size = strlen(helper->before) + length + strlen(helper->after);
+                char* program = (char*)malloc(size + 1);
+                CHECK_MALLOC_PTR(program)
+                snprintf(program, size + 1, "%s%s%s", helper->before, literal, helper->after);
+                FuzzCorpus_add(corpus, program, size);
+                free(program);
+            } else if (strstr(literal, "def ") != NULL ||
+                       (strchr(literal, ';') != NULL && strchr(literal, '%') == NULL)) {
+                /* probably Decaf code built up for a larger test */
+                FuzzCorpus_add(corpus, literal, length);
+            }
+            name = NULL;
+        } else {
+            if (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+                name = NULL;
+            }
+            p++;
+        }
+    }
+    free(literal);
+    return (int)(corpus->count - before);
+}
+
+/**
+ * @brief Whether a directory entry should be loaded (hidden files are not)
+ */
+static int visible (const struct dirent* entry)
+{
+    return entry->d_name[0] != '.';
+}
+
+int FuzzCorpus_load (FuzzCorpus* corpus, const char* path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        return -1;
+    }
+    if (S_ISDIR(info.st_mode)) {
+        struct dirent** entries;
+        int n = scandir(path, &entries, visible, alphasort);
+        if (n < 0) {
+            return -1;
+        }
+        int added = 0;
+        for (int i = 0; i < n; i++) {
+            char child[FILENAME_MAX];
+            snprintf(child, sizeof(child), "%s/%s", path, entries[i]->d_name);
+            struct stat child_info;
+            if (stat(child, &child_info) == 0 && S_ISREG(child_info.st_mode)) {
+                int count = FuzzCorpus_load(corpus, child);
+                added += (count > 0 ? count : 0);
+            }
+            free(entries[i]);
+        }
+        free(entries);
+        return added;
+    }
+
+    char* text = read_file(path);
+    if (text == NULL) {
+        return -1;
+    }
+    size_t length = strlen(path);
+    int added;
+    if (length > 2 && strcmp(path + length - 2, ".c") == 0) {
+        added = load_tests(corpus, text);
+    } else {
+        added = (FuzzCorpus_add(corpus, text, strlen(text)) ? 1 : 0);
+    }
+    free(text);
+    return added;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file fuzz.h
+ * @brief Shared pieces of the fuzzing harness (grammar mutator and seeds)
+ */
+
+#ifndef __FUZZ_H
+#define __FUZZ_H
+
+#include "p1-lexer.h"
+#include "p2-parser.h"
+
+/**
+ * @brief Deterministic pseudo-random number generator (xorshift64*)
+ *
+ * Everything random in the harness draws from one of these, so a run is
+ * reproduced exactly by its seed.
+ */
+typedef struct FuzzRng
+{
+    uint64_t state;     /**< @brief Current state (never zero) */
+} FuzzRng;
+
+/**
+ * @brief Seed a generator
+ *
+ * @param rng Generator to initialize
+ * @param seed Any value (zero included)
+ */
+void FuzzRng_seed (FuzzRng* rng, uint64_t seed);
+
+/**
+ * @brief Draw the next 64 random bits
+ *
+ * @param rng Generator
+ * @returns Random value
+ */
+uint64_t FuzzRng_next (FuzzRng* rng);
+
+/**
+ * @brief Draw a random number below a bound
+ *
+ * @param rng Generator
+ * @param bound Upper bound (exclusive; must be positive)
+ * @returns Random value in <tt>[0, bound)</tt>
+ */
+size_t FuzzRng_below (FuzzRng* rng, size_t bound);
+
+/**
+ * @brief Hash a byte string (FNV-1a)
+ *
+ * @param data Bytes to hash
+ * @param size Number of bytes
+ * @returns 64-bit hash
+ */
+uint64_t fuzz_hash (const void* data, size_t size);
+
+/**
+ * @brief Apply a random grammar-aware mutation to an input in place
+ *
+ * The input is split into Decaf tokens (anything that does not look like a
+ * token becomes a one-character piece, so every input can be mutated). Most
+ * mutations work on whole tokens or on balanced bracket ranges: replacing a
+ * token with another of the same class (an operator with an operator, a
+ * literal with a literal, ...), deleting, duplicating or nesting a range,
+ * inserting a randomly generated expression, statement or declaration, or
+ * growing a string literal. A few flip raw bytes, to keep the lexer honest.
+ * The result is written back one token per word.
+ *
+ * The signature matches libFuzzer's @c LLVMFuzzerCustomMutator, and the
+ * result depends only on the input and @p seed.
+ *
+ * @param data Input (NUL bytes are allowed); overwritten with the result
+ * @param size Length of the input
+ * @param max_size Capacity of @p data
+ * @param seed Random seed for this mutation
+ * @returns Length of the result (at most @p max_size)
+ */
+size_t FuzzMutator_mutate (char* data, size_t size, size_t max_size, uint64_t seed);
+
+/**
+ * @brief Combine two inputs by replacing a range of one with a range of the other
+ *
+ * Ranges are balanced (a bracketed group or a statement) when the inputs have
+ * any, so the result usually still parses. The signature matches libFuzzer's
+ * @c LLVMFuzzerCustomCrossOver.
+ *
+ * @param data1 First input
+ * @param size1 Length of the first input
+ * @param data2 Second input
+ * @param size2 Length of the second input
+ * @param out Buffer for the result
+ * @param max_out_size Capacity of @p out
+ * @param seed Random seed for this combination
+ * @returns Length of the result (at most @p max_out_size)
+ */
+size_t FuzzMutator_crossover (const char* data1, size_t size1,
+                              const char* data2, size_t size2,
+                              char* out, size_t max_out_size, uint64_t seed);
+
+/**
+ * @brief Ways to make an input bigger, for checking how costs scale
+ */
+typedef enum FuzzGrowth
+{
+    GROW_REPEAT,    /**< @brief Repeat a statement or bracketed range in place */
+    GROW_NEST,      /**< @brief Wrap a bracketed range in copies of its brackets */
+    GROW_STRING,    /**< @brief Lengthen a string literal */
+    GROW_LIST,      /**< @brief Append to the input (a sequence of declarations) */
+    NUM_GROWTHS
+} FuzzGrowth;
+
+/**
+ * @brief Name of a growth strategy (for reports)
+ *
+ * @param growth Strategy
+ * @returns Static string
+ */
+const char* FuzzGrowth_to_string (FuzzGrowth growth);
+
+/**
+ * @brief Choose where an input will be grown
+ *
+ * @param text Input (NUL-terminated)
+ * @param growth Strategy
+ * @param seed Random seed (picks among the possible places)
+ * @param prefix Receives the length of the text before the grown part
+ * @param unit Receives the length of the grown part
+ * @returns True if the strategy applies to this input
+ */
+bool FuzzMutator_growth_site (const char* text, FuzzGrowth growth, uint64_t seed,
+                              size_t* prefix, size_t* unit);
+
+/**
+ * @brief Build a grown version of an input
+ *
+ * @param text Input (NUL-terminated)
+ * @param growth Strategy
+ * @param prefix Length of the text before the grown part (see
+ * @ref FuzzMutator_growth_site)
+ * @param unit Length of the grown part
+ * @param factor How many copies of the grown part to use
+ * @returns Newly-allocated, NUL-terminated text
+ */
+char* FuzzMutator_grow (const char* text, FuzzGrowth growth, size_t prefix, size_t unit, int factor);
+
+/**
+ * @brief A list of inputs
+ */
+typedef struct FuzzCorpus
+{
+    char** inputs;      /**< @brief NUL-terminated inputs */
+    size_t* sizes;      /**< @brief Length of each input */
+    size_t count;       /**< @brief Number of inputs */
+    size_t capacity;    /**< @brief Size of the arrays */
+} FuzzCorpus;
+
+/**
+ * @brief Add a copy of an input to a corpus (unless it is already there)
+ *
+ * @param corpus Corpus
+ * @param data Input
+ * @param size Length of the input
+ * @returns True if the input was added
+ */
+bool FuzzCorpus_add (FuzzCorpus* corpus, const char* data, size_t size);
+
+/**
+ * @brief Add seed inputs from a file or directory
+ *
+ * A directory contributes each regular file in it (in name order). A C
+ * source file (<tt>*.c</tt>) contributes the programs in its Check test cases:
+ * the string literals passed to the @c TEST_VALID, @c TEST_INVALID, literal
+ * and @c run_parser helpers of the test suite (wrapped in a @c main function
+ * or a @c return statement where the helper does that), and any other string
+ * literal that looks like Decaf code. Any other file is added as it is.
+ *
+ * @param corpus Corpus
+ * @param path File or directory
+ * @returns Number of inputs added, or -1 if @p path could not be read
+ */
+int FuzzCorpus_load (FuzzCorpus* corpus, const char* path);
+
+/**
+ * @brief Deallocate a corpus's inputs
+ *
+ * @param corpus Corpus
+ */
+void FuzzCorpus_free (FuzzCorpus* corpus);
+
+#endif
@@ -0,0 +1,764 @@
+/**
+ * @file fuzz_parse.c
+ * @brief Fuzzing harness for the lexer, parser and AST printer
+ *
+ * Each input is lexed and parsed; if that succeeds, the tree is printed (to a
+ * stream that only counts bytes) the way the compiler prints it, so that the
+ * escaping routines are exercised too. The harness builds two ways:
+ *
+ * - With @c -DFUZZ_LIBFUZZER (see the @c libfuzzer target in the Makefile) it
+ *   provides @c LLVMFuzzerTestOneInput, plus the grammar mutator as
+ *   @c LLVMFuzzerCustomMutator and @c LLVMFuzzerCustomCrossOver.
+ *
+ * - Otherwise it is a standalone, AFL-style fuzzer that needs nothing but
+ *   this tree. It starts from seed inputs (by default @c tests/inputs and the
+ *   Check cases in @c tests/public.c), mutates them with the grammar mutator,
+ *   and keeps any mutant that reaches something new: a new pair of parent and
+ *   child node types (with the operator or literal type and a rough depth),
+ *   a new kind of error message, or a new size range. It reports its
+ *   throughput (exec/s) as it goes. Every random choice comes from the seed,
+ *   so a run with the same seed, seed inputs and options tries exactly the
+ *   same inputs in the same order.
+ *
+ * Each input that the standalone fuzzer keeps is also checked for
+ * super-linear behavior: it is grown repeatedly (a statement repeated, an
+ * expression or statement nested, a string literal lengthened, or the whole
+ * input repeated) and the time and the heap memory for each size are
+ * measured. A cost that grows faster than the size to the power given by
+ * @c -slow_exponent is reported (for time, the size is that of the input or
+ * of the printed tree, whichever grows faster: printing a deeply nested tree
+ * is quadratic because of its indentation, and that is not news), and the largest grown input is saved as a
+ * @c slow-* artifact. Crashes and inputs that take more than @c -timeout
+ * seconds are saved as @c crash-* and @c timeout-* artifacts.
+ *
+ * Usage: fuzz_parse [-option=value ...] [seed files or directories ...]
+ *
+ * - @c -runs: number of mutated inputs to try (default 100000; 0 only runs
+ *   the seed inputs, which replays artifacts)
+ * - @c -seed: random seed (default 1)
+ * - @c -max_len: maximum length of a mutated input (default 4096)
+ * - @c -max_total_time: stop after this many seconds (default 0: no limit)
+ * - @c -timeout: seconds before an input counts as a hang (default 5; 0 to
+ *   disable)
+ * - @c -slow_exponent: growth exponent that counts as super-linear (default
+ *   1.8: quadratic work approaches 2, and timings on a busy machine can make
+ *   linear work look like 1.5)
+ * - @c -artifact_prefix: where to save artifacts (default: current directory)
+ * - @c -write_seeds: write the seed inputs to this directory and exit (to
+ *   start a libFuzzer or AFL corpus)
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <math.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+#include "visitor.h"
+
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    ErrorTrap_throw_va(format, args);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    /* every run is trapped, so getting here is a bug in the harness */
+    abort();
+}
+
+/**
+ * @brief Where printed trees go
+ */
+static FILE* sink = NULL;
+
+/**
+ * @brief Number of bytes written to @ref sink
+ */
+static size_t output_bytes = 0;
+
+static ssize_t count_output (void* cookie, const char* data, size_t size)
+{
+    output_bytes += size;
+    return (ssize_t)size;
+}
+
+static void open_sink ()
+{
+    cookie_io_functions_t functions = { .write = count_output };
+    sink = fopencookie(NULL, "w", functions);
+}
+
+/**
+ * @brief Number of bits in a feature index
+ */
+#define FEATURE_BITS 16
+
+/**
+ * @brief Set of features reached so far
+ */
+typedef struct Coverage
+{
+    unsigned char seen[1 << FEATURE_BITS];  /**< @brief Whether each feature has been reached */
+    int count;                              /**< @brief Number of features reached */
+    int fresh;                              /**< @brief Number reached by the current input */
+} Coverage;
+
+static void Coverage_add (Coverage* coverage, uint64_t feature)
+{
+    size_t index = (size_t)(feature >> (64 - FEATURE_BITS));
+    if (!coverage->seen[index]) {
+        coverage->seen[index] = 1;
+        coverage->count++;
+        coverage->fresh++;
+    }
+}
+
+static uint64_t feature (int kind, int a, int b, int c)
+{
+    int values[] = { kind, a, b, c };
+    return fuzz_hash(values, sizeof(values));
+}
+
+/**
+ * @brief Number of significant bits (a logarithmic size class)
+ */
+static int magnitude (size_t value)
+{
+    int bits = 0;
+    while (value > 0) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+
+/**
+ * @brief State for collecting features from a tree
+ */
+typedef struct FeatureState
+{
+    Coverage* coverage;     /**< @brief Where features are recorded */
+    int parents[64];        /**< @brief Types of the enclosing nodes (innermost last) */
+    int depth;              /**< @brief Nesting depth of the current node */
+} FeatureState;
+
+static void FeatureState_previsit (FeatureState* state, ASTNode* node)
+{
+    int parent = (state->depth > 0 && state->depth <= 64 ? state->parents[state->depth-1] : -1);
+    int detail = 0;
+    if (node->type == BINARYOP) {
+        detail = (int)node->binaryop.operator;
+    } else if (node->type == UNARYOP) {
+        detail = (int)node->unaryop.operator;
+    } else if (node->type == LITERAL) {
+        detail = (int)node->literal.type;
+    }
+    Coverage_add(state->coverage, feature(1, parent, (int)node->type * 16 + detail, magnitude(state->depth)));
+    if (state->depth < 64) {
+        state->parents[state->depth] = (int)node->type;
+    }
+    state->depth++;
+}
+
+static void FeatureState_postvisit (FeatureState* state, ASTNode* node)
+{
+    state->depth--;
+}
+
+#define STATIC_VISITOR_TRAVERSE         FeatureState_traverse
+#define STATIC_VISITOR_STATE            FeatureState*
+#define STATIC_PREVISIT_default         FeatureState_previsit
+#define STATIC_POSTVISIT_default        FeatureState_postvisit
+#include "static-visitor.h"
+
+/**
+ * @brief Record the features of an error message (its text, minus numbers)
+ */
+static void error_features (Coverage* coverage, const char* message)
+{
+    char shape[MAX_ERROR_LEN];
+    size_t length = 0;
+    for (const char* p = message; *p != '\0' && length < sizeof(shape); p++) {
+        if (*p == '\'') {
+            /* quoted tokens vary too much to be interesting */
+            const char* close = strchr(p + 1, '\'');
+            p = (close != NULL ? close : p);
+            shape[length++] = 'Q';
+        } else if (*p < '0' || *p > '9') {
+            shape[length++] = *p;
+        }
+    }
+    Coverage_add(coverage, fuzz_hash(shape, length));
+}
+
+/**
+ * @brief Costs of running one input
+ */
+typedef struct Measurement
+{
+    double seconds;     /**< @brief Time to lex, parse, print and free */
+    size_t heap;        /**< @brief Heap memory in use after printing */
+    size_t output;      /**< @brief Length of the printed tree */
+} Measurement;
+
+static double now ()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Lex, parse and print one input
+ *
+ * @param data Input
+ * @param size Length of the input
+ * @param coverage Where to record features (or @c NULL)
+ * @param cost Where to record costs (or @c NULL)
+ * @returns True if the input parsed
+ */
+static bool run_input (const char* data, size_t size, Coverage* coverage, Measurement* cost)
+{
+    size_t heap_before = (cost != NULL ? mallinfo2().uordblks : 0);
+    size_t output_before = output_bytes;
+    double start = (cost != NULL ? now() : 0.0);
+
+    char* text = (char*)malloc(size + 1);
+    CHECK_MALLOC_PTR(text)
+    memcpy(text, data, size);
+    text[size] = '\0';
+    TokenQueue* volatile tokens = NULL;
+    ASTNode* volatile tree = NULL;
+    bool parsed = false;
+
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        tokens = lex(text);
+        tree = parse(tokens);
+        SetParentVisitor_traverse(tree);
+        CalcDepthVisitor_traverse(tree);
+        PrintVisitor_traverse(sink, tree);
+        parsed = true;
+    }
+    ErrorTrap_pop(&trap);
+
+    if (cost != NULL) {
+        size_t heap_after = mallinfo2().uordblks;
+        cost->heap = (heap_after > heap_before ? heap_after - heap_before : 0);
+        fflush(sink);
+        cost->output = output_bytes - output_before;
+    }
+    if (coverage != NULL) {
+        Coverage_add(coverage, feature(0, parsed, magnitude(size), 0));
+        if (parsed) {
+            FeatureState state = { .coverage = coverage, .depth = 0 };
+            FeatureState_traverse(&state, tree);
+        } else {
+            error_features(coverage, trap.message);
+        }
+    }
+    if (tree != NULL) {
+        ASTNode_free(tree);
+    }
+    if (tokens != NULL) {
+        TokenQueue_free(tokens);
+    }
+    free(text);
+    if (cost != NULL) {
+        cost->seconds = now() - start;
+    }
+    return parsed;
+}
+
+
+#ifdef FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput (const uint8_t* data, size_t size)
+{
+    if (sink == NULL) {
+        open_sink();
+    }
+    run_input((const char*)data, size, NULL, NULL);
+    return 0;
+}
+
+size_t LLVMFuzzerCustomMutator (uint8_t* data, size_t size, size_t max_size, unsigned int seed)
+{
+    return FuzzMutator_mutate((char*)data, size, max_size, seed);
+}
+
+size_t LLVMFuzzerCustomCrossOver (const uint8_t* data1, size_t size1,
+                                  const uint8_t* data2, size_t size2,
+                                  uint8_t* out, size_t max_out_size, unsigned int seed)
+{
+    return FuzzMutator_crossover((const char*)data1, size1, (const char*)data2, size2,
+                                 (char*)out, max_out_size, seed);
+}
+
+#else
+
+/**
+ * @brief Default location of the seed inputs (set by the Makefile)
+ */
+#ifndef SEED_DIR
+#define SEED_DIR "../tests"
+#endif
+
+/**
+ * @brief Command-line options
+ */
+typedef struct Options
+{
+    long runs;                  /**< @brief Number of mutated inputs to try */
+    uint64_t seed;              /**< @brief Random seed */
+    size_t max_len;             /**< @brief Maximum length of a mutated input */
+    double max_total_time;      /**< @brief Time limit in seconds (0 for none) */
+    int timeout;                /**< @brief Hang limit in seconds (0 for none) */
+    double slow_exponent;       /**< @brief Growth exponent that counts as super-linear */
+    const char* artifact_prefix;    /**< @brief Prefix for saved inputs */
+    const char* write_seeds;    /**< @brief Directory to write the seeds to (or @c NULL) */
+} Options;
+
+static Options options = {
+    .runs = 100000, .seed = 1, .max_len = 4096, .max_total_time = 0, .timeout = 5,
+    .slow_exponent = 1.8, .artifact_prefix = "", .write_seeds = NULL
+};
+
+/*
+ * The input being run and a count of finished runs, for the signal handlers
+ */
+static const char* volatile current_data = NULL;
+static volatile size_t current_size = 0;
+static volatile sig_atomic_t executions = 0;
+
+/**
+ * @brief Save an input as <tt>prefix + kind + "-" + hash</tt>
+ *
+ * Only uses async-signal-safe calls (it is called from signal handlers).
+ */
+static void save_artifact (const char* kind, const char* data, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    char path[FILENAME_MAX];
+    size_t length = 0;
+    for (const char* p = options.artifact_prefix; *p != '\0' && length < FILENAME_MAX - 40; p++) {
+        path[length++] = *p;
+    }
+    for (const char* p = kind; *p != '\0'; p++) {
+        path[length++] = *p;
+    }
+    path[length++] = '-';
+    uint64_t hash = fuzz_hash(data, size);
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        path[length++] = hex[(hash >> shift) & 0xF];
+    }
+    path[length] = '\0';
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        for (size_t done = 0; done < size; ) {
+            ssize_t n = write(fd, data + done, size - done);
+            if (n <= 0) {
+                break;
+            }
+            done += (size_t)n;
+        }
+        close(fd);
+    }
+    const char note[] = "==== input saved as ";
+    if (write(STDERR_FILENO, note, sizeof(note) - 1) > 0 &&
+            write(STDERR_FILENO, path, length) > 0) {
+        (void)!write(STDERR_FILENO, "\n", 1);
+    }
+}
+
+static void crash_handler (int signal)
+{
+    const char message[] = "==== fatal signal while running an input\n";
+    (void)!write(STDERR_FILENO, message, sizeof(message) - 1);
+    if (current_data != NULL) {
+        save_artifact("crash", current_data, current_size);
+    }
+    /* the handler was installed with SA_RESETHAND, so this is fatal */
+    raise(signal);
+}
+
+/**
+ * @brief Watchdog: an input has hung if no run has finished since the last tick
+ */
+static void timeout_handler (int signal)
+{
+    static sig_atomic_t last = -1;
+    if (current_data != NULL && executions == last) {
+        const char message[] = "==== timeout: an input ran for over -timeout seconds\n";
+        (void)!write(STDERR_FILENO, message, sizeof(message) - 1);
+        save_artifact("timeout", current_data, current_size);
+        _exit(EXIT_FAILURE);
+    }
+    last = executions;
+}
+
+static void install_handlers ()
+{
+    /* stack overflows from deep nesting need a stack of their own */
+    static char alternate[1 << 16];
+    stack_t stack = { .ss_sp = alternate, .ss_size = sizeof(alternate), .ss_flags = 0 };
+    sigaltstack(&stack, NULL);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = crash_handler;
+    action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    int signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        sigaction(signals[i], &action, NULL);
+    }
+
+    if (options.timeout > 0) {
+        action.sa_handler = timeout_handler;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGALRM, &action, NULL);
+        struct itimerval timer = {
+            .it_interval = { .tv_sec = options.timeout, .tv_usec = 0 },
+            .it_value = { .tv_sec = options.timeout, .tv_usec = 0 },
+        };
+        setitimer(ITIMER_REAL, &timer, NULL);
+    }
+}
+
+/**
+ * @brief Run an input under the signal handlers
+ */
+static bool execute (const char* data, size_t size, Coverage* coverage, Measurement* cost)
+{
+    current_size = size;
+    current_data = data;
+    bool parsed = run_input(data, size, coverage, cost);
+    current_data = NULL;
+    executions++;
+    return parsed;
+}
+
+/**
+ * @brief Number of super-linear inputs found
+ */
+static int slow_inputs = 0;
+
+/**
+ * @brief Largest input built while checking how costs grow
+ */
+#define PROBE_MAX_SIZE (1 << 20)
+
+/**
+ * @brief Estimate how fast one cost grows with the grown part of an input
+ *
+ * Fits <tt>cost ~ copies^exponent</tt> between two points. Counting copies
+ * of the grown part rather than bytes of the whole input means that the cost
+ * of the rest of the input can only pull the estimate down, however cheap or
+ * expensive the grown part is per byte: linear work gives at most 1.
+ */
+static double growth_exponent (double copies1, double cost1, double copies2, double cost2)
+{
+    if (cost1 <= 0 || cost2 <= 0 || copies2 <= copies1) {
+        return 0;
+    }
+    return log(cost2 / cost1) / log(copies2 / copies1);
+}
+
+/**
+ * @brief Measurements of one input grown by successive doublings
+ */
+typedef struct GrowthSeries
+{
+    double sizes[32];       /**< @brief Length of each grown input */
+    Measurement costs[32];  /**< @brief Costs of each grown input (best time of five runs) */
+    bool parsed[32];        /**< @brief Whether each grown input parsed */
+    char* inputs[32];       /**< @brief Grown inputs (1, 2, 4, ... copies) */
+    int count;              /**< @brief Number of inputs measured */
+} GrowthSeries;
+
+/**
+ * @brief Measure the next doubling
+ *
+ * @returns False if it would be too big to build
+ */
+static bool GrowthSeries_extend (GrowthSeries* series, const char* text, FuzzGrowth growth,
+                                 size_t prefix, size_t unit)
+{
+    int n = series->count;
+    if (n == 32 || (n > 0 && series->sizes[n-1] * 2 > PROBE_MAX_SIZE)) {
+        return false;
+    }
+    char* input = FuzzMutator_grow(text, growth, prefix, unit, 1 << n);
+    size_t size = strlen(input);
+    Measurement best = { .seconds = 1e9 };
+    for (int rep = 0; rep < 5; rep++) {
+        Measurement cost;
+        series->parsed[n] = execute(input, size, NULL, &cost);
+        best = (cost.seconds < best.seconds ? cost : best);
+    }
+    series->sizes[n] = (double)size;
+    series->costs[n] = best;
+    series->inputs[n] = input;
+    series->count++;
+    return true;
+}
+
+/**
+ * @brief Fit the exponents over the last eight-fold increase in copies
+ *
+ * The time exponent is relative to the increase in output instead, if that
+ * is more. Nothing is fitted unless every input in the range parsed or every
+ * one failed, or while the costs are too small to time or to matter.
+ *
+ * @returns True if either exponent is over the limit
+ */
+static bool GrowthSeries_super_linear (const GrowthSeries* series, double* time_exponent, double* heap_exponent)
+{
+    int last = series->count - 1;
+    int first = last - 3;
+    *time_exponent = *heap_exponent = 0;
+    if (first < 0) {
+        return false;
+    }
+    for (int i = first + 1; i <= last; i++) {
+        if (series->parsed[i] != series->parsed[first]) {
+            return false;
+        }
+    }
+    const Measurement* small = &series->costs[first];
+    const Measurement* large = &series->costs[last];
+    double work = (small->output > 0 && large->output > 8 * small->output ?
+                   (double)large->output / small->output : 8);
+    if (large->seconds > 0.002) {
+        *time_exponent = growth_exponent(1, small->seconds, work, large->seconds);
+    }
+    if (large->heap > 65536) {
+        *heap_exponent = growth_exponent(1, small->heap, 8, large->heap);
+    }
+    return *time_exponent > options.slow_exponent || *heap_exponent > options.slow_exponent;
+}
+
+/**
+ * @brief Check whether the cost of an input grows super-linearly with its size
+ *
+ * Each growth strategy that applies is tried with 1, 2, 4, ... copies of the
+ * grown part until the input takes a few milliseconds. A cost that grows too
+ * fast must keep doing so for two more doublings before it is reported, since
+ * a one-off step (e.g. when the data stops fitting in a cache) looks the same
+ * over a short range.
+ */
+static void check_growth (const char* text, uint64_t seed)
+{
+    for (int g = 0; g < NUM_GROWTHS; g++) {
+        FuzzGrowth growth = (FuzzGrowth)g;
+        size_t prefix, unit;
+        if (!FuzzMutator_growth_site(text, growth, seed + g, &prefix, &unit)) {
+            continue;
+        }
+        GrowthSeries series = { .count = 0 };
+        while (GrowthSeries_extend(&series, text, growth, prefix, unit) &&
+               series.costs[series.count-1].seconds < 0.004 && series.count < 13) {
+            continue;
+        }
+
+        double time_exponent, heap_exponent;
+        bool slow = GrowthSeries_super_linear(&series, &time_exponent, &heap_exponent);
+        for (int confirm = 0; slow && confirm < 2; confirm++) {
+            slow = (GrowthSeries_extend(&series, text, growth, prefix, unit) &&
+                    GrowthSeries_super_linear(&series, &time_exponent, &heap_exponent));
+        }
+        if (slow) {
+            int first = series.count - 4;
+            int last = series.count - 1;
+            const Measurement* small = &series.costs[first];
+            const Measurement* large = &series.costs[last];
+            slow_inputs++;
+            fprintf(stderr, "==== super-linear (%s growth): %.0f -> %.0f bytes, "
+                            "time %.3f -> %.3f ms (exponent %.2f), heap %zu -> %zu KB (exponent %.2f)\n",
+                    FuzzGrowth_to_string(growth), series.sizes[first], series.sizes[last],
+                    small->seconds * 1e3, large->seconds * 1e3, time_exponent,
+                    small->heap / 1024, large->heap / 1024, heap_exponent);
+            save_artifact("slow", series.inputs[last], (size_t)series.sizes[last]);
+        }
+        for (int i = 0; i < series.count; i++) {
+            free(series.inputs[i]);
+        }
+    }
+}
+
+/**
+ * @brief Print a progress line
+ *
+ * Lines are numbered by input rather than by execution (growth probes execute
+ * a varying number of times), so a seed always reports the same numbers.
+ */
+static void report (const char* what, long input, double start, const Coverage* coverage,
+                    const FuzzCorpus* corpus, size_t size)
+{
+    double elapsed = now() - start;
+    fprintf(stderr, "#%ld\t%-5s cov: %d corp: %zu exec/s: %.0f len: %zu\n",
+            input, what, coverage->count, corpus->count,
+            (elapsed > 0 ? executions / elapsed : 0.0), size);
+}
+
+static bool parse_option (const char* arg)
+{
+    const char* value = strchr(arg, '=');
+    if (arg[0] != '-' || value == NULL) {
+        return false;
+    }
+    size_t length = value++ - arg - 1;
+    #define OPTION(NAME) (length == strlen(NAME) && strncmp(arg + 1, NAME, length) == 0)
+    if (OPTION("runs")) {
+        options.runs = atol(value);
+    } else if (OPTION("seed")) {
+        options.seed = strtoull(value, NULL, 10);
+    } else if (OPTION("max_len")) {
+        options.max_len = (size_t)atol(value);
+    } else if (OPTION("max_total_time")) {
+        options.max_total_time = atof(value);
+    } else if (OPTION("timeout")) {
+        options.timeout = atoi(value);
+    } else if (OPTION("slow_exponent")) {
+        options.slow_exponent = atof(value);
+    } else if (OPTION("artifact_prefix")) {
+        options.artifact_prefix = value;
+    } else if (OPTION("write_seeds")) {
+        options.write_seeds = value;
+    } else {
+        return false;
+    }
+    #undef OPTION
+    return true;
+}
+
+static int write_seeds (const FuzzCorpus* corpus, const char* dir)
+{
+    mkdir(dir, 0755);
+    for (size_t i = 0; i < corpus->count; i++) {
+        char path[FILENAME_MAX];
+        snprintf(path, sizeof(path), "%s/seed-%04zu.decaf", dir, i);
+        FILE* file = fopen(path, "w");
+        if (file == NULL) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+        fwrite(corpus->inputs[i], 1, corpus->sizes[i], file);
+        fclose(file);
+    }
+    printf("wrote %zu seed inputs to %s\n", corpus->count, dir);
+    return EXIT_SUCCESS;
+}
+
+int main (int argc, char** argv)
+{
+    FuzzCorpus corpus = { .inputs = NULL, .sizes = NULL, .count = 0, .capacity = 0 };
+    bool seeds_given = false;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            if (!parse_option(argv[i])) {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            seeds_given = true;
+            if (FuzzCorpus_load(&corpus, argv[i]) < 0) {
+                fprintf(stderr, "Cannot read seeds: %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    if (!seeds_given) {
+        FuzzCorpus_load(&corpus, SEED_DIR "/inputs");
+        FuzzCorpus_load(&corpus, SEED_DIR "/public.c");
+    }
+    if (options.write_seeds != NULL) {
+        return write_seeds(&corpus, options.write_seeds);
+    }
+    if (corpus.count == 0) {
+        FuzzCorpus_add(&corpus, "", 0);
+    }
+
+    open_sink();
+    install_handlers();
+    Coverage* coverage = (Coverage*)calloc(1, sizeof(Coverage));
+    CHECK_MALLOC_PTR(coverage)
+    FuzzRng rng;
+    FuzzRng_seed(&rng, options.seed);
+    fprintf(stderr, "INFO: seed %" PRIu64 ", %zu seed inputs\n", options.seed, corpus.count);
+
+    double start = now();
+    size_t nseeds = corpus.count;
+    for (size_t i = 0; i < nseeds; i++) {
+        if (execute(corpus.inputs[i], corpus.sizes[i], coverage, NULL)) {
+            check_growth(corpus.inputs[i], options.seed + i);
+        }
+    }
+    report("INITED", (long)nseeds, start, coverage, &corpus, 0);
+
+    char* buffer = (char*)malloc(options.max_len + 1);
+    CHECK_MALLOC_PTR(buffer)
+    char* other = (char*)malloc(options.max_len + 1);
+    CHECK_MALLOC_PTR(other)
+    long run;
+    for (run = 0; run < options.runs; run++) {
+        if (options.max_total_time > 0 && now() - start > options.max_total_time) {
+            break;
+        }
+
+        /* stack a few mutations (and sometimes a crossover) on a corpus input */
+        size_t parent = FuzzRng_below(&rng, corpus.count);
+        size_t size = corpus.sizes[parent];
+        size = (size > options.max_len ? options.max_len : size);
+        memcpy(buffer, corpus.inputs[parent], size);
+        int nmutations = 1 + (int)FuzzRng_below(&rng, 4);
+        for (int m = 0; m < nmutations; m++) {
+            uint64_t seed = FuzzRng_next(&rng);
+            if (corpus.count > 1 && FuzzRng_below(&rng, 8) == 0) {
+                size_t donor = FuzzRng_below(&rng, corpus.count);
+                memcpy(other, buffer, size);
+                size = FuzzMutator_crossover(other, size, corpus.inputs[donor], corpus.sizes[donor],
+                                             buffer, options.max_len, seed);
+            } else {
+                size = FuzzMutator_mutate(buffer, size, options.max_len, seed);
+            }
+        }
+
+        long input = (long)nseeds + run + 1;
+        coverage->fresh = 0;
+        bool parsed = execute(buffer, size, coverage, NULL);
+        if (coverage->fresh > 0 && FuzzCorpus_add(&corpus, buffer, size)) {
+            report("NEW", input, start, coverage, &corpus, size);
+            if (parsed) {
+                check_growth(corpus.inputs[corpus.count-1], options.seed + corpus.count);
+            }
+        } else if ((input & (input - 1)) == 0) {
+            report("pulse", input, start, coverage, &corpus, size);
+        }
+    }
+    report("DONE", (long)nseeds + run, start, coverage, &corpus, 0);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "Done in %.1f s: %d super-linear inputs, peak RSS %.1f MB\n",
+            now() - start, slow_inputs, usage.ru_maxrss / 1024.0);
+
+    free(buffer);
+    free(other);
+    free(coverage);
+    FuzzCorpus_free(&corpus);
+    fclose(sink);
+    return (slow_inputs > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+#endif
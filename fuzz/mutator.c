@@ -0,0 +1,838 @@
+/**
+ * @file mutator.c
+ * @brief Grammar-aware mutation of Decaf source text
+ */
+
+#include "fuzz.h"
+
+void FuzzRng_seed (FuzzRng* rng, uint64_t seed)
+{
+    /* splitmix64 spreads similar seeds apart (and never yields zero twice) */
+    uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    rng->state = (z != 0 ? z : 1);
+}
+
+uint64_t FuzzRng_next (FuzzRng* rng)
+{
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+size_t FuzzRng_below (FuzzRng* rng, size_t bound)
+{
+    return (size_t)(FuzzRng_next(rng) % bound);
+}
+
+uint64_t fuzz_hash (const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+/*
+ * PIECES
+ */
+
+/**
+ * @brief Grammatical class of a piece of input
+ */
+typedef enum PieceClass
+{
+    P_ID, P_NUM, P_STR, P_BOOL, P_TYPE, P_KEYWORD,
+    P_BINOP, P_NOT, P_MINUS, P_OPEN, P_CLOSE, P_PUNCT, P_OTHER
+} PieceClass;
+
+/**
+ * @brief One token (or stray character) of an input
+ */
+typedef struct Piece
+{
+    const char* text;   /**< @brief Start of the piece in the input */
+    size_t length;      /**< @brief Length of the piece */
+    PieceClass class;   /**< @brief What kind of token it is */
+    int match;          /**< @brief Index of the matching bracket (or -1) */
+} Piece;
+
+/**
+ * @brief An input split into pieces
+ */
+typedef struct Pieces
+{
+    Piece* items;       /**< @brief Pieces in order */
+    int count;          /**< @brief Number of pieces */
+} Pieces;
+
+static const char* const keywords[] = {
+    "def", "if", "else", "while", "return", "break", "continue"
+};
+static const char* const types[] = { "int", "bool", "void" };
+static const char* const binops[] = {
+    "||", "&&", "==", "!=", "<", "<=", ">", ">=", "+", "-", "*", "/", "%"
+};
+static const char* const names[] = { "a", "b", "c", "x", "y", "f", "g", "main", "i", "n" };
+static const char* const numbers[] = {
+    "0", "1", "2", "7", "42", "0x10", "0x7fffffff", "2147483647", "2147483648", "00", "0x"
+};
+static const char* const strings[] = {
+    "\"\"", "\"abc\"", "\"a\\nb\"", "\"\\\"q\\\\\"", "\"\\t%d\"", "\"unterminated"
+};
+static const char interesting_bytes[] = "\"\\{}()[];,=+-*/%!<>&|0x9aZ_ \n\t";
+
+#define COUNT(A) (sizeof(A) / sizeof((A)[0]))
+
+static bool is_ident_char (char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool in_list (const char* text, size_t length, const char* const* list, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(list[i]) == length && strncmp(list[i], text, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static PieceClass classify (const char* text, size_t length)
+{
+    char c = text[0];
+    if (c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        if (in_list(text, length, types, COUNT(types))) {
+            return P_TYPE;
+        } else if (in_list(text, length, keywords, COUNT(keywords))) {
+            return P_KEYWORD;
+        } else if ((length == 4 && strncmp(text, "true", 4) == 0) ||
+                   (length == 5 && strncmp(text, "false", 5) == 0)) {
+            return P_BOOL;
+        }
+        return P_ID;
+    }
+    if (c >= '0' && c <= '9') {
+        return P_NUM;
+    }
+    if (c == '"') {
+        return P_STR;
+    }
+    if (length == 1) {
+        switch (c) {
+            case '(': case '[': case '{': return P_OPEN;
+            case ')': case ']': case '}': return P_CLOSE;
+            case ',': case ';': case '=': return P_PUNCT;
+            case '!': return P_NOT;
+            case '-': return P_MINUS;
+            default: break;
+        }
+    }
+    return (in_list(text, length, binops, COUNT(binops)) ? P_BINOP : P_OTHER);
+}
+
+/**
+ * @brief Split an input into pieces and match up its brackets
+ */
+static Pieces split (const char* text, size_t size)
+{
+    Pieces pieces = { .items = NULL, .count = 0 };
+    size_t capacity = 0;
+    int* open = NULL;       /* stack of unmatched opening brackets */
+    int depth = 0;
+    size_t i = 0;
+    while (i < size) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            i++;
+            continue;
+        }
+        if (c == '/' && i + 1 < size && text[i+1] == '/') {
+            while (i < size && text[i] != '\n') {
+                i++;
+            }
+            continue;
+        }
+        size_t end = i + 1;
+        if (is_ident_char(c)) {
+            while (end < size && is_ident_char(text[end])) {
+                end++;
+            }
+        } else if (c == '"') {
+            while (end < size && text[end] != '"' && text[end] != '\n') {
+                end += (text[end] == '\\' && end + 1 < size ? 2 : 1);
+            }
+            if (end < size && text[end] == '"') {
+                end++;
+            }
+        } else if (i + 1 < size && c != '\0' && strchr("=!<>&|", c) != NULL &&
+                   in_list(text + i, 2, binops, COUNT(binops))) {
+            end = i + 2;
+        }
+        if ((size_t)pieces.count == capacity) {
+            capacity = (capacity == 0 ? 64 : capacity * 2);
+            pieces.items = (Piece*)realloc(pieces.items, capacity * sizeof(Piece));
+            CHECK_MALLOC_PTR(pieces.items)
+            open = (int*)realloc(open, capacity * sizeof(int));
+            CHECK_MALLOC_PTR(open)
+        }
+        Piece* piece = &pieces.items[pieces.count];
+        piece->text = text + i;
+        piece->length = end - i;
+        piece->class = classify(piece->text, piece->length);
+        piece->match = -1;
+        if (piece->class == P_OPEN) {
+            open[depth++] = pieces.count;
+        } else if (piece->class == P_CLOSE && depth > 0) {
+            /* any closing bracket closes the innermost group */
+            piece->match = open[--depth];
+            pieces.items[piece->match].match = pieces.count;
+        }
+        pieces.count++;
+        i = end;
+    }
+    free(open);
+    return pieces;
+}
+
+/**
+ * @brief Growable output text
+ */
+typedef struct Text
+{
+    char* data;         /**< @brief Contents (NUL-terminated) */
+    size_t length;      /**< @brief Length of the contents */
+    size_t capacity;    /**< @brief Size of @c data */
+} Text;
+
+static void Text_append (Text* text, const char* data, size_t length)
+{
+    if (text->length + length + 1 > text->capacity) {
+        text->capacity = (text->length + length + 1) * 2;
+        text->data = (char*)realloc(text->data, text->capacity);
+        CHECK_MALLOC_PTR(text->data)
+    }
+    memcpy(text->data + text->length, data, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+}
+
+static void Text_puts (Text* text, const char* data)
+{
+    Text_append(text, data, strlen(data));
+}
+
+/**
+ * @brief Write pieces <tt>[first, last)</tt>, one per word
+ */
+static void render (Text* out, const Pieces* pieces, int first, int last)
+{
+    for (int i = first; i < last; i++) {
+        const Piece* piece = &pieces->items[i];
+        Text_append(out, piece->text, piece->length);
+        char c = piece->text[0];
+        Text_append(out, (piece->length == 1 && (c == ';' || c == '{' || c == '}') ? "\n" : " "), 1);
+    }
+}
+
+/**
+ * @brief Find the statement starting at a piece
+ *
+ * A statement ends at a semicolon or at a closing brace (not followed by
+ * @c else) at its own nesting level.
+ *
+ * @returns Index just past the statement, or -1 if the piece does not start one
+ */
+static int statement_end (const Pieces* pieces, int start)
+{
+    if (start > 0) {
+        const Piece* prev = &pieces->items[start-1];
+        char c = prev->text[0];
+        if (prev->length != 1 || (c != ';' && c != '{' && c != '}')) {
+            return -1;
+        }
+    }
+    int depth = 0;
+    for (int i = start; i < pieces->count; i++) {
+        const Piece* piece = &pieces->items[i];
+        if (piece->class == P_OPEN) {
+            depth++;
+        } else if (piece->class == P_CLOSE) {
+            if (--depth < 0) {
+                return -1;
+            }
+            if (depth == 0 && piece->text[0] == '}' &&
+                    (i + 1 == pieces->count || strncmp(pieces->items[i+1].text, "else", 4) != 0)) {
+                return i + 1;
+            }
+        } else if (depth == 0 && piece->length == 1 && piece->text[0] == ';') {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Pick a random piece of a given class
+ *
+ * @returns Index of the piece, or -1 if there is none
+ */
+static int pick (FuzzRng* rng, const Pieces* pieces, PieceClass class)
+{
+    if (pieces->count == 0) {
+        return -1;
+    }
+    int start = (int)FuzzRng_below(rng, pieces->count);
+    for (int k = 0; k < pieces->count; k++) {
+        int i = (start + k) % pieces->count;
+        if (pieces->items[i].class == class && (class != P_OPEN || pieces->items[i].match >= 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Pick a random balanced range (a bracketed group or a statement)
+ *
+ * @returns True if the input has one
+ */
+static bool pick_range (FuzzRng* rng, const Pieces* pieces, int* first, int* last)
+{
+    if (pieces->count == 0) {
+        return false;
+    }
+    if (FuzzRng_below(rng, 2) == 0) {
+        int open = pick(rng, pieces, P_OPEN);
+        if (open >= 0) {
+            *first = open;
+            *last = pieces->items[open].match + 1;
+            return true;
+        }
+    }
+    int start = (int)FuzzRng_below(rng, pieces->count);
+    for (int k = 0; k < pieces->count; k++) {
+        int i = (start + k) % pieces->count;
+        int end = statement_end(pieces, i);
+        if (end > i) {
+            *first = i;
+            *last = end;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * GENERATORS
+ */
+
+#define CHOOSE(RNG,A)   ((A)[FuzzRng_below((RNG), COUNT(A))])
+
+static void generate_expr (FuzzRng* rng, Text* out, int depth)
+{
+    int choice = (int)FuzzRng_below(rng, (depth > 0 ? 9 : 4));
+    switch (choice) {
+        case 0: Text_puts(out, CHOOSE(rng, numbers)); break;
+        case 1: Text_puts(out, (FuzzRng_below(rng, 2) ? "true" : "false")); break;
+        case 2: Text_puts(out, CHOOSE(rng, names)); break;
+        case 3: Text_puts(out, CHOOSE(rng, strings)); break;
+        case 4:
+            Text_puts(out, CHOOSE(rng, names));
+            Text_puts(out, "[");
+            generate_expr(rng, out, depth - 1);
+            Text_puts(out, "]");
+            break;
+        case 5: {
+            Text_puts(out, CHOOSE(rng, names));
+            Text_puts(out, "(");
+            int nargs = (int)FuzzRng_below(rng, 4);
+            for (int i = 0; i < nargs; i++) {
+                if (i > 0) {
+                    Text_puts(out, ", ");
+                }
+                generate_expr(rng, out, depth - 1);
+            }
+            Text_puts(out, ")");
+            break;
+        }
+        case 6:
+            Text_puts(out, "(");
+            generate_expr(rng, out, depth - 1);
+            Text_puts(out, ")");
+            break;
+        case 7:
+            Text_puts(out, (FuzzRng_below(rng, 2) ? "!" : "-"));
+            generate_expr(rng, out, depth - 1);
+            break;
+        default:
+            generate_expr(rng, out, depth - 1);
+            Text_puts(out, " ");
+            Text_puts(out, CHOOSE(rng, binops));
+            Text_puts(out, " ");
+            generate_expr(rng, out, depth - 1);
+            break;
+    }
+}
+
+static void generate_statement (FuzzRng* rng, Text* out, int depth);
+
+static void generate_block (FuzzRng* rng, Text* out, int depth)
+{
+    Text_puts(out, "{\n");
+    int nstmts = (int)FuzzRng_below(rng, 4);
+    for (int i = 0; i < nstmts; i++) {
+        generate_statement(rng, out, depth - 1);
+    }
+    Text_puts(out, "}\n");
+}
+
+static void generate_statement (FuzzRng* rng, Text* out, int depth)
+{
+    int choice = (int)FuzzRng_below(rng, (depth > 0 ? 9 : 7));
+    switch (choice) {
+        case 0:
+        case 1:
+            Text_puts(out, CHOOSE(rng, names));
+            if (choice == 1) {
+                Text_puts(out, "[");
+                generate_expr(rng, out, 1);
+                Text_puts(out, "]");
+            }
+            Text_puts(out, " = ");
+            generate_expr(rng, out, 2);
+            Text_puts(out, ";\n");
+            break;
+        case 2:
+            Text_puts(out, CHOOSE(rng, names));
+            Text_puts(out, "(");
+            generate_expr(rng, out, 1);
+            Text_puts(out, ");\n");
+            break;
+        case 3:
+            Text_puts(out, "return");
+            if (FuzzRng_below(rng, 2)) {
+                Text_puts(out, " ");
+                generate_expr(rng, out, 2);
+            }
+            Text_puts(out, ";\n");
+            break;
+        case 4: Text_puts(out, "break;\n"); break;
+        case 5: Text_puts(out, "continue;\n"); break;
+        case 6:
+            Text_puts(out, CHOOSE(rng, types));
+            Text_puts(out, " ");
+            Text_puts(out, CHOOSE(rng, names));
+            Text_puts(out, ";\n");
+            break;
+        case 7:
+            Text_puts(out, "if (");
+            generate_expr(rng, out, 2);
+            Text_puts(out, ") ");
+            generate_block(rng, out, depth);
+            if (FuzzRng_below(rng, 2)) {
+                Text_puts(out, "else ");
+                generate_block(rng, out, depth);
+            }
+            break;
+        default:
+            Text_puts(out, "while (");
+            generate_expr(rng, out, 2);
+            Text_puts(out, ") ");
+            generate_block(rng, out, depth);
+            break;
+    }
+}
+
+static void generate_declaration (FuzzRng* rng, Text* out)
+{
+    if (FuzzRng_below(rng, 3) == 0) {
+        Text_puts(out, CHOOSE(rng, types));
+        Text_puts(out, " ");
+        Text_puts(out, CHOOSE(rng, names));
+        if (FuzzRng_below(rng, 2)) {
+            Text_puts(out, "[");
+            Text_puts(out, CHOOSE(rng, numbers));
+            Text_puts(out, "]");
+        }
+        Text_puts(out, ";\n");
+        return;
+    }
+    Text_puts(out, "def ");
+    Text_puts(out, CHOOSE(rng, types));
+    Text_puts(out, " ");
+    Text_puts(out, CHOOSE(rng, names));
+    Text_puts(out, "(");
+    int nparams = (int)FuzzRng_below(rng, 3);
+    for (int i = 0; i < nparams; i++) {
+        if (i > 0) {
+            Text_puts(out, ", ");
+        }
+        Text_puts(out, CHOOSE(rng, types));
+        Text_puts(out, " ");
+        Text_puts(out, CHOOSE(rng, names));
+    }
+    Text_puts(out, ") ");
+    generate_block(rng, out, 2);
+}
+
+/**
+ * @brief Replacement text for a piece of the same class
+ */
+static const char* same_class (FuzzRng* rng, PieceClass class)
+{
+    switch (class) {
+        case P_ID:      return CHOOSE(rng, names);
+        case P_NUM:     return CHOOSE(rng, numbers);
+        case P_STR:     return CHOOSE(rng, strings);
+        case P_BOOL:    return (FuzzRng_below(rng, 2) ? "true" : "false");
+        case P_TYPE:    return CHOOSE(rng, types);
+        case P_KEYWORD: return CHOOSE(rng, keywords);
+        case P_BINOP:   return CHOOSE(rng, binops);
+        case P_NOT:
+        case P_MINUS:   return (FuzzRng_below(rng, 2) ? "!" : "-");
+        case P_OPEN:    return CHOOSE(rng, ((const char* const[]){ "(", "[", "{" }));
+        case P_CLOSE:   return CHOOSE(rng, ((const char* const[]){ ")", "]", "}" }));
+        case P_PUNCT:   return CHOOSE(rng, ((const char* const[]){ ",", ";", "=" }));
+        default:        return "";
+    }
+}
+
+
+/*
+ * MUTATIONS
+ */
+
+/**
+ * @brief Mutate raw bytes (insert, delete or overwrite one)
+ */
+static size_t mutate_bytes (FuzzRng* rng, char* data, size_t size, size_t max_size)
+{
+    char c = (FuzzRng_below(rng, 4) == 0 ? (char)(1 + FuzzRng_below(rng, 255))
+                                          : interesting_bytes[FuzzRng_below(rng, sizeof(interesting_bytes) - 1)]);
+    size_t pos = (size > 0 ? FuzzRng_below(rng, size) : 0);
+    switch (FuzzRng_below(rng, 3)) {
+        case 0:
+            if (size < max_size) {
+                memmove(data + pos + 1, data + pos, size - pos);
+                data[pos] = c;
+                return size + 1;
+            }
+            break;
+        case 1:
+            if (size > 0) {
+                memmove(data + pos, data + pos + 1, size - pos - 1);
+                return size - 1;
+            }
+            break;
+        default:
+            break;
+    }
+    if (size > 0) {
+        data[pos] = c;
+    }
+    return size;
+}
+
+/**
+ * @brief Replace pieces <tt>[first, last)</tt> of an input with some text
+ *
+ * @returns Length of the result, or 0 if it does not fit
+ */
+static size_t splice (char* data, size_t max_size, const Pieces* pieces,
+                      int first, int last, const Text* replacement)
+{
+    Text out = { .data = NULL, .length = 0, .capacity = 0 };
+    render(&out, pieces, 0, first);
+    if (replacement->length > 0) {
+        Text_append(&out, replacement->data, replacement->length);
+        Text_append(&out, " ", 1);
+    }
+    render(&out, pieces, last, pieces->count);
+    size_t size = 0;
+    if (out.length > 0 && out.length <= max_size) {
+        memcpy(data, out.data, out.length);
+        size = out.length;
+    }
+    free(out.data);
+    return size;
+}
+
+/**
+ * @brief Try one grammar-aware mutation
+ *
+ * @returns Length of the result, or 0 if the mutation did not apply
+ */
+static size_t mutate_pieces (FuzzRng* rng, char* data, const Pieces* pieces, size_t max_size)
+{
+    Text text = { .data = NULL, .length = 0, .capacity = 0 };
+    Text_append(&text, "", 0);
+    int first = -1;
+    int last = -1;
+    int n = pieces->count;
+    switch (FuzzRng_below(rng, 10)) {
+        case 0:     /* replace a token with another of the same class */
+            if (n > 0) {
+                first = (int)FuzzRng_below(rng, n);
+                last = first + 1;
+                Text_puts(&text, same_class(rng, pieces->items[first].class));
+            }
+            break;
+        case 1:     /* delete a token */
+            if (n > 0) {
+                first = (int)FuzzRng_below(rng, n);
+                last = first + 1;
+            }
+            break;
+        case 2:     /* insert a token */
+            first = last = (int)FuzzRng_below(rng, n + 1);
+            Text_puts(&text, same_class(rng, (PieceClass)FuzzRng_below(rng, P_OTHER)));
+            break;
+        case 3:     /* delete a range */
+            pick_range(rng, pieces, &first, &last);
+            break;
+        case 4: {   /* duplicate a range */
+            int a, b;
+            if (pick_range(rng, pieces, &a, &b)) {
+                render(&text, pieces, a, b);
+                first = last = b;
+            }
+            break;
+        }
+        case 5: {   /* nest a range inside a copy of its own brackets or in a loop */
+            int a, b;
+            if (pick_range(rng, pieces, &a, &b)) {
+                bool paren = (pieces->items[a].class == P_OPEN && pieces->items[a].text[0] == '(');
+                Text_puts(&text, (paren ? "( " : "while ( a ) { "));
+                render(&text, pieces, a, b);
+                Text_puts(&text, (paren ? ")" : "}\n"));
+                first = a;
+                last = b;
+            }
+            break;
+        }
+        case 6: {   /* insert a statement after another one or at the start of a block */
+            int start = (int)FuzzRng_below(rng, n + 1);
+            for (int k = 0; k <= n; k++) {
+                int i = (start + k) % (n + 1);
+                char c = (i > 0 ? pieces->items[i-1].text[0] : '\0');
+                if (i > 0 && pieces->items[i-1].length == 1 && (c == ';' || c == '{' || c == '}')) {
+                    first = last = i;
+                    break;
+                }
+            }
+            if (first >= 0) {
+                generate_statement(rng, &text, 2);
+            }
+            break;
+        }
+        case 7: {   /* replace an operand with a generated expression */
+            PieceClass classes[] = { P_ID, P_NUM, P_BOOL, P_STR };
+            first = pick(rng, pieces, CHOOSE(rng, classes));
+            if (first >= 0) {
+                last = first + 1;
+                generate_expr(rng, &text, 3);
+            }
+            break;
+        }
+        case 8:     /* add a declaration at the start or the end */
+            first = last = (FuzzRng_below(rng, 2) ? 0 : n);
+            generate_declaration(rng, &text);
+            break;
+        default: {  /* grow a string literal */
+            first = pick(rng, pieces, P_STR);
+            if (first >= 0) {
+                const Piece* piece = &pieces->items[first];
+                size_t inner = (piece->length >= 2 ? piece->length - 2 : 0);
+                last = first + 1;
+                Text_append(&text, piece->text, piece->length > 1 ? piece->length - 1 : 1);
+                Text_append(&text, piece->text + 1, inner);
+                Text_puts(&text, "\\n\"");
+            }
+            break;
+        }
+    }
+    size_t size = 0;
+    if (first >= 0) {
+        size = splice(data, max_size, pieces, first, last, &text);
+    }
+    free(text.data);
+    return size;
+}
+
+size_t FuzzMutator_mutate (char* data, size_t size, size_t max_size, uint64_t seed)
+{
+    FuzzRng rng;
+    FuzzRng_seed(&rng, seed);
+    if (max_size == 0) {
+        return 0;
+    }
+    if (FuzzRng_below(&rng, 16) == 0) {
+        return mutate_bytes(&rng, data, size, max_size);
+    }
+
+    /* the pieces point into a copy, since the result overwrites the input */
+    char* copy = (char*)malloc(size + 1);
+    CHECK_MALLOC_PTR(copy)
+    memcpy(copy, data, size);
+    copy[size] = '\0';
+    Pieces pieces = split(copy, size);
+    size_t result = 0;
+    for (int attempt = 0; attempt < 8 && result == 0; attempt++) {
+        result = mutate_pieces(&rng, data, &pieces, max_size);
+    }
+    free(pieces.items);
+    free(copy);
+    return (result > 0 ? result : mutate_bytes(&rng, data, size, max_size));
+}
+
+size_t FuzzMutator_crossover (const char* data1, size_t size1,
+                              const char* data2, size_t size2,
+                              char* out, size_t max_out_size, uint64_t seed)
+{
+    FuzzRng rng;
+    FuzzRng_seed(&rng, seed);
+    Pieces pieces1 = split(data1, size1);
+    Pieces pieces2 = split(data2, size2);
+    Text text = { .data = NULL, .length = 0, .capacity = 0 };
+    Text_append(&text, "", 0);
+
+    int first, last, a, b;
+    size_t result = 0;
+    if (pick_range(&rng, &pieces2, &a, &b)) {
+        render(&text, &pieces2, a, b);
+        if (!pick_range(&rng, &pieces1, &first, &last)) {
+            /* nothing to replace: insert it somewhere */
+            first = last = (int)FuzzRng_below(&rng, pieces1.count + 1);
+        }
+        result = splice(out, max_out_size, &pieces1, first, last, &text);
+    }
+    if (result == 0) {
+        /* no balanced ranges: fall back to joining a prefix to a suffix */
+        size_t cut1 = (size1 > 0 ? FuzzRng_below(&rng, size1 + 1) : 0);
+        size_t cut2 = (size2 > 0 ? FuzzRng_below(&rng, size2 + 1) : 0);
+        if (cut1 > max_out_size) {
+            cut1 = max_out_size;
+        }
+        if (size2 - cut2 > max_out_size - cut1) {
+            cut2 = size2 - (max_out_size - cut1);
+        }
+        memcpy(out, data1, cut1);
+        memcpy(out + cut1, data2 + cut2, size2 - cut2);
+        result = cut1 + size2 - cut2;
+    }
+    free(text.data);
+    free(pieces1.items);
+    free(pieces2.items);
+    return result;
+}
+
+
+/*
+ * GROWTH
+ */
+
+const char* FuzzGrowth_to_string (FuzzGrowth growth)
+{
+    switch (growth) {
+        case GROW_REPEAT:   return "repeat";
+        case GROW_NEST:     return "nest";
+        case GROW_STRING:   return "string";
+        case GROW_LIST:     return "list";
+        default:            return "INVALID";
+    }
+}
+
+bool FuzzMutator_growth_site (const char* text, FuzzGrowth growth, uint64_t seed,
+                              size_t* prefix, size_t* unit)
+{
+    FuzzRng rng;
+    FuzzRng_seed(&rng, seed);
+    size_t size = strlen(text);
+    Pieces pieces = split(text, size);
+    int first = -1;
+    int last = -1;
+    switch (growth) {
+        case GROW_REPEAT:
+            pick_range(&rng, &pieces, &first, &last);
+            break;
+        case GROW_NEST:
+            first = pick(&rng, &pieces, P_OPEN);
+            if (first >= 0 && pieces.items[first].text[0] == '(') {
+                last = pieces.items[first].match + 1;
+            } else {
+                /* not an expression: nest a statement in loops instead */
+                first = -1;
+                pick_range(&rng, &pieces, &first, &last);
+                if (first >= 0 && pieces.items[first].class == P_OPEN) {
+                    first = -1;
+                }
+            }
+            break;
+        case GROW_STRING:
+            first = pick(&rng, &pieces, P_STR);
+            last = first + 1;
+            break;
+        case GROW_LIST:
+            if (pieces.count > 0) {
+                first = 0;
+                last = pieces.count;
+            }
+            break;
+        default:
+            break;
+    }
+    bool found = (first >= 0 && last > first);
+    if (found) {
+        const Piece* end = &pieces.items[last-1];
+        *prefix = pieces.items[first].text - text;
+        *unit = (size_t)(end->text + end->length - pieces.items[first].text);
+    }
+    free(pieces.items);
+    return found;
+}
+
+char* FuzzMutator_grow (const char* text, FuzzGrowth growth, size_t prefix, size_t unit, int factor)
+{
+    Text out = { .data = NULL, .length = 0, .capacity = 0 };
+    const char* site = text + prefix;
+    Text_append(&out, text, prefix);
+    switch (growth) {
+        case GROW_NEST: {
+            bool paren = (site[0] == '(');
+            for (int i = 1; i < factor; i++) {
+                Text_puts(&out, (paren ? "(" : "while (a) {\n"));
+            }
+            Text_append(&out, site, unit);
+            for (int i = 1; i < factor; i++) {
+                Text_puts(&out, (paren ? ")" : "\n}"));
+            }
+            break;
+        }
+        case GROW_STRING:
+            Text_append(&out, site, 1);
+            for (int i = 0; i < factor; i++) {
+                Text_append(&out, site + 1, (unit >= 2 ? unit - 2 : 0));
+            }
+            Text_append(&out, site + unit - 1, 1);
+            break;
+        default:
+            for (int i = 0; i < factor; i++) {
+                Text_append(&out, site, unit);
+                Text_puts(&out, "\n");
+            }
+            break;
+    }
+    Text_puts(&out, site + unit);
+    return out.data;
+}
@@ -453,6 +453,7 @@ typedef struct Attribute
  * <tr><td>@c localSize</td><td>Size (in bytes as @c int) of local variables (only in function nodes)</td></tr>
  * <tr><td>@c code</td><td>ILOC instructions generated from the subtree rooted at this node</td></tr>
  * <tr><td>@c reg</td><td>Register storing the result of the expression rooted at this node (only in expression nodes)</td></tr>
+ * <tr><td>@c pure</td><td>Whether the function is pure (@c int, 1 or 0; only in function nodes; see purity.h)</td></tr>
  * </table>
  * 
  * Generally, the node-type-specific allocators (e.g., @ref ProgramNode_new)
@@ -471,6 +472,7 @@ typedef struct ASTNode
 {
     NodeType type;          /**< @brief Node type (discriminator/tag for the anonymous union) */
     int source_line;        /**< @brief Source code line number */
+    int source_offset;      /**< @brief Byte offset of the first token in the source (-1 if unknown) */
     Attribute* attributes;  /**< @brief Attribute list (not a formal list because of the provided accessor methods) */
     struct ASTNode* next;   /**< @brief Next node (if stored in a list) */
 
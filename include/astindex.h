@@ -0,0 +1,196 @@
+/**
+ * @file astindex.h
+ * @brief Indexed lookups of AST nodes by type, name and line
+ *
+ * Tools built on the parser often need to answer questions like "all calls
+ * to @c foo", "all assignments to the global @c a" or "every node on line
+ * 120". An @ref ASTIndex answers these without traversing the tree: it is
+ * built in a single traversal and files every node under three keys:
+ *
+ * - its node type
+ * - its (interned) name and node type, for named nodes: variable and function
+ *   declarations, locations, function calls and assignments (which are filed
+ *   under the name of the assigned variable); references are further split
+ *   by whether the name resolves to a global variable or to a local
+ *   variable/parameter
+ * - its source line
+ *
+ * Each key leads to a doubly-linked list of entries, so a query costs time
+ * proportional to the number of results, and entries can be added or
+ * removed one subtree at a time (see @ref Document_edit, which keeps an
+ * index up to date as the source changes).
+ */
+
+#ifndef __ASTINDEX_H
+#define __ASTINDEX_H
+
+#include "common.h"
+#include "ast.h"
+
+/**
+ * @brief Number of node types (see @ref NodeType)
+ */
+#define NUM_NODE_TYPES  (LITERAL + 1)
+
+/**
+ * @brief Scope filter for name queries
+ */
+typedef enum IndexScope {
+    ANY_SCOPE,          /**< @brief Every node with the name */
+    GLOBAL_SCOPE,       /**< @brief Global declarations and references to them */
+    LOCAL_SCOPE         /**< @brief Local declarations, parameters and references to them */
+} IndexScope;
+
+struct IndexEntry;
+struct IndexMap;
+
+/**
+ * @brief List of index entries filed under one key
+ */
+typedef struct IndexList
+{
+    struct IndexEntry* head;    /**< @brief First entry (or @c NULL if empty) */
+    struct IndexEntry* tail;    /**< @brief Last entry (or @c NULL if empty) */
+    int size;                   /**< @brief Number of entries */
+} IndexList;
+
+/**
+ * @brief AST index structure
+ */
+typedef struct ASTIndex
+{
+    IndexList by_type[NUM_NODE_TYPES];  /**< @brief Entries for each node type */
+    struct IndexMap* by_name;           /**< @brief (name, type, scope) to entries */
+    struct IndexMap* by_line;           /**< @brief Source line to entries */
+    struct IndexMap* by_node;           /**< @brief Node to entry */
+    int* symbol_slots;                  /**< @brief Hash table of interned names (-1 if empty) */
+    int symbol_capacity;                /**< @brief Size of @c symbol_slots (a power of two) */
+    char** names;                       /**< @brief Text of each interned name */
+    int nnames;                         /**< @brief Number of interned names */
+    int size;                           /**< @brief Number of indexed nodes */
+} ASTIndex;
+
+/**
+ * @brief Iterator over the results of a query
+ *
+ * Obtain one from a query function and call @ref ASTQuery_next until it
+ * returns @c NULL. Results are in no particular order. The index must not be
+ * modified while a query is in progress.
+ */
+typedef struct ASTQuery
+{
+    #ifndef SKIP_IN_DOXYGEN
+    struct IndexEntry* next;
+    IndexList* rest;
+    int key;
+    #endif
+} ASTQuery;
+
+/**
+ * @brief Build an index for an AST
+ *
+ * @param tree Root of the AST (usually a program; may be @c NULL for an
+ * empty index)
+ * @returns Newly-allocated index
+ */
+ASTIndex* ASTIndex_new (ASTNode* tree);
+
+/**
+ * @brief Add every node of a subtree to the index
+ *
+ * A subtree that is not a program (e.g., a single top-level declaration) is
+ * treated as if it appeared at the top level of a program.
+ *
+ * @param index Index to update
+ * @param tree Subtree to add
+ */
+void ASTIndex_add (ASTIndex* index, ASTNode* tree);
+
+/**
+ * @brief Remove every node of a subtree from the index
+ *
+ * @param index Index to update
+ * @param tree Subtree to remove (must have been added)
+ */
+void ASTIndex_remove (ASTIndex* index, ASTNode* tree);
+
+/**
+ * @brief Refile the nodes of a subtree whose source lines have changed
+ *
+ * @param index Index to update
+ * @param tree Subtree to update (must have been added)
+ */
+void ASTIndex_update_lines (ASTIndex* index, ASTNode* tree);
+
+/**
+ * @brief Intern a name
+ *
+ * @param index Index that owns the name table
+ * @param name Name to intern
+ * @returns Symbol number (the same for every call with an equal name)
+ */
+int ASTIndex_intern (ASTIndex* index, const char* name);
+
+/**
+ * @brief Look up the text of an interned name
+ *
+ * @param index Index that owns the name table
+ * @param symbol Symbol number from @ref ASTIndex_intern
+ * @returns Name (owned by the index)
+ */
+const char* ASTIndex_name (ASTIndex* index, int symbol);
+
+/**
+ * @brief Query all nodes of a type
+ *
+ * @param index Index to query
+ * @param type Node type
+ * @returns Query iterator
+ */
+ASTQuery ASTIndex_by_type (ASTIndex* index, NodeType type);
+
+/**
+ * @brief Query all named nodes of a type with a given name
+ *
+ * @param index Index to query
+ * @param type Node type (@c VARDECL, @c FUNCDECL, @c LOCATION, @c FUNCCALL or
+ * @c ASSIGNMENT)
+ * @param name Name to look for
+ * @param scope Which declarations or references to include
+ * @returns Query iterator
+ */
+ASTQuery ASTIndex_by_name (ASTIndex* index, NodeType type, const char* name, IndexScope scope);
+
+/**
+ * @brief Query all nodes that start on a given line
+ *
+ * @param index Index to query
+ * @param line Source line
+ * @returns Query iterator
+ */
+ASTQuery ASTIndex_by_line (ASTIndex* index, int line);
+
+/**
+ * @brief Get the next result of a query
+ *
+ * @param query Query iterator
+ * @returns Next matching node (or @c NULL if there are no more)
+ */
+ASTNode* ASTQuery_next (ASTQuery* query);
+
+/**
+ * @brief Count the remaining results of a query
+ *
+ * @param query Query iterator (not modified)
+ * @returns Number of results that @ref ASTQuery_next would still return
+ */
+int ASTQuery_count (ASTQuery query);
+
+/**
+ * @brief Deallocate an index
+ *
+ * @param index Index to free (the AST itself is not affected)
+ */
+void ASTIndex_free (ASTIndex* index);
+
+#endif
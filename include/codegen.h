@@ -0,0 +1,43 @@
+/**
+ * @file codegen.h
+ * @brief Naive ILOC code generation
+ *
+ * Lowers a parsed Decaf program to ILOC (see iloc.h), one AST node at a time,
+ * in the style of a simple textbook code generator: every expression result
+ * gets a fresh virtual register, and every variable lives in memory.
+ *
+ * - Global variables are laid out from @ref ILOC_STATIC_BASE in declaration
+ *   order (one 8-byte word per scalar or array element).
+ * - Each function starts at a label with its own name. Its frame has the
+ *   parameters at <tt>[bp+16]</tt>, <tt>[bp+24]</tt>, ... (pushed by the
+ *   caller in reverse order, above the return address and saved @c bp) and
+ *   a word for each local variable at <tt>[bp-8]</tt>, <tt>[bp-16]</tt>, ...
+ *   (every block gets its own slots).
+ * - A function returns its value in @c ret. Registers are not preserved by
+ *   calls, so the caller pushes any temporaries it still needs around them.
+ * - @c && and @c || evaluate both operands. The library functions
+ *   @c print_int, @c print_bool and @c print_str become @c print
+ *   instructions.
+ * - Generated labels start with a dot, so they never clash with Decaf names.
+ *
+ * The program is assumed to have passed static analysis; a reference to an
+ * undeclared variable throws an exception (see @ref Error_throw_printf).
+ */
+
+#ifndef __CODEGEN_H
+#define __CODEGEN_H
+
+#include "ast.h"
+#include "iloc.h"
+
+/**
+ * @brief Generate ILOC for a whole program
+ *
+ * Instructions carry the source line of the AST node that generated them.
+ *
+ * @param tree Program AST
+ * @returns Newly-allocated list of instructions
+ */
+ILOCInsnList* generate_code (ASTNode* tree);
+
+#endif
@@ -32,7 +32,7 @@
 #include <string.h>
 
 /**
- * @brief Maximum size (in bytes) of any Decaf source file
+ * @brief Initial size (in bytes) of the buffer used to read a Decaf source file
  */
 #define MAX_FILE_SIZE 65536
 
@@ -93,6 +93,15 @@ void print_escaped_string(const char* string, FILE* output);
  */
 void print_doubly_escaped_string(const char* string, FILE* output);
 
+/**
+ * @brief Read all text data from a file
+ *
+ * @param filename Name of file to read
+ * @returns Newly-allocated, NUL-terminated file contents (or @c NULL if the
+ * file could not be read)
+ */
+char* read_file (const char* filename);
+
 /**
  * @brief Throw an exception with an error message using @c printf syntax
  *
@@ -110,14 +119,89 @@ void print_doubly_escaped_string(const char* string, FILE* output);
 void Error_throw_printf (const char* format, ...);
 
 /**
- * @brief Check a pointer for NULL and terminate with an out-of-memory error
+ * @brief Thread-local exception handler
+ *
+ * The @c jmp_buf used by @ref Error_throw_printf lives in the compiler driver
+ * and is only valid on the thread that called @c setjmp on it. Front end code
+ * that runs on worker threads (e.g., the parallel lexer) must install one of
+ * these before calling anything that might throw. Drivers forward to @ref
+ * ErrorTrap_throw_va at the beginning of their Error_throw_printf
+ * implementation so that the exception is delivered to the innermost trap on
+ * the current thread (if there is one).
+ *
+ * Usage:
+ *
+ *     ErrorTrap trap;
+ *     ErrorTrap_push(&trap);
+ *     if (setjmp(trap.env) == 0) {
+ *         ...
+ *     } else {
+ *         ... (error message is in trap.message)
+ *     }
+ *     ErrorTrap_pop(&trap);
+ */
+typedef struct ErrorTrap {
+    jmp_buf env;                    /**< @brief Target for @c longjmp */
+    char message[MAX_ERROR_LEN];    /**< @brief Error message (valid after a throw) */
+    bool out_of_memory;             /**< @brief True if the error is a failed allocation */
+    struct ErrorTrap* prev;         /**< @brief Enclosing trap on the same thread */
+} ErrorTrap;
+
+/**
+ * @brief Install an exception handler on the current thread
+ *
+ * @param trap Handler to install (@c setjmp must be called on @c trap->env)
+ */
+void ErrorTrap_push (ErrorTrap* trap);
+
+/**
+ * @brief Remove the innermost exception handler from the current thread
+ *
+ * @param trap Handler to remove (must be the innermost one)
+ */
+void ErrorTrap_pop (ErrorTrap* trap);
+
+/**
+ * @brief Deliver an exception to the innermost trap on the current thread
+ *
+ * Does not return if a trap is installed; otherwise returns immediately
+ * without touching @c args so that the caller can fall back to its own
+ * handler.
+ *
+ * @param format Error message format string (@c printf syntax)
+ * @param args Error message arguments
+ */
+void ErrorTrap_throw_va (const char* format, va_list args);
+
+/**
+ * @brief Copy an error message, moving the line number in it ("... on line
+ * N ...") by @p lines
+ *
+ * This is for messages from code that was given part of a file (such as a
+ * lexer run on a chunk that starts partway through it).
+ *
+ * @param out Buffer for the new message (at least #MAX_ERROR_LEN long)
+ * @param message Original message
+ * @param lines Number of lines to add (may be negative)
+ */
+void Error_move_line (char* out, const char* message, int lines);
+
+/**
+ * @brief Report a failed allocation
+ *
+ * If a trap is installed on the current thread, the error is delivered to it
+ * (with @c out_of_memory set); otherwise the process terminates.
+ */
+void Error_out_of_memory ();
+
+/**
+ * @brief Check a pointer for NULL and fail with an out-of-memory error
  * 
  * This is meant to be called immediately after a malloc/calloc call.
  */
 #define CHECK_MALLOC_PTR(P) \
     if (P == NULL) { \
-        printf("Out of memory!\n"); \
-        exit(EXIT_FAILURE); \
+        Error_out_of_memory(); \
     }
 
 /**
@@ -0,0 +1,217 @@
+/**
+ * @file decaf.h
+ * @brief Embeddable front end library (libdecaf)
+ *
+ * This is the public interface of @c libdecaf.a and @c libdecaf.so (built
+ * with <tt>make lib</tt>). It is self-contained: it does not include any of
+ * the compiler's internal headers, and every type it exposes is either opaque
+ * or a plain structure whose layout only changes together with
+ * @ref DECAF_API_VERSION.
+ *
+ * All state lives in a @ref DecafContext or in the objects it creates, and no
+ * function longjmps out of the library or exits the process: failures are
+ * reported as @ref DecafStatus codes, with a message and source offset
+ * available from the context. Separate contexts may be used concurrently from
+ * different threads; a single context must not be used by two threads at
+ * once.
+ *
+ * Typical use:
+ *
+ * @code
+ *     DecafContext* context = DecafContext_new();
+ *     DecafTree* tree = NULL;
+ *     if (DecafContext_parse(context, text, length, &tree) == DECAF_OK) {
+ *         DecafTree_traverse(tree, callback, data);
+ *         DecafTree_free(tree);
+ *     } else {
+ *         fprintf(stderr, "%s", DecafContext_error(context));
+ *     }
+ *     DecafContext_free(context);
+ * @endcode
+ */
+
+#ifndef __DECAF_H
+#define __DECAF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Version of this interface
+ */
+#define DECAF_API_VERSION 1
+
+/**
+ * @brief Result of a library call
+ */
+typedef enum DecafStatus {
+    DECAF_OK = 0,               /**< @brief Success */
+    DECAF_LEX_ERROR,            /**< @brief Invalid token in the source */
+    DECAF_PARSE_ERROR,          /**< @brief Syntax error in the source */
+    DECAF_OUT_OF_MEMORY,        /**< @brief Memory allocation failed */
+    DECAF_INVALID_ARGUMENT      /**< @brief Bad argument (e.g., a @c NULL pointer) */
+} DecafStatus;
+
+/**
+ * @brief Library state (error information); create with
+ * @ref DecafContext_new
+ */
+typedef struct DecafContext DecafContext;
+
+/**
+ * @brief Parsed program; create with @ref DecafContext_parse
+ */
+typedef struct DecafTree DecafTree;
+
+/**
+ * @brief Single token, as reported to a @ref DecafTokenCallback
+ */
+typedef struct DecafToken
+{
+    const char* kind;           /**< @brief Token kind (e.g., "ID", "DECLIT", "while", "+") */
+    const char* text;           /**< @brief Source text of the token */
+    int line;                   /**< @brief Source line */
+    int offset;                 /**< @brief Byte offset in the source */
+} DecafToken;
+
+/**
+ * @brief Single AST node, as reported to a @ref DecafNodeCallback
+ */
+typedef struct DecafNode
+{
+    const char* type;           /**< @brief Node type (e.g., "FuncDecl", "Location") */
+    const char* name;           /**< @brief Name of a declaration, location or call (or @c NULL) */
+    int depth;                  /**< @brief Depth in the tree (0 for the program) */
+    int line;                   /**< @brief Source line */
+    int offset;                 /**< @brief Byte offset in the source (or -1) */
+} DecafNode;
+
+/**
+ * @brief Called for every token of a source buffer, in order
+ *
+ * @param token Token (valid only during the call)
+ * @param data User data passed to @ref DecafContext_lex
+ */
+typedef void (*DecafTokenCallback) (const DecafToken* token, void* data);
+
+/**
+ * @brief Called for every node of a tree, in pre-order
+ *
+ * @param node Node (valid only during the call)
+ * @param data User data passed to @ref DecafTree_traverse
+ * @returns Zero to continue the traversal, or nonzero to skip the node's
+ * children
+ */
+typedef int (*DecafNodeCallback) (const DecafNode* node, void* data);
+
+/**
+ * @brief Output formats for @ref DecafTree_serialize
+ */
+typedef enum DecafFormat {
+    DECAF_FORMAT_TEXT,          /**< @brief Indented text (as printed by the @c decaf tool) */
+    DECAF_FORMAT_DOT,           /**< @brief GraphViz DOT graph */
+    DECAF_FORMAT_JSON,          /**< @brief JSON (one object per node; see emit.h) */
+    DECAF_FORMAT_SEXP           /**< @brief S-expression (one list per node; see emit.h) */
+} DecafFormat;
+
+/**
+ * @brief Create a library context
+ *
+ * @returns New context, or @c NULL if out of memory
+ */
+DecafContext* DecafContext_new (void);
+
+/**
+ * @brief Get the message for the most recent failure in a context
+ *
+ * @param context Context
+ * @returns Error message (empty if the most recent call succeeded; owned by
+ * the context)
+ */
+const char* DecafContext_error (DecafContext* context);
+
+/**
+ * @brief Get the source offset of the most recent failure in a context
+ *
+ * @param context Context
+ * @returns Byte offset of the offending token (or -1 if unknown)
+ */
+int DecafContext_error_offset (DecafContext* context);
+
+/**
+ * @brief Lex a source buffer
+ *
+ * @param context Context
+ * @param text Source text (need not be NUL-terminated)
+ * @param length Length of @p text in bytes
+ * @param callback Called for each token (if the whole buffer lexes)
+ * @param data Passed to @p callback
+ * @returns Status
+ */
+DecafStatus DecafContext_lex (DecafContext* context, const char* text, size_t length,
+                              DecafTokenCallback callback, void* data);
+
+/**
+ * @brief Parse a source buffer
+ *
+ * @param context Context
+ * @param text Source text (need not be NUL-terminated)
+ * @param length Length of @p text in bytes
+ * @param tree Set to the new tree on success (free with @ref DecafTree_free)
+ * @returns Status
+ */
+DecafStatus DecafContext_parse (DecafContext* context, const char* text, size_t length,
+                                DecafTree** tree);
+
+/**
+ * @brief Visit every node of a tree in pre-order
+ *
+ * @param tree Tree
+ * @param callback Called for each node
+ * @param data Passed to @p callback
+ * @returns Status
+ */
+DecafStatus DecafTree_traverse (DecafTree* tree, DecafNodeCallback callback, void* data);
+
+/**
+ * @brief Serialize a tree into a newly-allocated buffer
+ *
+ * @param tree Tree
+ * @param format Output format
+ * @param output Set to the NUL-terminated output (free with @ref Decaf_free)
+ * @param length Set to the length of the output (may be @c NULL)
+ * @returns Status
+ */
+DecafStatus DecafTree_serialize (DecafTree* tree, DecafFormat format, char** output, size_t* length);
+
+/**
+ * @brief Deallocate a tree
+ *
+ * @param tree Tree to free (may be @c NULL)
+ */
+void DecafTree_free (DecafTree* tree);
+
+/**
+ * @brief Deallocate a buffer returned by the library
+ *
+ * @param buffer Buffer to free (may be @c NULL)
+ */
+void Decaf_free (void* buffer);
+
+/**
+ * @brief Deallocate a context
+ *
+ * Trees created with the context remain valid.
+ *
+ * @param context Context to free (may be @c NULL)
+ */
+void DecafContext_free (DecafContext* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
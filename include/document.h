@@ -0,0 +1,139 @@
+/**
+ * @file document.h
+ * @brief Source files that are edited and reparsed incrementally
+ *
+ * A @ref Document keeps a source file's text together with its tokens and
+ * AST (and, on request, an @ref ASTIndex) and keeps all of them current as
+ * the text is edited. An edit is applied by re-lexing the changed region
+ * (see @ref relex) and then reparsing only the top-level declarations that
+ * the edit touches:
+ *
+ * - declarations before the edit are kept as they are
+ * - declarations after the edit are kept, with their source offsets and line
+ *   numbers shifted
+ * - the touched declarations are replaced by whatever their (new) tokens
+ *   parse to, which may be any number of declarations
+ *
+ * Decaf's top level is a flat sequence of declarations that is parsed with
+ * one token of lookahead, so this always gives the same AST as parsing the
+ * whole file.
+ *
+ * Errors do not propagate out of this module: if the text does not lex or
+ * parse, the document records the error message (the same one that lexing
+ * and parsing the whole file would report) and has no AST until a later edit
+ * fixes the problem. Internally, the text that does not lex or parse is kept
+ * as an unparsed region (parsing resumes at the next @c def after an error)
+ * and the declarations around it are kept as usual, so a later edit only
+ * retries the broken region rather than the whole file; this matters while
+ * an editor is sending a change for every keystroke.
+ *
+ * Shifting the positions of every later declaration is the only part of an
+ * edit whose cost grows with the size of the file. A document that is
+ * @c deferred only moves the top-level declaration nodes and catches their
+ * descendants and tokens up when they are asked for (see
+ * @ref Document_declaration_at and @ref Document_sync).
+ */
+
+#ifndef __DOCUMENT_H
+#define __DOCUMENT_H
+
+#include "common.h"
+#include "token.h"
+#include "ast.h"
+#include "relex.h"
+#include "astindex.h"
+
+struct DocumentSegment;
+
+/**
+ * @brief Source file with its tokens and AST
+ */
+typedef struct Document
+{
+    char* text;                 /**< @brief Current source text (owned) */
+    int length;                 /**< @brief Length of @c text (in bytes) */
+    TokenQueue* tokens;         /**< @brief Tokens with offsets (or @c NULL if the text does not lex) */
+    ASTNode* tree;              /**< @brief Program (or @c NULL if the text does not lex or parse) */
+    ASTIndex* index;            /**< @brief Index of @c tree (or @c NULL; see @ref Document_index) */
+    bool indexed;               /**< @brief Whether to maintain @c index */
+    bool deferred;              /**< @brief Whether to shift nodes and tokens after an edit only on request */
+    char error[MAX_ERROR_LEN];  /**< @brief Error message (empty if @c tree is not @c NULL) */
+    int error_offset;           /**< @brief Offset of the token where parsing failed (or -1) */
+    int reparsed;               /**< @brief Declarations parsed by the most recent update */
+
+    TokenQueue* token_list;     /**< @brief Every token that lexed (owned; @c tokens is this or @c NULL) */
+    ASTNode* program;           /**< @brief Every declaration that parsed (owned; @c tree is this or @c NULL) */
+    struct DocumentSegment* segments;   /**< @brief Declarations and unparsed regions in source order */
+    int nsegments;
+    int segment_capacity;
+} Document;
+
+/**
+ * @brief Lex and parse a source file
+ *
+ * @param text Source text (copied)
+ * @returns Newly-allocated document
+ */
+Document* Document_new (const char* text);
+
+/**
+ * @brief Apply an edit to a document and update its tokens, AST and index
+ *
+ * AST nodes of the declarations that the edit touches are freed; nodes of
+ * all other declarations stay where they are in memory.
+ *
+ * @param doc Document to edit
+ * @param edit Location and size of the edit (offsets refer to the current text)
+ * @param replacement Text to insert (@c edit.new_length bytes; need not be
+ * NUL-terminated)
+ */
+void Document_edit (Document* doc, TextEdit edit, const char* replacement);
+
+/**
+ * @brief Replace the whole text of a document and parse it from scratch
+ *
+ * @param doc Document to update
+ * @param text New source text (copied)
+ */
+void Document_replace (Document* doc, const char* text);
+
+/**
+ * @brief Get an index of the document's AST
+ *
+ * The index is built on the first call and kept up to date by later edits.
+ *
+ * @param doc Document
+ * @returns Index (owned by the document), or @c NULL if there is no AST
+ */
+ASTIndex* Document_index (Document* doc);
+
+/**
+ * @brief Find the top-level declaration at an offset
+ *
+ * The positions of the declaration's nodes and tokens are brought up to date
+ * first (see @c deferred).
+ *
+ * @param doc Document
+ * @param offset Offset in the current text
+ * @returns The last declaration that starts at or before @p offset, or
+ * @c NULL if there is none or that part of the text does not parse
+ */
+ASTNode* Document_declaration_at (Document* doc, int offset);
+
+/**
+ * @brief Bring the positions of all nodes and tokens up to date
+ *
+ * This is only needed for a @c deferred document.
+ *
+ * @param doc Document
+ */
+void Document_sync (Document* doc);
+
+/**
+ * @brief Deallocate a document (including its tokens, AST and index)
+ *
+ * @param doc Document to free
+ */
+void Document_free (Document* doc);
+
+#endif
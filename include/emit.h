@@ -0,0 +1,57 @@
+/**
+ * @file emit.h
+ * @brief Machine-readable AST output (JSON and S-expressions)
+ *
+ * These are for tools written in other languages. Both formats are written
+ * in a single statically dispatched traversal through a @ref Writer, with no
+ * intermediate document: each node is opened in its pre-visit and closed in
+ * its post-visit, and the only state is whether a separator is needed, so
+ * memory use does not depend on the size or the depth of the tree.
+ *
+ * Every node has its kind (see @ref NodeType_to_string), its source line and
+ * the fields below, followed by its children in traversal order (a
+ * program's variables, then its functions; a conditional's condition, then
+ * its if and else blocks; and so on):
+ *
+ * - @c VarDecl: @c name, @c type, @c is_array, @c array_length
+ * - @c FuncDecl: @c name, @c return_type, @c parameters (name and type pairs)
+ * - @c BinaryOp and @c UnaryOp: @c op
+ * - @c Location and @c FuncCall: @c name
+ * - @c Literal: @c type and @c value
+ *
+ * For example, the JSON form of <tt>int x;</tt> is
+ *
+ *     {"node":"Program","line":1,"children":[{"node":"VarDecl","line":1,"name":"x",
+ *      "type":"int","is_array":false,"array_length":1,"children":[]}]}
+ *
+ * (on one line) and its S-expression form is
+ *
+ *     (Program :line 1 (VarDecl :line 1 :name "x" :type int :is_array false :array_length 1))
+ *
+ * Strings are escaped as in JSON in both formats.
+ */
+
+#ifndef __EMIT_H
+#define __EMIT_H
+
+#include "common.h"
+#include "ast.h"
+#include "writer.h"
+
+/**
+ * @brief Write an AST as JSON (one line, followed by a newline)
+ *
+ * @param output File stream for the output
+ * @param tree Root of AST structure to write
+ */
+void JsonVisitor_traverse (FILE* output, ASTNode* tree);
+
+/**
+ * @brief Write an AST as an S-expression (one line, followed by a newline)
+ *
+ * @param output File stream for the output
+ * @param tree Root of AST structure to write
+ */
+void SExprVisitor_traverse (FILE* output, ASTNode* tree);
+
+#endif
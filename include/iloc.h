@@ -0,0 +1,247 @@
+/**
+ * @file iloc.h
+ * @brief ILOC intermediate code (representation and text format)
+ *
+ * ILOC is the three-address code that the back end generates (see the @c code
+ * attribute in ast.h). A program is a list of instructions, with labels as
+ * pseudo-instructions that mark jump targets and function entry points. The
+ * text format has one instruction (or label) per line:
+ *
+ *     fact:
+ *         push bp
+ *         i2i sp => bp
+ *         loadAI [bp+16] => r0
+ *         loadI 1 => r1
+ *         cmp_LE r0, r1 => r2
+ *         cbr r2 => l0, l1
+ *     l0:
+ *         ...
+ *
+ * Sources come before the arrow and destinations after it; memory operands
+ * are written in brackets (<tt>[r1]</tt>, <tt>[bp-8]</tt> or <tt>[r1+r2]</tt>).
+ * Registers are the virtual registers <tt>r0</tt>, <tt>r1</tt>, ... and the
+ * special registers @c bp (frame base), @c sp (stack top) and @c ret (return
+ * value). Comments start with @c // or @c # and run to the end of the line.
+ *
+ * <table border="1">
+ * <tr><th>Form</th><th>Meaning</th></tr>
+ * <tr><td><tt>add r1, r2 => r3</tt> (also @c sub, @c mult, @c div, @c and, @c or)</td><td>r3 = r1 op r2</td></tr>
+ * <tr><td><tt>addI r1, c => r2</tt> (also @c subI, @c multI)</td><td>r2 = r1 op c</td></tr>
+ * <tr><td><tt>not r1 => r2</tt>, <tt>neg r1 => r2</tt>, <tt>i2i r1 => r2</tt></td><td>r2 = !r1, -r1, r1</td></tr>
+ * <tr><td><tt>cmp_LT r1, r2 => r3</tt> (also @c LE, @c EQ, @c GE, @c GT, @c NE)</td><td>r3 = (r1 < r2)</td></tr>
+ * <tr><td><tt>loadI c => r1</tt></td><td>r1 = c</td></tr>
+ * <tr><td><tt>load [r1] => r2</tt>, <tt>loadAI [r1+c] => r2</tt>, <tt>loadAO [r1+r2] => r3</tt></td><td>load a word</td></tr>
+ * <tr><td><tt>store r1 => [r2]</tt>, <tt>storeAI r1 => [r2+c]</tt>, <tt>storeAO r1 => [r2+r3]</tt></td><td>store a word</td></tr>
+ * <tr><td><tt>jump l1</tt>, <tt>cbr r1 => l1, l2</tt></td><td>jump (to @c l1 if r1 is nonzero, else @c l2)</td></tr>
+ * <tr><td><tt>call f</tt>, <tt>return</tt></td><td>push the return address and jump; pop it and jump back</td></tr>
+ * <tr><td><tt>push r1</tt>, <tt>pop => r1</tt></td><td>stack push and pop (one word)</td></tr>
+ * <tr><td><tt>print r1</tt>, <tt>print "text"</tt></td><td>write an integer or a string</td></tr>
+ * <tr><td><tt>nop</tt>, <tt>l1:</tt></td><td>no operation; label</td></tr>
+ * </table>
+ */
+
+#ifndef __ILOC_H
+#define __ILOC_H
+
+#include "common.h"
+
+/**
+ * @brief ILOC operation
+ */
+typedef enum ILOCOpcode {
+    ILOC_NOP,
+    ILOC_ADD, ILOC_SUB, ILOC_MULT, ILOC_DIV, ILOC_AND, ILOC_OR,
+    ILOC_ADD_I, ILOC_SUB_I, ILOC_MULT_I,
+    ILOC_NOT, ILOC_NEG, ILOC_I2I,
+    ILOC_CMP_LT, ILOC_CMP_LE, ILOC_CMP_EQ, ILOC_CMP_GE, ILOC_CMP_GT, ILOC_CMP_NE,
+    ILOC_LOAD_I, ILOC_LOAD, ILOC_LOAD_AI, ILOC_LOAD_AO,
+    ILOC_STORE, ILOC_STORE_AI, ILOC_STORE_AO,
+    ILOC_JUMP, ILOC_CBR, ILOC_CALL, ILOC_RETURN,
+    ILOC_PUSH, ILOC_POP, ILOC_PRINT,
+    ILOC_LABEL,
+    NUM_ILOC_OPCODES
+} ILOCOpcode;
+
+/**
+ * @brief Return the mnemonic of an opcode (e.g., "addI" or "cmp_LT")
+ *
+ * @param opcode Opcode
+ * @returns Static string
+ */
+const char* ILOCOpcode_to_string (ILOCOpcode opcode);
+
+/**
+ * @brief Special register numbers (virtual registers are numbered from zero)
+ */
+#define ILOC_BP     (-1)    /**< @brief Frame base register */
+#define ILOC_SP     (-2)    /**< @brief Stack pointer register */
+#define ILOC_RET    (-3)    /**< @brief Return value register */
+
+/**
+ * @brief Address of the first global variable (memory below it is never
+ * valid, so that address zero is not)
+ */
+#define ILOC_STATIC_BASE 256
+
+/**
+ * @brief Kind of an instruction operand
+ */
+typedef enum ILOCOperandType {
+    OPERAND_NONE,       /**< @brief Unused operand slot */
+    OPERAND_REG,        /**< @brief Register (virtual or special) */
+    OPERAND_INT,        /**< @brief Integer constant */
+    OPERAND_STR,        /**< @brief String constant (only for @c print) */
+    OPERAND_LABEL       /**< @brief Jump target or function name */
+} ILOCOperandType;
+
+/**
+ * @brief Instruction operand
+ */
+typedef struct ILOCOperand
+{
+    ILOCOperandType type;   /**< @brief Kind of operand */
+    long value;             /**< @brief Register number or integer constant */
+    char* name;             /**< @brief Label name or string contents (owned; @c NULL otherwise) */
+} ILOCOperand;
+
+/**
+ * @brief Number of operand slots in an instruction
+ */
+#define ILOC_MAX_OPERANDS 3
+
+/**
+ * @brief Single ILOC instruction (or label)
+ *
+ * Operands are stored in the order in which they are written, e.g. for
+ * <tt>storeAI r1 => [r2+c]</tt> they are r1, r2 and c. Use
+ * @ref ILOCInsn_sources and @ref ILOCInsn_destination to find the registers
+ * that an instruction reads and writes.
+ */
+typedef struct ILOCInsn
+{
+    ILOCOpcode opcode;                          /**< @brief Operation */
+    ILOCOperand operands[ILOC_MAX_OPERANDS];    /**< @brief Operands (unused ones are @c OPERAND_NONE) */
+    int source_line;                            /**< @brief Line in the ILOC text (0 if generated) */
+    struct ILOCInsn* next;                      /**< @brief Next instruction (if stored in a list) */
+} ILOCInsn;
+
+/*
+ * Declare ILOCInsnList to be a linked list of ILOCInsn* elements.
+ */
+DECL_LIST_TYPE(ILOCInsn, struct ILOCInsn*)
+
+/**
+ * @brief Make a register operand
+ *
+ * @param reg Register number (or @ref ILOC_BP, @ref ILOC_SP or @ref ILOC_RET)
+ * @returns Operand
+ */
+ILOCOperand ILOCOperand_reg (long reg);
+
+/**
+ * @brief Make an integer constant operand
+ *
+ * @param value Constant
+ * @returns Operand
+ */
+ILOCOperand ILOCOperand_int (long value);
+
+/**
+ * @brief Make a label operand
+ *
+ * @param name Label name (copied)
+ * @returns Operand
+ */
+ILOCOperand ILOCOperand_label (const char* name);
+
+/**
+ * @brief Make a string constant operand
+ *
+ * @param text String contents (copied)
+ * @returns Operand
+ */
+ILOCOperand ILOCOperand_str (const char* text);
+
+/**
+ * @brief Allocate a new instruction
+ *
+ * Pass @c OPERAND_NONE operands (e.g., a zero-initialized @ref ILOCOperand)
+ * for unused slots. The instruction takes ownership of any names in the
+ * operands.
+ *
+ * @param opcode Operation
+ * @param op1 First operand
+ * @param op2 Second operand
+ * @param op3 Third operand
+ * @returns Newly-allocated instruction
+ */
+ILOCInsn* ILOCInsn_new (ILOCOpcode opcode, ILOCOperand op1, ILOCOperand op2, ILOCOperand op3);
+
+/**
+ * @brief Make a deep copy of an instruction (not including its @c next link)
+ *
+ * @param insn Instruction to copy
+ * @returns Newly-allocated copy
+ */
+ILOCInsn* ILOCInsn_copy (ILOCInsn* insn);
+
+/**
+ * @brief Find the registers that an instruction reads
+ *
+ * Memory operands count as reads of their address registers; @c push, @c pop,
+ * @c call and @c return also read @c sp.
+ *
+ * @param insn Instruction
+ * @param regs Receives up to #ILOC_MAX_OPERANDS register numbers
+ * @returns Number of registers read
+ */
+int ILOCInsn_sources (ILOCInsn* insn, long* regs);
+
+/**
+ * @brief Find the register that an instruction writes (other than @c sp)
+ *
+ * @param insn Instruction
+ * @param reg Receives the register number
+ * @returns True if the instruction writes a register
+ */
+bool ILOCInsn_destination (ILOCInsn* insn, long* reg);
+
+/**
+ * @brief Print an instruction in the ILOC text format (without a newline)
+ *
+ * @param insn Instruction
+ * @param output Output stream
+ */
+void ILOCInsn_print (ILOCInsn* insn, FILE* output);
+
+/**
+ * @brief Deallocate an instruction (not including the rest of its list)
+ *
+ * @param insn Instruction to free
+ */
+void ILOCInsn_free (ILOCInsn* insn);
+
+/**
+ * @brief Parse ILOC text into a list of instructions
+ *
+ * Throws an exception (see @ref Error_throw_printf) for an unknown opcode,
+ * a malformed operand, or a jump to a label that is not defined. Calls are
+ * not checked, since they may refer to code that is linked in later.
+ *
+ * @param text ILOC source (NUL-terminated)
+ * @returns Newly-allocated list of instructions
+ */
+ILOCInsnList* ILOCInsnList_parse (const char* text);
+
+/**
+ * @brief Print a list of instructions in the ILOC text format
+ *
+ * Labels are flush left and instructions are indented, so that the output
+ * parses back to the same list.
+ *
+ * @param list Instructions
+ * @param output Output stream
+ */
+void ILOCInsnList_print (ILOCInsnList* list, FILE* output);
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * @file ilocsim.h
+ * @brief ILOC simulator with instruction and cycle counting
+ *
+ * Runs an ILOC program (see iloc.h) on a simple machine, so that code
+ * generation and optimization changes can be measured by what the code does
+ * rather than by how it looks.
+ *
+ * The machine has a register file, and a byte-addressed memory of 8-byte
+ * words. Arithmetic results (and @c loadI constants) wrap around to 32-bit
+ * integers like Decaf's @c int, so memory is limited to @c INT32_MAX bytes
+ * for every address to fit in a register. Every memory access must be word-aligned and at or
+ * above @c static_base (global data starts there, so address zero is never
+ * valid). The stack grows down from the top of memory: @c sp and @c bp start
+ * at @c memory_size, @c push and @c call pre-decrement @c sp by one word, and
+ * @c pop and @c return post-increment it. Execution starts at the label
+ * @c main and ends when @c main returns (or the program falls off its last
+ * instruction); the value in @c ret is the program's result.
+ *
+ * Cycles are counted with a per-opcode latency table. In the pipelined model,
+ * one instruction issues per cycle in program order, but an instruction waits
+ * for the registers it reads to be ready (@c latency cycles after the
+ * instruction that writes them issued), and control transfers wait for their
+ * own latency. Otherwise, every instruction simply takes its latency. Loads and
+ * stores may also go through a direct-mapped data cache, which adds a penalty
+ * to each miss.
+ *
+ * Errors (a missing function, a bad memory access, division by zero or too
+ * many instructions) are thrown with @ref Error_throw_printf.
+ */
+
+#ifndef __ILOCSIM_H
+#define __ILOCSIM_H
+
+#include "iloc.h"
+
+/**
+ * @brief Machine and cost model
+ *
+ * Initialize with @ref ILOCMachineConfig_init and then change any field.
+ */
+typedef struct ILOCMachineConfig
+{
+    size_t memory_size;                 /**< @brief Bytes of memory (a multiple of 8, at most @c INT32_MAX) */
+    long static_base;                   /**< @brief Lowest valid address (start of global data) */
+    int latencies[NUM_ILOC_OPCODES];    /**< @brief Cycles per instruction (labels are free) */
+    bool pipelined;                     /**< @brief Overlap independent instructions (see file comment) */
+    int cache_lines;                    /**< @brief Lines in the data cache (0 for no cache) */
+    int cache_line_size;                /**< @brief Bytes per cache line (a power of two) */
+    int miss_penalty;                   /**< @brief Extra cycles for each cache miss */
+    long max_instructions;              /**< @brief Limit on instructions executed (0 for none) */
+} ILOCMachineConfig;
+
+/**
+ * @brief Fill in the default machine
+ *
+ * 1 MB of memory with global data at address 256; loads and stores take 3
+ * cycles, multiplication 2, division 4, calls and returns 2 and everything
+ * else 1; pipelined; no cache (a 64-line cache of 64-byte lines with a 20
+ * cycle miss penalty once @c cache_lines is set); at most a billion
+ * instructions.
+ *
+ * @param config Configuration to initialize
+ */
+void ILOCMachineConfig_init (ILOCMachineConfig* config);
+
+/**
+ * @brief What a simulated run did
+ */
+typedef struct ILOCStats
+{
+    long instructions;                  /**< @brief Instructions executed (not counting labels) */
+    long cycles;                        /**< @brief Cycles taken */
+    long counts[NUM_ILOC_OPCODES];      /**< @brief Instructions executed by opcode */
+    long loads;                         /**< @brief Words loaded (including pops and returns) */
+    long stores;                        /**< @brief Words stored (including pushes and calls) */
+    long cache_misses;                  /**< @brief Loads and stores that missed the cache */
+    long max_stack;                     /**< @brief Deepest stack (in bytes) */
+    long result;                        /**< @brief Value of @c ret at the end */
+} ILOCStats;
+
+/**
+ * @brief Run an ILOC program
+ *
+ * @param program Instructions (see @ref ILOCInsnList_parse)
+ * @param config Machine (or @c NULL for the default one)
+ * @param output Stream for @c print instructions
+ * @param stats Receives the counts (or @c NULL)
+ * @returns Value of @c ret at the end
+ */
+long ILOCMachine_run (ILOCInsnList* program, const ILOCMachineConfig* config,
+                      FILE* output, ILOCStats* stats);
+
+/**
+ * @brief Print the counts from a run, with an opcode histogram (most frequent
+ * first)
+ *
+ * @param stats Counts
+ * @param output Output stream
+ */
+void ILOCStats_print (ILOCStats* stats, FILE* output);
+
+#endif
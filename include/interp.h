@@ -0,0 +1,92 @@
+/**
+ * @file interp.h
+ * @brief AST interpreter with memoization of pure function calls
+ *
+ * Runs a Decaf program by walking its AST, without compiling it to ILOC (see
+ * codegen.h and ilocsim.h). Values are 32-bit integers (booleans are 0 or 1)
+ * and arithmetic wraps around exactly as in the ILOC simulator; global and
+ * local variables start at zero (locals each time their block is entered).
+ * Like the generated code, both operands of @c && and @c || are always
+ * evaluated. Execution starts at @c main, and the value it returns is the
+ * program's result.
+ *
+ * With memoization enabled, calls to pure functions (see purity.h) whose
+ * parameters are all scalars (@c int or @c bool) are cached: the first call
+ * with a given function and arguments runs the body and records the result,
+ * and later calls with the same arguments just return it. A pure function
+ * cannot tell the difference, and recursive ones like
+ * <tt>fib(n) = fib(n - 1) + fib(n - 2)</tt> make a linear rather than an
+ * exponential number of calls. The cache is a hash table keyed by the function
+ * and its arguments; it stops growing at @c max_memo_entries.
+ *
+ * Errors (a missing function or variable, an array index out of bounds,
+ * division by zero, or too many steps or nested calls) are thrown with
+ * @ref Error_throw_printf.
+ */
+
+#ifndef __INTERP_H
+#define __INTERP_H
+
+#include "purity.h"
+
+/**
+ * @brief Interpreter options
+ *
+ * Initialize with @ref InterpConfig_init and then change any field.
+ */
+typedef struct InterpConfig
+{
+    bool memoize;               /**< @brief Cache the results of pure function calls */
+    long max_memo_entries;      /**< @brief Limit on cached results (0 for none) */
+    int max_depth;              /**< @brief Limit on nested calls */
+    long max_steps;             /**< @brief Limit on statements and expressions evaluated (0 for none) */
+} InterpConfig;
+
+/**
+ * @brief Fill in the default options
+ *
+ * No memoization (and at most a million cached results once it is enabled);
+ * at most 10000 nested calls; at most a billion steps.
+ *
+ * @param config Configuration to initialize
+ */
+void InterpConfig_init (InterpConfig* config);
+
+/**
+ * @brief What an interpreted run did
+ */
+typedef struct InterpStats
+{
+    long steps;                 /**< @brief Statements and expressions evaluated */
+    long calls;                 /**< @brief Function bodies run (not counting @c print_* or cache hits) */
+    int max_depth;              /**< @brief Deepest nesting of calls */
+    int functions;              /**< @brief Functions in the program */
+    int pure;                   /**< @brief Pure functions (see purity.h) */
+    long memo_lookups;          /**< @brief Calls looked up in the cache */
+    long memo_hits;             /**< @brief Lookups that found a cached result */
+    long memo_entries;          /**< @brief Results cached at the end */
+    long result;                /**< @brief Value returned by @c main */
+} InterpStats;
+
+/**
+ * @brief Run a Decaf program
+ *
+ * Also runs @ref Purity_analyze on the program.
+ *
+ * @param tree Program AST
+ * @param config Options (or @c NULL for the default ones)
+ * @param output Stream for @c print_int, @c print_bool and @c print_str
+ * @param stats Receives the counts (or @c NULL)
+ * @returns Value returned by @c main
+ */
+long Interp_run (ASTNode* tree, const InterpConfig* config, FILE* output, InterpStats* stats);
+
+/**
+ * @brief Print the counts from a run, including the cache hit rate
+ *
+ * @param stats Counts
+ * @param output Output stream
+ */
+void InterpStats_print (InterpStats* stats, FILE* output);
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * @file json.h
+ * @brief Minimal JSON reader and writer helpers
+ *
+ * This is just enough JSON for protocols such as the language server (see
+ * lsp.h): @ref Json_parse reads a complete message into a tree of
+ * @ref JsonValue structures, and @ref Json_print_string writes a string with
+ * the escaping that JSON requires. Malformed input is reported by returning
+ * @c NULL rather than by throwing, since it comes from another program rather
+ * than from a Decaf source file.
+ */
+
+#ifndef __JSON_H
+#define __JSON_H
+
+#include "common.h"
+#include "writer.h"
+
+/**
+ * @brief Kinds of JSON values
+ */
+typedef enum JsonType {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+/**
+ * @brief Parsed JSON value
+ */
+typedef struct JsonValue
+{
+    JsonType type;              /**< @brief Kind of value */
+    bool boolean;               /**< @brief Value of a @c JSON_BOOL */
+    double number;              /**< @brief Value of a @c JSON_NUMBER */
+    char* string;               /**< @brief NUL-terminated value of a @c JSON_STRING (owned) */
+    int length;                 /**< @brief Length of @c string in bytes (it may contain NULs) */
+    struct JsonValue* items;    /**< @brief Elements of an array or member values of an object */
+    char** keys;                /**< @brief Member names of an object (parallel to @c items) */
+    int size;                   /**< @brief Number of elements or members */
+} JsonValue;
+
+/**
+ * @brief Parse a JSON text
+ *
+ * @param text JSON text (need not be NUL-terminated)
+ * @param length Length of @p text in bytes
+ * @returns Newly-allocated value, or @c NULL if the text is not valid JSON
+ */
+JsonValue* Json_parse (const char* text, size_t length);
+
+/**
+ * @brief Look up a member of an object
+ *
+ * @param value Object (may be @c NULL or another kind of value)
+ * @param key Member name
+ * @returns Member value, or @c NULL if @p value is not an object with that
+ * member
+ */
+JsonValue* JsonValue_get (JsonValue* value, const char* key);
+
+/**
+ * @brief Look up an element of an array
+ *
+ * @param value Array (may be @c NULL or another kind of value)
+ * @param i Element number
+ * @returns Element, or @c NULL if @p value is not an array with that many
+ * elements
+ */
+JsonValue* JsonValue_at (JsonValue* value, int i);
+
+/**
+ * @brief Get the text of a string value
+ *
+ * @param value Value (may be @c NULL)
+ * @returns String (owned by the value), or @c NULL if @p value is not a string
+ */
+const char* JsonValue_string (JsonValue* value);
+
+/**
+ * @brief Get the value of an integer
+ *
+ * @param value Value (may be @c NULL)
+ * @param fallback Result if @p value is not a number
+ * @returns Integer value
+ */
+int JsonValue_int (JsonValue* value, int fallback);
+
+/**
+ * @brief Write a string as a quoted, escaped JSON string
+ *
+ * This is @ref Writer_json_string for a plain stream.
+ *
+ * @param output File stream for output
+ * @param text String to write
+ * @param length Length of @p text in bytes
+ */
+void Json_print_string (FILE* output, const char* text, size_t length);
+
+/**
+ * @brief Write a value as JSON text
+ *
+ * @param output File stream for output
+ * @param value Value to write
+ */
+void Json_print (FILE* output, JsonValue* value);
+
+/**
+ * @brief Deallocate a value and everything in it
+ *
+ * @param value Value to free (may be @c NULL)
+ */
+void Json_free (JsonValue* value);
+
+#endif
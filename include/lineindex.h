@@ -0,0 +1,96 @@
+/**
+ * @file lineindex.h
+ * @brief Line/column lookups for byte offsets in a source file
+ *
+ * Tokens (see @ref TokenQueue_locate) and AST nodes record the byte offset at
+ * which they begin. A @ref LineIndex converts those offsets into line and
+ * column numbers: it is built with a single @c memchr pass over the source
+ * text (which glibc vectorizes) and answers each query with a binary search
+ * over the line-start offsets. Nothing is computed until an index is actually
+ * requested, so diagnostics that never fire cost nothing.
+ */
+
+#ifndef __LINEINDEX_H
+#define __LINEINDEX_H
+
+#include "common.h"
+#include "token.h"
+
+/**
+ * @brief Table of line-start offsets for a source buffer
+ */
+typedef struct LineIndex
+{
+    int* starts;        /**< @brief Offset of the first character of each line */
+    int count;          /**< @brief Number of lines (always at least one) */
+    int length;         /**< @brief Length of the indexed text (in bytes) */
+} LineIndex;
+
+/**
+ * @brief Build a line index for a source buffer
+ *
+ * @param text NUL-terminated source text
+ * @returns Newly-allocated index (free with @ref LineIndex_free)
+ */
+LineIndex* LineIndex_new (const char* text);
+
+/**
+ * @brief Look up the line that contains a byte offset
+ *
+ * Offsets past the end of the text are treated as being on the last line.
+ *
+ * @param index Line index
+ * @param offset Byte offset in the indexed text
+ * @returns Line number (starting at 1)
+ */
+int LineIndex_line (LineIndex* index, int offset);
+
+/**
+ * @brief Look up the column of a byte offset
+ *
+ * @param index Line index
+ * @param offset Byte offset in the indexed text
+ * @returns Column number in bytes (starting at 1)
+ */
+int LineIndex_column (LineIndex* index, int offset);
+
+/**
+ * @brief Print the source line containing an offset with a caret under it
+ *
+ * Output looks like this (tabs in the source are preserved in the caret line
+ * so that the caret lines up in a terminal):
+ *
+ * @code
+ *     3 |     x = 5 +;
+ *       |            ^
+ * @endcode
+ *
+ * @param index Line index for @p text
+ * @param text Source text that was indexed
+ * @param offset Byte offset to mark
+ * @param output File stream for output
+ */
+void LineIndex_print_caret (LineIndex* index, const char* text, int offset, FILE* output);
+
+/**
+ * @brief Print the source line where a front-end error occurred
+ *
+ * The parser leaves the offending token at the head of the queue, so its
+ * offset identifies the error location; if the queue is empty, the error is
+ * at the end of the file. The line index is only built here, on the error
+ * path.
+ *
+ * @param text Source text
+ * @param tokens Remaining tokens when the error was thrown
+ * @param output File stream for output
+ */
+void LineIndex_print_error_location (const char* text, TokenQueue* tokens, FILE* output);
+
+/**
+ * @brief Deallocate a line index
+ *
+ * @param index Index to free
+ */
+void LineIndex_free (LineIndex* index);
+
+#endif
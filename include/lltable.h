@@ -0,0 +1,120 @@
+/**
+ * @file lltable.h
+ * @brief LL(1) parse table for Decaf expressions
+ *
+ * The tables declared here are generated from @c grammar.txt by
+ * @c tools/llgen and checked in as @c src/expr-table.c. They drive the
+ * expression parser in @c src/p2-parser.c: the next token's @ref TokenKind
+ * and the nonterminal on top of the parse stack select a production with a
+ * single array lookup.
+ *
+ * Grammar symbols are encoded as small integers:
+ *
+ * - terminals are @ref TokenKind values (optionally or'ed with @ref LL_KEEP)
+ * - nonterminal @c i is @c LL_NT(i); the start symbol is always @c LL_NT(0)
+ * - semantic action @c i is @c LL_ACTION(i) (an index into @ref ll_actions)
+ */
+
+#ifndef __LLTABLE_H
+#define __LLTABLE_H
+
+#include "common.h"
+#include "token.h"
+#include "ast.h"
+
+/**
+ * @brief Encode nonterminal number @p I as a grammar symbol
+ */
+#define LL_NT(I)            (0x100 + (I))
+
+/**
+ * @brief Encode semantic action number @p I as a grammar symbol
+ */
+#define LL_ACTION(I)        (0x200 + (I))
+
+/**
+ * @brief Flag for terminals whose token is kept on the value stack
+ */
+#define LL_KEEP             0x400
+
+/**
+ * @brief Test whether an encoded symbol is a terminal
+ */
+#define LL_IS_TERMINAL(S)   (((S) & 0x300) == 0)
+
+/**
+ * @brief Test whether an encoded symbol is a nonterminal
+ */
+#define LL_IS_NT(S)         (((S) & 0x300) == 0x100)
+
+/**
+ * @brief Extract the @ref TokenKind of an encoded terminal
+ */
+#define LL_KIND(S)          ((TokenKind)((S) & 0xff))
+
+/**
+ * @brief Extract the index of an encoded nonterminal or action
+ */
+#define LL_INDEX(S)         ((S) & 0xff)
+
+/**
+ * @brief Maximum length of the right-hand side of a production
+ */
+#define LL_MAX_RHS          8
+
+/**
+ * @brief Semantic action types
+ *
+ * Each action manipulates the parser's value stack:
+ *
+ * - @c LL_BINOP(op): pop right and left operands, push a BinaryOpNode
+ * - @c LL_UNOP(op): pop the operand, push a UnaryOpNode
+ * - @c LL_PAREN: move the start position of the top value to the '('
+ * - @c LL_LIT: push a LiteralNode built from the lookahead token
+ * - @c LL_LOC: pop an identifier, push a scalar LocationNode
+ * - @c LL_INDEX: pop an index and an identifier, push an array LocationNode
+ * - @c LL_ARGS: push an empty argument list
+ * - @c LL_ARG: pop an expression and append it to the argument list
+ * - @c LL_CALL: pop an argument list and an identifier, push a FuncCallNode
+ */
+typedef enum LLActionType {
+    LL_BINOP, LL_UNOP, LL_PAREN, LL_LIT, LL_LOC, LL_INDEX,
+    LL_ARGS, LL_ARG, LL_CALL
+} LLActionType;
+
+/**
+ * @brief Semantic action with its (optional) argument
+ */
+typedef struct LLAction
+{
+    LLActionType type;      /**< @brief What to do */
+    int arg;                /**< @brief Operator for @c LL_BINOP and @c LL_UNOP */
+} LLAction;
+
+/**
+ * @brief Single production
+ */
+typedef struct LLProduction
+{
+    short length;               /**< @brief Number of right-hand side symbols */
+    short rhs[LL_MAX_RHS];      /**< @brief Encoded right-hand side symbols */
+} LLProduction;
+
+/**
+ * @brief Parse table: production number for each (nonterminal, token kind)
+ *
+ * Entries are indices into @ref ll_productions; 0 means a syntax error.
+ */
+extern const unsigned char ll_table[][NUM_TOKEN_KINDS];
+
+/**
+ * @brief Productions (entry 0 is unused)
+ */
+extern const LLProduction ll_productions[];
+
+/**
+ * @brief Semantic actions
+ */
+extern const LLAction ll_actions[];
+
+#endif
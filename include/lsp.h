@@ -0,0 +1,97 @@
+/**
+ * @file lsp.h
+ * @brief Language server: incremental analysis for editors over JSON-RPC
+ *
+ * A @ref LanguageServer speaks a subset of the Language Server Protocol
+ * (JSON-RPC messages with @c Content-Length headers, normally over standard
+ * input and output). Each open file is kept as a @ref Document, so an edit
+ * from the editor re-lexes and reparses only the declarations it touches
+ * (and positions in the rest of the file are brought up to date only when a
+ * request needs them).
+ * Supported messages:
+ *
+ * - @c initialize, @c initialized, @c shutdown and @c exit
+ * - @c textDocument/didOpen, @c textDocument/didChange (full or incremental
+ *   changes) and @c textDocument/didClose; after each of these the server
+ *   sends @c textDocument/publishDiagnostics with the file's lex or parse
+ *   error (or an empty list)
+ * - @c textDocument/definition: the declaration of the variable, parameter or
+ *   function named at a position, resolved with Decaf's scoping rules
+ * - @c textDocument/documentSymbol: global variables and functions (with their
+ *   local variables as children)
+ *
+ * Positions are zero-based lines and UTF-16 code units within a line, as the
+ * protocol specifies.
+ */
+
+#ifndef __LSP_H
+#define __LSP_H
+
+#include "common.h"
+#include "document.h"
+#include "lineindex.h"
+
+struct OpenDocument;
+
+/**
+ * @brief Language server state
+ */
+typedef struct LanguageServer
+{
+    FILE* output;                   /**< @brief Stream for responses and notifications */
+    struct OpenDocument* docs;      /**< @brief Open files */
+    int ndocs;
+    int doc_capacity;
+    bool shutdown;                  /**< @brief Whether a @c shutdown request has been received */
+    bool exited;                    /**< @brief Whether an @c exit notification has been received */
+} LanguageServer;
+
+/**
+ * @brief Create a language server
+ *
+ * @param output Stream for responses and notifications
+ * @returns Newly-allocated server
+ */
+LanguageServer* LanguageServer_new (FILE* output);
+
+/**
+ * @brief Handle a single message (without its header)
+ *
+ * Responses and notifications are written to the server's output (with
+ * headers) before this returns.
+ *
+ * @param server Server
+ * @param message JSON-RPC message
+ * @param length Length of @p message in bytes
+ * @returns False once the client has sent @c exit
+ */
+bool LanguageServer_handle (LanguageServer* server, const char* message, size_t length);
+
+/**
+ * @brief Look up an open file
+ *
+ * @param server Server
+ * @param uri URI of the file
+ * @returns Document, or @c NULL if the file is not open
+ */
+Document* LanguageServer_document (LanguageServer* server, const char* uri);
+
+/**
+ * @brief Deallocate a server and every open document
+ *
+ * @param server Server to free
+ */
+void LanguageServer_free (LanguageServer* server);
+
+/**
+ * @brief Serve requests from an input stream until the client exits or the
+ * stream ends
+ *
+ * @param input Stream of messages with headers (normally standard input)
+ * @param output Stream for responses (normally standard output)
+ * @returns Exit status: success if the client sent @c shutdown before
+ * @c exit, failure otherwise
+ */
+int LanguageServer_run (FILE* input, FILE* output);
+
+#endif
@@ -19,4 +19,16 @@
  */
 ASTNode* parse (TokenQueue* input);
 
+/**
+ * @brief Parse a single top-level declaration (a global variable or a
+ * function) from the front of a queue of tokens
+ *
+ * This is used to reparse part of a program after an edit (see
+ * @ref Document_edit).
+ *
+ * @param input Tokens to parse (the declaration's tokens are removed)
+ * @returns Declaration node (@c VARDECL or @c FUNCDECL)
+ */
+ASTNode* parse_declaration (TokenQueue* input);
+
 #endif
@@ -0,0 +1,52 @@
+/**
+ * @file parlex.h
+ * @brief Parallel lexing of large source files
+ *
+ * The Project 1 lexer (@ref lex) is strictly sequential. For large inputs,
+ * this module splits the source text into chunks at line boundaries, lexes
+ * each chunk on a separate thread, and stitches the resulting token queues
+ * back together.
+ *
+ * Splitting at a newline is always safe in Decaf: neither string literals
+ * nor comments may contain a newline, so a chunk can never begin in the
+ * middle of a token. The only fix-up needed is to shift each chunk's line
+ * numbers by the number of newlines in the chunks before it.
+ */
+
+#ifndef __PARLEX_H
+#define __PARLEX_H
+
+#include "common.h"
+#include "token.h"
+
+/**
+ * @brief Minimum input size (in bytes) before @ref lex_parallel uses threads
+ *
+ * Smaller inputs are handed straight to @ref lex because thread startup
+ * would dominate.
+ */
+#define PARALLEL_LEX_MIN_SIZE   (256 * 1024)
+
+/**
+ * @brief Minimum size (in bytes) of a single chunk handed to a worker
+ */
+#define PARALLEL_LEX_MIN_CHUNK  (64 * 1024)
+
+/**
+ * @brief Convert a string containing a Decaf program into a queue of tokens
+ * using multiple threads.
+ *
+ * The result is identical to calling @ref lex on the same text (with token
+ * offsets filled in as by @ref TokenQueue_locate), including error behavior:
+ * if any chunk fails to lex, the whole text is re-lexed sequentially on the
+ * calling thread so that the exception (and its line number) is exactly the
+ * one @ref lex would have thrown.
+ *
+ * @param text String to lex
+ * @param nthreads Maximum number of worker threads (0 to use one per
+ * online processor)
+ * @returns Newly-created queue of tokens
+ */
+TokenQueue* lex_parallel (const char* text, int nthreads);
+
+#endif
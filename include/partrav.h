@@ -0,0 +1,92 @@
+/**
+ * @file partrav.h
+ * @brief Parallel AST traversal
+ *
+ * Most analyses treat each function declaration independently, so a
+ * traversal can visit the functions of a program on several threads at once.
+ * This module runs such traversals on a small work-stealing scheduler: each
+ * worker thread owns a deque of tasks (a task is a function declaration or a
+ * run of statements from a large block), works on its own deque from the
+ * bottom, and steals from the top of other workers' deques when it runs out.
+ *
+ * Every worker gets its own @ref NodeVisitor from a factory callback, so the
+ * callbacks never share visitor state. When the traversal is done, a
+ * reduction callback folds each worker's visitor into the final result (on
+ * the calling thread, in worker order) and the visitors are freed.
+ *
+ * Ordering guarantees are weaker than those of @ref NodeVisitor_traverse:
+ *
+ * - The program node and global variables are visited by worker 0 on the
+ *   calling thread; the program's postvisit callback runs after every
+ *   function has been visited.
+ * - Each function (or statement run) is visited in the usual order by
+ *   whichever worker runs its task, but different tasks may run concurrently
+ *   and in any order.
+ * - When a block is split, its previsit and postvisit callbacks both run on
+ *   the worker that reached the block, after (resp. before) all of its
+ *   statements. While it waits for them, that worker may run other tasks with
+ *   the same visitor, so callbacks should not keep a traversal stack in the
+ *   visitor state if block splitting is enabled.
+ *
+ * Callbacks may modify the nodes they visit (e.g., by setting attributes) as
+ * long as they do not modify nodes that belong to another task.
+ */
+
+#ifndef __PARTRAV_H
+#define __PARTRAV_H
+
+#include "common.h"
+#include "ast.h"
+#include "visitor.h"
+
+/**
+ * @brief Create the visitor for one worker
+ *
+ * @param context Traversal context (see @ref ParallelTraversal)
+ * @param worker Worker index (0 is the calling thread)
+ * @returns Newly-allocated visitor (freed with @ref NodeVisitor_free)
+ */
+typedef NodeVisitor* (*VisitorFactory) (void* context, int worker);
+
+/**
+ * @brief Fold the results of one worker's visitor into the traversal context
+ *
+ * @param context Traversal context (see @ref ParallelTraversal)
+ * @param visitor Visitor used by one of the workers
+ */
+typedef void (*VisitorReduction) (void* context, NodeVisitor* visitor);
+
+/**
+ * @brief Parallel traversal settings
+ */
+typedef struct ParallelTraversal
+{
+    VisitorFactory create;      /**< @brief Creates each worker's visitor */
+    VisitorReduction reduce;    /**< @brief Folds each worker's visitor into @c context (optional) */
+    void* context;              /**< @brief Passed to @c create and @c reduce */
+
+    /**
+     * @brief Number of worker threads (0 to use one per online processor)
+     */
+    int nthreads;
+
+    /**
+     * @brief Split blocks with more statements than this into tasks of this
+     * many statements each (0 to never split blocks)
+     */
+    int block_split;
+} ParallelTraversal;
+
+/**
+ * @brief Traverse an AST using several threads
+ *
+ * If a callback throws an error, the remaining tasks are abandoned and the
+ * first error is rethrown on the calling thread (after every worker thread
+ * has stopped and every visitor has been freed, without reduction).
+ *
+ * @param traversal Traversal settings
+ * @param tree Root of the AST to traverse (usually a program)
+ */
+void NodeVisitor_traverse_parallel (ParallelTraversal* traversal, ASTNode* tree);
+
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file peephole.h
+ * @brief Peephole optimization of ILOC code
+ *
+ * Rewrites short windows of adjacent instructions according to a declarative
+ * rule table. Each rule gives the instructions to match (with pattern
+ * variables standing for operands), conditions on the variables, and the
+ * instructions to put in their place:
+ *
+ *     { "store_load", 2,
+ *       { { ILOC_STORE_AI, { PP_VAR(0), PP_VAR(1), PP_VAR(2) } },
+ *         { ILOC_LOAD_AI,  { PP_VAR(1), PP_VAR(2), PP_VAR(3) } } },
+ *       1,
+ *       { { ILOC_STORE_AI, { PP_VAR(0), PP_VAR(1), PP_VAR(2) } },
+ *         { ILOC_I2I,      { PP_VAR(0), PP_VAR(3) } } } }
+ *
+ * The first occurrence of a variable binds it to an operand, and later
+ * occurrences must match the same operand. Windows never match across a label
+ * (unless the rule includes it), so rules only see straight-line code.
+ *
+ * The pass keeps the instructions it has already seen on a stack and tries
+ * the rules on each window that ends at the top. When a rule fires, the
+ * matched instructions are popped and the replacement (along with the few
+ * instructions before it) is pushed back onto the front of the input, so that
+ * it is matched again in its new context. Rules are indexed by the opcode of the last instruction in their
+ * window, so only a few are tried at each step. Each rule must make the code
+ * strictly cheaper (fewer or cheaper instructions), so a pass does a linear
+ * amount of work. Because the
+ * conditions depend on register use counts over the whole program, a rewrite
+ * can enable another one earlier in the code (a definition far above the use
+ * that was just removed may now be dead), so passes repeat until one fires no
+ * rules.
+ */
+
+#ifndef __PEEPHOLE_H
+#define __PEEPHOLE_H
+
+#include "iloc.h"
+
+/**
+ * @brief Maximum number of instructions in a rule's window or replacement
+ */
+#define PEEPHOLE_WINDOW 3
+
+/**
+ * @brief Maximum number of pattern variables in a rule
+ */
+#define PEEPHOLE_MAX_VARS 6
+
+/**
+ * @brief Maximum number of rules in a table
+ */
+#define PEEPHOLE_MAX_RULES 64
+
+/**
+ * @brief Pseudo-opcodes that match (or build) an instruction of any opcode
+ */
+typedef enum PeepholeOpcode {
+    /** @brief (Pattern) Any instruction without side effects that writes
+     * register @c operands[0] (arithmetic, comparisons, moves and loads) */
+    PP_DEFINES = NUM_ILOC_OPCODES,
+    /** @brief (Pattern) Any instruction that reads register @c operands[0] */
+    PP_USES,
+    /** @brief (Pattern) Any instruction (but not a label) */
+    PP_ANY,
+    /** @brief (Replacement) Copy of matched instruction @c operands[0] (a
+     * constant index in the window), with every occurrence of register
+     * @c operands[1] (if given) replaced by register @c operands[2] */
+    PP_COPY
+} PeepholeOpcode;
+
+/**
+ * @brief Kind of an operand pattern or template
+ */
+typedef enum PeepholeOperandKind {
+    PP_OPERAND_NONE,    /**< @brief Unused slot (pattern: matches anything) */
+    PP_OPERAND_VAR,     /**< @brief Pattern variable */
+    PP_OPERAND_INT,     /**< @brief Integer constant */
+    PP_OPERAND_SUM,     /**< @brief (Replacement) Sum of two integer variables */
+    PP_OPERAND_PRODUCT  /**< @brief (Replacement) Product of two integer variables */
+} PeepholeOperandKind;
+
+/**
+ * @brief Operand pattern (in a window) or template (in a replacement)
+ */
+typedef struct PeepholeOperand
+{
+    PeepholeOperandKind kind;   /**< @brief Kind of pattern */
+    long a;                     /**< @brief Variable number or constant */
+    long b;                     /**< @brief Second variable (for sums and products) */
+} PeepholeOperand;
+
+#define PP_VAR(N)           { PP_OPERAND_VAR, (N), 0 }      /**< @brief Pattern variable @c N */
+#define PP_INT(C)           { PP_OPERAND_INT, (C), 0 }      /**< @brief Integer constant @c C */
+#define PP_SUM(M,N)         { PP_OPERAND_SUM, (M), (N) }    /**< @brief Sum of variables @c M and @c N */
+#define PP_PRODUCT(M,N)     { PP_OPERAND_PRODUCT, (M), (N) } /**< @brief Product of variables @c M and @c N */
+
+/**
+ * @brief Instruction pattern (in a window) or template (in a replacement)
+ */
+typedef struct PeepholeInsn
+{
+    int opcode;                                     /**< @brief @ref ILOCOpcode or @ref PeepholeOpcode */
+    PeepholeOperand operands[ILOC_MAX_OPERANDS];    /**< @brief Operands, as written in the text format */
+} PeepholeInsn;
+
+/**
+ * @brief Condition on the variables of a rule
+ */
+typedef enum PeepholeConditionKind {
+    PP_ALWAYS,          /**< @brief No condition */
+    PP_SINGLE_USE,      /**< @brief Register @c a is a virtual register written once and read once */
+    PP_UNUSED,          /**< @brief Register @c a is a virtual register that is never read */
+    PP_DIFFERENT        /**< @brief Registers @c a and @c b differ */
+} PeepholeConditionKind;
+
+/**
+ * @brief Condition on the variables of a rule
+ */
+typedef struct PeepholeCondition
+{
+    PeepholeConditionKind kind;     /**< @brief Kind of condition */
+    int a;                          /**< @brief First variable */
+    int b;                          /**< @brief Second variable */
+} PeepholeCondition;
+
+/**
+ * @brief Rewriting rule
+ */
+typedef struct PeepholeRule
+{
+    const char* name;                           /**< @brief Name (for statistics) */
+    int length;                                 /**< @brief Instructions in the window */
+    PeepholeInsn match[PEEPHOLE_WINDOW];        /**< @brief Window to match */
+    int replacement_length;                     /**< @brief Instructions in the replacement */
+    PeepholeInsn replacement[PEEPHOLE_WINDOW];  /**< @brief Replacement instructions */
+    PeepholeCondition conditions[2];            /**< @brief Conditions (all must hold) */
+} PeepholeRule;
+
+/**
+ * @brief Default rules (for code from a naive per-node code generator)
+ *
+ * Forwarding of stored and loaded values, copy propagation through @c i2i,
+ * folding of @c loadI constants into immediate and address-offset forms,
+ * algebraic identities, and removal of self-moves, dead definitions and jumps
+ * to the next instruction.
+ */
+extern const PeepholeRule peephole_rules[];
+
+/**
+ * @brief Number of rules in @ref peephole_rules
+ */
+extern const int peephole_rule_count;
+
+/**
+ * @brief What an optimization did
+ */
+typedef struct PeepholeStats
+{
+    long fired[PEEPHOLE_MAX_RULES];     /**< @brief Times each rule fired */
+    long rewrites;                      /**< @brief Total rules fired */
+    int passes;                         /**< @brief Passes over the code (including the last, unchanged one) */
+    int before;                         /**< @brief Instructions before (not counting labels) */
+    int after;                          /**< @brief Instructions after (not counting labels) */
+} PeepholeStats;
+
+/**
+ * @brief Optimize a list of instructions in place, until no rule applies
+ *
+ * @param list Instructions
+ * @param rules Rule table (e.g., @ref peephole_rules)
+ * @param nrules Number of rules (at most #PEEPHOLE_MAX_RULES)
+ * @param stats Receives what the pass did (or @c NULL)
+ */
+void Peephole_optimize (ILOCInsnList* list, const PeepholeRule* rules, int nrules,
+                        PeepholeStats* stats);
+
+/**
+ * @brief Print the rules that fired (most frequent first) and the change in
+ * code size
+ *
+ * @param stats Statistics from @ref Peephole_optimize
+ * @param rules Rule table that was used
+ * @param nrules Number of rules
+ * @param output Output stream
+ */
+void PeepholeStats_print (PeepholeStats* stats, const PeepholeRule* rules, int nrules,
+                          FILE* output);
+
+#endif
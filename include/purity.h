@@ -0,0 +1,54 @@
+/**
+ * @file purity.h
+ * @brief Interprocedural purity analysis
+ *
+ * Finds the Decaf functions whose result depends only on their arguments and
+ * that have no effects a caller could see, so that calls to them can be
+ * cached (see interp.h). A function is pure if its body:
+ *
+ * - reads and writes only its parameters and local variables (no globals),
+ * - calls no @c print_int, @c print_bool or @c print_str, and
+ * - calls only functions of the program that are themselves pure.
+ *
+ * The last rule is interprocedural: the analysis starts by assuming that every
+ * function that passes the first two rules is pure, then repeatedly drops the
+ * ones that call a function that is not, until nothing changes. Recursive and
+ * mutually recursive functions (like @c fib) therefore stay pure as long as
+ * nothing in their cycle is impure. Whether a function terminates is not
+ * considered.
+ *
+ * The result is stored in the @c pure attribute (@c int, 1 or 0) of every
+ * function declaration node.
+ */
+
+#ifndef __PURITY_H
+#define __PURITY_H
+
+#include "ast.h"
+
+/**
+ * @brief What the purity analysis found
+ */
+typedef struct PurityStats
+{
+    int functions;      /**< @brief Functions in the program */
+    int pure;           /**< @brief Functions found to be pure */
+} PurityStats;
+
+/**
+ * @brief Set the @c pure attribute of every function in a program
+ *
+ * @param tree Program AST
+ * @param stats Receives the counts (or @c NULL)
+ */
+void Purity_analyze (ASTNode* tree, PurityStats* stats);
+
+/**
+ * @brief Check the result of @ref Purity_analyze for one function
+ *
+ * @param func Function declaration node
+ * @returns True if the function has been found to be pure
+ */
+bool Purity_is_pure (ASTNode* func);
+
+#endif
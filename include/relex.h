@@ -0,0 +1,131 @@
+/**
+ * @file relex.h
+ * @brief Incremental re-lexing after a text edit
+ *
+ * Editors and watch-mode tools change a few bytes of a file at a time. Rather
+ * than lexing the whole file again, @ref relex patches an existing token
+ * queue: it re-scans from the last token boundary before the edit up to the
+ * point where the new token stream lines up with the old one again, and
+ * keeps every other token (shifting offsets and line numbers as needed).
+ *
+ * Because no Decaf token, string literal or comment can span a line, the
+ * two streams are guaranteed to resynchronize at the first line boundary
+ * after the end of the edit, so the re-scanned region is bounded by the
+ * edit itself plus the remainder of the lines it touches.
+ *
+ * The rest of the work is kept close to proportional to the edit by a
+ * @ref TokenIndex, which splits the queue into chunks of consecutive tokens
+ * and keeps the chunks in a balanced search tree (a treap) ordered by offset.
+ * Shifting every chunk after an edit is a single pending shift on a subtree,
+ * pushed down as the tree is walked, and the tokens of a chunk only catch up
+ * when the chunk is next touched or when the index is synced (like the
+ * segments of a deferred @ref Document). An edit costs O(log n) in the number
+ * of chunks, plus the chunks it rewrites.
+ */
+
+#ifndef __RELEX_H
+#define __RELEX_H
+
+#include "common.h"
+#include "token.h"
+
+/**
+ * @brief Most tokens per chunk of a @ref TokenIndex
+ *
+ * A run of tokens is (re)indexed as evenly sized chunks, with neighbors taken
+ * in when it is short, so every chunk has at least half this many tokens
+ * (unless the whole queue has fewer).
+ */
+#define TOKEN_CHUNK_SIZE 64
+
+/**
+ * @brief Description of a single replacement edit in a source buffer
+ */
+typedef struct TextEdit
+{
+    int offset;         /**< @brief Byte offset at which the edit begins */
+    int old_length;     /**< @brief Number of bytes removed from the old text */
+    int new_length;     /**< @brief Number of bytes inserted in the new text */
+} TextEdit;
+
+/**
+ * @brief Run of consecutive tokens in a @ref TokenIndex (a node of its tree)
+ */
+typedef struct TokenChunk
+{
+    Token* first;               /**< @brief First token */
+    Token* last;                /**< @brief Last token */
+    int offset_shift;           /**< @brief Offset still to be added to every token */
+    int line_shift;             /**< @brief Line number still to be added to every token */
+    int pending_offset;         /**< @brief Offset shift still to be passed to both subtrees */
+    int pending_line;           /**< @brief Line shift still to be passed to both subtrees */
+    unsigned int priority;      /**< @brief Heap priority (random) */
+    struct TokenChunk* left;    /**< @brief Earlier chunks */
+    struct TokenChunk* right;   /**< @brief Later chunks */
+} TokenChunk;
+
+/**
+ * @brief Chunked index over a token queue, for re-lexing in time proportional
+ * to the edit
+ *
+ * Allocate with @ref TokenIndex_new and de-allocate with @ref TokenIndex_free.
+ *
+ * Methods:
+ * - @ref relex
+ * - @ref TokenIndex_sync
+ */
+typedef struct TokenIndex
+{
+    TokenQueue* tokens;     /**< @brief Indexed queue (not owned) */
+    TokenChunk* root;       /**< @brief Root of the tree of chunks */
+    int nchunks;            /**< @brief Number of chunks */
+    unsigned int seed;      /**< @brief State for chunk priorities */
+} TokenIndex;
+
+/**
+ * @brief Index a token queue
+ *
+ * The queue must have token offsets recorded (see @ref TokenQueue_locate),
+ * and must only be changed through the index while it is in use.
+ *
+ * @param tokens Queue to index
+ * @returns Newly-allocated index
+ */
+TokenIndex* TokenIndex_new (TokenQueue* tokens);
+
+/**
+ * @brief Bring the offsets and line numbers of all tokens up to date
+ *
+ * Needed before reading tokens directly after @ref relex.
+ *
+ * @param index Index
+ */
+void TokenIndex_sync (TokenIndex* index);
+
+/**
+ * @brief Deallocate an index (but not its queue)
+ *
+ * The queue is synced first, so it can be used on its own afterwards.
+ *
+ * @param index Index to deallocate
+ */
+void TokenIndex_free (TokenIndex* index);
+
+/**
+ * @brief Update an indexed token queue in place to reflect an edit
+ *
+ * The queue must have been produced from @p old_text. Tokens outside the
+ * re-scanned region are reused rather than reallocated, and only the tokens
+ * near the edit are touched (see @ref TokenIndex_sync). Like @ref lex, this
+ * throws an exception if the edited region contains an invalid token; in
+ * that case the queue is left unchanged.
+ *
+ * @param index Index of the token queue for @p old_text (modified in place)
+ * @param old_text Source text before the edit
+ * @param new_text Source text after the edit
+ * @param edit Location and size of the edit
+ * @returns Number of tokens that were re-scanned
+ */
+int relex (TokenIndex* index, const char* old_text, const char* new_text, TextEdit edit);
+
+#endif
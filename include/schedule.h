@@ -0,0 +1,77 @@
+/**
+ * @file schedule.h
+ * @brief List scheduling of ILOC basic blocks
+ *
+ * Reorders the instructions in each basic block of an ILOC program (see
+ * iloc.h) so that independent work fills the cycles in which the pipelined
+ * machine of ilocsim.h would otherwise wait for a load, a multiplication or a
+ * division to finish.
+ *
+ * A basic block starts at a label (or after a control transfer) and ends at a
+ * @c jump, @c cbr, @c call or @c return (or before a label). Labels stay at
+ * the start of their block and the control transfer stays at the end. Within
+ * a block, the scheduler builds a dependence DAG:
+ *
+ * - A register read depends on the instruction that last wrote the register,
+ *   with that instruction's latency from the machine model (one cycle for the
+ *   @c sp update of @c push and @c pop). A register write must also stay after
+ *   earlier reads and writes of the same register.
+ * - Stores stay in order, and a load or store stays on its side of any store
+ *   that might write the same word. Two addresses are known to differ if they
+ *   use the same base register value (or constant) with different offsets;
+ *   @c loadAO, @c storeAO, @c push and @c pop might access any word.
+ * - @c print instructions stay in order.
+ *
+ * Instructions are then issued one per cycle, each time choosing the ready
+ * instruction with the longest latency-weighted path to the end of the block
+ * (ties go to the earlier instruction). Building the DAG takes time linear in
+ * the block size (every instruction adds a bounded number of edges, apart from
+ * stores, which take over the loads issued since the previous store), and
+ * issuing takes O(n log n), so huge straight-line blocks from unrolled code
+ * are cheap to schedule.
+ *
+ * The cost of a block is estimated with the same timing model that the
+ * simulator uses (starting with every register ready), and a block keeps its
+ * original order unless the new one is estimated to be faster. Because the
+ * simulator executes instructions in order, a scheduled program computes the
+ * same results and prints the same output as the original.
+ */
+
+#ifndef __SCHEDULE_H
+#define __SCHEDULE_H
+
+#include "ilocsim.h"
+
+/**
+ * @brief What a scheduling pass did
+ */
+typedef struct ScheduleStats
+{
+    int blocks;             /**< @brief Basic blocks (with at least one instruction) */
+    int instructions;       /**< @brief Instructions (not counting labels) */
+    int largest_block;      /**< @brief Instructions in the largest block */
+    int reordered;          /**< @brief Blocks that got a new order */
+    long edges;             /**< @brief Edges in all dependence DAGs */
+    long cycles_before;     /**< @brief Estimated cycles for running every block once, before */
+    long cycles_after;      /**< @brief Estimated cycles for running every block once, after */
+} ScheduleStats;
+
+/**
+ * @brief Schedule every basic block of a program in place
+ *
+ * @param list Instructions
+ * @param config Machine model (or @c NULL for the default one); only the
+ * latencies and the @c pipelined flag are used
+ * @param stats Receives what the pass did (or @c NULL)
+ */
+void Schedule_blocks (ILOCInsnList* list, const ILOCMachineConfig* config, ScheduleStats* stats);
+
+/**
+ * @brief Print the statistics from a scheduling pass
+ *
+ * @param stats Statistics from @ref Schedule_blocks
+ * @param output Output stream
+ */
+void ScheduleStats_print (ScheduleStats* stats, FILE* output);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file server.h
+ * @brief Persistent compile server and its client
+ *
+ * When a build system runs the compiler on thousands of tiny files, process
+ * startup and per-run setup (compiling the lexer's regular expressions,
+ * writing the AST graph) cost more than the compilation itself. In server
+ * mode, a single long-running process listens on a Unix domain socket and
+ * compiles requests from clients with a fixed-size pool of worker threads,
+ * so the lexer's compiled-regex cache (see @ref Regex_new) stays warm across
+ * requests and nothing is set up twice.
+ *
+ * The protocol is a single request and response per connection:
+ *
+ * @code
+ *     request:  <command> <length>\n<payload>
+ *     response: <status> <output length> <error length>\n<output><errors>
+ * @endcode
+ *
+ * where @c command is one of @c PARSE or @c PRINT (the payload is source
+ * text), @c PARSEFILE or @c PRINTFILE (the payload is the path of a file for
+ * the server to read), or @c SHUTDOWN (no payload). The status is the exit
+ * status that a normal compiler run would have had, and the output and
+ * errors are what it would have written to standard output and standard
+ * error (@c PARSE requests only check for errors and produce no output).
+ */
+
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include "common.h"
+
+/**
+ * @brief Maximum size of a request payload (in bytes)
+ */
+#define MAX_REQUEST_SIZE (64 * 1024 * 1024)
+
+/**
+ * @brief Maximum number of accepted connections waiting for a worker (per
+ * worker); when the queue is full, the server stops accepting connections
+ */
+#define SERVER_QUEUE_PER_WORKER 4
+
+/**
+ * @brief Compile server request types
+ */
+typedef enum ServerCommand {
+    PARSE_COMMAND,      /**< @brief Check source for errors */
+    PRINT_COMMAND,      /**< @brief Check source for errors and print its AST */
+    SHUTDOWN_COMMAND    /**< @brief Stop the server */
+} ServerCommand;
+
+/**
+ * @brief Single compile server request
+ */
+typedef struct ServerRequest
+{
+    ServerCommand command;  /**< @brief What to do */
+    const char* path;       /**< @brief File for the server to read (or @c NULL) */
+    const char* text;       /**< @brief Source text (if @c path is @c NULL) */
+} ServerRequest;
+
+/**
+ * @brief Lex and parse source text, writing results and diagnostics to
+ * streams instead of exiting
+ *
+ * This is safe to call from several threads at once.
+ *
+ * @param text Source text
+ * @param command @c PARSE_COMMAND or @c PRINT_COMMAND
+ * @param output File stream for the AST (if printing)
+ * @param errors File stream for error messages
+ * @returns @c EXIT_SUCCESS or @c EXIT_FAILURE
+ */
+int compile_source (const char* text, ServerCommand command, FILE* output, FILE* errors);
+
+/**
+ * @brief Run a compile server until it receives a @c SHUTDOWN request or
+ * @ref CompileServer_stop is called
+ *
+ * Any existing socket file at @p socket_path is replaced, and the socket
+ * file is removed when the server stops.
+ *
+ * @param socket_path Path of the Unix domain socket to listen on
+ * @param nworkers Number of worker threads (0 to use one per online
+ * processor)
+ * @returns @c EXIT_SUCCESS, or @c EXIT_FAILURE if the socket could not be set
+ * up (after printing a message to standard error)
+ */
+int CompileServer_run (const char* socket_path, int nworkers);
+
+/**
+ * @brief Ask a running server to stop once its queued requests are done
+ *
+ * This is async-signal-safe, so it may be called from a signal handler.
+ */
+void CompileServer_stop ();
+
+/**
+ * @brief Send a request to a compile server and wait for the response
+ *
+ * @param socket_path Path of the server's socket
+ * @param request Request to send
+ * @param output File stream for the output of the request
+ * @param errors File stream for the error messages of the request
+ * @returns Exit status of the request, or -1 if the server could not be
+ * reached or did not send a valid response
+ */
+int CompileClient_send (const char* socket_path, ServerRequest* request, FILE* output, FILE* errors);
+
+#endif
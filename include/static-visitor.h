@@ -0,0 +1,335 @@
+/**
+ * @file static-visitor.h
+ * @brief Generator for statically dispatched AST traversals
+ *
+ * A @ref NodeVisitor calls its callbacks through function pointers, checking
+ * each one for @c NULL at every node. This header instead generates a
+ * traversal function for one particular set of callbacks, so every callback
+ * is a direct call (which the compiler can inline) and callbacks that are not
+ * defined expand to nothing at all.
+ *
+ * It is an "X-macro" template: define the parameters below, then include this
+ * file (it may be included any number of times per source file; it removes
+ * all of its parameter definitions at the end). For example:
+ *
+ * @code
+ * #define STATIC_VISITOR_TRAVERSE     CountCalls_traverse
+ * #define STATIC_VISITOR_STATE        int*
+ * #define STATIC_PREVISIT_funccall    CountCalls_visit_funccall
+ * #include "static-visitor.h"
+ * @endcode
+ *
+ * This defines <tt>static void CountCalls_traverse (int* state, ASTNode* node)</tt>,
+ * which visits nodes in the same order as @ref NodeVisitor_traverse and calls
+ * <tt>CountCalls_visit_funccall(state, node)</tt> for each function call.
+ *
+ * Parameters:
+ *
+ * - @c STATIC_VISITOR_TRAVERSE (required): name of the generated function
+ * - @c STATIC_VISITOR_STATE (required): type of its first parameter, which is
+ *   passed unchanged to every callback
+ * - <tt>STATIC_PREVISIT_</tt><i>type</i>, <tt>STATIC_POSTVISIT_</tt><i>type</i>
+ *   and @c STATIC_INVISIT_binaryop: callbacks, named like the corresponding
+ *   @ref NodeVisitor members (e.g., @c STATIC_PREVISIT_program); each may be a
+ *   function or a function-like macro taking @c (state, node)
+ * - @c STATIC_PREVISIT_default, @c STATIC_POSTVISIT_default: used for node
+ *   types that have no specific callback
+ * - @c STATIC_VISITOR_DISPATCH(WHEN,TYPE): if defined, replaces every callback;
+ *   @c WHEN is @c PREVISIT, @c POSTVISIT or @c INVISIT and @c TYPE is the node
+ *   type (this is how @ref NodeVisitor_traverse itself is generated)
+ * - @c STATIC_VISITOR_STATEMENTS(state,node): if defined, called to visit the
+ *   statements of a block instead of traversing them one by one (this is how
+ *   @ref NodeVisitor_traverse_parallel splits large blocks into tasks)
+ * - @c STATIC_VISITOR_PRUNE(state,node): if defined, called before visiting
+ *   each node; if it returns true, neither the node nor any of its
+ *   descendants are visited
+ */
+
+#include "ast.h"
+
+#ifndef STATIC_VISITOR_TRAVERSE
+#error "STATIC_VISITOR_TRAVERSE must be defined before including static-visitor.h"
+#endif
+#ifndef STATIC_VISITOR_STATE
+#error "STATIC_VISITOR_STATE must be defined before including static-visitor.h"
+#endif
+
+#ifndef SKIP_IN_DOXYGEN
+
+#ifndef STATIC_PREVISIT_default
+#define STATIC_PREVISIT_default(S,N)    ((void)0)
+#endif
+#ifndef STATIC_POSTVISIT_default
+#define STATIC_POSTVISIT_default(S,N)   ((void)0)
+#endif
+
+#ifndef STATIC_PREVISIT_program
+#define STATIC_PREVISIT_program         STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_program
+#define STATIC_POSTVISIT_program        STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_vardecl
+#define STATIC_PREVISIT_vardecl         STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_vardecl
+#define STATIC_POSTVISIT_vardecl        STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_funcdecl
+#define STATIC_PREVISIT_funcdecl        STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_funcdecl
+#define STATIC_POSTVISIT_funcdecl       STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_block
+#define STATIC_PREVISIT_block           STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_block
+#define STATIC_POSTVISIT_block          STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_assignment
+#define STATIC_PREVISIT_assignment      STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_assignment
+#define STATIC_POSTVISIT_assignment     STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_conditional
+#define STATIC_PREVISIT_conditional     STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_conditional
+#define STATIC_POSTVISIT_conditional    STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_whileloop
+#define STATIC_PREVISIT_whileloop       STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_whileloop
+#define STATIC_POSTVISIT_whileloop      STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_return
+#define STATIC_PREVISIT_return          STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_return
+#define STATIC_POSTVISIT_return         STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_break
+#define STATIC_PREVISIT_break           STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_break
+#define STATIC_POSTVISIT_break          STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_continue
+#define STATIC_PREVISIT_continue        STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_continue
+#define STATIC_POSTVISIT_continue       STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_binaryop
+#define STATIC_PREVISIT_binaryop        STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_INVISIT_binaryop
+#define STATIC_INVISIT_binaryop(S,N)    ((void)0)
+#endif
+#ifndef STATIC_POSTVISIT_binaryop
+#define STATIC_POSTVISIT_binaryop       STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_unaryop
+#define STATIC_PREVISIT_unaryop         STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_unaryop
+#define STATIC_POSTVISIT_unaryop        STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_location
+#define STATIC_PREVISIT_location        STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_location
+#define STATIC_POSTVISIT_location       STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_funccall
+#define STATIC_PREVISIT_funccall        STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_funccall
+#define STATIC_POSTVISIT_funccall       STATIC_POSTVISIT_default
+#endif
+#ifndef STATIC_PREVISIT_literal
+#define STATIC_PREVISIT_literal         STATIC_PREVISIT_default
+#endif
+#ifndef STATIC_POSTVISIT_literal
+#define STATIC_POSTVISIT_literal        STATIC_POSTVISIT_default
+#endif
+
+#ifdef STATIC_VISITOR_DISPATCH
+#define STATIC_VISIT(WHEN,TYPE)     STATIC_VISITOR_DISPATCH(WHEN,TYPE)
+#else
+#define STATIC_VISIT(WHEN,TYPE)     STATIC_ ## WHEN ## _ ## TYPE (state, node)
+#endif
+
+static void STATIC_VISITOR_TRAVERSE (STATIC_VISITOR_STATE state, ASTNode* node)
+{
+#ifdef STATIC_VISITOR_PRUNE
+    if (STATIC_VISITOR_PRUNE(state, node)) {
+        return;
+    }
+#endif
+    switch (node->type)
+    {
+        case PROGRAM:
+            STATIC_VISIT(PREVISIT, program);
+            FOR_EACH(ASTNode*, var, node->program.variables) {
+                STATIC_VISITOR_TRAVERSE(state, var);
+            }
+            FOR_EACH(ASTNode*, func, node->program.functions) {
+                STATIC_VISITOR_TRAVERSE(state, func);
+            }
+            STATIC_VISIT(POSTVISIT, program);
+            break;
+
+        case VARDECL:
+            STATIC_VISIT(PREVISIT, vardecl);
+            STATIC_VISIT(POSTVISIT, vardecl);
+            break;
+
+        case FUNCDECL:
+            STATIC_VISIT(PREVISIT, funcdecl);
+            STATIC_VISITOR_TRAVERSE(state, node->funcdecl.body);
+            STATIC_VISIT(POSTVISIT, funcdecl);
+            break;
+
+        case BLOCK:
+            STATIC_VISIT(PREVISIT, block);
+            FOR_EACH (ASTNode*, var, node->block.variables) {
+                STATIC_VISITOR_TRAVERSE(state, var);
+            }
+#ifdef STATIC_VISITOR_STATEMENTS
+            STATIC_VISITOR_STATEMENTS(state, node);
+#else
+            FOR_EACH (ASTNode*, stmt, node->block.statements) {
+                STATIC_VISITOR_TRAVERSE(state, stmt);
+            }
+#endif
+            STATIC_VISIT(POSTVISIT, block);
+            break;
+
+        case ASSIGNMENT:
+            STATIC_VISIT(PREVISIT, assignment);
+            STATIC_VISITOR_TRAVERSE(state, node->assignment.location);
+            STATIC_VISITOR_TRAVERSE(state, node->assignment.value);
+            STATIC_VISIT(POSTVISIT, assignment);
+            break;
+
+        case CONDITIONAL:
+            STATIC_VISIT(PREVISIT, conditional);
+            STATIC_VISITOR_TRAVERSE(state, node->conditional.condition);
+            STATIC_VISITOR_TRAVERSE(state, node->conditional.if_block);
+            if (node->conditional.else_block != NULL) {
+                STATIC_VISITOR_TRAVERSE(state, node->conditional.else_block);
+            }
+            STATIC_VISIT(POSTVISIT, conditional);
+            break;
+
+        case WHILELOOP:
+            STATIC_VISIT(PREVISIT, whileloop);
+            STATIC_VISITOR_TRAVERSE(state, node->whileloop.condition);
+            STATIC_VISITOR_TRAVERSE(state, node->whileloop.body);
+            STATIC_VISIT(POSTVISIT, whileloop);
+            break;
+
+        case RETURNSTMT:
+            STATIC_VISIT(PREVISIT, return);
+            if (node->funcreturn.value != NULL) {
+                STATIC_VISITOR_TRAVERSE(state, node->funcreturn.value);
+            }
+            STATIC_VISIT(POSTVISIT, return);
+            break;
+
+        case BREAKSTMT:
+            STATIC_VISIT(PREVISIT, break);
+            STATIC_VISIT(POSTVISIT, break);
+            break;
+
+        case CONTINUESTMT:
+            STATIC_VISIT(PREVISIT, continue);
+            STATIC_VISIT(POSTVISIT, continue);
+            break;
+
+        case BINARYOP:
+            STATIC_VISIT(PREVISIT, binaryop);
+            STATIC_VISITOR_TRAVERSE(state, node->binaryop.left);
+            STATIC_VISIT(INVISIT, binaryop);
+            STATIC_VISITOR_TRAVERSE(state, node->binaryop.right);
+            STATIC_VISIT(POSTVISIT, binaryop);
+            break;
+
+        case UNARYOP:
+            STATIC_VISIT(PREVISIT, unaryop);
+            STATIC_VISITOR_TRAVERSE(state, node->unaryop.child);
+            STATIC_VISIT(POSTVISIT, unaryop);
+            break;
+
+        case LOCATION:
+            STATIC_VISIT(PREVISIT, location);
+            if (node->location.index != NULL) {
+                STATIC_VISITOR_TRAVERSE(state, node->location.index);
+            }
+            STATIC_VISIT(POSTVISIT, location);
+            break;
+
+        case FUNCCALL:
+            STATIC_VISIT(PREVISIT, funccall);
+            FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
+                STATIC_VISITOR_TRAVERSE(state, arg);
+            }
+            STATIC_VISIT(POSTVISIT, funccall);
+            break;
+
+        case LITERAL:
+            STATIC_VISIT(PREVISIT, literal);
+            STATIC_VISIT(POSTVISIT, literal);
+            break;
+
+        default:
+            Error_throw_printf("ERROR: Unhandled node traversal\n");
+            break;
+    }
+}
+
+#undef STATIC_VISIT
+#undef STATIC_VISITOR_DISPATCH
+#undef STATIC_VISITOR_STATEMENTS
+#undef STATIC_VISITOR_PRUNE
+#undef STATIC_VISITOR_TRAVERSE
+#undef STATIC_VISITOR_STATE
+#undef STATIC_PREVISIT_default
+#undef STATIC_POSTVISIT_default
+#undef STATIC_PREVISIT_program
+#undef STATIC_POSTVISIT_program
+#undef STATIC_PREVISIT_vardecl
+#undef STATIC_POSTVISIT_vardecl
+#undef STATIC_PREVISIT_funcdecl
+#undef STATIC_POSTVISIT_funcdecl
+#undef STATIC_PREVISIT_block
+#undef STATIC_POSTVISIT_block
+#undef STATIC_PREVISIT_assignment
+#undef STATIC_POSTVISIT_assignment
+#undef STATIC_PREVISIT_conditional
+#undef STATIC_POSTVISIT_conditional
+#undef STATIC_PREVISIT_whileloop
+#undef STATIC_POSTVISIT_whileloop
+#undef STATIC_PREVISIT_return
+#undef STATIC_POSTVISIT_return
+#undef STATIC_PREVISIT_break
+#undef STATIC_POSTVISIT_break
+#undef STATIC_PREVISIT_continue
+#undef STATIC_POSTVISIT_continue
+#undef STATIC_PREVISIT_binaryop
+#undef STATIC_INVISIT_binaryop
+#undef STATIC_POSTVISIT_binaryop
+#undef STATIC_PREVISIT_unaryop
+#undef STATIC_POSTVISIT_unaryop
+#undef STATIC_PREVISIT_location
+#undef STATIC_POSTVISIT_location
+#undef STATIC_PREVISIT_funccall
+#undef STATIC_POSTVISIT_funccall
+#undef STATIC_PREVISIT_literal
+#undef STATIC_POSTVISIT_literal
+
+#endif
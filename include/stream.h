@@ -0,0 +1,75 @@
+/**
+ * @file stream.h
+ * @brief Streaming front end for very large inputs
+ *
+ * The normal pipeline lexes the whole file, builds the whole tree and only
+ * then prints it, so its peak memory grows with the size of the program. When
+ * the only output wanted is a dump, the front end can instead work one
+ * top-level declaration at a time: @ref parse_stream reads the source in
+ * chunks that end at line boundaries (no Decaf token spans a line, as in
+ * parlex.h), lexes each chunk as it arrives and hands every completed global
+ * variable or function to a callback, which owns it from then on. Peak memory
+ * is then bounded by the largest single declaration (plus one chunk of text
+ * and its tokens) rather than by the whole program.
+ *
+ * A declaration is parsed only once the lexer has reached the start of the
+ * next one and the token after it, since the parser never looks more than
+ * two tokens ahead. A declaration starts at a @c def (no declaration can
+ * contain one) or after a @c ; outside any braces (which can only end a
+ * global variable), so a long run of globals is also handed on as it goes. The parser therefore sees exactly
+ * the tokens it would see in a full parse and throws the same errors, with
+ * the same line numbers. However, an error is only reported when the stream
+ * reaches it: the declarations before it have already been handed on, and a
+ * parse error is reported even if a later line would not lex.
+ */
+
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include "common.h"
+#include "ast.h"
+
+/**
+ * @brief Number of bytes read (and lexed) at a time
+ *
+ * Each chunk is extended to the end of the line it stops in.
+ */
+#define STREAM_CHUNK_SIZE   (64 * 1024)
+
+/**
+ * @brief Callback for each top-level declaration of a streamed program
+ *
+ * @param decl Declaration node (@c VARDECL or @c FUNCDECL), owned by the
+ * callback from now on
+ * @param data Pointer passed to @ref parse_stream
+ */
+typedef void (*DeclarationHandler) (ASTNode* decl, void* data);
+
+/**
+ * @brief Lex and parse a program from a stream one declaration at a time
+ *
+ * Declarations are handed to @p handler in source order, as soon as each one
+ * has been parsed. Lexer and parser errors are thrown as usual (see
+ * @ref Error_throw_printf), after everything allocated here has been freed.
+ *
+ * @param input Stream of Decaf source text
+ * @param handler Function to call with each declaration
+ * @param data Pointer passed through to @p handler
+ */
+void parse_stream (FILE* input, DeclarationHandler handler, void* data);
+
+/**
+ * @brief Print the AST of a program from a stream without building all of it
+ *
+ * Each declaration is printed (in the @ref PrintVisitor_new format) and freed
+ * as soon as it has been parsed. The output is the same as for the full tree
+ * as long as the global variables come before the functions; otherwise it
+ * keeps the declarations in source order, whereas the full tree lists all
+ * the variables first.
+ *
+ * @param input Stream of Decaf source text
+ * @param output File stream for the print output
+ */
+void PrintVisitor_stream (FILE* input, FILE* output);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file tailcall.h
+ * @brief Tail call elimination
+ *
+ * Rewrites tail-recursive Decaf functions as loops, so that deep recursion
+ * runs in constant stack space.
+ *
+ * A tail call is a <tt>return f(...)</tt> statement, or (in a @c void
+ * function) a call statement that is the last thing the function does: the
+ * last statement of the body (or of an @c if or @c else block that is itself
+ * last), or one followed by <tt>return;</tt>.
+ *
+ * - A function that tail-calls itself gets its body wrapped in
+ *   <tt>while (true) { ...; break; }</tt>, and each self tail call becomes an
+ *   assignment of the arguments to the parameters (through temporaries when
+ *   more than one changes, so that they are all evaluated first) followed by
+ *   @c continue.
+ * - Two functions with the same return type that tail-call each other are
+ *   merged into one new looping function that takes a state parameter (which
+ *   body to run next) and both sets of parameters. The original functions
+ *   become wrappers that call it, so callers are unchanged. A pair is left
+ *   alone if a name that one body uses for a global would be captured by the
+ *   other's parameters.
+ *
+ * A call would start with fresh local variables, so each block of a looping
+ * body (outside @c while loops) starts by setting its locals back to zero or
+ * @c false. A function that declares a local array, or a local inside a
+ * @c while loop, cannot be reset that simply and is left alone.
+ *
+ * Tail calls inside a @c while loop are not rewritten (a @c continue there
+ * would restart the inner loop), and neither are calls whose arguments could
+ * not be assigned to the parameters because a local variable shadows one.
+ * Generated names start with an underscore, which Decaf identifiers cannot,
+ * so they never clash with the program's own.
+ */
+
+#ifndef __TAILCALL_H
+#define __TAILCALL_H
+
+#include "ast.h"
+
+/**
+ * @brief What tail call elimination did
+ */
+typedef struct TailCallStats
+{
+    int tail_calls;     /**< @brief Tail calls to functions of the program */
+    int rewritten;      /**< @brief Tail calls replaced by jumps */
+    int loops;          /**< @brief Functions turned into loops (including merged ones) */
+    int merged;         /**< @brief Mutually recursive pairs merged */
+} TailCallStats;
+
+/**
+ * @brief Eliminate self and mutual tail recursion in a program, in place
+ *
+ * @param tree Program AST
+ * @param stats Receives what the pass did (or @c NULL)
+ */
+void TailCall_transform (ASTNode* tree, TailCallStats* stats);
+
+/**
+ * @brief Print the statistics from a tail call pass
+ *
+ * @param stats Statistics from @ref TailCall_transform
+ * @param output Output stream
+ */
+void TailCallStats_print (TailCallStats* stats, FILE* output);
+
+#endif
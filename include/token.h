@@ -27,6 +27,10 @@ typedef regex_t Regex;
 /**
  * @brief Allocate and compile a new regular expression
  *
+ * Compiled regexes are cached for the lifetime of the process, so asking for
+ * a pattern that has been compiled (and freed) before does no @c regcomp
+ * work. This function is thread-safe.
+ *
  * @param regex String containing regular expression to compile
  * @returns Newly-compiled regular expression
  */
@@ -38,6 +42,12 @@ Regex* Regex_new (const char* regex);
  * If the regex matches, the matched text will be written into the given match
  * buffer.
  *
+ * A match of #MAX_TOKEN_LEN characters or more is never truncated: it counts
+ * as no match, and so does every later call at the same text (until the next
+ * @ref Regex_new), so that the lexer stops there and reports an invalid token.
+ * @ref Regex_explain_error then turns that report into a "token too long"
+ * error.
+ *
  * @param regex Compiled regular expression to match against
  * @param text  Text to match
  * @param match Character buffer (must be at least #MAX_TOKEN_LEN long)
@@ -45,13 +55,36 @@ Regex* Regex_new (const char* regex);
  */
 bool Regex_match (Regex *regex, const char *text, char *match);
 
+/**
+ * @brief Replace an invalid token error caused by an over-long token
+ *
+ * If the last @ref Regex_match on this thread refused a match for being too
+ * long, and the message is the lexer's "Invalid token on line N" error, it is
+ * rewritten to "Token too long on line N". Other messages are left alone.
+ * Callers that catch an error thrown by @c lex call this on its message.
+ *
+ * @param message Formatted error message (#MAX_ERROR_LEN bytes)
+ */
+void Regex_explain_error (char* message);
+
 /**
  * @brief Deallocate a regular expression
  *
+ * The compiled regex is returned to the cache for reuse by a later call to
+ * @ref Regex_new with the same pattern. This function is thread-safe.
+ *
  * @param regex Compiled regular expression to deallocate
  */
 void Regex_free (Regex* regex);
 
+/**
+ * @brief Release all cached compiled regexes
+ *
+ * Only needed to keep leak checkers quiet at exit; must not be called while
+ * any regex is still in use.
+ */
+void Regex_cache_clear ();
+
 /**
  * @brief Valid token types
  *
@@ -70,6 +103,33 @@ typedef enum TokenType {
     ID, DECLIT, HEXLIT, STRLIT, KEY, SYM
 } TokenType;
 
+/**
+ * @brief Fine-grained token classification
+ *
+ * Every keyword and symbol in Decaf gets its own kind, so that the parser can
+ * dispatch on a small integer (e.g., index a parse table or @c switch on it)
+ * instead of comparing token text. Tokens are classified once, by
+ * @ref Token_new. @c TK_EOF is never assigned to a token; the parser uses it
+ * to stand for the end of the input. Reserved words and symbols that are
+ * not used by the grammar are @c TK_OTHER.
+ */
+typedef enum TokenKind {
+    TK_EOF, TK_OTHER,
+    TK_ID, TK_DECLIT, TK_HEXLIT, TK_STRLIT,
+
+    /* keywords */
+    TK_DEF, TK_IF, TK_ELSE, TK_WHILE, TK_RETURN, TK_BREAK, TK_CONTINUE,
+    TK_INT, TK_BOOL, TK_VOID, TK_TRUE, TK_FALSE,
+
+    /* symbols */
+    TK_LPAREN, TK_RPAREN, TK_LBRACKET, TK_RBRACKET, TK_LBRACE, TK_RBRACE,
+    TK_COMMA, TK_SEMICOLON, TK_ASSIGN,
+    TK_OR, TK_AND, TK_EQ, TK_NE, TK_LT, TK_LE, TK_GT, TK_GE,
+    TK_PLUS, TK_MINUS, TK_TIMES, TK_DIV, TK_MOD, TK_NOT,
+
+    NUM_TOKEN_KINDS
+} TokenKind;
+
 /**
  * @brief Single token
  * 
@@ -82,6 +142,11 @@ typedef struct Token
      */
     TokenType type;
 
+    /**
+     * @brief Kind of the token (derived from @c type and @c text)
+     */
+    TokenKind kind;
+
     /**
      * @brief Raw text of the token
      */
@@ -92,6 +157,24 @@ typedef struct Token
      */
     int line;
 
+    /**
+     * @brief Decoded value (only for @c DECLIT and @c HEXLIT tokens)
+     */
+    int value;
+
+    /**
+     * @brief True if the literal does not fit in a 32-bit signed integer
+     * (only for @c DECLIT and @c HEXLIT tokens; @c value is @c INT32_MIN if
+     * the literal is exactly 2^31, and undefined otherwise)
+     */
+    bool overflow;
+
+    /**
+     * @brief Byte offset of the first character of the token in the source
+     * text (or -1 if unknown; see @ref TokenQueue_locate)
+     */
+    int offset;
+
     /**
      * @brief Pointer to next token (used to store in a list)
      */
@@ -107,6 +190,25 @@ typedef struct Token
  */
 const char* TokenType_to_string(TokenType type);
 
+/**
+ * @brief Classify a token
+ *
+ * @param type Type of the token
+ * @param text Raw text of the token
+ * @returns Kind of the token
+ */
+TokenKind TokenKind_classify (TokenType type, const char* text);
+
+/**
+ * @brief Convert a token kind to a string for output
+ *
+ * Keywords and symbols are returned as they are spelled in source code.
+ *
+ * @param kind Kind to convert
+ * @returns Static const string representation of the given kind
+ */
+const char* TokenKind_to_string (TokenKind kind);
+
 /**
  * @brief Check string equality for tokens. Limits comparison to @c
  * MAX_TOKEN_LEN for safety.
@@ -123,6 +225,9 @@ bool token_str_eq(const char* str1, const char* str2);
  * Make sure Token_free() is called to deallocate the token, otherwise there
  * will be a memory leak.
  *
+ * Integer literals (@c DECLIT and @c HEXLIT) are decoded here, while the
+ * text is still hot, so that the parser never has to re-read the digits.
+ *
  * @param type Type of new token
  * @param text Raw text for new token
  * @param line Line number of new token
@@ -211,6 +316,20 @@ bool TokenQueue_is_empty (TokenQueue* queue);
  */
 size_t TokenQueue_size (TokenQueue* queue);
 
+/**
+ * @brief Record the source position of every token in a queue
+ *
+ * The Project 1 lexer only tracks line numbers. This walks the lexed text
+ * alongside the token stream, skipping whitespace and comments, and fills in
+ * the @c offset of each token. It is a single linear pass with no regex
+ * matching.
+ *
+ * @param queue Tokens produced by lexing @p text
+ * @param text Text that was lexed
+ * @param base Offset of @p text within the full source (if it is a fragment)
+ */
+void TokenQueue_locate (TokenQueue* queue, const char* text, int base);
+
 /**
  * @brief Print a queue to the given file descriptor (debug output)
  *
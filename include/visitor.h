@@ -79,6 +79,25 @@ typedef struct NodeVisitor
 
 } NodeVisitor;
 
+/**
+ * @brief Call a visitor's previsit callback for a node of the given type
+ * (or its default previsit callback if there is none)
+ */
+#define NODEVISITOR_PREVISIT(V,N,TYPE)  if ((V)->previsit_ ## TYPE != NULL)  { (V)->previsit_ ## TYPE (V, N); } \
+                                                                     else  { (V)->previsit_default  (V, N); }
+
+/**
+ * @brief Call a visitor's postvisit callback for a node of the given type
+ * (or its default postvisit callback if there is none)
+ */
+#define NODEVISITOR_POSTVISIT(V,N,TYPE) if ((V)->postvisit_ ## TYPE != NULL) { (V)->postvisit_ ## TYPE(V, N); } \
+                                                                     else  { (V)->postvisit_default (V, N); }
+
+/**
+ * @brief Call a visitor's invisit callback for a node of the given type (if any)
+ */
+#define NODEVISITOR_INVISIT(V,N,TYPE)   if ((V)->invisit_ ## TYPE != NULL)   { (V)->invisit_ ## TYPE  (V, N); }
+
 /**
  * @brief Allocate a new generic visitor structure
  * 
@@ -129,6 +148,18 @@ void NodeVisitor_free (NodeVisitor* visitor);
  */
 NodeVisitor* PrintVisitor_new (FILE* output);
 
+/**
+ * @brief Print an AST using a statically dispatched traversal
+ * 
+ * Produces the same output as traversing with @ref PrintVisitor_new, but the
+ * callbacks are called directly (see static-visitor.h) and no visitor
+ * structure is allocated.
+ * 
+ * @param output File stream for the print output
+ * @param tree Root of AST structure to print
+ */
+void PrintVisitor_traverse (FILE* output, ASTNode* tree);
+
 /**
  * @brief Create a new AST debug graph output visitor
  * 
@@ -138,11 +169,42 @@ NodeVisitor* PrintVisitor_new (FILE* output);
  * 
  *     dot -Tpng -o ast.png ast.dot
  * 
+ * The output is buffered, and is flushed once the program node has been
+ * visited.
+ * 
  * @param output File stream for the DOT output
  * @returns Pointer to visitor structure
  */
 NodeVisitor* GenerateASTGraph_new (FILE* output);
 
+/**
+ * @brief Selection of nodes for @ref GenerateASTGraph_traverse
+ *
+ * GraphViz cannot lay out the tree of a large program in any reasonable time,
+ * so a graph can be limited to part of it. A zero-initialized structure
+ * selects every node. A node that is left out does not hide its descendants:
+ * those that are selected are attached to its nearest selected ancestor.
+ */
+typedef struct ASTGraphOptions
+{
+    const char* function;   /**< @brief Only this function's subtree (if not @c NULL) */
+    int max_depth;          /**< @brief Only this many levels from the root (if positive) */
+    int first_line;         /**< @brief Only nodes on this line or later (if positive) */
+    int last_line;          /**< @brief Only nodes on this line or earlier (if positive) */
+} ASTGraphOptions;
+
+/**
+ * @brief Write a DOT graph of an AST using a statically dispatched traversal
+ *
+ * With no options this produces the same graph as traversing a program with
+ * @ref GenerateASTGraph_new.
+ *
+ * @param output File stream for the DOT output
+ * @param tree Root of AST structure to write
+ * @param options Nodes to include (or @c NULL for all of them)
+ */
+void GenerateASTGraph_traverse (FILE* output, ASTNode* tree, const ASTGraphOptions* options);
+
 /**
  * @brief Create a new visitor that sets up parent pointers as attributes
  * 
@@ -152,6 +214,15 @@ NodeVisitor* GenerateASTGraph_new (FILE* output);
  */
 NodeVisitor* SetParentVisitor_new();
 
+/**
+ * @brief Set up parent pointers using a statically dispatched traversal
+ * 
+ * Equivalent to traversing with @ref SetParentVisitor_new.
+ * 
+ * @param tree Root of AST structure to traverse
+ */
+void SetParentVisitor_traverse (ASTNode* tree);
+
 /**
  * @brief Create a new visitor that calculates node depths as attributes
  * 
@@ -161,4 +232,14 @@ NodeVisitor* SetParentVisitor_new();
  */
 NodeVisitor* CalcDepthVisitor_new ();
 
+/**
+ * @brief Calculate node depths using a statically dispatched traversal
+ * 
+ * Equivalent to traversing with @ref CalcDepthVisitor_new (parent pointers
+ * must already be set up).
+ * 
+ * @param tree Root of AST structure to traverse
+ */
+void CalcDepthVisitor_traverse (ASTNode* tree);
+
 #endif
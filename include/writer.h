@@ -0,0 +1,106 @@
+/**
+ * @file writer.h
+ * @brief Buffered output for machine-readable dumps
+ *
+ * Printing a large tree with @c fprintf costs a format-string parse and a
+ * stream lock for every field. A @ref Writer collects output in a fixed-size
+ * buffer (usually on the caller's stack) and hands it to the underlying
+ * stream only when the buffer fills up or at the end, so most writes are a
+ * bounds check and a @c memcpy. Nothing is allocated.
+ */
+
+#ifndef __WRITER_H
+#define __WRITER_H
+
+#include "common.h"
+
+/**
+ * @brief Size of a writer's buffer (in bytes)
+ */
+#define WRITER_BUFFER_SIZE  (16 * 1024)
+
+/**
+ * @brief Buffered output stream
+ *
+ * Initialize with @ref Writer_init and call @ref Writer_flush when done.
+ */
+typedef struct Writer
+{
+    FILE* output;                       /**< @brief Underlying stream */
+    size_t used;                        /**< @brief Number of bytes in @c buffer */
+    char buffer[WRITER_BUFFER_SIZE];    /**< @brief Output not yet written to the stream */
+} Writer;
+
+/**
+ * @brief Set up a writer
+ *
+ * @param writer Writer to initialize
+ * @param output Stream for the output
+ */
+void Writer_init (Writer* writer, FILE* output);
+
+/**
+ * @brief Write out everything buffered so far
+ *
+ * @param writer Writer
+ */
+void Writer_flush (Writer* writer);
+
+/**
+ * @brief Write some bytes
+ *
+ * @param writer Writer
+ * @param text Bytes to write
+ * @param length Number of bytes
+ */
+void Writer_write (Writer* writer, const char* text, size_t length);
+
+/**
+ * @brief Write a single character
+ *
+ * @param writer Writer
+ * @param c Character to write
+ */
+static inline void Writer_putc (Writer* writer, char c)
+{
+    if (writer->used == WRITER_BUFFER_SIZE) {
+        Writer_flush(writer);
+    }
+    writer->buffer[writer->used++] = c;
+}
+
+/**
+ * @brief Write a string literal (its length is known at compile time)
+ */
+#define Writer_literal(W,S)     Writer_write((W), (S), sizeof(S) - 1)
+
+/**
+ * @brief Write a NUL-terminated string
+ *
+ * @param writer Writer
+ * @param text String to write
+ */
+void Writer_puts (Writer* writer, const char* text);
+
+/**
+ * @brief Write an integer in decimal
+ *
+ * @param writer Writer
+ * @param value Integer to write
+ */
+void Writer_int (Writer* writer, long long value);
+
+/**
+ * @brief Write a string as a quoted, escaped JSON string
+ *
+ * Quotes, backslashes and control characters are escaped (the latter as
+ * @c \\n, @c \\r, @c \\t or @c \\u00XX); runs of other characters are copied
+ * in one piece.
+ *
+ * @param writer Writer
+ * @param text String to write
+ * @param length Length of @p text in bytes
+ */
+void Writer_json_string (Writer* writer, const char* text, size_t length);
+
+#endif
@@ -62,6 +62,7 @@ ASTNode* ASTNode_new (NodeType type, int source_line)
     CHECK_MALLOC_PTR(node)
     node->type = type;
     node->source_line = source_line;
+    node->source_offset = -1;
     node->attributes = NULL;
     node->next = NULL;
     return node;
@@ -103,8 +104,11 @@ void ASTNode_set_printable_attribute (ASTNode* node, const char* key, void* valu
             if (strncmp(key, a->key, MAX_ID_LEN) == 0) {
 
                 /* key present; replace with new value */
-                a->dtor(a->value);
+                if (a->dtor != NULL) {
+                    a->dtor(a->value);
+                }
                 a->value = value;
+                a->dot_printer = dot_printer;
                 a->dtor = dtor;
                 free(attr);
                 return;
@@ -0,0 +1,581 @@
+/**
+ * @file astindex.c
+ * @brief Indexed lookups of AST nodes by type, name and line
+ */
+
+#include "astindex.h"
+
+/**
+ * @brief Which list an entry link belongs to
+ */
+enum { TYPE_KEY, NAME_KEY, LINE_KEY, NUM_KEYS };
+
+/**
+ * @brief Links for one of an entry's lists
+ */
+typedef struct IndexLink
+{
+    struct IndexEntry* prev;
+    struct IndexEntry* next;
+} IndexLink;
+
+/**
+ * @brief Index record for a single node
+ */
+typedef struct IndexEntry
+{
+    ASTNode* node;
+    int line;                       /**< @brief Line the entry is filed under */
+    IndexList* lists[NUM_KEYS];     /**< @brief Lists containing the entry (or @c NULL) */
+    IndexLink links[NUM_KEYS];
+} IndexEntry;
+
+/**
+ * @brief Open-addressing hash map from 64-bit keys to pointers
+ */
+typedef struct IndexMap
+{
+    uint64_t* keys;
+    void** values;                  /**< @brief @c NULL marks an empty slot */
+    int capacity;                   /**< @brief Always a power of two */
+    int count;
+} IndexMap;
+
+/*
+ * HASH MAP
+ */
+
+static inline uint64_t hash_key (uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static IndexMap* IndexMap_new ()
+{
+    IndexMap* map = (IndexMap*)calloc(1, sizeof(IndexMap));
+    CHECK_MALLOC_PTR(map)
+    map->capacity = 64;
+    map->keys = (uint64_t*)calloc(map->capacity, sizeof(uint64_t));
+    CHECK_MALLOC_PTR(map->keys)
+    map->values = (void**)calloc(map->capacity, sizeof(void*));
+    CHECK_MALLOC_PTR(map->values)
+    return map;
+}
+
+static int IndexMap_slot (IndexMap* map, uint64_t key)
+{
+    int mask = map->capacity - 1;
+    int slot = (int)(hash_key(key) & mask);
+    while (map->values[slot] != NULL && map->keys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static void* IndexMap_get (IndexMap* map, uint64_t key)
+{
+    return map->values[IndexMap_slot(map, key)];
+}
+
+static void IndexMap_put (IndexMap* map, uint64_t key, void* value)
+{
+    if ((map->count + 1) * 4 > map->capacity * 3) {
+        /* grow and rehash */
+        uint64_t* old_keys = map->keys;
+        void** old_values = map->values;
+        int old_capacity = map->capacity;
+        map->capacity *= 2;
+        map->keys = (uint64_t*)calloc(map->capacity, sizeof(uint64_t));
+        CHECK_MALLOC_PTR(map->keys)
+        map->values = (void**)calloc(map->capacity, sizeof(void*));
+        CHECK_MALLOC_PTR(map->values)
+        for (int i = 0; i < old_capacity; i++) {
+            if (old_values[i] != NULL) {
+                int slot = IndexMap_slot(map, old_keys[i]);
+                map->keys[slot] = old_keys[i];
+                map->values[slot] = old_values[i];
+            }
+        }
+        free(old_keys);
+        free(old_values);
+    }
+    int slot = IndexMap_slot(map, key);
+    if (map->values[slot] == NULL) {
+        map->count++;
+    }
+    map->keys[slot] = key;
+    map->values[slot] = value;
+}
+
+static void IndexMap_delete (IndexMap* map, uint64_t key)
+{
+    int mask = map->capacity - 1;
+    int slot = IndexMap_slot(map, key);
+    if (map->values[slot] == NULL) {
+        return;
+    }
+    map->values[slot] = NULL;
+    map->count--;
+
+    /* shift later entries of the probe sequence back into the hole */
+    int hole = slot;
+    for (int i = (slot + 1) & mask; map->values[i] != NULL; i = (i + 1) & mask) {
+        int home = (int)(hash_key(map->keys[i]) & mask);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->keys[hole] = map->keys[i];
+            map->values[hole] = map->values[i];
+            map->values[i] = NULL;
+            hole = i;
+        }
+    }
+}
+
+static void IndexMap_free (IndexMap* map, bool free_values)
+{
+    if (free_values) {
+        for (int i = 0; i < map->capacity; i++) {
+            free(map->values[i]);
+        }
+    }
+    free(map->keys);
+    free(map->values);
+    free(map);
+}
+
+/*
+ * NAME INTERNING
+ */
+
+static uint64_t hash_name (const char* name)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (const char* p = name; *p != '\0'; p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Find the slot for a name (either holding it, or empty)
+ */
+static int symbol_slot (ASTIndex* index, const char* name)
+{
+    int mask = index->symbol_capacity - 1;
+    int slot = (int)(hash_name(name) & mask);
+    while (index->symbol_slots[slot] != -1 &&
+           strcmp(index->names[index->symbol_slots[slot]], name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Look up a name without interning it
+ *
+ * @returns Symbol number (or -1 if the name has never been interned)
+ */
+static int find_symbol (ASTIndex* index, const char* name)
+{
+    return index->symbol_slots[symbol_slot(index, name)];
+}
+
+int ASTIndex_intern (ASTIndex* index, const char* name)
+{
+    int slot = symbol_slot(index, name);
+    if (index->symbol_slots[slot] != -1) {
+        return index->symbol_slots[slot];
+    }
+
+    if ((index->nnames + 1) * 2 > index->symbol_capacity) {
+        free(index->symbol_slots);
+        index->symbol_capacity *= 2;
+        index->symbol_slots = (int*)malloc(index->symbol_capacity * sizeof(int));
+        CHECK_MALLOC_PTR(index->symbol_slots)
+        memset(index->symbol_slots, -1, index->symbol_capacity * sizeof(int));
+        index->names = (char**)realloc(index->names, (index->symbol_capacity / 2) * sizeof(char*));
+        CHECK_MALLOC_PTR(index->names)
+        for (int i = 0; i < index->nnames; i++) {
+            index->symbol_slots[symbol_slot(index, index->names[i])] = i;
+        }
+        slot = symbol_slot(index, name);
+    }
+
+    char* copy = (char*)malloc(strlen(name) + 1);
+    CHECK_MALLOC_PTR(copy)
+    strcpy(copy, name);
+    index->names[index->nnames] = copy;
+    index->symbol_slots[slot] = index->nnames;
+    return index->nnames++;
+}
+
+const char* ASTIndex_name (ASTIndex* index, int symbol)
+{
+    return (symbol >= 0 && symbol < index->nnames ? index->names[symbol] : NULL);
+}
+
+/*
+ * ENTRY LISTS
+ */
+
+static inline uint64_t name_key (int symbol, NodeType type, IndexScope scope)
+{
+    return ((uint64_t)symbol << 8) | ((uint64_t)type << 2) | (uint64_t)scope;
+}
+
+static IndexList* get_list (IndexMap* map, uint64_t key)
+{
+    IndexList* list = (IndexList*)IndexMap_get(map, key);
+    if (list == NULL) {
+        list = (IndexList*)calloc(1, sizeof(IndexList));
+        CHECK_MALLOC_PTR(list)
+        IndexMap_put(map, key, list);
+    }
+    return list;
+}
+
+static void link_entry (IndexEntry* entry, int key, IndexList* list)
+{
+    entry->lists[key] = list;
+    entry->links[key].prev = list->tail;
+    entry->links[key].next = NULL;
+    if (list->tail == NULL) {
+        list->head = entry;
+    } else {
+        list->tail->links[key].next = entry;
+    }
+    list->tail = entry;
+    list->size++;
+}
+
+static void unlink_entry (IndexEntry* entry, int key)
+{
+    IndexList* list = entry->lists[key];
+    if (list == NULL) {
+        return;
+    }
+    IndexLink* link = &entry->links[key];
+    if (link->prev == NULL) {
+        list->head = link->next;
+    } else {
+        link->prev->links[key].next = link->next;
+    }
+    if (link->next == NULL) {
+        list->tail = link->prev;
+    } else {
+        link->next->links[key].prev = link->prev;
+    }
+    list->size--;
+    entry->lists[key] = NULL;
+}
+
+/*
+ * INDEX CONSTRUCTION
+ */
+
+/**
+ * @brief Traversal state while adding nodes
+ *
+ * Local names are tracked on a scope stack so that references can be filed
+ * as global or local.
+ */
+typedef struct IndexBuilder
+{
+    ASTIndex* index;
+    int* names;             /**< @brief Symbols declared in enclosing local scopes */
+    int nnames;
+    int capacity;
+    int* marks;             /**< @brief Value of @c nnames when each scope was entered */
+    int nmarks;
+    int mark_capacity;
+    int function_depth;     /**< @brief Greater than zero inside a function */
+} IndexBuilder;
+
+static void declare_local (IndexBuilder* builder, int symbol)
+{
+    if (builder->nnames == builder->capacity) {
+        builder->capacity = (builder->capacity == 0 ? 16 : builder->capacity * 2);
+        builder->names = (int*)realloc(builder->names, builder->capacity * sizeof(int));
+        CHECK_MALLOC_PTR(builder->names)
+    }
+    builder->names[builder->nnames++] = symbol;
+}
+
+static bool is_local (IndexBuilder* builder, int symbol)
+{
+    for (int i = builder->nnames - 1; i >= 0; i--) {
+        if (builder->names[i] == symbol) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void enter_scope (IndexBuilder* builder)
+{
+    if (builder->nmarks == builder->mark_capacity) {
+        builder->mark_capacity = (builder->mark_capacity == 0 ? 16 : builder->mark_capacity * 2);
+        builder->marks = (int*)realloc(builder->marks, builder->mark_capacity * sizeof(int));
+        CHECK_MALLOC_PTR(builder->marks)
+    }
+    builder->marks[builder->nmarks++] = builder->nnames;
+}
+
+static void exit_scope (IndexBuilder* builder)
+{
+    builder->nnames = builder->marks[--builder->nmarks];
+}
+
+/**
+ * @brief Add a node to the type and line lists (and the name list, if
+ * @p name is not @c NULL)
+ */
+static void add_entry (IndexBuilder* builder, ASTNode* node, const char* name, IndexScope scope)
+{
+    ASTIndex* index = builder->index;
+    IndexEntry* entry = (IndexEntry*)calloc(1, sizeof(IndexEntry));
+    CHECK_MALLOC_PTR(entry)
+    entry->node = node;
+    entry->line = node->source_line;
+    link_entry(entry, TYPE_KEY, &index->by_type[node->type]);
+    link_entry(entry, LINE_KEY, get_list(index->by_line, (uint64_t)(uint32_t)entry->line));
+    if (name != NULL) {
+        int symbol = ASTIndex_intern(index, name);
+        link_entry(entry, NAME_KEY, get_list(index->by_name, name_key(symbol, node->type, scope)));
+    }
+    IndexMap_put(index->by_node, (uint64_t)(uintptr_t)node, entry);
+    index->size++;
+}
+
+/**
+ * @brief Decide whether a reference is to a local or a global
+ */
+static IndexScope reference_scope (IndexBuilder* builder, const char* name)
+{
+    int symbol = find_symbol(builder->index, name);
+    return (symbol != -1 && is_local(builder, symbol) ? LOCAL_SCOPE : GLOBAL_SCOPE);
+}
+
+static void add_default (IndexBuilder* builder, ASTNode* node)
+{
+    add_entry(builder, node, NULL, ANY_SCOPE);
+}
+
+static void add_vardecl (IndexBuilder* builder, ASTNode* node)
+{
+    if (builder->function_depth > 0) {
+        add_entry(builder, node, node->vardecl.name, LOCAL_SCOPE);
+        declare_local(builder, ASTIndex_intern(builder->index, node->vardecl.name));
+    } else {
+        add_entry(builder, node, node->vardecl.name, GLOBAL_SCOPE);
+    }
+}
+
+static void enter_funcdecl (IndexBuilder* builder, ASTNode* node)
+{
+    add_entry(builder, node, node->funcdecl.name, GLOBAL_SCOPE);
+    builder->function_depth++;
+    enter_scope(builder);
+    FOR_EACH (Parameter*, param, node->funcdecl.parameters) {
+        declare_local(builder, ASTIndex_intern(builder->index, param->name));
+    }
+}
+
+static void exit_funcdecl (IndexBuilder* builder, ASTNode* node)
+{
+    exit_scope(builder);
+    builder->function_depth--;
+}
+
+static void enter_block (IndexBuilder* builder, ASTNode* node)
+{
+    add_entry(builder, node, NULL, ANY_SCOPE);
+    enter_scope(builder);
+}
+
+static void exit_block (IndexBuilder* builder, ASTNode* node)
+{
+    exit_scope(builder);
+}
+
+static void add_assignment (IndexBuilder* builder, ASTNode* node)
+{
+    const char* name = node->assignment.location->location.name;
+    add_entry(builder, node, name, reference_scope(builder, name));
+}
+
+static void add_location (IndexBuilder* builder, ASTNode* node)
+{
+    add_entry(builder, node, node->location.name, reference_scope(builder, node->location.name));
+}
+
+static void add_funccall (IndexBuilder* builder, ASTNode* node)
+{
+    add_entry(builder, node, node->funccall.name, GLOBAL_SCOPE);
+}
+
+#define STATIC_VISITOR_TRAVERSE         add_nodes
+#define STATIC_VISITOR_STATE            IndexBuilder*
+#define STATIC_PREVISIT_default         add_default
+#define STATIC_PREVISIT_vardecl         add_vardecl
+#define STATIC_PREVISIT_funcdecl        enter_funcdecl
+#define STATIC_POSTVISIT_funcdecl       exit_funcdecl
+#define STATIC_PREVISIT_block           enter_block
+#define STATIC_POSTVISIT_block          exit_block
+#define STATIC_PREVISIT_assignment      add_assignment
+#define STATIC_PREVISIT_location        add_location
+#define STATIC_PREVISIT_funccall        add_funccall
+#include "static-visitor.h"
+
+static void remove_node (ASTIndex* index, ASTNode* node)
+{
+    IndexEntry* entry = (IndexEntry*)IndexMap_get(index->by_node, (uint64_t)(uintptr_t)node);
+    if (entry == NULL) {
+        return;
+    }
+    for (int key = 0; key < NUM_KEYS; key++) {
+        unlink_entry(entry, key);
+    }
+    IndexMap_delete(index->by_node, (uint64_t)(uintptr_t)node);
+    free(entry);
+    index->size--;
+}
+
+#define STATIC_VISITOR_TRAVERSE         remove_nodes
+#define STATIC_VISITOR_STATE            ASTIndex*
+#define STATIC_PREVISIT_default         remove_node
+#include "static-visitor.h"
+
+static void update_line (ASTIndex* index, ASTNode* node)
+{
+    IndexEntry* entry = (IndexEntry*)IndexMap_get(index->by_node, (uint64_t)(uintptr_t)node);
+    if (entry != NULL && entry->line != node->source_line) {
+        unlink_entry(entry, LINE_KEY);
+        entry->line = node->source_line;
+        link_entry(entry, LINE_KEY, get_list(index->by_line, (uint64_t)(uint32_t)entry->line));
+    }
+}
+
+#define STATIC_VISITOR_TRAVERSE         update_lines
+#define STATIC_VISITOR_STATE            ASTIndex*
+#define STATIC_PREVISIT_default         update_line
+#include "static-visitor.h"
+
+ASTIndex* ASTIndex_new (ASTNode* tree)
+{
+    ASTIndex* index = (ASTIndex*)calloc(1, sizeof(ASTIndex));
+    CHECK_MALLOC_PTR(index)
+    index->by_name = IndexMap_new();
+    index->by_line = IndexMap_new();
+    index->by_node = IndexMap_new();
+    index->symbol_capacity = 64;
+    index->symbol_slots = (int*)malloc(index->symbol_capacity * sizeof(int));
+    CHECK_MALLOC_PTR(index->symbol_slots)
+    memset(index->symbol_slots, -1, index->symbol_capacity * sizeof(int));
+    index->names = (char**)calloc(index->symbol_capacity / 2, sizeof(char*));
+    CHECK_MALLOC_PTR(index->names)
+    if (tree != NULL) {
+        ASTIndex_add(index, tree);
+    }
+    return index;
+}
+
+void ASTIndex_add (ASTIndex* index, ASTNode* tree)
+{
+    IndexBuilder builder = { .index = index };
+    add_nodes(&builder, tree);
+    free(builder.names);
+    free(builder.marks);
+}
+
+void ASTIndex_remove (ASTIndex* index, ASTNode* tree)
+{
+    remove_nodes(index, tree);
+}
+
+void ASTIndex_update_lines (ASTIndex* index, ASTNode* tree)
+{
+    update_lines(index, tree);
+}
+
+/*
+ * QUERIES
+ */
+
+static ASTQuery make_query (IndexList* first, IndexList* second, int key)
+{
+    ASTQuery query;
+    query.key = key;
+    if (first != NULL && first->head != NULL) {
+        query.next = first->head;
+        query.rest = second;
+    } else {
+        query.next = (second != NULL ? second->head : NULL);
+        query.rest = NULL;
+    }
+    return query;
+}
+
+ASTQuery ASTIndex_by_type (ASTIndex* index, NodeType type)
+{
+    return make_query(&index->by_type[type], NULL, TYPE_KEY);
+}
+
+ASTQuery ASTIndex_by_name (ASTIndex* index, NodeType type, const char* name, IndexScope scope)
+{
+    int symbol = find_symbol(index, name);
+    if (symbol == -1) {
+        return make_query(NULL, NULL, NAME_KEY);
+    }
+    IndexList* global = (scope != LOCAL_SCOPE ?
+            (IndexList*)IndexMap_get(index->by_name, name_key(symbol, type, GLOBAL_SCOPE)) : NULL);
+    IndexList* local = (scope != GLOBAL_SCOPE ?
+            (IndexList*)IndexMap_get(index->by_name, name_key(symbol, type, LOCAL_SCOPE)) : NULL);
+    return make_query(global, local, NAME_KEY);
+}
+
+ASTQuery ASTIndex_by_line (ASTIndex* index, int line)
+{
+    return make_query((IndexList*)IndexMap_get(index->by_line, (uint64_t)(uint32_t)line), NULL, LINE_KEY);
+}
+
+ASTNode* ASTQuery_next (ASTQuery* query)
+{
+    IndexEntry* entry = query->next;
+    if (entry == NULL) {
+        return NULL;
+    }
+    query->next = entry->links[query->key].next;
+    if (query->next == NULL && query->rest != NULL) {
+        query->next = query->rest->head;
+        query->rest = NULL;
+    }
+    return entry->node;
+}
+
+int ASTQuery_count (ASTQuery query)
+{
+    int count = 0;
+    while (ASTQuery_next(&query) != NULL) {
+        count++;
+    }
+    return count;
+}
+
+void ASTIndex_free (ASTIndex* index)
+{
+    for (int i = 0; i < index->by_node->capacity; i++) {
+        free(index->by_node->values[i]);
+    }
+    IndexMap_free(index->by_node, false);
+    IndexMap_free(index->by_name, true);
+    IndexMap_free(index->by_line, true);
+    for (int i = 0; i < index->nnames; i++) {
+        free(index->names[i]);
+    }
+    free(index->names);
+    free(index->symbol_slots);
+    free(index);
+}
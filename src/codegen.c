@@ -0,0 +1,514 @@
+/**
+ * @file codegen.c
+ * @brief Naive ILOC code generation
+ */
+
+#include "codegen.h"
+
+/**
+ * @brief Bytes per variable (and per stack slot)
+ */
+#define WORD_SIZE 8
+
+/**
+ * @brief Where a variable lives
+ */
+typedef struct Symbol
+{
+    const char* name;   /**< @brief Variable name (owned by the AST) */
+    bool global;        /**< @brief Global (absolute address) or local (offset from @c bp) */
+    long location;      /**< @brief Address or @c bp offset */
+} Symbol;
+
+/**
+ * @brief Code generation state
+ */
+typedef struct CodeGen
+{
+    ILOCInsnList* code;     /**< @brief Output */
+    int line;               /**< @brief Source line for new instructions */
+    long next_reg;          /**< @brief Next unused virtual register */
+    long next_label;        /**< @brief Next unused label number */
+
+    Symbol* symbols;        /**< @brief Scopes (innermost last) */
+    int nsymbols;           /**< @brief Number of symbols in scope */
+    int symbol_capacity;    /**< @brief Allocated symbols */
+    long frame_size;        /**< @brief Bytes of locals in the current function */
+
+    long* live;             /**< @brief Registers that hold values still needed (see gen_call) */
+    int nlive;              /**< @brief Number of live registers */
+    int live_capacity;      /**< @brief Allocated live registers */
+
+    long epilogue;          /**< @brief Label of the current function's epilogue */
+    long loop_top;          /**< @brief Label that @c continue jumps to (-1 outside loops) */
+    long loop_exit;         /**< @brief Label that @c break jumps to */
+} CodeGen;
+
+static void CodeGen_fail (CodeGen* gen, const char* format, ...)
+{
+    char message[MAX_ERROR_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, MAX_ERROR_LEN, format, args);
+    va_end(args);
+    ILOCInsnList_free(gen->code);
+    free(gen->symbols);
+    free(gen->live);
+    Error_throw_printf("%s", message);
+}
+
+static void emit (CodeGen* gen, ILOCOpcode opcode, ILOCOperand a, ILOCOperand b, ILOCOperand c)
+{
+    ILOCInsn* insn = ILOCInsn_new(opcode, a, b, c);
+    insn->source_line = gen->line;
+    ILOCInsnList_add(gen->code, insn);
+}
+
+static const ILOCOperand NONE = { .type = OPERAND_NONE };
+
+static ILOCOperand reg (long r)
+{
+    return ILOCOperand_reg(r);
+}
+
+static ILOCOperand num (long value)
+{
+    return ILOCOperand_int(value);
+}
+
+static ILOCOperand label (long number)
+{
+    char name[32];
+    snprintf(name, sizeof(name), ".L%ld", number);
+    return ILOCOperand_label(name);
+}
+
+static long new_reg (CodeGen* gen)
+{
+    return gen->next_reg++;
+}
+
+static long new_label (CodeGen* gen)
+{
+    return gen->next_label++;
+}
+
+static void emit_label (CodeGen* gen, long number)
+{
+    emit(gen, ILOC_LABEL, label(number), NONE, NONE);
+}
+
+
+/*
+ * SYMBOLS
+ */
+
+static void add_symbol (CodeGen* gen, const char* name, bool global, long location)
+{
+    if (gen->nsymbols == gen->symbol_capacity) {
+        gen->symbol_capacity = (gen->symbol_capacity == 0 ? 32 : gen->symbol_capacity * 2);
+        gen->symbols = (Symbol*)realloc(gen->symbols, sizeof(Symbol) * gen->symbol_capacity);
+        CHECK_MALLOC_PTR(gen->symbols)
+    }
+    Symbol symbol = { .name = name, .global = global, .location = location };
+    gen->symbols[gen->nsymbols++] = symbol;
+}
+
+static Symbol* lookup (CodeGen* gen, const char* name)
+{
+    for (int i = gen->nsymbols - 1; i >= 0; i--) {
+        if (strcmp(gen->symbols[i].name, name) == 0) {
+            return &gen->symbols[i];
+        }
+    }
+    CodeGen_fail(gen, "Undefined variable '%s' on line %d\n", name, gen->line);
+    return NULL;
+}
+
+/**
+ * @brief Give each local variable of a block a slot in the frame
+ */
+static void add_locals (CodeGen* gen, NodeList* variables)
+{
+    FOR_EACH (ASTNode*, var, variables) {
+        long words = (var->vardecl.is_array ? var->vardecl.array_length : 1);
+        gen->frame_size += words * WORD_SIZE;
+        if (gen->frame_size > INT32_MAX) {
+            /* offsets are 32-bit constants (see ilocsim.h) */
+            CodeGen_fail(gen, "Local variables too large on line %d\n", var->source_line);
+        }
+        add_symbol(gen, var->vardecl.name, false, -gen->frame_size);
+    }
+}
+
+/*
+ * Registers still holding values for an enclosing expression
+ */
+
+static void live_push (CodeGen* gen, long r)
+{
+    if (gen->nlive == gen->live_capacity) {
+        gen->live_capacity = (gen->live_capacity == 0 ? 16 : gen->live_capacity * 2);
+        gen->live = (long*)realloc(gen->live, sizeof(long) * gen->live_capacity);
+        CHECK_MALLOC_PTR(gen->live)
+    }
+    gen->live[gen->nlive++] = r;
+}
+
+static void live_pop (CodeGen* gen, int count)
+{
+    gen->nlive -= count;
+}
+
+
+/*
+ * EXPRESSIONS
+ */
+
+static long gen_expr (CodeGen* gen, ASTNode* node);
+
+/**
+ * @brief Load the address of an array element (or a global scalar) into a
+ * base and offset register pair, or return false for a local scalar
+ */
+static bool gen_address (CodeGen* gen, ASTNode* location, Symbol* symbol, long* base, long* offset)
+{
+    if (location->location.index != NULL) {
+        long index = gen_expr(gen, location->location.index);
+        *offset = new_reg(gen);
+        emit(gen, ILOC_MULT_I, reg(index), num(WORD_SIZE), reg(*offset));
+    } else if (symbol->global) {
+        *offset = -1;
+    } else {
+        return false;
+    }
+    *base = new_reg(gen);
+    if (symbol->global) {
+        emit(gen, ILOC_LOAD_I, num(symbol->location), reg(*base), NONE);
+    } else {
+        emit(gen, ILOC_ADD_I, reg(ILOC_BP), num(symbol->location), reg(*base));
+    }
+    return true;
+}
+
+static long gen_location (CodeGen* gen, ASTNode* node)
+{
+    Symbol* symbol = lookup(gen, node->location.name);
+    long base, offset;
+    long result = new_reg(gen);
+    if (!gen_address(gen, node, symbol, &base, &offset)) {
+        emit(gen, ILOC_LOAD_AI, reg(ILOC_BP), num(symbol->location), reg(result));
+    } else if (offset < 0) {
+        emit(gen, ILOC_LOAD, reg(base), reg(result), NONE);
+    } else {
+        emit(gen, ILOC_LOAD_AO, reg(base), reg(offset), reg(result));
+    }
+    return result;
+}
+
+static long gen_binaryop (CodeGen* gen, ASTNode* node)
+{
+    long left = gen_expr(gen, node->binaryop.left);
+    live_push(gen, left);
+    long right = gen_expr(gen, node->binaryop.right);
+    live_pop(gen, 1);
+    gen->line = node->source_line;
+
+    long result = new_reg(gen);
+    ILOCOpcode opcode = ILOC_NOP;
+    switch (node->binaryop.operator) {
+        case OROP:  opcode = ILOC_OR;       break;
+        case ANDOP: opcode = ILOC_AND;      break;
+        case EQOP:  opcode = ILOC_CMP_EQ;   break;
+        case NEQOP: opcode = ILOC_CMP_NE;   break;
+        case LTOP:  opcode = ILOC_CMP_LT;   break;
+        case LEOP:  opcode = ILOC_CMP_LE;   break;
+        case GEOP:  opcode = ILOC_CMP_GE;   break;
+        case GTOP:  opcode = ILOC_CMP_GT;   break;
+        case ADDOP: opcode = ILOC_ADD;      break;
+        case SUBOP: opcode = ILOC_SUB;      break;
+        case MULOP: opcode = ILOC_MULT;     break;
+        case DIVOP: opcode = ILOC_DIV;      break;
+        case MODOP: {
+            long quotient = new_reg(gen);
+            long product = new_reg(gen);
+            emit(gen, ILOC_DIV, reg(left), reg(right), reg(quotient));
+            emit(gen, ILOC_MULT, reg(quotient), reg(right), reg(product));
+            emit(gen, ILOC_SUB, reg(left), reg(product), reg(result));
+            return result;
+        }
+    }
+    emit(gen, opcode, reg(left), reg(right), reg(result));
+    return result;
+}
+
+static long gen_print (CodeGen* gen, ASTNode* node)
+{
+    ASTNode* arg = node->funccall.arguments->head;
+    if (arg == NULL) {
+        return -1;
+    }
+    if (arg->type == LITERAL && arg->literal.type == STR) {
+        emit(gen, ILOC_PRINT, ILOCOperand_str(arg->literal.string), NONE, NONE);
+        return -1;
+    }
+    long value = gen_expr(gen, arg);
+    gen->line = node->source_line;
+    if (strcmp(node->funccall.name, "print_bool") == 0) {
+        long if_true = new_label(gen);
+        long if_false = new_label(gen);
+        long done = new_label(gen);
+        emit(gen, ILOC_CBR, reg(value), label(if_true), label(if_false));
+        emit_label(gen, if_true);
+        emit(gen, ILOC_PRINT, ILOCOperand_str("true"), NONE, NONE);
+        emit(gen, ILOC_JUMP, label(done), NONE, NONE);
+        emit_label(gen, if_false);
+        emit(gen, ILOC_PRINT, ILOCOperand_str("false"), NONE, NONE);
+        emit_label(gen, done);
+    } else {
+        emit(gen, ILOC_PRINT, reg(value), NONE, NONE);
+    }
+    return -1;
+}
+
+/**
+ * @brief Call a function: evaluate the arguments, save the temporaries of
+ * enclosing expressions, push the arguments (last first), call, and restore
+ */
+static long gen_call (CodeGen* gen, ASTNode* node)
+{
+    const char* name = node->funccall.name;
+    if (strcmp(name, "print_int") == 0 || strcmp(name, "print_bool") == 0 ||
+            strcmp(name, "print_str") == 0) {
+        return gen_print(gen, node);
+    }
+
+    int nargs = 0;
+    FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
+        live_push(gen, gen_expr(gen, arg));
+        nargs++;
+    }
+    gen->line = node->source_line;
+    live_pop(gen, nargs);
+    long* args = gen->live + gen->nlive;
+
+    for (int i = 0; i < gen->nlive; i++) {
+        emit(gen, ILOC_PUSH, reg(gen->live[i]), NONE, NONE);
+    }
+    for (int i = nargs - 1; i >= 0; i--) {
+        emit(gen, ILOC_PUSH, reg(args[i]), NONE, NONE);
+    }
+    emit(gen, ILOC_CALL, ILOCOperand_label(name), NONE, NONE);
+    if (nargs > 0) {
+        emit(gen, ILOC_ADD_I, reg(ILOC_SP), num(nargs * WORD_SIZE), reg(ILOC_SP));
+    }
+    for (int i = gen->nlive - 1; i >= 0; i--) {
+        emit(gen, ILOC_POP, reg(gen->live[i]), NONE, NONE);
+    }
+
+    long result = new_reg(gen);
+    emit(gen, ILOC_I2I, reg(ILOC_RET), reg(result), NONE);
+    return result;
+}
+
+static long gen_expr (CodeGen* gen, ASTNode* node)
+{
+    gen->line = node->source_line;
+    long result;
+    switch (node->type) {
+        case LITERAL:
+            result = new_reg(gen);
+            emit(gen, ILOC_LOAD_I, num(node->literal.type == BOOL ? node->literal.boolean
+                                                                 : node->literal.integer),
+                 reg(result), NONE);
+            return result;
+        case LOCATION:
+            return gen_location(gen, node);
+        case BINARYOP:
+            return gen_binaryop(gen, node);
+        case UNARYOP: {
+            long child = gen_expr(gen, node->unaryop.child);
+            gen->line = node->source_line;
+            result = new_reg(gen);
+            emit(gen, (node->unaryop.operator == NEGOP ? ILOC_NEG : ILOC_NOT),
+                 reg(child), reg(result), NONE);
+            return result;
+        }
+        case FUNCCALL:
+            return gen_call(gen, node);
+        default:
+            return -1;
+    }
+}
+
+
+/*
+ * STATEMENTS
+ */
+
+static void gen_block (CodeGen* gen, ASTNode* block);
+
+static void gen_assignment (CodeGen* gen, ASTNode* node)
+{
+    long value = gen_expr(gen, node->assignment.value);
+    live_push(gen, value);
+    ASTNode* location = node->assignment.location;
+    gen->line = node->source_line;
+    Symbol* symbol = lookup(gen, location->location.name);
+    long base, offset;
+    if (!gen_address(gen, location, symbol, &base, &offset)) {
+        emit(gen, ILOC_STORE_AI, reg(value), reg(ILOC_BP), num(symbol->location));
+    } else if (offset < 0) {
+        emit(gen, ILOC_STORE, reg(value), reg(base), NONE);
+    } else {
+        emit(gen, ILOC_STORE_AO, reg(value), reg(base), reg(offset));
+    }
+    live_pop(gen, 1);
+}
+
+static void gen_stmt (CodeGen* gen, ASTNode* node)
+{
+    gen->line = node->source_line;
+    switch (node->type) {
+        case ASSIGNMENT:
+            gen_assignment(gen, node);
+            break;
+        case FUNCCALL:
+            gen_call(gen, node);
+            break;
+        case BLOCK:
+            gen_block(gen, node);
+            break;
+        case CONDITIONAL: {
+            long condition = gen_expr(gen, node->conditional.condition);
+            long if_true = new_label(gen);
+            long if_false = new_label(gen);
+            long done = (node->conditional.else_block != NULL ? new_label(gen) : if_false);
+            gen->line = node->source_line;
+            emit(gen, ILOC_CBR, reg(condition), label(if_true), label(if_false));
+            emit_label(gen, if_true);
+            gen_block(gen, node->conditional.if_block);
+            if (node->conditional.else_block != NULL) {
+                emit(gen, ILOC_JUMP, label(done), NONE, NONE);
+                emit_label(gen, if_false);
+                gen_block(gen, node->conditional.else_block);
+            }
+            emit_label(gen, done);
+            break;
+        }
+        case WHILELOOP: {
+            long outer_top = gen->loop_top;
+            long outer_exit = gen->loop_exit;
+            gen->loop_top = new_label(gen);
+            gen->loop_exit = new_label(gen);
+            long body = new_label(gen);
+            emit_label(gen, gen->loop_top);
+            long condition = gen_expr(gen, node->whileloop.condition);
+            gen->line = node->source_line;
+            emit(gen, ILOC_CBR, reg(condition), label(body), label(gen->loop_exit));
+            emit_label(gen, body);
+            gen_block(gen, node->whileloop.body);
+            emit(gen, ILOC_JUMP, label(gen->loop_top), NONE, NONE);
+            emit_label(gen, gen->loop_exit);
+            gen->loop_top = outer_top;
+            gen->loop_exit = outer_exit;
+            break;
+        }
+        case RETURNSTMT:
+            if (node->funcreturn.value != NULL) {
+                long value = gen_expr(gen, node->funcreturn.value);
+                gen->line = node->source_line;
+                emit(gen, ILOC_I2I, reg(value), reg(ILOC_RET), NONE);
+            }
+            emit(gen, ILOC_JUMP, label(gen->epilogue), NONE, NONE);
+            break;
+        case BREAKSTMT:
+            if (gen->loop_top >= 0) {
+                emit(gen, ILOC_JUMP, label(gen->loop_exit), NONE, NONE);
+            }
+            break;
+        case CONTINUESTMT:
+            if (gen->loop_top >= 0) {
+                emit(gen, ILOC_JUMP, label(gen->loop_top), NONE, NONE);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void gen_block (CodeGen* gen, ASTNode* block)
+{
+    int outer_symbols = gen->nsymbols;
+    add_locals(gen, block->block.variables);
+    FOR_EACH (ASTNode*, stmt, block->block.statements) {
+        gen_stmt(gen, stmt);
+    }
+    gen->nsymbols = outer_symbols;
+}
+
+static void gen_function (CodeGen* gen, ASTNode* func)
+{
+    gen->line = func->source_line;
+    gen->frame_size = 0;
+    gen->epilogue = new_label(gen);
+    gen->loop_top = -1;
+
+    int outer_symbols = gen->nsymbols;
+    long offset = 2 * WORD_SIZE;
+    FOR_EACH (Parameter*, param, func->funcdecl.parameters) {
+        add_symbol(gen, param->name, false, offset);
+        offset += WORD_SIZE;
+    }
+
+    emit(gen, ILOC_LABEL, ILOCOperand_label(func->funcdecl.name), NONE, NONE);
+    emit(gen, ILOC_PUSH, reg(ILOC_BP), NONE, NONE);
+    emit(gen, ILOC_I2I, reg(ILOC_SP), reg(ILOC_BP), NONE);
+    ILOCInsn* frame = gen->code->tail;
+    emit(gen, ILOC_ADD_I, reg(ILOC_SP), num(0), reg(ILOC_SP));
+
+    gen_block(gen, func->funcdecl.body);
+
+    /* the frame size is only known now; drop the allocation if it's empty */
+    ILOCInsn* allocate = frame->next;
+    allocate->operands[1].value = -gen->frame_size;
+    if (gen->frame_size == 0) {
+        frame->next = allocate->next;
+        if (gen->code->tail == allocate) {
+            gen->code->tail = frame;
+        }
+        gen->code->size--;
+        ILOCInsn_free(allocate);
+    }
+    gen->line = func->source_line;
+    emit_label(gen, gen->epilogue);
+    emit(gen, ILOC_I2I, reg(ILOC_BP), reg(ILOC_SP), NONE);
+    emit(gen, ILOC_POP, reg(ILOC_BP), NONE, NONE);
+    emit(gen, ILOC_RETURN, NONE, NONE, NONE);
+    gen->nsymbols = outer_symbols;
+}
+
+ILOCInsnList* generate_code (ASTNode* tree)
+{
+    CodeGen gen;
+    memset(&gen, 0, sizeof(CodeGen));
+    gen.code = ILOCInsnList_new();
+    gen.loop_top = -1;
+
+    long address = ILOC_STATIC_BASE;
+    FOR_EACH (ASTNode*, var, tree->program.variables) {
+        add_symbol(&gen, var->vardecl.name, true, address);
+        address += (var->vardecl.is_array ? (long)var->vardecl.array_length : 1) * WORD_SIZE;
+        if (address > INT32_MAX) {
+            /* addresses are 32-bit constants (see ilocsim.h) */
+            CodeGen_fail(&gen, "Global variables too large on line %d\n", var->source_line);
+        }
+    }
+    FOR_EACH (ASTNode*, func, tree->program.functions) {
+        gen_function(&gen, func);
+    }
+
+    free(gen.symbols);
+    free(gen.live);
+    return gen.code;
+}
@@ -1,5 +1,57 @@
 #include "common.h"
 
+/**
+ * @brief Innermost exception handler installed on the current thread
+ */
+static _Thread_local ErrorTrap* current_trap = NULL;
+
+void ErrorTrap_push (ErrorTrap* trap)
+{
+    trap->message[0] = '\0';
+    trap->out_of_memory = false;
+    trap->prev = current_trap;
+    current_trap = trap;
+}
+
+void ErrorTrap_pop (ErrorTrap* trap)
+{
+    current_trap = trap->prev;
+}
+
+void ErrorTrap_throw_va (const char* format, va_list args)
+{
+    if (current_trap == NULL) {
+        return;     /* no trap; let the driver handle it */
+    }
+    ErrorTrap* trap = current_trap;
+    vsnprintf(trap->message, MAX_ERROR_LEN, format, args);
+    longjmp(trap->env, 1);
+}
+
+void Error_move_line (char* out, const char* message, int lines)
+{
+    const char* at = strstr(message, " line ");
+    char* rest;
+    long line = (at != NULL ? strtol(at + 6, &rest, 10) : 0);
+    if (line > 0) {
+        snprintf(out, MAX_ERROR_LEN, "%.*s line %ld%s", (int)(at - message), message, line + lines, rest);
+    } else {
+        snprintf(out, MAX_ERROR_LEN, "%s", message);
+    }
+}
+
+void Error_out_of_memory ()
+{
+    if (current_trap != NULL) {
+        ErrorTrap* trap = current_trap;
+        snprintf(trap->message, MAX_ERROR_LEN, "Out of memory!\n");
+        trap->out_of_memory = true;
+        longjmp(trap->env, 1);
+    }
+    printf("Out of memory!\n");
+    exit(EXIT_FAILURE);
+}
+
 const char* DecafType_to_string(DecafType type)
 {
     switch (type) {
@@ -12,31 +64,63 @@ const char* DecafType_to_string(DecafType type)
     return "invalid";
 }
 
-void print_escaped_string(const char* string, FILE* output)
+/**
+ * @brief Print a string with the given replacements for newline, tab, quote
+ * and backslash (in that order), copying each run of other characters with a
+ * single write
+ */
+static void print_with_escapes (const char* string, FILE* output, const char* const escapes[4])
 {
-    for (int i = 0; i < strlen(string); i++) {
-        /* escape special characters */
-        switch (string[i]) {
-            case '\n':  fprintf(output, "\\n");  break;
-            case '\t':  fprintf(output, "\\t");  break;
-            case '\"':  fprintf(output, "\\\""); break;
-            case '\\':  fprintf(output, "\\\\"); break;
-            default:    fprintf(output, "%c", string[i]); break;
+    const char* run = string;
+    const char* p = string;
+    for (; *p != '\0'; p++) {
+        int escape;
+        switch (*p) {
+            case '\n':  escape = 0; break;
+            case '\t':  escape = 1; break;
+            case '\"':  escape = 2; break;
+            case '\\':  escape = 3; break;
+            default:    continue;
         }
+        fwrite(run, 1, p - run, output);
+        fputs(escapes[escape], output);
+        run = p + 1;
     }
+    fwrite(run, 1, p - run, output);
+}
+
+void print_escaped_string(const char* string, FILE* output)
+{
+    static const char* const escapes[4] = { "\\n", "\\t", "\\\"", "\\\\" };
+    print_with_escapes(string, output, escapes);
 }
 
 void print_doubly_escaped_string(const char* string, FILE* output)
 {
-    for (int i = 0; i < strlen(string); i++) {
-        /* escape special characters */
-        switch (string[i]) {
-            case '\n':  fprintf(output, "\\\\n");  break;
-            case '\t':  fprintf(output, "\\\\t");  break;
-            case '\"':  fprintf(output, "\\\\\\\""); break;
-            case '\\':  fprintf(output, "\\\\\\\\"); break;
-            default:    fprintf(output, "%c", string[i]); break;
+    static const char* const escapes[4] = { "\\\\n", "\\\\t", "\\\\\\\"", "\\\\\\\\" };
+    print_with_escapes(string, output, escapes);
+}
+
+char* read_file (const char* filename)
+{
+    FILE* input = fopen(filename, "r");
+    if (input == NULL) {
+        return NULL;
+    }
+    size_t capacity = MAX_FILE_SIZE;
+    size_t nchars = 0;
+    char* text = (char*)malloc(capacity);
+    CHECK_MALLOC_PTR(text)
+    size_t n;
+    while ((n = fread(text + nchars, 1, capacity - nchars - 1, input)) > 0) {
+        nchars += n;
+        if (nchars == capacity - 1) {
+            capacity *= 2;
+            text = (char*)realloc(text, capacity);
+            CHECK_MALLOC_PTR(text)
         }
     }
+    text[nchars] = '\0';
+    fclose(input);
+    return text;
 }
-
@@ -0,0 +1,657 @@
+/**
+ * @file document.c
+ * @brief Source files that are edited and reparsed incrementally
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "document.h"
+#include "p1-lexer.h"
+#include "p2-parser.h"
+
+/**
+ * @brief Count the newlines in part of a text
+ */
+static int count_newlines (const char* text, int start, int end)
+{
+    int count = 0;
+    for (const char* p = text + start; p < text + end; p++) {
+        if (*p == '\n') {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Part of a document's text: one top-level declaration, or a region
+ * that does not lex or parse
+ *
+ * Segment i owns the text from its first token up to the first token of
+ * segment i+1 (the first one also owns any leading text, the last one any
+ * trailing text).
+ */
+typedef struct DocumentSegment
+{
+    ASTNode* decl;          /**< @brief Declaration (or @c NULL if the text does not parse) */
+    Token* first;           /**< @brief First token (or @c NULL if the text does not lex) */
+    Token* last;            /**< @brief Last token */
+    int offset;             /**< @brief Offset where the segment starts */
+    int line;               /**< @brief Line where the segment starts */
+    int synced_offset;      /**< @brief Value of @c offset that the tokens and nodes are relative to */
+    int synced_line;        /**< @brief Value of @c line that the tokens and nodes are relative to */
+    char* error;            /**< @brief Error message if @c decl is @c NULL (owned) */
+    int error_offset;       /**< @brief Offset of the token where parsing failed (or -1) */
+    bool ran_out;           /**< @brief Whether parsing failed because the segment's tokens ran out */
+} DocumentSegment;
+
+/**
+ * @brief Growable array of segments
+ */
+typedef struct SegmentList
+{
+    DocumentSegment* items;
+    int count;
+    int capacity;
+} SegmentList;
+
+/**
+ * @brief Append an empty segment to a list
+ */
+static DocumentSegment* add_segment (SegmentList* list)
+{
+    if (list->count == list->capacity) {
+        list->capacity = (list->capacity == 0 ? 16 : list->capacity * 2);
+        list->items = (DocumentSegment*)realloc(list->items, list->capacity * sizeof(DocumentSegment));
+        CHECK_MALLOC_PTR(list->items)
+    }
+    DocumentSegment* seg = &list->items[list->count++];
+    memset(seg, 0, sizeof(DocumentSegment));
+    seg->error_offset = -1;
+    return seg;
+}
+
+/**
+ * @brief Deallocate a segment's declaration (removing it from the index) and
+ * error message
+ */
+static void free_segment (Document* doc, DocumentSegment* seg)
+{
+    if (seg->decl != NULL) {
+        if (doc->index != NULL) {
+            ASTIndex_remove(doc->index, seg->decl);
+        }
+        seg->decl->next = NULL;
+        ASTNode_free(seg->decl);
+    }
+    free(seg->error);
+}
+
+/**
+ * @brief Amounts by which to move a segment's nodes and tokens
+ */
+typedef struct Shift
+{
+    int offset;
+    int lines;
+} Shift;
+
+static void shift_node (Shift* shift, ASTNode* node)
+{
+    if (node->source_offset >= 0) {
+        node->source_offset += shift->offset;
+    }
+    node->source_line += shift->lines;
+}
+
+#define STATIC_VISITOR_TRAVERSE         shift_nodes
+#define STATIC_VISITOR_STATE            Shift*
+#define STATIC_PREVISIT_default         shift_node
+#include "static-visitor.h"
+
+/**
+ * @brief Bring a segment's nodes and tokens up to date with its position
+ */
+static void sync_segment (DocumentSegment* seg)
+{
+    Shift shift = { seg->offset - seg->synced_offset, seg->line - seg->synced_line };
+    if (shift.offset == 0 && shift.lines == 0) {
+        return;
+    }
+    if (seg->decl != NULL) {
+        /* the declaration node itself is always current */
+        shift_node(&(Shift){ -shift.offset, -shift.lines }, seg->decl);
+        shift_nodes(&shift, seg->decl);
+    }
+    for (Token* t = seg->first; t != NULL; t = (t == seg->last ? NULL : t->next)) {
+        t->offset += shift.offset;
+        t->line += shift.lines;
+    }
+    seg->synced_offset = seg->offset;
+    seg->synced_line = seg->line;
+}
+
+/**
+ * @brief Find the last segment that starts before an offset (or the first
+ * segment if there is none)
+ */
+static int find_segment (Document* doc, int offset)
+{
+    int lo = 0;
+    int hi = doc->nsegments - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (doc->segments[mid].offset < offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Copy the tokens from @p first up to (but not including) @p stop
+ */
+static TokenQueue* copy_tokens (Token* first, Token* stop)
+{
+    TokenQueue* copy = TokenQueue_new();
+    for (Token* t = first; t != stop; t = t->next) {
+        Token* c = Token_new(t->type, t->text, t->line);
+        c->offset = t->offset;
+        TokenQueue_add(copy, c);
+    }
+    return copy;
+}
+
+static void record_error (Document* doc, const char* message, int offset)
+{
+    snprintf(doc->error, MAX_ERROR_LEN, "%s", message);
+    doc->error_offset = offset;
+}
+
+/**
+ * @brief Lex part of a text, giving tokens offsets and line numbers in the
+ * whole text
+ *
+ * @returns Tokens, or @c NULL if the text does not lex (the error, with the
+ * line number corrected, is copied to @p message)
+ */
+static TokenQueue* lex_region (const char* text, int start, int end, int start_line, char* message)
+{
+    char* region = (char*)malloc(end - start + 1);
+    CHECK_MALLOC_PTR(region)
+    memcpy(region, text + start, end - start);
+    region[end - start] = '\0';
+    TokenQueue* tokens = NULL;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        tokens = lex(region);
+    } else {
+        Regex_explain_error(trap.message);
+        Error_move_line(message, trap.message, start_line - 1);
+    }
+    ErrorTrap_pop(&trap);
+    if (tokens != NULL) {
+        TokenQueue_locate(tokens, region, start);
+        for (Token* t = tokens->head; t != NULL; t = t->next) {
+            t->line += start_line - 1;
+        }
+    }
+    free(region);
+    return tokens;
+}
+
+/**
+ * @brief Parse one top-level declaration
+ *
+ * @returns Declaration, or @c NULL if it does not parse (the error is copied
+ * to @p message)
+ */
+static ASTNode* try_parse_declaration (TokenQueue* input, char* message)
+{
+    ASTNode* decl = NULL;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        decl = parse_declaration(input);
+    } else {
+        snprintf(message, MAX_ERROR_LEN, "%s", trap.message);
+    }
+    ErrorTrap_pop(&trap);
+    return decl;
+}
+
+/**
+ * @brief Split a run of tokens into segments
+ *
+ * After an error, parsing resumes at the next @c def (no declaration can
+ * contain one), so one broken function does not hide the ones after it.
+ *
+ * @param doc Document (for its length)
+ * @param first First token
+ * @param stop Token after the last one (or @c NULL)
+ * @param end_offset Offset where the text covered by the tokens ends
+ * @param out List to add segments to
+ * @returns Number of declarations parsed
+ */
+static int parse_segments (Document* doc, Token* first, Token* stop, int end_offset, SegmentList* out)
+{
+    char message[MAX_ERROR_LEN];
+    int parsed = 0;
+    TokenQueue* input = copy_tokens(first, stop);
+    Token* next = first;
+    while (next != stop) {
+        ASTNode* decl = try_parse_declaration(input, message);
+        Token* after = TokenQueue_peek(input);
+        DocumentSegment* seg = add_segment(out);
+        seg->first = seg->last = next;
+        seg->offset = seg->synced_offset = next->offset;
+        seg->line = seg->synced_line = next->line;
+        if (decl != NULL) {
+            int end = (after != NULL ? after->offset : end_offset);
+            while (seg->last->next != stop && seg->last->next->offset < end) {
+                seg->last = seg->last->next;
+            }
+            decl->next = NULL;
+            seg->decl = decl;
+            parsed++;
+        } else {
+            seg->error = strdup(message);
+            CHECK_MALLOC_PTR(seg->error)
+            seg->error_offset = (after != NULL ? after->offset : end_offset);
+            seg->ran_out = (after == NULL && end_offset < doc->length);
+            while (seg->last->next != stop && seg->last->next->kind != TK_DEF) {
+                seg->last = seg->last->next;
+            }
+            TokenQueue_free(input);
+            input = copy_tokens(seg->last->next, stop);
+        }
+        next = seg->last->next;
+    }
+    TokenQueue_free(input);
+    return parsed;
+}
+
+/**
+ * @brief Rebuild the program and the public state of a document after its
+ * segments have changed
+ *
+ * @param doc Document
+ * @param from First new segment
+ * @param to One past the last new segment
+ * @param line_delta Lines by which the segments after the new ones moved
+ */
+static void finish_update (Document* doc, int from, int to, int line_delta)
+{
+    NodeList* vars = doc->program->program.variables;
+    NodeList* funcs = doc->program->program.functions;
+    vars->head = vars->tail = NULL;
+    vars->size = 0;
+    funcs->head = funcs->tail = NULL;
+    funcs->size = 0;
+    int failed = -1;
+    bool lexed = true;
+    for (int i = 0; i < doc->nsegments; i++) {
+        DocumentSegment* seg = &doc->segments[i];
+        if (seg->decl != NULL) {
+            seg->decl->next = NULL;
+            NodeList_add(seg->decl->type == FUNCDECL ? funcs : vars, seg->decl);
+        } else if (seg->first == NULL) {
+            /* the whole file is lexed before any of it is parsed */
+            if (lexed) {
+                failed = i;
+                lexed = false;
+            }
+        } else if (failed < 0) {
+            failed = i;
+        }
+    }
+
+    doc->tokens = (lexed ? doc->token_list : NULL);
+    if (failed >= 0) {
+        record_error(doc, doc->segments[failed].error, doc->segments[failed].error_offset);
+        doc->tree = NULL;
+        if (doc->index != NULL) {
+            ASTIndex_free(doc->index);
+            doc->index = NULL;
+        }
+    } else {
+        doc->error[0] = '\0';
+        doc->error_offset = -1;
+        doc->tree = doc->program;
+        if (doc->index != NULL) {
+            for (int i = from; i < to; i++) {
+                ASTIndex_add(doc->index, doc->segments[i].decl);
+            }
+            for (int i = to; i < doc->nsegments && line_delta != 0; i++) {
+                sync_segment(&doc->segments[i]);
+                ASTIndex_update_lines(doc->index, doc->segments[i].decl);
+            }
+        } else if (doc->indexed) {
+            Document_sync(doc);
+            doc->index = ASTIndex_new(doc->tree);
+        }
+    }
+    if (!doc->deferred) {
+        Document_sync(doc);
+    }
+}
+
+/**
+ * @brief Throw away the tokens, AST and index and rebuild them from scratch
+ */
+static void update_full (Document* doc)
+{
+    if (doc->index != NULL) {
+        ASTIndex_free(doc->index);
+        doc->index = NULL;
+    }
+    if (doc->program != NULL) {
+        ASTNode_free(doc->program);
+    }
+    for (int i = 0; i < doc->nsegments; i++) {
+        free(doc->segments[i].error);
+    }
+    if (doc->token_list != NULL) {
+        TokenQueue_free(doc->token_list);
+    }
+    SegmentList segments = { doc->segments, 0, doc->segment_capacity };
+    doc->program = ProgramNode_new(NodeList_new(), NodeList_new());
+
+    char message[MAX_ERROR_LEN];
+    doc->token_list = lex_region(doc->text, 0, doc->length, 1, message);
+    if (doc->token_list != NULL) {
+        doc->reparsed = parse_segments(doc, doc->token_list->head, NULL, doc->length, &segments);
+    } else {
+        doc->token_list = TokenQueue_new();
+        DocumentSegment* seg = add_segment(&segments);
+        seg->line = seg->synced_line = 1;
+        seg->error = strdup(message);
+        CHECK_MALLOC_PTR(seg->error)
+        doc->reparsed = 0;
+    }
+    doc->segments = segments.items;
+    doc->nsegments = segments.count;
+    doc->segment_capacity = segments.capacity;
+    finish_update(doc, 0, 0, 0);
+}
+
+Document* Document_new (const char* text)
+{
+    Document* doc = (Document*)calloc(1, sizeof(Document));
+    CHECK_MALLOC_PTR(doc)
+    doc->length = (int)strlen(text);
+    doc->text = (char*)malloc(doc->length + 1);
+    CHECK_MALLOC_PTR(doc->text)
+    memcpy(doc->text, text, doc->length + 1);
+    update_full(doc);
+    return doc;
+}
+
+/**
+ * @brief Re-lex and reparse the segments touched by an edit (the text has
+ * already been updated)
+ */
+static void update_segments (Document* doc, const char* old_text, TextEdit edit, int line_delta)
+{
+    DocumentSegment* segs = doc->segments;
+    int count = doc->nsegments;
+    int delta = edit.new_length - edit.old_length;
+    int old_length = doc->length - delta;
+
+    /*
+     * Every segment whose text touches the edited range is reparsed,
+     * including those that merely border it (the edit may extend them), any
+     * that start later on the last edited line (where re-lexing stops) and
+     * any run of unparsed segments just before (where parsing failed and
+     * resumed depends on the tokens that follow them).
+     */
+    int edit_end = edit.offset + edit.old_length;
+    const char* newline = memchr(old_text + edit_end, '\n', old_length - edit_end);
+    int old_stop = (newline != NULL ? (int)(newline - old_text) + 1 : old_length);
+    int first = find_segment(doc, edit.offset);
+    while (first > 0 && segs[first - 1].decl == NULL && segs[first - 1].first != NULL) {
+        first--;
+    }
+    int last = first;
+    while (last + 1 < count && segs[last + 1].offset < old_stop) {
+        last++;
+    }
+    int region_start = (first == 0 ? 0 : segs[first].offset);
+    int region_line = (first == 0 ? 1 : segs[first].line);
+    int region_end = (last + 1 < count ? segs[last + 1].offset : old_length) + delta;
+
+    /* detach the region's tokens */
+    Token* before = NULL;
+    for (int i = first - 1; i >= 0 && before == NULL; i--) {
+        before = segs[i].last;
+    }
+    Token* after = NULL;
+    for (int i = last + 1; i < count && after == NULL; i++) {
+        after = segs[i].first;
+    }
+    TokenQueue* region = TokenQueue_new();
+    bool lexed = true;
+    for (int i = first; i <= last; i++) {
+        sync_segment(&segs[i]);
+        if (segs[i].first == NULL) {
+            lexed = false;
+        } else {
+            region->head = (region->head != NULL ? region->head : segs[i].first);
+            region->tail = segs[i].last;
+        }
+    }
+    if (region->tail != NULL) {
+        region->tail->next = NULL;
+    }
+
+    char message[MAX_ERROR_LEN];
+    TokenQueue* fresh = NULL;
+    if (lexed) {
+        ErrorTrap trap;
+        ErrorTrap_push(&trap);
+        TokenIndex* index = TokenIndex_new(region);
+        if (setjmp(trap.env) == 0) {
+            relex(index, old_text, doc->text, edit);
+            fresh = region;
+        }
+        TokenIndex_free(index);
+        ErrorTrap_pop(&trap);
+    }
+    if (fresh == NULL) {
+        TokenQueue_free(region);
+        fresh = lex_region(doc->text, region_start, region_end, region_line, message);
+    }
+
+    SegmentList parsed = { NULL, 0, 0 };
+    doc->reparsed = 0;
+    for (int more = 1; fresh != NULL; more *= 2) {
+        doc->reparsed = parse_segments(doc, fresh->head, NULL, region_end, &parsed);
+        if (parsed.count == 0 || !parsed.items[parsed.count - 1].ran_out ||
+                last + 1 == count || segs[last + 1].first == NULL) {
+            break;
+        }
+
+        /*
+         * The region ends in the middle of a declaration (e.g., the edit
+         * removed a closing brace), which swallows the segments after it:
+         * move them into the region (up to date and in the new text's
+         * coordinates) and try again.
+         */
+        for (int i = 0; i < more && last + 1 < count && segs[last + 1].first != NULL; i++) {
+            DocumentSegment* seg = &segs[++last];
+            seg->offset += delta;
+            seg->line += line_delta;
+            if (seg->decl != NULL) {
+                shift_node(&(Shift){ delta, line_delta }, seg->decl);
+            }
+            sync_segment(seg);
+            fresh->tail->next = seg->first;
+            fresh->tail = seg->last;
+        }
+        fresh->tail->next = NULL;
+        after = NULL;
+        for (int i = last + 1; i < count && after == NULL; i++) {
+            after = segs[i].first;
+        }
+        region_end = (last + 1 < count ? segs[last + 1].offset : old_length) + delta;
+        for (int i = 0; i < parsed.count; i++) {
+            if (parsed.items[i].decl != NULL) {
+                ASTNode_free(parsed.items[i].decl);
+            }
+            free(parsed.items[i].error);
+        }
+        parsed.count = 0;
+    }
+    Token* head = after;
+    if (fresh != NULL) {
+        if (fresh->head != NULL) {
+            fresh->tail->next = after;
+            head = fresh->head;
+        }
+        fresh->head = fresh->tail = NULL;
+        TokenQueue_free(fresh);
+    } else {
+        /* remember the text that does not lex (without any tokens) */
+        DocumentSegment* seg = add_segment(&parsed);
+        seg->offset = seg->synced_offset = region_start;
+        seg->line = seg->synced_line = region_line;
+        seg->error = strdup(message);
+        CHECK_MALLOC_PTR(seg->error)
+    }
+
+    /* splice in the new tokens */
+    TokenQueue* tokens = doc->token_list;
+    if (before != NULL) {
+        before->next = head;
+    } else {
+        tokens->head = head;
+    }
+    if (after == NULL) {
+        Token* tail = (head != NULL ? head : before);
+        while (tail != NULL && tail->next != NULL) {
+            tail = tail->next;
+        }
+        tokens->tail = tail;
+    }
+
+    /* replace the old segments */
+    for (int i = first; i <= last; i++) {
+        free_segment(doc, &segs[i]);
+    }
+    int new_count = count - (last - first + 1) + parsed.count;
+    if (new_count > doc->segment_capacity) {
+        doc->segment_capacity = new_count * 2;
+        doc->segments = (DocumentSegment*)realloc(doc->segments,
+                doc->segment_capacity * sizeof(DocumentSegment));
+        CHECK_MALLOC_PTR(doc->segments)
+        segs = doc->segments;
+    }
+    memmove(&segs[first + parsed.count], &segs[last + 1], (count - last - 1) * sizeof(DocumentSegment));
+    if (parsed.count > 0) {
+        memcpy(&segs[first], parsed.items, parsed.count * sizeof(DocumentSegment));
+    }
+    doc->nsegments = new_count;
+    free(parsed.items);
+
+    /* move the later ones; their nodes and tokens catch up in sync_segment */
+    for (int i = first + parsed.count; i < new_count; i++) {
+        segs[i].offset += delta;
+        segs[i].line += line_delta;
+        if (segs[i].decl != NULL) {
+            shift_node(&(Shift){ delta, line_delta }, segs[i].decl);
+        }
+        if (segs[i].error_offset >= 0) {
+            segs[i].error_offset += delta;
+        }
+        if (segs[i].error != NULL && line_delta != 0) {
+            Error_move_line(message, segs[i].error, line_delta);
+            free(segs[i].error);
+            segs[i].error = strdup(message);
+            CHECK_MALLOC_PTR(segs[i].error)
+        }
+    }
+    finish_update(doc, first, first + parsed.count, line_delta);
+}
+
+void Document_edit (Document* doc, TextEdit edit, const char* replacement)
+{
+    int old_length = doc->length;
+    int new_length = old_length + edit.new_length - edit.old_length;
+    char* old_text = doc->text;
+    char* new_text = (char*)malloc(new_length + 1);
+    CHECK_MALLOC_PTR(new_text)
+    memcpy(new_text, old_text, edit.offset);
+    memcpy(new_text + edit.offset, replacement, edit.new_length);
+    memcpy(new_text + edit.offset + edit.new_length,
+           old_text + edit.offset + edit.old_length,
+           old_length - edit.offset - edit.old_length + 1);
+    int line_delta = count_newlines(new_text, edit.offset, edit.offset + edit.new_length)
+                   - count_newlines(old_text, edit.offset, edit.offset + edit.old_length);
+
+    doc->text = new_text;
+    doc->length = new_length;
+    if (doc->nsegments > 0) {
+        update_segments(doc, old_text, edit, line_delta);
+    } else {
+        update_full(doc);
+    }
+    free(old_text);
+}
+
+void Document_replace (Document* doc, const char* text)
+{
+    free(doc->text);
+    doc->length = (int)strlen(text);
+    doc->text = (char*)malloc(doc->length + 1);
+    CHECK_MALLOC_PTR(doc->text)
+    memcpy(doc->text, text, doc->length + 1);
+    update_full(doc);
+}
+
+ASTIndex* Document_index (Document* doc)
+{
+    doc->indexed = true;
+    if (doc->index == NULL && doc->tree != NULL) {
+        Document_sync(doc);
+        doc->index = ASTIndex_new(doc->tree);
+    }
+    return doc->index;
+}
+
+ASTNode* Document_declaration_at (Document* doc, int offset)
+{
+    if (doc->nsegments == 0) {
+        return NULL;
+    }
+    DocumentSegment* seg = &doc->segments[find_segment(doc, offset + 1)];
+    if (seg->offset > offset) {
+        return NULL;
+    }
+    sync_segment(seg);
+    return seg->decl;
+}
+
+void Document_sync (Document* doc)
+{
+    for (int i = 0; i < doc->nsegments; i++) {
+        sync_segment(&doc->segments[i]);
+    }
+}
+
+void Document_free (Document* doc)
+{
+    if (doc->index != NULL) {
+        ASTIndex_free(doc->index);
+    }
+    ASTNode_free(doc->program);
+    for (int i = 0; i < doc->nsegments; i++) {
+        free(doc->segments[i].error);
+    }
+    free(doc->segments);
+    TokenQueue_free(doc->token_list);
+    free(doc->text);
+    free(doc);
+}
@@ -0,0 +1,320 @@
+/**
+ * @file emit.c
+ * @brief Machine-readable AST output (JSON and S-expressions)
+ */
+
+#include "emit.h"
+
+/**
+ * @brief Traversal state shared by both formats
+ */
+typedef struct Emitter
+{
+    Writer writer;      /**< @brief Buffered output */
+    bool separate;      /**< @brief Whether the next node needs a separator first */
+} Emitter;
+
+/**
+ * @brief Write a name (identifiers never need escaping, but cannot be trusted
+ * not to in a hand-built tree)
+ */
+static void write_name (Writer* writer, const char* name)
+{
+    Writer_json_string(writer, name, strlen(name));
+}
+
+static void write_bool (Writer* writer, bool value)
+{
+    if (value) {
+        Writer_literal(writer, "true");
+    } else {
+        Writer_literal(writer, "false");
+    }
+}
+
+
+/*
+ * JSON
+ */
+
+/**
+ * @brief Open a node: its kind and line (the caller adds its other fields)
+ */
+static void JsonVisitor_open (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    if (emitter->separate) {
+        Writer_putc(writer, ',');
+    }
+    Writer_literal(writer, "{\"node\":\"");
+    Writer_puts(writer, NodeType_to_string(node->type));
+    Writer_literal(writer, "\",\"line\":");
+    Writer_int(writer, node->source_line);
+}
+
+/**
+ * @brief Finish a node's fields and start its children
+ */
+static void JsonVisitor_children (Emitter* emitter)
+{
+    Writer_literal(&emitter->writer, ",\"children\":[");
+    emitter->separate = false;
+}
+
+static void JsonVisitor_type (Writer* writer, DecafType type)
+{
+    Writer_putc(writer, '"');
+    Writer_puts(writer, DecafType_to_string(type));
+    Writer_putc(writer, '"');
+}
+
+static void JsonVisitor_previsit_default (Emitter* emitter, ASTNode* node)
+{
+    JsonVisitor_open(emitter, node);
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_vardecl (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    JsonVisitor_open(emitter, node);
+    Writer_literal(writer, ",\"name\":");
+    write_name(writer, node->vardecl.name);
+    Writer_literal(writer, ",\"type\":");
+    JsonVisitor_type(writer, node->vardecl.type);
+    Writer_literal(writer, ",\"is_array\":");
+    write_bool(writer, node->vardecl.is_array);
+    Writer_literal(writer, ",\"array_length\":");
+    Writer_int(writer, node->vardecl.array_length);
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_funcdecl (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    JsonVisitor_open(emitter, node);
+    Writer_literal(writer, ",\"name\":");
+    write_name(writer, node->funcdecl.name);
+    Writer_literal(writer, ",\"return_type\":");
+    JsonVisitor_type(writer, node->funcdecl.return_type);
+    Writer_literal(writer, ",\"parameters\":[");
+    bool first = true;
+    FOR_EACH (Parameter*, param, node->funcdecl.parameters) {
+        if (!first) {
+            Writer_putc(writer, ',');
+        }
+        Writer_literal(writer, "{\"name\":");
+        write_name(writer, param->name);
+        Writer_literal(writer, ",\"type\":");
+        JsonVisitor_type(writer, param->type);
+        Writer_putc(writer, '}');
+        first = false;
+    }
+    Writer_putc(writer, ']');
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_binaryop (Emitter* emitter, ASTNode* node)
+{
+    JsonVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, ",\"op\":");
+    write_name(&emitter->writer, BinaryOpToString(node->binaryop.operator));
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_unaryop (Emitter* emitter, ASTNode* node)
+{
+    JsonVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, ",\"op\":");
+    write_name(&emitter->writer, UnaryOpToString(node->unaryop.operator));
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_location (Emitter* emitter, ASTNode* node)
+{
+    JsonVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, ",\"name\":");
+    write_name(&emitter->writer, node->location.name);
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_funccall (Emitter* emitter, ASTNode* node)
+{
+    JsonVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, ",\"name\":");
+    write_name(&emitter->writer, node->funccall.name);
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_previsit_literal (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    JsonVisitor_open(emitter, node);
+    Writer_literal(writer, ",\"type\":");
+    JsonVisitor_type(writer, node->literal.type);
+    Writer_literal(writer, ",\"value\":");
+    switch (node->literal.type) {
+        case INT:  Writer_int(writer, node->literal.integer); break;
+        case BOOL: write_bool(writer, node->literal.boolean); break;
+        case STR:  write_name(writer, node->literal.string); break;
+        default:   Writer_literal(writer, "null"); break;
+    }
+    JsonVisitor_children(emitter);
+}
+
+static void JsonVisitor_postvisit_default (Emitter* emitter, ASTNode* node)
+{
+    Writer_literal(&emitter->writer, "]}");
+    emitter->separate = true;
+}
+
+#define STATIC_VISITOR_TRAVERSE         JsonVisitor_traverse_node
+#define STATIC_VISITOR_STATE            Emitter*
+#define STATIC_PREVISIT_default         JsonVisitor_previsit_default
+#define STATIC_PREVISIT_vardecl         JsonVisitor_previsit_vardecl
+#define STATIC_PREVISIT_funcdecl        JsonVisitor_previsit_funcdecl
+#define STATIC_PREVISIT_binaryop        JsonVisitor_previsit_binaryop
+#define STATIC_PREVISIT_unaryop         JsonVisitor_previsit_unaryop
+#define STATIC_PREVISIT_location        JsonVisitor_previsit_location
+#define STATIC_PREVISIT_funccall        JsonVisitor_previsit_funccall
+#define STATIC_PREVISIT_literal         JsonVisitor_previsit_literal
+#define STATIC_POSTVISIT_default        JsonVisitor_postvisit_default
+#include "static-visitor.h"
+
+void JsonVisitor_traverse (FILE* output, ASTNode* tree)
+{
+    Emitter emitter = { .separate = false };
+    Writer_init(&emitter.writer, output);
+    JsonVisitor_traverse_node(&emitter, tree);
+    Writer_putc(&emitter.writer, '\n');
+    Writer_flush(&emitter.writer);
+}
+
+
+/*
+ * S-EXPRESSIONS
+ */
+
+/**
+ * @brief Open a node: its kind and line (the caller adds its other fields)
+ */
+static void SExprVisitor_open (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    if (emitter->separate) {
+        Writer_putc(writer, ' ');
+    }
+    emitter->separate = true;
+    Writer_putc(writer, '(');
+    Writer_puts(writer, NodeType_to_string(node->type));
+    Writer_literal(writer, " :line ");
+    Writer_int(writer, node->source_line);
+}
+
+static void SExprVisitor_previsit_vardecl (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    SExprVisitor_open(emitter, node);
+    Writer_literal(writer, " :name ");
+    write_name(writer, node->vardecl.name);
+    Writer_literal(writer, " :type ");
+    Writer_puts(writer, DecafType_to_string(node->vardecl.type));
+    Writer_literal(writer, " :is_array ");
+    write_bool(writer, node->vardecl.is_array);
+    Writer_literal(writer, " :array_length ");
+    Writer_int(writer, node->vardecl.array_length);
+}
+
+static void SExprVisitor_previsit_funcdecl (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    SExprVisitor_open(emitter, node);
+    Writer_literal(writer, " :name ");
+    write_name(writer, node->funcdecl.name);
+    Writer_literal(writer, " :return_type ");
+    Writer_puts(writer, DecafType_to_string(node->funcdecl.return_type));
+    Writer_literal(writer, " :parameters (");
+    bool first = true;
+    FOR_EACH (Parameter*, param, node->funcdecl.parameters) {
+        if (!first) {
+            Writer_putc(writer, ' ');
+        }
+        Writer_putc(writer, '(');
+        write_name(writer, param->name);
+        Writer_putc(writer, ' ');
+        Writer_puts(writer, DecafType_to_string(param->type));
+        Writer_putc(writer, ')');
+        first = false;
+    }
+    Writer_putc(writer, ')');
+}
+
+static void SExprVisitor_previsit_binaryop (Emitter* emitter, ASTNode* node)
+{
+    SExprVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, " :op ");
+    write_name(&emitter->writer, BinaryOpToString(node->binaryop.operator));
+}
+
+static void SExprVisitor_previsit_unaryop (Emitter* emitter, ASTNode* node)
+{
+    SExprVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, " :op ");
+    write_name(&emitter->writer, UnaryOpToString(node->unaryop.operator));
+}
+
+static void SExprVisitor_previsit_location (Emitter* emitter, ASTNode* node)
+{
+    SExprVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, " :name ");
+    write_name(&emitter->writer, node->location.name);
+}
+
+static void SExprVisitor_previsit_funccall (Emitter* emitter, ASTNode* node)
+{
+    SExprVisitor_open(emitter, node);
+    Writer_literal(&emitter->writer, " :name ");
+    write_name(&emitter->writer, node->funccall.name);
+}
+
+static void SExprVisitor_previsit_literal (Emitter* emitter, ASTNode* node)
+{
+    Writer* writer = &emitter->writer;
+    SExprVisitor_open(emitter, node);
+    Writer_literal(writer, " :type ");
+    Writer_puts(writer, DecafType_to_string(node->literal.type));
+    Writer_literal(writer, " :value ");
+    switch (node->literal.type) {
+        case INT:  Writer_int(writer, node->literal.integer); break;
+        case BOOL: write_bool(writer, node->literal.boolean); break;
+        case STR:  write_name(writer, node->literal.string); break;
+        default:   Writer_literal(writer, "nil"); break;
+    }
+}
+
+static void SExprVisitor_postvisit_default (Emitter* emitter, ASTNode* node)
+{
+    Writer_putc(&emitter->writer, ')');
+}
+
+#define STATIC_VISITOR_TRAVERSE         SExprVisitor_traverse_node
+#define STATIC_VISITOR_STATE            Emitter*
+#define STATIC_PREVISIT_default         SExprVisitor_open
+#define STATIC_PREVISIT_vardecl         SExprVisitor_previsit_vardecl
+#define STATIC_PREVISIT_funcdecl        SExprVisitor_previsit_funcdecl
+#define STATIC_PREVISIT_binaryop        SExprVisitor_previsit_binaryop
+#define STATIC_PREVISIT_unaryop         SExprVisitor_previsit_unaryop
+#define STATIC_PREVISIT_location        SExprVisitor_previsit_location
+#define STATIC_PREVISIT_funccall        SExprVisitor_previsit_funccall
+#define STATIC_PREVISIT_literal         SExprVisitor_previsit_literal
+#define STATIC_POSTVISIT_default        SExprVisitor_postvisit_default
+#include "static-visitor.h"
+
+void SExprVisitor_traverse (FILE* output, ASTNode* tree)
+{
+    Emitter emitter = { .separate = false };
+    Writer_init(&emitter.writer, output);
+    SExprVisitor_traverse_node(&emitter, tree);
+    Writer_putc(&emitter.writer, '\n');
+    Writer_flush(&emitter.writer);
+}
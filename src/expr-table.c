@@ -0,0 +1,360 @@
+/**
+ * @file expr-table.c
+ * @brief LL(1) parse table for Decaf expressions
+ *
+ * GENERATED by tools/llgen from grammar.txt; do not edit by hand.
+ */
+
+#include "lltable.h"
+
+/*
+ * FIRST and FOLLOW sets
+ *
+ * Expr     FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { ")" "]" "," ";" }
+ * And      FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" ")" "]" "," ";" }
+ * OrT      FIRST  { "||" } + e
+ *          FOLLOW { ")" "]" "," ";" }
+ * Eq       FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" "&&" ")" "]" "," ";" }
+ * AndT     FIRST  { "&&" } + e
+ *          FOLLOW { "||" ")" "]" "," ";" }
+ * Rel      FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" "&&" "==" "!=" ")" "]" "," ";" }
+ * EqT      FIRST  { "==" "!=" } + e
+ *          FOLLOW { "||" "&&" ")" "]" "," ";" }
+ * Arith    FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" ")" "]" "," ";" }
+ * RelT     FIRST  { "<" "<=" ">" ">=" } + e
+ *          FOLLOW { "||" "&&" "==" "!=" ")" "]" "," ";" }
+ * Mult     FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" "+" "-" ")" "]" "," ";" }
+ * ArithT   FIRST  { "+" "-" } + e
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" ")" "]" "," ";" }
+ * Unary    FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" "+" "-" "*" "/" "%" ")" "]" "," ";" }
+ * MultT    FIRST  { "*" "/" "%" } + e
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" "+" "-" ")" "]" "," ";" }
+ * Base     FIRST  { "(" "true" "false" ID DECLIT HEXLIT STRLIT }
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" "+" "-" "*" "/" "%" ")" "]" "," ";" }
+ * Suffix   FIRST  { "(" "[" } + e
+ *          FOLLOW { "||" "&&" "==" "!=" "<" "<=" ">" ">=" "+" "-" "*" "/" "%" ")" "]" "," ";" }
+ * Args     FIRST  { "-" "!" "(" "true" "false" ID DECLIT HEXLIT STRLIT } + e
+ *          FOLLOW { ")" }
+ * ArgsT    FIRST  { "," } + e
+ *          FOLLOW { ")" }
+ */
+
+const LLProduction ll_productions[] = {
+    { 0, { 0 } },
+    /* 1: Expr -> And OrT */
+    { 2, { LL_NT(1), LL_NT(2) } },
+    /* 2: OrT -> "||" And @binop(OROP) OrT */
+    { 4, { TK_OR, LL_NT(1), LL_ACTION(0), LL_NT(2) } },
+    /* 3: OrT -> e */
+    { 0, { 0 } },
+    /* 4: And -> Eq AndT */
+    { 2, { LL_NT(3), LL_NT(4) } },
+    /* 5: AndT -> "&&" Eq @binop(ANDOP) AndT */
+    { 4, { TK_AND, LL_NT(3), LL_ACTION(1), LL_NT(4) } },
+    /* 6: AndT -> e */
+    { 0, { 0 } },
+    /* 7: Eq -> Rel EqT */
+    { 2, { LL_NT(5), LL_NT(6) } },
+    /* 8: EqT -> "==" Rel @binop(EQOP) EqT */
+    { 4, { TK_EQ, LL_NT(5), LL_ACTION(2), LL_NT(6) } },
+    /* 9: EqT -> "!=" Rel @binop(NEQOP) EqT */
+    { 4, { TK_NE, LL_NT(5), LL_ACTION(3), LL_NT(6) } },
+    /* 10: EqT -> e */
+    { 0, { 0 } },
+    /* 11: Rel -> Arith RelT */
+    { 2, { LL_NT(7), LL_NT(8) } },
+    /* 12: RelT -> "<" Arith @binop(LTOP) RelT */
+    { 4, { TK_LT, LL_NT(7), LL_ACTION(4), LL_NT(8) } },
+    /* 13: RelT -> "<=" Arith @binop(LEOP) RelT */
+    { 4, { TK_LE, LL_NT(7), LL_ACTION(5), LL_NT(8) } },
+    /* 14: RelT -> ">" Arith @binop(GTOP) RelT */
+    { 4, { TK_GT, LL_NT(7), LL_ACTION(6), LL_NT(8) } },
+    /* 15: RelT -> ">=" Arith @binop(GEOP) RelT */
+    { 4, { TK_GE, LL_NT(7), LL_ACTION(7), LL_NT(8) } },
+    /* 16: RelT -> e */
+    { 0, { 0 } },
+    /* 17: Arith -> Mult ArithT */
+    { 2, { LL_NT(9), LL_NT(10) } },
+    /* 18: ArithT -> "+" Mult @binop(ADDOP) ArithT */
+    { 4, { TK_PLUS, LL_NT(9), LL_ACTION(8), LL_NT(10) } },
+    /* 19: ArithT -> "-" Mult @binop(SUBOP) ArithT */
+    { 4, { TK_MINUS, LL_NT(9), LL_ACTION(9), LL_NT(10) } },
+    /* 20: ArithT -> e */
+    { 0, { 0 } },
+    /* 21: Mult -> Unary MultT */
+    { 2, { LL_NT(11), LL_NT(12) } },
+    /* 22: MultT -> "*" Unary @binop(MULOP) MultT */
+    { 4, { TK_TIMES, LL_NT(11), LL_ACTION(10), LL_NT(12) } },
+    /* 23: MultT -> "/" Unary @binop(DIVOP) MultT */
+    { 4, { TK_DIV, LL_NT(11), LL_ACTION(11), LL_NT(12) } },
+    /* 24: MultT -> "%" Unary @binop(MODOP) MultT */
+    { 4, { TK_MOD, LL_NT(11), LL_ACTION(12), LL_NT(12) } },
+    /* 25: MultT -> e */
+    { 0, { 0 } },
+    /* 26: Unary -> "-" Base @unop(NEGOP) */
+    { 3, { TK_MINUS, LL_NT(13), LL_ACTION(13) } },
+    /* 27: Unary -> "!" Base @unop(NOTOP) */
+    { 3, { TK_NOT, LL_NT(13), LL_ACTION(14) } },
+    /* 28: Unary -> Base */
+    { 1, { LL_NT(13) } },
+    /* 29: Base -> "(" Expr ")" @paren */
+    { 4, { TK_LPAREN, LL_NT(0), TK_RPAREN, LL_ACTION(15) } },
+    /* 30: Base -> ID$ Suffix */
+    { 2, { TK_ID | LL_KEEP, LL_NT(14) } },
+    /* 31: Base -> @lit DECLIT */
+    { 2, { LL_ACTION(16), TK_DECLIT } },
+    /* 32: Base -> @lit HEXLIT */
+    { 2, { LL_ACTION(16), TK_HEXLIT } },
+    /* 33: Base -> @lit STRLIT */
+    { 2, { LL_ACTION(16), TK_STRLIT } },
+    /* 34: Base -> @lit "true" */
+    { 2, { LL_ACTION(16), TK_TRUE } },
+    /* 35: Base -> @lit "false" */
+    { 2, { LL_ACTION(16), TK_FALSE } },
+    /* 36: Suffix -> "(" @args Args ")" @call */
+    { 5, { TK_LPAREN, LL_ACTION(17), LL_NT(15), TK_RPAREN, LL_ACTION(18) } },
+    /* 37: Suffix -> "[" Expr "]" @index */
+    { 4, { TK_LBRACKET, LL_NT(0), TK_RBRACKET, LL_ACTION(19) } },
+    /* 38: Suffix -> @loc */
+    { 1, { LL_ACTION(20) } },
+    /* 39: Args -> Expr @arg ArgsT */
+    { 3, { LL_NT(0), LL_ACTION(21), LL_NT(16) } },
+    /* 40: Args -> e */
+    { 0, { 0 } },
+    /* 41: ArgsT -> "," Expr @arg ArgsT */
+    { 4, { TK_COMMA, LL_NT(0), LL_ACTION(21), LL_NT(16) } },
+    /* 42: ArgsT -> e */
+    { 0, { 0 } },
+};
+
+const LLAction ll_actions[] = {
+    { LL_BINOP, OROP },
+    { LL_BINOP, ANDOP },
+    { LL_BINOP, EQOP },
+    { LL_BINOP, NEQOP },
+    { LL_BINOP, LTOP },
+    { LL_BINOP, LEOP },
+    { LL_BINOP, GTOP },
+    { LL_BINOP, GEOP },
+    { LL_BINOP, ADDOP },
+    { LL_BINOP, SUBOP },
+    { LL_BINOP, MULOP },
+    { LL_BINOP, DIVOP },
+    { LL_BINOP, MODOP },
+    { LL_UNOP, NEGOP },
+    { LL_UNOP, NOTOP },
+    { LL_PAREN, 0 },
+    { LL_LIT, 0 },
+    { LL_ARGS, 0 },
+    { LL_CALL, 0 },
+    { LL_INDEX, 0 },
+    { LL_LOC, 0 },
+    { LL_ARG, 0 },
+};
+
+const unsigned char ll_table[][NUM_TOKEN_KINDS] = {
+    /* Expr */ {
+        [TK_MINUS] = 1,
+        [TK_NOT] = 1,
+        [TK_LPAREN] = 1,
+        [TK_TRUE] = 1,
+        [TK_FALSE] = 1,
+        [TK_ID] = 1,
+        [TK_DECLIT] = 1,
+        [TK_HEXLIT] = 1,
+        [TK_STRLIT] = 1
+    },
+    /* And */ {
+        [TK_MINUS] = 4,
+        [TK_NOT] = 4,
+        [TK_LPAREN] = 4,
+        [TK_TRUE] = 4,
+        [TK_FALSE] = 4,
+        [TK_ID] = 4,
+        [TK_DECLIT] = 4,
+        [TK_HEXLIT] = 4,
+        [TK_STRLIT] = 4
+    },
+    /* OrT */ {
+        [TK_OR] = 2,
+        [TK_RPAREN] = 3,
+        [TK_RBRACKET] = 3,
+        [TK_COMMA] = 3,
+        [TK_SEMICOLON] = 3
+    },
+    /* Eq */ {
+        [TK_MINUS] = 7,
+        [TK_NOT] = 7,
+        [TK_LPAREN] = 7,
+        [TK_TRUE] = 7,
+        [TK_FALSE] = 7,
+        [TK_ID] = 7,
+        [TK_DECLIT] = 7,
+        [TK_HEXLIT] = 7,
+        [TK_STRLIT] = 7
+    },
+    /* AndT */ {
+        [TK_OR] = 6,
+        [TK_AND] = 5,
+        [TK_RPAREN] = 6,
+        [TK_RBRACKET] = 6,
+        [TK_COMMA] = 6,
+        [TK_SEMICOLON] = 6
+    },
+    /* Rel */ {
+        [TK_MINUS] = 11,
+        [TK_NOT] = 11,
+        [TK_LPAREN] = 11,
+        [TK_TRUE] = 11,
+        [TK_FALSE] = 11,
+        [TK_ID] = 11,
+        [TK_DECLIT] = 11,
+        [TK_HEXLIT] = 11,
+        [TK_STRLIT] = 11
+    },
+    /* EqT */ {
+        [TK_OR] = 10,
+        [TK_AND] = 10,
+        [TK_EQ] = 8,
+        [TK_NE] = 9,
+        [TK_RPAREN] = 10,
+        [TK_RBRACKET] = 10,
+        [TK_COMMA] = 10,
+        [TK_SEMICOLON] = 10
+    },
+    /* Arith */ {
+        [TK_MINUS] = 17,
+        [TK_NOT] = 17,
+        [TK_LPAREN] = 17,
+        [TK_TRUE] = 17,
+        [TK_FALSE] = 17,
+        [TK_ID] = 17,
+        [TK_DECLIT] = 17,
+        [TK_HEXLIT] = 17,
+        [TK_STRLIT] = 17
+    },
+    /* RelT */ {
+        [TK_OR] = 16,
+        [TK_AND] = 16,
+        [TK_EQ] = 16,
+        [TK_NE] = 16,
+        [TK_LT] = 12,
+        [TK_LE] = 13,
+        [TK_GT] = 14,
+        [TK_GE] = 15,
+        [TK_RPAREN] = 16,
+        [TK_RBRACKET] = 16,
+        [TK_COMMA] = 16,
+        [TK_SEMICOLON] = 16
+    },
+    /* Mult */ {
+        [TK_MINUS] = 21,
+        [TK_NOT] = 21,
+        [TK_LPAREN] = 21,
+        [TK_TRUE] = 21,
+        [TK_FALSE] = 21,
+        [TK_ID] = 21,
+        [TK_DECLIT] = 21,
+        [TK_HEXLIT] = 21,
+        [TK_STRLIT] = 21
+    },
+    /* ArithT */ {
+        [TK_OR] = 20,
+        [TK_AND] = 20,
+        [TK_EQ] = 20,
+        [TK_NE] = 20,
+        [TK_LT] = 20,
+        [TK_LE] = 20,
+        [TK_GT] = 20,
+        [TK_GE] = 20,
+        [TK_PLUS] = 18,
+        [TK_MINUS] = 19,
+        [TK_RPAREN] = 20,
+        [TK_RBRACKET] = 20,
+        [TK_COMMA] = 20,
+        [TK_SEMICOLON] = 20
+    },
+    /* Unary */ {
+        [TK_MINUS] = 26,
+        [TK_NOT] = 27,
+        [TK_LPAREN] = 28,
+        [TK_TRUE] = 28,
+        [TK_FALSE] = 28,
+        [TK_ID] = 28,
+        [TK_DECLIT] = 28,
+        [TK_HEXLIT] = 28,
+        [TK_STRLIT] = 28
+    },
+    /* MultT */ {
+        [TK_OR] = 25,
+        [TK_AND] = 25,
+        [TK_EQ] = 25,
+        [TK_NE] = 25,
+        [TK_LT] = 25,
+        [TK_LE] = 25,
+        [TK_GT] = 25,
+        [TK_GE] = 25,
+        [TK_PLUS] = 25,
+        [TK_MINUS] = 25,
+        [TK_TIMES] = 22,
+        [TK_DIV] = 23,
+        [TK_MOD] = 24,
+        [TK_RPAREN] = 25,
+        [TK_RBRACKET] = 25,
+        [TK_COMMA] = 25,
+        [TK_SEMICOLON] = 25
+    },
+    /* Base */ {
+        [TK_LPAREN] = 29,
+        [TK_TRUE] = 34,
+        [TK_FALSE] = 35,
+        [TK_ID] = 30,
+        [TK_DECLIT] = 31,
+        [TK_HEXLIT] = 32,
+        [TK_STRLIT] = 33
+    },
+    /* Suffix */ {
+        [TK_OR] = 38,
+        [TK_AND] = 38,
+        [TK_EQ] = 38,
+        [TK_NE] = 38,
+        [TK_LT] = 38,
+        [TK_LE] = 38,
+        [TK_GT] = 38,
+        [TK_GE] = 38,
+        [TK_PLUS] = 38,
+        [TK_MINUS] = 38,
+        [TK_TIMES] = 38,
+        [TK_DIV] = 38,
+        [TK_MOD] = 38,
+        [TK_LPAREN] = 36,
+        [TK_RPAREN] = 38,
+        [TK_LBRACKET] = 37,
+        [TK_RBRACKET] = 38,
+        [TK_COMMA] = 38,
+        [TK_SEMICOLON] = 38
+    },
+    /* Args */ {
+        [TK_MINUS] = 39,
+        [TK_NOT] = 39,
+        [TK_LPAREN] = 39,
+        [TK_RPAREN] = 40,
+        [TK_TRUE] = 39,
+        [TK_FALSE] = 39,
+        [TK_ID] = 39,
+        [TK_DECLIT] = 39,
+        [TK_HEXLIT] = 39,
+        [TK_STRLIT] = 39
+    },
+    /* ArgsT */ {
+        [TK_RPAREN] = 42,
+        [TK_COMMA] = 41
+    },
+};
@@ -0,0 +1,581 @@
+/**
+ * @file iloc.c
+ * @brief ILOC intermediate code (representation and text format)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+
+#include "iloc.h"
+
+/**
+ * @brief Text format of each opcode
+ *
+ * The operand pattern lists the operands in the order they are written:
+ * @c r is a register, @c c an integer constant, @c l a label and @c s a
+ * string, with the punctuation between them (@c = stands for the arrow). In
+ * a memory operand, the @c + before a constant also accepts a @c - (and
+ * negates the constant).
+ */
+static const struct {
+    const char* mnemonic;
+    const char* pattern;
+} formats[NUM_ILOC_OPCODES] = {
+    [ILOC_NOP]      = { "nop",      "" },
+    [ILOC_ADD]      = { "add",      "r,r=r" },
+    [ILOC_SUB]      = { "sub",      "r,r=r" },
+    [ILOC_MULT]     = { "mult",     "r,r=r" },
+    [ILOC_DIV]      = { "div",      "r,r=r" },
+    [ILOC_AND]      = { "and",      "r,r=r" },
+    [ILOC_OR]       = { "or",       "r,r=r" },
+    [ILOC_ADD_I]    = { "addI",     "r,c=r" },
+    [ILOC_SUB_I]    = { "subI",     "r,c=r" },
+    [ILOC_MULT_I]   = { "multI",    "r,c=r" },
+    [ILOC_NOT]      = { "not",      "r=r" },
+    [ILOC_NEG]      = { "neg",      "r=r" },
+    [ILOC_I2I]      = { "i2i",      "r=r" },
+    [ILOC_CMP_LT]   = { "cmp_LT",   "r,r=r" },
+    [ILOC_CMP_LE]   = { "cmp_LE",   "r,r=r" },
+    [ILOC_CMP_EQ]   = { "cmp_EQ",   "r,r=r" },
+    [ILOC_CMP_GE]   = { "cmp_GE",   "r,r=r" },
+    [ILOC_CMP_GT]   = { "cmp_GT",   "r,r=r" },
+    [ILOC_CMP_NE]   = { "cmp_NE",   "r,r=r" },
+    [ILOC_LOAD_I]   = { "loadI",    "c=r" },
+    [ILOC_LOAD]     = { "load",     "[r]=r" },
+    [ILOC_LOAD_AI]  = { "loadAI",   "[r+c]=r" },
+    [ILOC_LOAD_AO]  = { "loadAO",   "[r+r]=r" },
+    [ILOC_STORE]    = { "store",    "r=[r]" },
+    [ILOC_STORE_AI] = { "storeAI",  "r=[r+c]" },
+    [ILOC_STORE_AO] = { "storeAO",  "r=[r+r]" },
+    [ILOC_JUMP]     = { "jump",     "l" },
+    [ILOC_CBR]      = { "cbr",      "r=l,l" },
+    [ILOC_CALL]     = { "call",     "l" },
+    [ILOC_RETURN]   = { "return",   "" },
+    [ILOC_PUSH]     = { "push",     "r" },
+    [ILOC_POP]      = { "pop",      "=r" },
+    [ILOC_PRINT]    = { "print",    "r" },      /* or a string (see ILOCInsn_format) */
+    [ILOC_LABEL]    = { "",         "l" },
+};
+
+const char* ILOCOpcode_to_string (ILOCOpcode opcode)
+{
+    return (opcode >= 0 && opcode < NUM_ILOC_OPCODES ? formats[opcode].mnemonic : "???");
+}
+
+/**
+ * @brief Operand pattern of an instruction (which, for @c print, depends on
+ * its operand)
+ */
+static const char* ILOCInsn_format (ILOCInsn* insn)
+{
+    if (insn->opcode == ILOC_PRINT && insn->operands[0].type == OPERAND_STR) {
+        return "s";
+    }
+    return formats[insn->opcode].pattern;
+}
+
+DEF_LIST_IMPL(ILOCInsn, struct ILOCInsn*, ILOCInsn_free)
+
+ILOCOperand ILOCOperand_reg (long reg)
+{
+    ILOCOperand operand = { .type = OPERAND_REG, .value = reg, .name = NULL };
+    return operand;
+}
+
+ILOCOperand ILOCOperand_int (long value)
+{
+    ILOCOperand operand = { .type = OPERAND_INT, .value = value, .name = NULL };
+    return operand;
+}
+
+ILOCOperand ILOCOperand_label (const char* name)
+{
+    ILOCOperand operand = { .type = OPERAND_LABEL, .value = 0, .name = strdup(name) };
+    CHECK_MALLOC_PTR(operand.name)
+    return operand;
+}
+
+ILOCOperand ILOCOperand_str (const char* text)
+{
+    ILOCOperand operand = { .type = OPERAND_STR, .value = 0, .name = strdup(text) };
+    CHECK_MALLOC_PTR(operand.name)
+    return operand;
+}
+
+ILOCInsn* ILOCInsn_new (ILOCOpcode opcode, ILOCOperand op1, ILOCOperand op2, ILOCOperand op3)
+{
+    ILOCInsn* insn = (ILOCInsn*)calloc(1, sizeof(ILOCInsn));
+    CHECK_MALLOC_PTR(insn)
+    insn->opcode = opcode;
+    insn->operands[0] = op1;
+    insn->operands[1] = op2;
+    insn->operands[2] = op3;
+    insn->source_line = 0;
+    insn->next = NULL;
+    return insn;
+}
+
+ILOCInsn* ILOCInsn_copy (ILOCInsn* insn)
+{
+    ILOCInsn* copy = ILOCInsn_new(insn->opcode, insn->operands[0], insn->operands[1], insn->operands[2]);
+    for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+        if (insn->operands[i].name != NULL) {
+            copy->operands[i].name = strdup(insn->operands[i].name);
+            CHECK_MALLOC_PTR(copy->operands[i].name)
+        }
+    }
+    copy->source_line = insn->source_line;
+    return copy;
+}
+
+void ILOCInsn_free (ILOCInsn* insn)
+{
+    for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+        free(insn->operands[i].name);
+    }
+    free(insn);
+}
+
+/*
+ * A register in the pattern is read unless it comes after the arrow and
+ * outside of brackets (a memory destination only reads its address).
+ */
+
+int ILOCInsn_sources (ILOCInsn* insn, long* regs)
+{
+    int count = 0;
+    int operand = 0;
+    bool after_arrow = false;
+    bool in_brackets = false;
+    for (const char* p = ILOCInsn_format(insn); *p != '\0'; p++) {
+        switch (*p) {
+            case '=': after_arrow = true; break;
+            case '[': in_brackets = true; break;
+            case ']': in_brackets = false; break;
+            case 'r':
+                if ((!after_arrow || in_brackets) && count < ILOC_MAX_OPERANDS) {
+                    regs[count++] = insn->operands[operand].value;
+                }
+                operand++;
+                break;
+            case 'c': case 'l': case 's':
+                operand++;
+                break;
+            default: break;
+        }
+    }
+    switch (insn->opcode) {
+        case ILOC_PUSH: case ILOC_POP: case ILOC_CALL: case ILOC_RETURN:
+            if (count < ILOC_MAX_OPERANDS) {
+                regs[count++] = ILOC_SP;
+            }
+            break;
+        default: break;
+    }
+    return count;
+}
+
+bool ILOCInsn_destination (ILOCInsn* insn, long* reg)
+{
+    int operand = 0;
+    bool after_arrow = false;
+    bool in_brackets = false;
+    for (const char* p = ILOCInsn_format(insn); *p != '\0'; p++) {
+        switch (*p) {
+            case '=': after_arrow = true; break;
+            case '[': in_brackets = true; break;
+            case ']': in_brackets = false; break;
+            case 'r':
+                if (after_arrow && !in_brackets) {
+                    *reg = insn->operands[operand].value;
+                    return true;
+                }
+                operand++;
+                break;
+            case 'c': case 'l': case 's':
+                operand++;
+                break;
+            default: break;
+        }
+    }
+    return false;
+}
+
+static void print_reg (long reg, FILE* output)
+{
+    switch (reg) {
+        case ILOC_BP:  fputs("bp", output); break;
+        case ILOC_SP:  fputs("sp", output); break;
+        case ILOC_RET: fputs("ret", output); break;
+        default:       fprintf(output, "r%ld", reg); break;
+    }
+}
+
+void ILOCInsn_print (ILOCInsn* insn, FILE* output)
+{
+    if (insn->opcode == ILOC_LABEL) {
+        fprintf(output, "%s:", insn->operands[0].name);
+        return;
+    }
+    fputs(formats[insn->opcode].mnemonic, output);
+    const char* pattern = ILOCInsn_format(insn);
+    if (*pattern != '\0') {
+        fputc(' ', output);
+    }
+    int operand = 0;
+    for (const char* p = pattern; *p != '\0'; p++) {
+        ILOCOperand* op = &insn->operands[operand];
+        switch (*p) {
+            case 'r': print_reg(op->value, output); operand++; break;
+            case 'c': fprintf(output, "%ld", op->value); operand++; break;
+            case 'l': fputs(op->name, output); operand++; break;
+            case 's':
+                fputc('"', output);
+                print_escaped_string(op->name, output);
+                fputc('"', output);
+                operand++;
+                break;
+            case ',': fputs(", ", output); break;
+            case '=': fputs(p == pattern ? "=> " : " => ", output); break;
+            case '+':
+                /* the sign of the following constant */
+                fputc(p[1] == 'c' && op->value < 0 ? '-' : '+', output);
+                if (p[1] == 'c' && op->value < 0) {
+                    fprintf(output, "%ld", -op->value);
+                    operand++;
+                    p++;
+                }
+                break;
+            default: fputc(*p, output); break;
+        }
+    }
+}
+
+void ILOCInsnList_print (ILOCInsnList* list, FILE* output)
+{
+    FOR_EACH (ILOCInsn*, insn, list) {
+        if (insn->opcode != ILOC_LABEL) {
+            fputs("    ", output);
+        }
+        ILOCInsn_print(insn, output);
+        fputc('\n', output);
+    }
+}
+
+
+/*
+ * PARSING
+ */
+
+/**
+ * @brief Parser state (one line at a time)
+ */
+typedef struct ILOCParser
+{
+    const char* p;          /**< @brief Current position */
+    int line;               /**< @brief Current line number */
+    ILOCInsnList* list;     /**< @brief Instructions so far (freed on error) */
+} ILOCParser;
+
+/**
+ * @brief Free everything parsed so far and throw an error for the current line
+ */
+static void ILOCParser_fail (ILOCParser* parser, const char* message, const char* detail)
+{
+    char buffer[MAX_ERROR_LEN];
+    snprintf(buffer, sizeof(buffer), "Invalid ILOC on line %d: %s%s\n",
+             parser->line, message, detail);     /* before detail is freed */
+    ILOCInsnList_free(parser->list);
+    parser->list = NULL;
+    Error_throw_printf("%s", buffer);
+}
+
+static void skip_blanks (ILOCParser* parser)
+{
+    while (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\r') {
+        parser->p++;
+    }
+}
+
+/**
+ * @brief Whether the rest of the line is blank (or a comment)
+ */
+static bool at_end_of_line (ILOCParser* parser)
+{
+    skip_blanks(parser);
+    const char* p = parser->p;
+    return (*p == '\0' || *p == '\n' || *p == '#' || (p[0] == '/' && p[1] == '/'));
+}
+
+static bool is_name_start (char c)
+{
+    return isalpha((unsigned char)c) || c == '_' || c == '.';
+}
+
+static bool is_name_char (char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+/**
+ * @brief Read a name (mnemonic, register or label) into a buffer
+ *
+ * @returns Length of the name (0 if there is none here)
+ */
+static size_t read_name (ILOCParser* parser, char* buffer, size_t capacity)
+{
+    skip_blanks(parser);
+    size_t length = 0;
+    if (!is_name_start(*parser->p)) {
+        return 0;
+    }
+    while (is_name_char(*parser->p)) {
+        if (length + 1 < capacity) {
+            buffer[length++] = *parser->p;
+        }
+        parser->p++;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Expect a punctuation character (or "=>" for '=')
+ */
+static void expect (ILOCParser* parser, char c)
+{
+    skip_blanks(parser);
+    if (c == '=' && parser->p[0] == '=' && parser->p[1] == '>') {
+        parser->p += 2;
+    } else if (c != '=' && *parser->p == c) {
+        parser->p++;
+    } else {
+        char what[8];
+        snprintf(what, sizeof(what), "'%s'", (c == '=' ? "=>" : (char[]){ c, '\0' }));
+        ILOCParser_fail(parser, "expected ", what);
+    }
+}
+
+static ILOCOperand parse_reg (ILOCParser* parser)
+{
+    char name[MAX_ID_LEN+1];
+    read_name(parser, name, sizeof(name));
+    if (strcmp(name, "bp") == 0) {
+        return ILOCOperand_reg(ILOC_BP);
+    } else if (strcmp(name, "sp") == 0) {
+        return ILOCOperand_reg(ILOC_SP);
+    } else if (strcmp(name, "ret") == 0) {
+        return ILOCOperand_reg(ILOC_RET);
+    }
+    char* end;
+    long reg = (name[0] == 'r' ? strtol(name + 1, &end, 10) : -1);
+    if (name[0] != 'r' || !isdigit((unsigned char)name[1]) || *end != '\0' || reg > INT32_MAX) {
+        ILOCParser_fail(parser, "expected a register", "");
+    }
+    return ILOCOperand_reg(reg);
+}
+
+static ILOCOperand parse_int (ILOCParser* parser, bool negate)
+{
+    skip_blanks(parser);
+    char* end;
+    long value = strtol(parser->p, &end, 0);
+    if (end == parser->p || is_name_char(*end)) {
+        ILOCParser_fail(parser, "expected an integer constant", "");
+    }
+    parser->p = end;
+    return ILOCOperand_int(negate ? -value : value);
+}
+
+static ILOCOperand parse_label (ILOCParser* parser)
+{
+    char name[MAX_ID_LEN+1];
+    if (read_name(parser, name, sizeof(name)) == 0) {
+        ILOCParser_fail(parser, "expected a label", "");
+    }
+    return ILOCOperand_label(name);
+}
+
+static ILOCOperand parse_str (ILOCParser* parser)
+{
+    skip_blanks(parser);
+    if (*parser->p != '"') {
+        ILOCParser_fail(parser, "expected a register or string", "");
+    }
+    const char* start = ++parser->p;
+    char* text = (char*)malloc(strcspn(start, "\n") + 1);
+    CHECK_MALLOC_PTR(text)
+    size_t length = 0;
+    while (*parser->p != '"') {
+        char c = *parser->p;
+        if (c == '\0' || c == '\n') {
+            free(text);
+            ILOCParser_fail(parser, "unterminated string", "");
+        }
+        if (c == '\\' && parser->p[1] != '\0' && parser->p[1] != '\n') {
+            c = *++parser->p;
+            c = (c == 'n' ? '\n' : (c == 't' ? '\t' : c));
+        }
+        text[length++] = c;
+        parser->p++;
+    }
+    parser->p++;
+    text[length] = '\0';
+    ILOCOperand operand = { .type = OPERAND_STR, .value = 0, .name = text };
+    return operand;
+}
+
+/**
+ * @brief Parse the operands of an instruction according to its pattern
+ */
+static void parse_operands (ILOCParser* parser, ILOCInsn* insn, const char* pattern)
+{
+    int operand = 0;
+    bool negate = false;
+    for (const char* p = pattern; *p != '\0'; p++) {
+        switch (*p) {
+            case 'r': insn->operands[operand++] = parse_reg(parser); break;
+            case 'c': insn->operands[operand++] = parse_int(parser, negate); break;
+            case 'l': insn->operands[operand++] = parse_label(parser); break;
+            case 's': insn->operands[operand++] = parse_str(parser); break;
+            case '+':
+                skip_blanks(parser);
+                negate = (*parser->p == '-' && p[1] == 'c');
+                expect(parser, negate ? '-' : '+');
+                break;
+            default: expect(parser, *p); break;
+        }
+    }
+}
+
+/**
+ * @brief Parse one instruction (after its mnemonic) and add it to the list
+ */
+static void parse_instruction (ILOCParser* parser, const char* mnemonic)
+{
+    ILOCOpcode opcode = NUM_ILOC_OPCODES;
+    for (int op = 0; op < NUM_ILOC_OPCODES; op++) {
+        if (op != ILOC_LABEL && strcmp(formats[op].mnemonic, mnemonic) == 0) {
+            opcode = (ILOCOpcode)op;
+        }
+    }
+    if (opcode == NUM_ILOC_OPCODES) {
+        ILOCParser_fail(parser, "unknown opcode ", mnemonic);
+    }
+
+    /* add the instruction first so that it is freed if its operands are bad */
+    ILOCOperand none = { .type = OPERAND_NONE };
+    ILOCInsn* insn = ILOCInsn_new(opcode, none, none, none);
+    insn->source_line = parser->line;
+    ILOCInsnList_add(parser->list, insn);
+    skip_blanks(parser);
+    bool string = (opcode == ILOC_PRINT && *parser->p == '"');
+    parse_operands(parser, insn, (string ? "s" : formats[opcode].pattern));
+    if (!at_end_of_line(parser)) {
+        ILOCParser_fail(parser, "unexpected text after ", mnemonic);
+    }
+}
+
+static int compare_labels (const void* a, const void* b)
+{
+    return strcmp((*(ILOCInsn* const*)a)->operands[0].name, (*(ILOCInsn* const*)b)->operands[0].name);
+}
+
+/**
+ * @brief Check that labels are defined once and that every jump target is
+ * defined
+ */
+static void check_labels (ILOCParser* parser)
+{
+    /* sorted table of label definitions */
+    size_t count = 0;
+    FOR_EACH (ILOCInsn*, insn, parser->list) {
+        count += (insn->opcode == ILOC_LABEL);
+    }
+    ILOCInsn** labels = (ILOCInsn**)malloc((count + 1) * sizeof(ILOCInsn*));
+    CHECK_MALLOC_PTR(labels)
+    count = 0;
+    FOR_EACH (ILOCInsn*, insn, parser->list) {
+        if (insn->opcode == ILOC_LABEL) {
+            labels[count++] = insn;
+        }
+    }
+    qsort(labels, count, sizeof(ILOCInsn*), compare_labels);
+
+    const char* error = NULL;
+    ILOCInsn* culprit = NULL;
+    const char* name = NULL;
+    for (size_t i = 1; i < count && error == NULL; i++) {
+        if (compare_labels(&labels[i-1], &labels[i]) == 0) {
+            culprit = (labels[i-1]->source_line > labels[i]->source_line ? labels[i-1] : labels[i]);
+            name = culprit->operands[0].name;
+            error = "duplicate label ";
+        }
+    }
+    FOR_EACH (ILOCInsn*, insn, parser->list) {
+        if (error != NULL) {
+            break;
+        }
+        for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+            if (insn->operands[i].type != OPERAND_LABEL ||
+                    (insn->opcode != ILOC_JUMP && insn->opcode != ILOC_CBR)) {
+                continue;
+            }
+            ILOCInsn key = { .operands = { insn->operands[i] } };
+            ILOCInsn* target = &key;
+            if (bsearch(&target, labels, count, sizeof(ILOCInsn*), compare_labels) == NULL) {
+                culprit = insn;
+                name = insn->operands[i].name;
+                error = "undefined label ";
+                break;
+            }
+        }
+    }
+    free(labels);
+    if (error != NULL) {
+        parser->line = culprit->source_line;
+        ILOCParser_fail(parser, error, name);
+    }
+}
+
+ILOCInsnList* ILOCInsnList_parse (const char* text)
+{
+    ILOCParser parser = { .p = text, .line = 1, .list = ILOCInsnList_new() };
+    while (*parser.p != '\0') {
+        char name[MAX_ID_LEN+1];
+        if (!at_end_of_line(&parser)) {
+            if (read_name(&parser, name, sizeof(name)) == 0) {
+                ILOCParser_fail(&parser, "expected an opcode or label", "");
+            }
+            skip_blanks(&parser);
+            if (*parser.p == ':') {
+                /* label (possibly followed by an instruction) */
+                parser.p++;
+                ILOCOperand none = { .type = OPERAND_NONE };
+                ILOCInsn* label = ILOCInsn_new(ILOC_LABEL, ILOCOperand_label(name), none, none);
+                label->source_line = parser.line;
+                ILOCInsnList_add(parser.list, label);
+                if (!at_end_of_line(&parser)) {
+                    if (read_name(&parser, name, sizeof(name)) == 0) {
+                        ILOCParser_fail(&parser, "expected an opcode", "");
+                    }
+                    parse_instruction(&parser, name);
+                }
+            } else {
+                parse_instruction(&parser, name);
+            }
+        }
+
+        /* skip any comment and move to the next line */
+        while (*parser.p != '\0' && *parser.p != '\n') {
+            parser.p++;
+        }
+        if (*parser.p == '\n') {
+            parser.p++;
+            parser.line++;
+        }
+    }
+    check_labels(&parser);
+    return parser.list;
+}
@@ -0,0 +1,490 @@
+/**
+ * @file ilocsim.c
+ * @brief ILOC simulator with instruction and cycle counting
+ */
+
+#include "ilocsim.h"
+
+/**
+ * @brief Bytes per word (and per stack slot)
+ */
+#define WORD_SIZE 8
+
+/**
+ * @brief Return address that ends the run (pushed by the initial call of main)
+ */
+#define HALT_ADDRESS (-1)
+
+/**
+ * @brief Number of special registers (stored below the virtual registers)
+ */
+#define NUM_SPECIAL_REGS 3
+
+void ILOCMachineConfig_init (ILOCMachineConfig* config)
+{
+    config->memory_size = 1024 * 1024;
+    config->static_base = ILOC_STATIC_BASE;
+    for (int op = 0; op < NUM_ILOC_OPCODES; op++) {
+        config->latencies[op] = 1;
+    }
+    config->latencies[ILOC_LABEL] = 0;
+    config->latencies[ILOC_MULT] = config->latencies[ILOC_MULT_I] = 2;
+    config->latencies[ILOC_DIV] = 4;
+    config->latencies[ILOC_LOAD] = config->latencies[ILOC_LOAD_AI] = config->latencies[ILOC_LOAD_AO] = 3;
+    config->latencies[ILOC_STORE] = config->latencies[ILOC_STORE_AI] = config->latencies[ILOC_STORE_AO] = 3;
+    config->latencies[ILOC_PUSH] = config->latencies[ILOC_POP] = 3;
+    config->latencies[ILOC_CALL] = config->latencies[ILOC_RETURN] = 2;
+    config->pipelined = true;
+    config->cache_lines = 0;
+    config->cache_line_size = 64;
+    config->miss_penalty = 20;
+    config->max_instructions = 1000000000L;
+}
+
+/**
+ * @brief Instruction decoded for execution
+ *
+ * Registers are indices into the register file (special registers first) and
+ * labels are indices into the decoded code.
+ */
+typedef struct Decoded
+{
+    ILOCOpcode opcode;      /**< @brief Operation (never @c ILOC_LABEL) */
+    int src1;               /**< @brief First register read (or -1) */
+    int src2;               /**< @brief Second register read (or -1) */
+    int src3;               /**< @brief Third register read (or -1) */
+    int dest;               /**< @brief Register written (or -1) */
+    long imm;               /**< @brief Constant operand */
+    int target;             /**< @brief Jump target (or taken branch target) */
+    int other;              /**< @brief Branch target when not taken */
+    const char* text;       /**< @brief String for @c print (owned by the program) */
+    int source_line;        /**< @brief Line in the ILOC text */
+} Decoded;
+
+/**
+ * @brief Simulator state
+ */
+typedef struct Machine
+{
+    const ILOCMachineConfig* config;    /**< @brief Machine description */
+    Decoded* code;                      /**< @brief Decoded program */
+    int ncode;                          /**< @brief Number of decoded instructions */
+    long* regs;                         /**< @brief Register file */
+    long* ready;                        /**< @brief Cycle at which each register is ready */
+    int nregs;                          /**< @brief Size of the register file */
+    unsigned char* memory;              /**< @brief Main memory */
+    long* tags;                         /**< @brief Cache tags (-1 for an empty line) */
+    int line_bits;                      /**< @brief log2 of the cache line size */
+} Machine;
+
+static void Machine_free (Machine* machine)
+{
+    free(machine->code);
+    free(machine->regs);
+    free(machine->ready);
+    free(machine->memory);
+    free(machine->tags);
+}
+
+/**
+ * @brief Free the machine and throw an error (@c printf syntax)
+ */
+static void Machine_fail (Machine* machine, const char* format, ...)
+{
+    char buffer[MAX_ERROR_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);    /* before any names are freed */
+    va_end(args);
+    Machine_free(machine);
+    Error_throw_printf("%s", buffer);
+}
+
+static int reg_index (long reg)
+{
+    return (int)(reg + NUM_SPECIAL_REGS);
+}
+
+/*
+ * LOADING
+ */
+
+static int compare_names (const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+ * @brief Label name and the index of the instruction after it
+ */
+typedef struct LabelEntry
+{
+    const char* name;
+    int index;
+} LabelEntry;
+
+static int find_label (LabelEntry* labels, int nlabels, const char* name)
+{
+    LabelEntry key = { name, 0 };
+    LabelEntry* found = (LabelEntry*)bsearch(&key, labels, nlabels, sizeof(LabelEntry), compare_names);
+    return (found != NULL ? found->index : -1);
+}
+
+/**
+ * @brief Decode a program and allocate the machine
+ */
+static void Machine_load (Machine* machine, ILOCInsnList* program)
+{
+    /* count instructions and labels, and find the highest register */
+    int ninsns = 0, nlabels = 0;
+    long max_reg = -1;
+    FOR_EACH (ILOCInsn*, insn, program) {
+        if (insn->opcode == ILOC_LABEL) {
+            nlabels++;
+            continue;
+        }
+        ninsns++;
+        for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+            if (insn->operands[i].type == OPERAND_REG && insn->operands[i].value > max_reg) {
+                max_reg = insn->operands[i].value;
+            }
+        }
+    }
+    machine->ncode = ninsns;
+    machine->code = (Decoded*)calloc(ninsns + 1, sizeof(Decoded));
+    CHECK_MALLOC_PTR(machine->code)
+    machine->nregs = (int)max_reg + 1 + NUM_SPECIAL_REGS;
+    machine->regs = (long*)calloc(machine->nregs, sizeof(long));
+    CHECK_MALLOC_PTR(machine->regs)
+    machine->ready = (long*)calloc(machine->nregs, sizeof(long));
+    CHECK_MALLOC_PTR(machine->ready)
+
+    /* label table (sorted by name) */
+    LabelEntry* labels = (LabelEntry*)malloc((nlabels + 1) * sizeof(LabelEntry));
+    CHECK_MALLOC_PTR(labels)
+    int index = 0;
+    nlabels = 0;
+    FOR_EACH (ILOCInsn*, insn, program) {
+        if (insn->opcode == ILOC_LABEL) {
+            labels[nlabels].name = insn->operands[0].name;
+            labels[nlabels++].index = index;
+        } else {
+            index++;
+        }
+    }
+    qsort(labels, nlabels, sizeof(LabelEntry), compare_names);
+
+    /* decode */
+    Decoded* d = machine->code;
+    FOR_EACH (ILOCInsn*, insn, program) {
+        if (insn->opcode == ILOC_LABEL) {
+            continue;
+        }
+        long srcs[ILOC_MAX_OPERANDS], dest;
+        int nsrcs = ILOCInsn_sources(insn, srcs);
+        d->opcode = insn->opcode;
+        d->src1 = (nsrcs > 0 ? reg_index(srcs[0]) : -1);
+        d->src2 = (nsrcs > 1 ? reg_index(srcs[1]) : -1);
+        d->src3 = (nsrcs > 2 ? reg_index(srcs[2]) : -1);
+        d->dest = (ILOCInsn_destination(insn, &dest) ? reg_index(dest) : -1);
+        d->target = d->other = -1;
+        d->source_line = insn->source_line;
+        for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+            ILOCOperand* op = &insn->operands[i];
+            if (op->type == OPERAND_INT) {
+                d->imm = op->value;
+            } else if (op->type == OPERAND_STR) {
+                d->text = op->name;
+            } else if (op->type == OPERAND_LABEL) {
+                int target = find_label(labels, nlabels, op->name);
+                if (target < 0) {
+                    free(labels);
+                    Machine_fail(machine, "ILOC error on line %d: undefined %s '%s'\n", insn->source_line,
+                                 (insn->opcode == ILOC_CALL ? "function" : "label"), op->name);
+                }
+                if (d->target < 0) {
+                    d->target = target;
+                } else {
+                    d->other = target;
+                }
+            }
+        }
+        d++;
+    }
+
+    /* the program starts with a call to main */
+    int main_index = find_label(labels, nlabels, "main");
+    free(labels);
+    if (main_index < 0) {
+        Machine_fail(machine, "ILOC error: no main function\n");
+    }
+    machine->code[ninsns].target = main_index;
+}
+
+/*
+ * EXECUTION
+ */
+
+/**
+ * @brief Check a word address and charge any cache miss
+ *
+ * @returns Extra cycles for the access
+ */
+static inline int Machine_access (Machine* machine, Decoded* d, long address, ILOCStats* stats)
+{
+    const ILOCMachineConfig* config = machine->config;
+    if (address < config->static_base || address > (long)config->memory_size - WORD_SIZE) {
+        Machine_fail(machine, "ILOC error on line %d: memory access out of bounds at address %ld\n",
+                     d->source_line, address);
+    }
+    if ((address & (WORD_SIZE - 1)) != 0) {
+        Machine_fail(machine, "ILOC error on line %d: unaligned memory access at address %ld\n",
+                     d->source_line, address);
+    }
+    if (machine->tags == NULL) {
+        return 0;
+    }
+    long line = address >> machine->line_bits;
+    long* tag = &machine->tags[line % config->cache_lines];
+    if (*tag == line) {
+        return 0;
+    }
+    *tag = line;
+    stats->cache_misses++;
+    return config->miss_penalty;
+}
+
+static inline long load_word (Machine* machine, long address)
+{
+    long value;
+    memcpy(&value, machine->memory + address, sizeof(value));
+    return value;
+}
+
+static inline void store_word (Machine* machine, long address, long value)
+{
+    memcpy(machine->memory + address, &value, sizeof(value));
+}
+
+/**
+ * @brief Arithmetic with two's complement wraparound to 32 bits, like Decaf's
+ * @c int (no undefined behavior)
+ */
+#define WRAP(A, OP, B) ((long)(int32_t)(uint32_t)((unsigned long)(A) OP (unsigned long)(B)))
+
+/**
+ * @brief Address arithmetic (not wrapped, so that a wild address is caught)
+ */
+#define ADDRESS(A, B) ((long)((unsigned long)(A) + (unsigned long)(B)))
+
+static long run (Machine* machine, FILE* output, ILOCStats* stats)
+{
+    const ILOCMachineConfig* config = machine->config;
+    long* r = machine->regs;
+    long* ready = machine->ready;
+    Decoded* code = machine->code;
+    const int SP = reg_index(ILOC_SP), BP = reg_index(ILOC_BP), RET = reg_index(ILOC_RET);
+    long lowest_sp = (long)config->memory_size;
+    long limit = (config->max_instructions > 0 ? config->max_instructions : -1);
+
+    /* call main */
+    r[SP] = r[BP] = (long)config->memory_size - WORD_SIZE;
+    store_word(machine, r[SP], HALT_ADDRESS);
+    int pc = code[machine->ncode].target;
+    long clock = 0;         /* cycle at which the next instruction can issue */
+    long finish = 0;        /* cycle at which every result is ready */
+
+    while (pc >= 0 && pc < machine->ncode) {
+        Decoded* d = &code[pc];
+        if (stats->instructions == limit) {
+            Machine_fail(machine, "ILOC error on line %d: more than %ld instructions executed\n",
+                         d->source_line, limit);
+        }
+        stats->instructions++;
+        stats->counts[d->opcode]++;
+        int latency = config->latencies[d->opcode];
+        int next = pc + 1;
+        long a = (d->src1 >= 0 ? r[d->src1] : 0);
+        long b = (d->src2 >= 0 ? r[d->src2] : 0);
+        long address;
+
+        switch (d->opcode) {
+            case ILOC_NOP:      break;
+            case ILOC_ADD:      r[d->dest] = WRAP(a, +, b); break;
+            case ILOC_SUB:      r[d->dest] = WRAP(a, -, b); break;
+            case ILOC_MULT:     r[d->dest] = WRAP(a, *, b); break;
+            case ILOC_DIV:
+                if (b == 0) {
+                    Machine_fail(machine, "ILOC error on line %d: division by zero\n", d->source_line);
+                }
+                r[d->dest] = (b == -1 ? WRAP(0, -, a) : a / b);
+                break;
+            case ILOC_AND:      r[d->dest] = a & b; break;
+            case ILOC_OR:       r[d->dest] = a | b; break;
+            case ILOC_ADD_I:    r[d->dest] = WRAP(a, +, d->imm); break;
+            case ILOC_SUB_I:    r[d->dest] = WRAP(a, -, d->imm); break;
+            case ILOC_MULT_I:   r[d->dest] = WRAP(a, *, d->imm); break;
+            case ILOC_NOT:      r[d->dest] = (a == 0); break;
+            case ILOC_NEG:      r[d->dest] = WRAP(0, -, a); break;
+            case ILOC_I2I:      r[d->dest] = a; break;
+            case ILOC_CMP_LT:   r[d->dest] = (a < b); break;
+            case ILOC_CMP_LE:   r[d->dest] = (a <= b); break;
+            case ILOC_CMP_EQ:   r[d->dest] = (a == b); break;
+            case ILOC_CMP_GE:   r[d->dest] = (a >= b); break;
+            case ILOC_CMP_GT:   r[d->dest] = (a > b); break;
+            case ILOC_CMP_NE:   r[d->dest] = (a != b); break;
+            case ILOC_LOAD_I:   r[d->dest] = WRAP(d->imm, +, 0); break;
+
+            case ILOC_LOAD: case ILOC_LOAD_AI: case ILOC_LOAD_AO:
+                address = (d->opcode == ILOC_LOAD ? a : ADDRESS(a, (d->opcode == ILOC_LOAD_AI ? d->imm : b)));
+                latency += Machine_access(machine, d, address, stats);
+                r[d->dest] = load_word(machine, address);
+                stats->loads++;
+                break;
+            case ILOC_STORE: case ILOC_STORE_AI: case ILOC_STORE_AO:
+                address = (d->opcode == ILOC_STORE ? b :
+                           ADDRESS(b, (d->opcode == ILOC_STORE_AI ? d->imm : r[d->src3])));
+                latency += Machine_access(machine, d, address, stats);
+                store_word(machine, address, a);
+                stats->stores++;
+                break;
+            case ILOC_PUSH: case ILOC_CALL:
+                address = r[SP] - WORD_SIZE;
+                latency += Machine_access(machine, d, address, stats);
+                store_word(machine, address, (d->opcode == ILOC_PUSH ? a : pc + 1));
+                r[SP] = address;
+                lowest_sp = (address < lowest_sp ? address : lowest_sp);
+                stats->stores++;
+                if (d->opcode == ILOC_CALL) {
+                    next = d->target;
+                }
+                break;
+            case ILOC_POP: case ILOC_RETURN:
+                address = r[SP];
+                latency += Machine_access(machine, d, address, stats);
+                r[SP] = address + WORD_SIZE;
+                stats->loads++;
+                if (d->opcode == ILOC_POP) {
+                    r[d->dest] = load_word(machine, address);
+                } else {
+                    long target = load_word(machine, address);
+                    if (target != HALT_ADDRESS && (target <= 0 || target > machine->ncode)) {
+                        Machine_fail(machine, "ILOC error on line %d: bad return address %ld\n",
+                                     d->source_line, target);
+                    }
+                    next = (int)target;
+                }
+                break;
+
+            case ILOC_JUMP:     next = d->target; break;
+            case ILOC_CBR:      next = (a != 0 ? d->target : d->other); break;
+            case ILOC_PRINT:
+                if (d->text != NULL) {
+                    fputs(d->text, output);
+                } else {
+                    fprintf(output, "%ld", a);
+                }
+                break;
+            default: break;
+        }
+
+        /* timing */
+        if (config->pipelined) {
+            long issue = clock;
+            if (d->src1 >= 0 && ready[d->src1] > issue) issue = ready[d->src1];
+            if (d->src2 >= 0 && ready[d->src2] > issue) issue = ready[d->src2];
+            if (d->src3 >= 0 && ready[d->src3] > issue) issue = ready[d->src3];
+            long done = issue + latency;
+            if (d->dest >= 0) {
+                ready[d->dest] = done;
+            }
+            switch (d->opcode) {
+                case ILOC_PUSH: case ILOC_POP: case ILOC_CALL: case ILOC_RETURN:
+                    ready[SP] = issue + 1;      /* the address is known right away */
+                    /* fall through */
+                case ILOC_JUMP: case ILOC_CBR:
+                    clock = (d->opcode == ILOC_PUSH || d->opcode == ILOC_POP ? issue + 1 : done);
+                    break;
+                default:
+                    clock = issue + 1;
+                    break;
+            }
+            finish = (done > finish ? done : finish);
+        } else {
+            clock += latency;
+            finish = clock;
+        }
+        pc = next;
+    }
+
+    stats->cycles = (clock > finish ? clock : finish);
+    stats->max_stack = (long)config->memory_size - lowest_sp;
+    stats->result = r[RET];
+    return r[RET];
+}
+
+long ILOCMachine_run (ILOCInsnList* program, const ILOCMachineConfig* config,
+                      FILE* output, ILOCStats* stats)
+{
+    ILOCMachineConfig defaults;
+    if (config == NULL) {
+        ILOCMachineConfig_init(&defaults);
+        config = &defaults;
+    }
+    ILOCStats local;
+    stats = (stats != NULL ? stats : &local);
+    memset(stats, 0, sizeof(ILOCStats));
+
+    if (config->memory_size > INT32_MAX) {
+        Error_throw_printf("ILOC error: memory size %zu is too large (at most %d bytes)\n",
+                           config->memory_size, INT32_MAX);
+    }
+    Machine machine = { .config = config };
+    Machine_load(&machine, program);
+    machine.memory = (unsigned char*)calloc(config->memory_size, 1);
+    CHECK_MALLOC_PTR(machine.memory)
+    if (config->cache_lines > 0) {
+        machine.tags = (long*)malloc(config->cache_lines * sizeof(long));
+        CHECK_MALLOC_PTR(machine.tags)
+        for (int i = 0; i < config->cache_lines; i++) {
+            machine.tags[i] = -1;
+        }
+        while ((1 << machine.line_bits) < config->cache_line_size) {
+            machine.line_bits++;
+        }
+    }
+
+    long result = run(&machine, output, stats);
+    Machine_free(&machine);
+    return result;
+}
+
+void ILOCStats_print (ILOCStats* stats, FILE* output)
+{
+    fprintf(output, "instructions: %ld\n", stats->instructions);
+    fprintf(output, "cycles: %ld (%.2f instructions per cycle)\n", stats->cycles,
+            (stats->cycles > 0 ? (double)stats->instructions / stats->cycles : 0.0));
+    fprintf(output, "loads: %ld  stores: %ld  cache misses: %ld\n",
+            stats->loads, stats->stores, stats->cache_misses);
+    fprintf(output, "max stack: %ld bytes\n", stats->max_stack);
+    fprintf(output, "result: %ld\n", stats->result);
+
+    /* histogram, most frequent first (insertion sort: there are few opcodes) */
+    int order[NUM_ILOC_OPCODES];
+    int n = 0;
+    for (int op = 0; op < NUM_ILOC_OPCODES; op++) {
+        if (stats->counts[op] > 0) {
+            int i = n++;
+            while (i > 0 && stats->counts[order[i-1]] < stats->counts[op]) {
+                order[i] = order[i-1];
+                i--;
+            }
+            order[i] = op;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        long count = stats->counts[order[i]];
+        fprintf(output, "  %-8s %12ld  %5.1f%%\n", ILOCOpcode_to_string(order[i]), count,
+                100.0 * count / (stats->instructions > 0 ? stats->instructions : 1));
+    }
+}
@@ -0,0 +1,619 @@
+/**
+ * @file interp.c
+ * @brief AST interpreter with memoization of pure function calls
+ */
+
+#include "interp.h"
+
+void InterpConfig_init (InterpConfig* config)
+{
+    config->memoize = false;
+    config->max_memo_entries = 1000000;
+    config->max_depth = 10000;
+    config->max_steps = 1000000000L;
+}
+
+/**
+ * @brief Variable in scope
+ */
+typedef struct Variable
+{
+    const char* name;   /**< @brief Variable name (owned by the AST) */
+    long index;         /**< @brief First value (index into the value stack) */
+    long length;        /**< @brief Array length (0 for a scalar) */
+} Variable;
+
+/**
+ * @brief Function of the program
+ */
+typedef struct Function
+{
+    ASTNode* decl;      /**< @brief Declaration */
+    int nparams;        /**< @brief Number of parameters */
+    bool memoize;       /**< @brief Results are cached */
+} Function;
+
+/**
+ * @brief Cached result of a call
+ */
+typedef struct MemoEntry
+{
+    int func;           /**< @brief Function index plus one (0 for an empty slot) */
+    unsigned long hash; /**< @brief Hash of the function and arguments */
+    long key;           /**< @brief First argument (index into @c memo_keys) */
+    long value;         /**< @brief Result */
+} MemoEntry;
+
+/**
+ * @brief Interpreter state
+ */
+typedef struct Interp
+{
+    const InterpConfig* config;     /**< @brief Options */
+    FILE* output;                   /**< @brief Stream for prints */
+    InterpStats* stats;             /**< @brief Counts */
+    int line;                       /**< @brief Source line being run (for errors) */
+
+    Function* funcs;                /**< @brief Functions of the program */
+    int nfuncs;                     /**< @brief Number of functions */
+
+    long* values;                   /**< @brief Value stack: globals, then each call's parameters and locals */
+    long nvalues;                   /**< @brief Values in use */
+    long value_capacity;            /**< @brief Allocated values */
+
+    Variable* vars;                 /**< @brief Scopes: globals, then the current call's (innermost last) */
+    int nvars;                      /**< @brief Variables in scope */
+    int var_capacity;               /**< @brief Allocated variables */
+    int nglobals;                   /**< @brief Global variables (at the start of @c vars) */
+    int frame;                      /**< @brief First variable of the current call */
+
+    int depth;                      /**< @brief Nested calls */
+    int loops;                      /**< @brief Enclosing loops in the current call */
+    long return_value;              /**< @brief Value of the last @c return */
+
+    MemoEntry* memo;                /**< @brief Cache (open addressing) */
+    long memo_capacity;             /**< @brief Slots in the cache (a power of two) */
+    long memo_count;                /**< @brief Results in the cache */
+    long* memo_keys;                /**< @brief Arguments of the cached calls */
+    long nmemo_keys;                /**< @brief Arguments stored */
+    long memo_key_capacity;         /**< @brief Allocated arguments */
+} Interp;
+
+/**
+ * @brief Outcome of running a statement
+ */
+typedef enum ExecStatus {
+    EXEC_NEXT, EXEC_BREAK, EXEC_CONTINUE, EXEC_RETURN
+} ExecStatus;
+
+static void Interp_free (Interp* in)
+{
+    free(in->funcs);
+    free(in->values);
+    free(in->vars);
+    free(in->memo);
+    free(in->memo_keys);
+}
+
+/**
+ * @brief Free the interpreter and throw an error (@c printf syntax)
+ */
+static void Interp_fail (Interp* in, const char* format, ...)
+{
+    char buffer[MAX_ERROR_LEN];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);    /* before any names are freed */
+    va_end(args);
+    Interp_free(in);
+    Error_throw_printf("%s", buffer);
+}
+
+static void step (Interp* in, ASTNode* node)
+{
+    in->line = node->source_line;
+    if (++in->stats->steps > in->config->max_steps && in->config->max_steps > 0) {
+        Interp_fail(in, "Runtime error on line %d: more than %ld steps\n",
+                    in->line, in->config->max_steps);
+    }
+}
+
+static int find_function (Interp* in, const char* name)
+{
+    for (int i = 0; i < in->nfuncs; i++) {
+        if (strcmp(in->funcs[i].decl->funcdecl.name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * VARIABLES
+ */
+
+static long push_value (Interp* in, long value)
+{
+    if (in->nvalues == in->value_capacity) {
+        in->value_capacity = (in->value_capacity == 0 ? 256 : in->value_capacity * 2);
+        in->values = (long*)realloc(in->values, sizeof(long) * in->value_capacity);
+        CHECK_MALLOC_PTR(in->values)
+    }
+    in->values[in->nvalues] = value;
+    return in->nvalues++;
+}
+
+static void add_variable (Interp* in, const char* name, long index, long length)
+{
+    if (in->nvars == in->var_capacity) {
+        in->var_capacity = (in->var_capacity == 0 ? 32 : in->var_capacity * 2);
+        in->vars = (Variable*)realloc(in->vars, sizeof(Variable) * in->var_capacity);
+        CHECK_MALLOC_PTR(in->vars)
+    }
+    Variable var = { .name = name, .index = index, .length = length };
+    in->vars[in->nvars++] = var;
+}
+
+/**
+ * @brief Declare variables with fresh (zeroed) storage
+ */
+static void add_locals (Interp* in, NodeList* variables)
+{
+    FOR_EACH (ASTNode*, decl, variables) {
+        long length = (decl->vardecl.is_array ? decl->vardecl.array_length : 0);
+        long index = push_value(in, 0);
+        for (long i = 1; i < length; i++) {
+            push_value(in, 0);
+        }
+        add_variable(in, decl->vardecl.name, index, length);
+    }
+}
+
+static Variable* lookup (Interp* in, const char* name)
+{
+    for (int i = in->nvars - 1; i >= in->frame; i--) {
+        if (strcmp(in->vars[i].name, name) == 0) {
+            return &in->vars[i];
+        }
+    }
+    for (int i = in->nglobals - 1; i >= 0; i--) {
+        if (strcmp(in->vars[i].name, name) == 0) {
+            return &in->vars[i];
+        }
+    }
+    Interp_fail(in, "Runtime error on line %d: undefined variable '%s'\n", in->line, name);
+    return NULL;
+}
+
+static long eval (Interp* in, ASTNode* node);
+
+/**
+ * @brief Find the value a location refers to (evaluating its index first)
+ *
+ * @returns Index into the value stack
+ */
+static long locate (Interp* in, ASTNode* location)
+{
+    long index = 0;
+    if (location->location.index != NULL) {
+        index = eval(in, location->location.index);
+        in->line = location->source_line;
+    }
+    Variable* var = lookup(in, location->location.name);
+    if ((location->location.index != NULL) != (var->length > 0)) {
+        Interp_fail(in, "Runtime error on line %d: '%s' %s an array\n", in->line,
+                    var->name, (var->length > 0 ? "is" : "is not"));
+    }
+    if (index < 0 || (var->length > 0 && index >= var->length)) {
+        Interp_fail(in, "Runtime error on line %d: index %ld out of bounds for '%s'\n",
+                    in->line, index, var->name);
+    }
+    return var->index + index;
+}
+
+
+/*
+ * MEMOIZATION
+ */
+
+static unsigned long memo_hash (int func, const long* args, int nargs)
+{
+    unsigned long hash = (unsigned long)func * 0x9E3779B97F4A7C15UL;
+    for (int i = 0; i < nargs; i++) {
+        hash = (hash ^ (unsigned long)args[i]) * 0x9E3779B97F4A7C15UL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+/**
+ * @brief Find the cache slot for a call (the empty slot where it would go if
+ * it is not cached)
+ */
+static MemoEntry* memo_slot (Interp* in, int func, unsigned long hash, const long* args, int nargs)
+{
+    long mask = in->memo_capacity - 1;
+    for (long i = (long)(hash & (unsigned long)mask); ; i = (i + 1) & mask) {
+        MemoEntry* entry = &in->memo[i];
+        if (entry->func == 0 || (entry->func == func + 1 && entry->hash == hash &&
+                memcmp(in->memo_keys + entry->key, args, sizeof(long) * nargs) == 0)) {
+            return entry;
+        }
+    }
+}
+
+static void memo_grow (Interp* in)
+{
+    MemoEntry* old = in->memo;
+    long old_capacity = in->memo_capacity;
+    in->memo_capacity = (old_capacity == 0 ? 1024 : old_capacity * 2);
+    in->memo = (MemoEntry*)calloc(in->memo_capacity, sizeof(MemoEntry));
+    CHECK_MALLOC_PTR(in->memo)
+    long mask = in->memo_capacity - 1;
+    for (long i = 0; i < old_capacity; i++) {
+        if (old[i].func != 0) {
+            long j = (long)(old[i].hash & (unsigned long)mask);
+            while (in->memo[j].func != 0) {
+                j = (j + 1) & mask;
+            }
+            in->memo[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+/**
+ * @brief Look up a call in the cache
+ *
+ * @returns True (and the result in @c value) if it was there
+ */
+static bool memo_find (Interp* in, int func, unsigned long hash, const long* args, int nargs, long* value)
+{
+    in->stats->memo_lookups++;
+    if (in->memo_count == 0) {
+        return false;
+    }
+    MemoEntry* entry = memo_slot(in, func, hash, args, nargs);
+    if (entry->func == 0) {
+        return false;
+    }
+    in->stats->memo_hits++;
+    *value = entry->value;
+    return true;
+}
+
+/**
+ * @brief Copy the arguments of a call that is about to run, to be cached
+ * with its result
+ *
+ * @returns Index of the copy in @c memo_keys
+ */
+static long memo_save_key (Interp* in, const long* args, int nargs)
+{
+    if (in->nmemo_keys + nargs > in->memo_key_capacity) {
+        in->memo_key_capacity = (in->memo_key_capacity + nargs) * 2;
+        in->memo_keys = (long*)realloc(in->memo_keys, sizeof(long) * in->memo_key_capacity);
+        CHECK_MALLOC_PTR(in->memo_keys)
+    }
+    memcpy(in->memo_keys + in->nmemo_keys, args, sizeof(long) * nargs);
+    in->nmemo_keys += nargs;
+    return in->nmemo_keys - nargs;
+}
+
+/**
+ * @brief Cache the result of a call (unless the cache is full)
+ */
+static void memo_add (Interp* in, int func, unsigned long hash, long key, int nargs, long value)
+{
+    if (in->memo_count >= in->config->max_memo_entries && in->config->max_memo_entries > 0) {
+        return;
+    }
+    if (2 * (in->memo_count + 1) > in->memo_capacity) {
+        memo_grow(in);
+    }
+    MemoEntry* entry = memo_slot(in, func, hash, in->memo_keys + key, nargs);
+    entry->func = func + 1;
+    entry->hash = hash;
+    entry->key = key;
+    entry->value = value;
+    in->memo_count++;
+}
+
+/*
+ * CALLS
+ */
+
+static ExecStatus exec (Interp* in, ASTNode* node);
+
+static long print (Interp* in, ASTNode* node)
+{
+    ASTNode* arg = node->funccall.arguments->head;
+    if (arg == NULL) {
+        return 0;
+    }
+    if (arg->type == LITERAL && arg->literal.type == STR) {
+        fputs(arg->literal.string, in->output);
+        return 0;
+    }
+    long value = eval(in, arg);
+    if (strcmp(node->funccall.name, "print_bool") == 0) {
+        fputs(value ? "true" : "false", in->output);
+    } else {
+        fprintf(in->output, "%ld", value);
+    }
+    return 0;
+}
+
+/**
+ * @brief Run a function whose arguments are on top of the value stack
+ * (starting at @c base), then pop them
+ *
+ * @returns Value returned (0 if none)
+ */
+static long run_function (Interp* in, int func, long base)
+{
+    Function* fn = &in->funcs[func];
+    unsigned long hash = 0;
+    long key = -1;
+    long result;
+    if (fn->memoize) {
+        const long* args = in->values + base;
+        hash = memo_hash(func, args, fn->nparams);
+        if (memo_find(in, func, hash, args, fn->nparams, &result)) {
+            in->nvalues = base;
+            return result;
+        }
+        if (in->memo_count < in->config->max_memo_entries || in->config->max_memo_entries <= 0) {
+            key = memo_save_key(in, args, fn->nparams);     /* the parameters may change */
+        }
+    }
+
+    if (in->depth >= in->config->max_depth) {
+        Interp_fail(in, "Runtime error on line %d: more than %d nested calls\n",
+                    in->line, in->config->max_depth);
+    }
+    in->depth++;
+    in->stats->calls++;
+    if (in->depth > in->stats->max_depth) {
+        in->stats->max_depth = in->depth;
+    }
+
+    int outer_vars = in->nvars;
+    int outer_frame = in->frame;
+    int outer_loops = in->loops;
+    in->frame = in->nvars;
+    in->loops = 0;
+    long index = base;
+    FOR_EACH (Parameter*, param, fn->decl->funcdecl.parameters) {
+        add_variable(in, param->name, index++, 0);
+    }
+    result = (exec(in, fn->decl->funcdecl.body) == EXEC_RETURN ? in->return_value : 0);
+    in->nvars = outer_vars;
+    in->frame = outer_frame;
+    in->loops = outer_loops;
+    in->depth--;
+    in->nvalues = base;
+
+    if (key >= 0) {
+        memo_add(in, func, hash, key, fn->nparams, result);
+    }
+    return result;
+}
+
+static long call (Interp* in, ASTNode* node)
+{
+    const char* name = node->funccall.name;
+    if (strcmp(name, "print_int") == 0 || strcmp(name, "print_bool") == 0 ||
+            strcmp(name, "print_str") == 0) {
+        return print(in, node);
+    }
+    int func = find_function(in, name);
+    if (func < 0) {
+        Interp_fail(in, "Runtime error on line %d: undefined function '%s'\n", in->line, name);
+    }
+
+    long base = in->nvalues;
+    FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
+        long value = eval(in, arg);
+        push_value(in, value);
+    }
+    in->line = node->source_line;
+    if (in->nvalues - base != in->funcs[func].nparams) {
+        Interp_fail(in, "Runtime error on line %d: wrong number of arguments to '%s'\n",
+                    in->line, name);
+    }
+    return run_function(in, func, base);
+}
+
+
+/*
+ * EXPRESSIONS AND STATEMENTS
+ */
+
+/**
+ * @brief Arithmetic with wraparound to 32 bits, like Decaf's @c int (and the
+ * ILOC simulator)
+ */
+#define WRAP(A, OP, B) ((long)(int32_t)(uint32_t)((unsigned long)(A) OP (unsigned long)(B)))
+
+static long binaryop (Interp* in, ASTNode* node)
+{
+    long a = eval(in, node->binaryop.left);
+    long b = eval(in, node->binaryop.right);
+    in->line = node->source_line;
+    switch (node->binaryop.operator) {
+        case OROP:  return a | b;
+        case ANDOP: return a & b;
+        case EQOP:  return a == b;
+        case NEQOP: return a != b;
+        case LTOP:  return a < b;
+        case LEOP:  return a <= b;
+        case GEOP:  return a >= b;
+        case GTOP:  return a > b;
+        case ADDOP: return WRAP(a, +, b);
+        case SUBOP: return WRAP(a, -, b);
+        case MULOP: return WRAP(a, *, b);
+        case DIVOP:
+        case MODOP: {
+            if (b == 0) {
+                Interp_fail(in, "Runtime error on line %d: division by zero\n", in->line);
+            }
+            long quotient = (b == -1 ? WRAP(0, -, a) : a / b);
+            return (node->binaryop.operator == DIVOP ? quotient : WRAP(a, -, WRAP(quotient, *, b)));
+        }
+    }
+    return 0;
+}
+
+static long eval (Interp* in, ASTNode* node)
+{
+    step(in, node);
+    switch (node->type) {
+        case LITERAL:
+            return (node->literal.type == BOOL ? node->literal.boolean :
+                    node->literal.type == INT ? node->literal.integer : 0);
+        case LOCATION:
+            return in->values[locate(in, node)];
+        case BINARYOP:
+            return binaryop(in, node);
+        case UNARYOP: {
+            long child = eval(in, node->unaryop.child);
+            return (node->unaryop.operator == NEGOP ? WRAP(0, -, child) : child == 0);
+        }
+        case FUNCCALL:
+            return call(in, node);
+        default:
+            return 0;
+    }
+}
+
+static ExecStatus exec_block (Interp* in, ASTNode* block)
+{
+    int outer_vars = in->nvars;
+    long outer_values = in->nvalues;
+    add_locals(in, block->block.variables);
+    ExecStatus status = EXEC_NEXT;
+    FOR_EACH (ASTNode*, stmt, block->block.statements) {
+        status = exec(in, stmt);
+        if (status != EXEC_NEXT) {
+            break;
+        }
+    }
+    in->nvars = outer_vars;
+    in->nvalues = outer_values;
+    return status;
+}
+
+static ExecStatus exec (Interp* in, ASTNode* node)
+{
+    step(in, node);
+    switch (node->type) {
+        case BLOCK:
+            return exec_block(in, node);
+        case ASSIGNMENT: {
+            long value = eval(in, node->assignment.value);
+            in->line = node->source_line;
+            in->values[locate(in, node->assignment.location)] = value;
+            return EXEC_NEXT;
+        }
+        case FUNCCALL:
+            call(in, node);
+            return EXEC_NEXT;
+        case CONDITIONAL:
+            if (eval(in, node->conditional.condition)) {
+                return exec_block(in, node->conditional.if_block);
+            } else if (node->conditional.else_block != NULL) {
+                return exec_block(in, node->conditional.else_block);
+            }
+            return EXEC_NEXT;
+        case WHILELOOP:
+            in->loops++;
+            while (eval(in, node->whileloop.condition)) {
+                ExecStatus status = exec_block(in, node->whileloop.body);
+                if (status == EXEC_BREAK) {
+                    break;
+                } else if (status == EXEC_RETURN) {
+                    in->loops--;
+                    return status;
+                }
+            }
+            in->loops--;
+            return EXEC_NEXT;
+        case RETURNSTMT:
+            in->return_value = (node->funcreturn.value != NULL ? eval(in, node->funcreturn.value) : 0);
+            return EXEC_RETURN;
+        case BREAKSTMT:
+            return (in->loops > 0 ? EXEC_BREAK : EXEC_NEXT);
+        case CONTINUESTMT:
+            return (in->loops > 0 ? EXEC_CONTINUE : EXEC_NEXT);
+        default:
+            return EXEC_NEXT;
+    }
+}
+
+long Interp_run (ASTNode* tree, const InterpConfig* config, FILE* output, InterpStats* stats)
+{
+    InterpConfig default_config;
+    if (config == NULL) {
+        InterpConfig_init(&default_config);
+        config = &default_config;
+    }
+    InterpStats local_stats;
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(InterpStats));
+    PurityStats purity;
+    Purity_analyze(tree, &purity);
+    stats->functions = purity.functions;
+    stats->pure = purity.pure;
+
+    Interp in;
+    memset(&in, 0, sizeof(Interp));
+    in.config = config;
+    in.output = output;
+    in.stats = stats;
+    in.line = tree->source_line;
+
+    in.funcs = (Function*)calloc(tree->program.functions->size + 1, sizeof(Function));
+    CHECK_MALLOC_PTR(in.funcs)
+    FOR_EACH (ASTNode*, func, tree->program.functions) {
+        Function* fn = &in.funcs[in.nfuncs++];
+        fn->decl = func;
+        fn->memoize = config->memoize && Purity_is_pure(func);
+        FOR_EACH (Parameter*, param, func->funcdecl.parameters) {
+            fn->nparams++;
+            if (param->type != INT && param->type != BOOL) {
+                fn->memoize = false;
+            }
+        }
+    }
+    add_locals(&in, tree->program.variables);
+    in.nglobals = in.nvars;
+    in.frame = in.nvars;
+
+    int main_func = find_function(&in, "main");
+    if (main_func < 0) {
+        Interp_fail(&in, "Runtime error: no main function\n");
+    }
+    if (in.funcs[main_func].nparams != 0) {
+        Interp_fail(&in, "Runtime error: main must not take parameters\n");
+    }
+    stats->result = run_function(&in, main_func, in.nvalues);
+    stats->memo_entries = in.memo_count;
+    Interp_free(&in);
+    return stats->result;
+}
+
+void InterpStats_print (InterpStats* stats, FILE* output)
+{
+    fprintf(output, "steps: %ld\n", stats->steps);
+    fprintf(output, "calls: %ld (max depth %d)\n", stats->calls, stats->max_depth);
+    fprintf(output, "pure functions: %d of %d\n", stats->pure, stats->functions);
+    fprintf(output, "memo lookups: %ld  hits: %ld (%.1f%%)  entries: %ld\n",
+            stats->memo_lookups, stats->memo_hits,
+            100.0 * stats->memo_hits / (stats->memo_lookups > 0 ? stats->memo_lookups : 1),
+            stats->memo_entries);
+    fprintf(output, "result: %ld\n", stats->result);
+}
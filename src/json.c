@@ -0,0 +1,396 @@
+/**
+ * @file json.c
+ * @brief Minimal JSON reader and writer helpers
+ */
+
+#include "json.h"
+
+/**
+ * @brief Maximum nesting depth of arrays and objects
+ */
+#define MAX_JSON_DEPTH 64
+
+/**
+ * @brief Parser state
+ */
+typedef struct JsonReader
+{
+    const char* p;      /**< @brief Next character */
+    const char* end;    /**< @brief End of the text */
+    int depth;          /**< @brief Current nesting depth */
+} JsonReader;
+
+static bool parse_value (JsonReader* reader, JsonValue* value);
+
+static void skip_space (JsonReader* reader)
+{
+    while (reader->p < reader->end &&
+            (*reader->p == ' ' || *reader->p == '\t' || *reader->p == '\n' || *reader->p == '\r')) {
+        reader->p++;
+    }
+}
+
+static bool consume (JsonReader* reader, const char* word)
+{
+    size_t length = strlen(word);
+    if ((size_t)(reader->end - reader->p) < length || strncmp(reader->p, word, length) != 0) {
+        return false;
+    }
+    reader->p += length;
+    return true;
+}
+
+static int hex_digit (char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4 (JsonReader* reader, unsigned* code)
+{
+    if (reader->end - reader->p < 4) {
+        return false;
+    }
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_digit(*reader->p++);
+        if (digit < 0) {
+            return false;
+        }
+        *code = *code * 16 + digit;
+    }
+    return true;
+}
+
+static int encode_utf8 (unsigned code, char* out)
+{
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    } else if (code < 0x800) {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    } else if (code < 0x10000) {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief Parse a string (the opening quote has not been consumed yet)
+ *
+ * Escapes never make a string longer, so the result is allocated with the
+ * size of the raw text up to the closing quote.
+ */
+static bool parse_string (JsonReader* reader, char** result, int* length)
+{
+    reader->p++;
+    const char* close = reader->p;
+    while (close < reader->end && *close != '"') {
+        close += (*close == '\\' ? 2 : 1);
+    }
+    if (close >= reader->end) {
+        return false;
+    }
+    char* text = (char*)malloc(close - reader->p + 1);
+    CHECK_MALLOC_PTR(text)
+    char* out = text;
+    while (reader->p < close) {
+        char c = *reader->p++;
+        if ((unsigned char)c < 0x20) {
+            free(text);
+            return false;
+        }
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        c = *reader->p++;
+        switch (c) {
+            case '"': case '\\': case '/': *out++ = c; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned code;
+                if (!read_hex4(reader, &code)) {
+                    free(text);
+                    return false;
+                }
+                /* combine a surrogate pair into one code point */
+                unsigned low;
+                if (code >= 0xD800 && code < 0xDC00 && close - reader->p >= 6 &&
+                        reader->p[0] == '\\' && reader->p[1] == 'u') {
+                    reader->p += 2;
+                    if (!read_hex4(reader, &low) || low < 0xDC00 || low >= 0xE000) {
+                        free(text);
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                out += encode_utf8(code, out);
+                break;
+            }
+            default:
+                free(text);
+                return false;
+        }
+    }
+    reader->p = close + 1;
+    *out = '\0';
+    *result = text;
+    *length = (int)(out - text);
+    return true;
+}
+
+static bool parse_number (JsonReader* reader, JsonValue* value)
+{
+    /* copy the number so that strtod cannot read past the end of the text */
+    char digits[64];
+    int n = 0;
+    while (reader->p < reader->end && n < (int)sizeof(digits) - 1 &&
+            strchr("+-0123456789.eE", *reader->p) != NULL) {
+        digits[n++] = *reader->p++;
+    }
+    digits[n] = '\0';
+    char* end;
+    value->number = strtod(digits, &end);
+    value->type = JSON_NUMBER;
+    return n > 0 && *end == '\0';
+}
+
+/**
+ * @brief Append an empty element to an array or object
+ */
+static JsonValue* add_item (JsonValue* value, int* capacity)
+{
+    if (value->size == *capacity) {
+        *capacity = (*capacity == 0 ? 4 : *capacity * 2);
+        value->items = (JsonValue*)realloc(value->items, *capacity * sizeof(JsonValue));
+        CHECK_MALLOC_PTR(value->items)
+        if (value->type == JSON_OBJECT) {
+            value->keys = (char**)realloc(value->keys, *capacity * sizeof(char*));
+            CHECK_MALLOC_PTR(value->keys)
+        }
+    }
+    JsonValue* item = &value->items[value->size];
+    memset(item, 0, sizeof(JsonValue));
+    return item;
+}
+
+static bool parse_members (JsonReader* reader, JsonValue* value, char close)
+{
+    int capacity = 0;
+    reader->p++;
+    skip_space(reader);
+    if (reader->p < reader->end && *reader->p == close) {
+        reader->p++;
+        return true;
+    }
+    while (true) {
+        JsonValue* item = add_item(value, &capacity);
+        if (value->type == JSON_OBJECT) {
+            int length;
+            skip_space(reader);
+            if (reader->p >= reader->end || *reader->p != '"' ||
+                    !parse_string(reader, &value->keys[value->size], &length)) {
+                return false;
+            }
+            value->size++;      /* the key is owned by the object from here on */
+            skip_space(reader);
+            if (!consume(reader, ":")) {
+                return false;
+            }
+        } else {
+            value->size++;
+        }
+        if (!parse_value(reader, item)) {
+            return false;
+        }
+        skip_space(reader);
+        if (consume(reader, ",")) {
+            continue;
+        }
+        if (reader->p < reader->end && *reader->p == close) {
+            reader->p++;
+            return true;
+        }
+        return false;
+    }
+}
+
+static bool parse_value (JsonReader* reader, JsonValue* value)
+{
+    skip_space(reader);
+    if (reader->p >= reader->end) {
+        return false;
+    }
+    switch (*reader->p) {
+        case 'n':
+            value->type = JSON_NULL;
+            return consume(reader, "null");
+        case 't':
+            value->type = JSON_BOOL;
+            value->boolean = true;
+            return consume(reader, "true");
+        case 'f':
+            value->type = JSON_BOOL;
+            return consume(reader, "false");
+        case '"':
+            value->type = JSON_STRING;
+            return parse_string(reader, &value->string, &value->length);
+        case '[':
+        case '{': {
+            if (reader->depth == MAX_JSON_DEPTH) {
+                return false;
+            }
+            value->type = (*reader->p == '[' ? JSON_ARRAY : JSON_OBJECT);
+            reader->depth++;
+            bool ok = parse_members(reader, value, (value->type == JSON_ARRAY ? ']' : '}'));
+            reader->depth--;
+            return ok;
+        }
+        default:
+            return parse_number(reader, value);
+    }
+}
+
+/**
+ * @brief Deallocate everything in a value (but not the value itself)
+ */
+static void free_contents (JsonValue* value)
+{
+    for (int i = 0; i < value->size; i++) {
+        free_contents(&value->items[i]);
+        if (value->type == JSON_OBJECT) {
+            free(value->keys[i]);
+        }
+    }
+    free(value->items);
+    free(value->keys);
+    free(value->string);
+}
+
+JsonValue* Json_parse (const char* text, size_t length)
+{
+    JsonReader reader = { text, text + length, 0 };
+    JsonValue* value = (JsonValue*)calloc(1, sizeof(JsonValue));
+    CHECK_MALLOC_PTR(value)
+    bool ok = parse_value(&reader, value);
+    skip_space(&reader);
+    if (!ok || reader.p != reader.end) {
+        Json_free(value);
+        return NULL;
+    }
+    return value;
+}
+
+JsonValue* JsonValue_get (JsonValue* value, const char* key)
+{
+    if (value == NULL || value->type != JSON_OBJECT) {
+        return NULL;
+    }
+    for (int i = 0; i < value->size; i++) {
+        if (strcmp(value->keys[i], key) == 0) {
+            return &value->items[i];
+        }
+    }
+    return NULL;
+}
+
+JsonValue* JsonValue_at (JsonValue* value, int i)
+{
+    if (value == NULL || value->type != JSON_ARRAY || i < 0 || i >= value->size) {
+        return NULL;
+    }
+    return &value->items[i];
+}
+
+const char* JsonValue_string (JsonValue* value)
+{
+    return (value != NULL && value->type == JSON_STRING ? value->string : NULL);
+}
+
+int JsonValue_int (JsonValue* value, int fallback)
+{
+    return (value != NULL && value->type == JSON_NUMBER ? (int)value->number : fallback);
+}
+
+void Json_print_string (FILE* output, const char* text, size_t length)
+{
+    Writer writer;
+    Writer_init(&writer, output);
+    Writer_json_string(&writer, text, length);
+    Writer_flush(&writer);
+}
+
+static void write_value (Writer* writer, JsonValue* value)
+{
+    switch (value->type) {
+        case JSON_NULL:
+            Writer_literal(writer, "null");
+            break;
+        case JSON_BOOL:
+            if (value->boolean) {
+                Writer_literal(writer, "true");
+            } else {
+                Writer_literal(writer, "false");
+            }
+            break;
+        case JSON_NUMBER:
+            if (value->number > -1e15 && value->number < 1e15 &&
+                    value->number == (double)(long long)value->number) {
+                Writer_int(writer, (long long)value->number);
+            } else {
+                char digits[32];
+                Writer_write(writer, digits, snprintf(digits, sizeof(digits), "%.17g", value->number));
+            }
+            break;
+        case JSON_STRING:
+            Writer_json_string(writer, value->string, value->length);
+            break;
+        case JSON_ARRAY:
+        case JSON_OBJECT:
+            Writer_putc(writer, value->type == JSON_ARRAY ? '[' : '{');
+            for (int i = 0; i < value->size; i++) {
+                if (i > 0) {
+                    Writer_putc(writer, ',');
+                }
+                if (value->type == JSON_OBJECT) {
+                    Writer_json_string(writer, value->keys[i], strlen(value->keys[i]));
+                    Writer_putc(writer, ':');
+                }
+                write_value(writer, &value->items[i]);
+            }
+            Writer_putc(writer, value->type == JSON_ARRAY ? ']' : '}');
+            break;
+    }
+}
+
+void Json_print (FILE* output, JsonValue* value)
+{
+    Writer writer;
+    Writer_init(&writer, output);
+    write_value(&writer, value);
+    Writer_flush(&writer);
+}
+
+void Json_free (JsonValue* value)
+{
+    if (value != NULL) {
+        free_contents(value);
+        free(value);
+    }
+}
@@ -0,0 +1,22 @@
+/**
+ * @file libdecaf-error.c
+ * @brief Exception delivery for library builds
+ *
+ * The compiler and test drivers each define @ref Error_throw_printf with a
+ * fallback @c jmp_buf of their own. The library has no such global: every
+ * entry point installs an @ref ErrorTrap before calling into the front end,
+ * so errors are always delivered to one of those.
+ */
+
+#include "common.h"
+
+void Error_throw_printf (const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    ErrorTrap_throw_va(format, args);   /* only returns if no trap is installed */
+    va_end(args);
+
+    /* a library entry point forgot to install a trap */
+    abort();
+}
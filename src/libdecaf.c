@@ -0,0 +1,283 @@
+/**
+ * @file libdecaf.c
+ * @brief Embeddable front end library (libdecaf)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "decaf.h"
+#include "p1-lexer.h"
+#include "p2-parser.h"
+#include "visitor.h"
+#include "emit.h"
+
+/**
+ * @brief Library context
+ */
+struct DecafContext
+{
+    char error[MAX_ERROR_LEN];  /**< @brief Most recent error message */
+    int error_offset;           /**< @brief Most recent error offset (or -1) */
+};
+
+/**
+ * @brief Parsed program
+ */
+struct DecafTree
+{
+    ASTNode* root;
+};
+
+DecafContext* DecafContext_new (void)
+{
+    DecafContext* context = (DecafContext*)calloc(1, sizeof(DecafContext));
+    if (context != NULL) {
+        context->error_offset = -1;
+    }
+    return context;
+}
+
+const char* DecafContext_error (DecafContext* context)
+{
+    return (context != NULL ? context->error : "");
+}
+
+int DecafContext_error_offset (DecafContext* context)
+{
+    return (context != NULL ? context->error_offset : -1);
+}
+
+static DecafStatus fail (DecafContext* context, DecafStatus status, const char* message, int offset)
+{
+    snprintf(context->error, MAX_ERROR_LEN, "%s", message);
+    context->error_offset = offset;
+    return status;
+}
+
+static DecafStatus invalid_argument (DecafContext* context)
+{
+    if (context == NULL) {
+        return DECAF_INVALID_ARGUMENT;
+    }
+    return fail(context, DECAF_INVALID_ARGUMENT, "Invalid argument\n", -1);
+}
+
+/**
+ * @brief Lex (and, if @p tree is not @c NULL, parse) a source buffer
+ *
+ * Everything that can throw runs under a trap, so errors turn into status
+ * codes instead of escaping from the library.
+ */
+static DecafStatus run_front_end (DecafContext* context, const char* text, size_t length,
+                                  TokenQueue** tokens, ASTNode** tree)
+{
+    if (context == NULL || (text == NULL && length > 0) || length > INT32_MAX) {
+        return invalid_argument(context);
+    }
+    context->error[0] = '\0';
+    context->error_offset = -1;
+
+    /* the lexer expects a NUL-terminated string */
+    char* source = (char*)malloc(length + 1);
+    if (source == NULL) {
+        return fail(context, DECAF_OUT_OF_MEMORY, "Out of memory!\n", -1);
+    }
+    memcpy(source, text, length);
+    source[length] = '\0';
+
+    TokenQueue* volatile lexed = NULL;
+    DecafStatus status = DECAF_OK;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        lexed = lex(source);
+        TokenQueue_locate(lexed, source, 0);
+        if (tree != NULL) {
+            *tree = parse(lexed);
+        }
+    } else {
+        int offset = -1;
+        status = DECAF_LEX_ERROR;
+        if (lexed != NULL) {
+            Token* next = TokenQueue_peek(lexed);
+            offset = (next != NULL ? next->offset : (int)length);
+            status = DECAF_PARSE_ERROR;
+        } else {
+            Regex_explain_error(trap.message);
+        }
+        if (trap.out_of_memory) {
+            status = DECAF_OUT_OF_MEMORY;
+        }
+        fail(context, status, trap.message, offset);
+    }
+    ErrorTrap_pop(&trap);
+
+    free(source);
+    if (status == DECAF_OK && tokens != NULL) {
+        *tokens = lexed;
+    } else if (lexed != NULL) {
+        TokenQueue_free(lexed);
+    }
+    return status;
+}
+
+DecafStatus DecafContext_lex (DecafContext* context, const char* text, size_t length,
+                              DecafTokenCallback callback, void* data)
+{
+    TokenQueue* tokens = NULL;
+    DecafStatus status = run_front_end(context, text, length, &tokens, NULL);
+    if (status != DECAF_OK) {
+        return status;
+    }
+    if (callback != NULL) {
+        for (Token* t = tokens->head; t != NULL; t = t->next) {
+            DecafToken token = { TokenKind_to_string(t->kind), t->text, t->line, t->offset };
+            callback(&token, data);
+        }
+    }
+    TokenQueue_free(tokens);
+    return DECAF_OK;
+}
+
+DecafStatus DecafContext_parse (DecafContext* context, const char* text, size_t length,
+                                DecafTree** tree)
+{
+    if (tree == NULL) {
+        return invalid_argument(context);
+    }
+    *tree = NULL;
+    DecafTree* result = (DecafTree*)calloc(1, sizeof(DecafTree));
+    if (result == NULL) {
+        return (context != NULL ? fail(context, DECAF_OUT_OF_MEMORY, "Out of memory!\n", -1)
+                                : DECAF_OUT_OF_MEMORY);
+    }
+    DecafStatus status = run_front_end(context, text, length, NULL, &result->root);
+    if (status != DECAF_OK) {
+        free(result);
+        return status;
+    }
+    *tree = result;
+    return DECAF_OK;
+}
+
+/**
+ * @brief Traversal state for @ref DecafTree_traverse
+ */
+typedef struct TreeWalk
+{
+    DecafNodeCallback callback;
+    void* data;
+    int depth;              /**< @brief Depth of the node being visited */
+    int skip_depth;         /**< @brief Report no nodes deeper than this (or -1) */
+} TreeWalk;
+
+static const char* node_name (ASTNode* node)
+{
+    switch (node->type) {
+        case VARDECL:   return node->vardecl.name;
+        case FUNCDECL:  return node->funcdecl.name;
+        case LOCATION:  return node->location.name;
+        case FUNCCALL:  return node->funccall.name;
+        default:        return NULL;
+    }
+}
+
+static void enter_node (TreeWalk* walk, ASTNode* node)
+{
+    if (walk->skip_depth < 0) {
+        DecafNode info = { NodeType_to_string(node->type), node_name(node),
+                           walk->depth, node->source_line, node->source_offset };
+        if (walk->callback(&info, walk->data) != 0) {
+            walk->skip_depth = walk->depth;
+        }
+    }
+    walk->depth++;
+}
+
+static void exit_node (TreeWalk* walk, ASTNode* node)
+{
+    walk->depth--;
+    if (walk->skip_depth == walk->depth) {
+        walk->skip_depth = -1;
+    }
+}
+
+#define STATIC_VISITOR_TRAVERSE         walk_tree
+#define STATIC_VISITOR_STATE            TreeWalk*
+#define STATIC_PREVISIT_default         enter_node
+#define STATIC_POSTVISIT_default        exit_node
+#include "static-visitor.h"
+
+DecafStatus DecafTree_traverse (DecafTree* tree, DecafNodeCallback callback, void* data)
+{
+    if (tree == NULL || callback == NULL) {
+        return DECAF_INVALID_ARGUMENT;
+    }
+    TreeWalk walk = { callback, data, 0, -1 };
+    walk_tree(&walk, tree->root);
+    return DECAF_OK;
+}
+
+DecafStatus DecafTree_serialize (DecafTree* tree, DecafFormat format, char** output, size_t* length)
+{
+    if (tree == NULL || output == NULL) {
+        return DECAF_INVALID_ARGUMENT;
+    }
+    size_t size = 0;
+    *output = NULL;
+    FILE* stream = open_memstream(output, &size);
+    if (stream == NULL) {
+        return DECAF_OUT_OF_MEMORY;
+    }
+
+    DecafStatus status = DECAF_OK;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        if (format == DECAF_FORMAT_DOT) {
+            GenerateASTGraph_traverse(stream, tree->root, NULL);
+        } else if (format == DECAF_FORMAT_JSON) {
+            JsonVisitor_traverse(stream, tree->root);
+        } else if (format == DECAF_FORMAT_SEXP) {
+            SExprVisitor_traverse(stream, tree->root);
+        } else {
+            SetParentVisitor_traverse(tree->root);
+            CalcDepthVisitor_traverse(tree->root);
+            PrintVisitor_traverse(stream, tree->root);
+        }
+    } else {
+        status = DECAF_OUT_OF_MEMORY;
+    }
+    ErrorTrap_pop(&trap);
+
+    if (fclose(stream) != 0) {
+        status = DECAF_OUT_OF_MEMORY;
+    }
+    if (status != DECAF_OK) {
+        free(*output);
+        *output = NULL;
+        size = 0;
+    }
+    if (length != NULL) {
+        *length = size;
+    }
+    return status;
+}
+
+void DecafTree_free (DecafTree* tree)
+{
+    if (tree != NULL) {
+        ASTNode_free(tree->root);
+        free(tree);
+    }
+}
+
+void Decaf_free (void* buffer)
+{
+    free(buffer);
+}
+
+void DecafContext_free (DecafContext* context)
+{
+    free(context);
+}
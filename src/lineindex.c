@@ -0,0 +1,95 @@
+/**
+ * @file lineindex.c
+ * @brief Line/column lookups for byte offsets in a source file
+ */
+
+#include "lineindex.h"
+
+LineIndex* LineIndex_new (const char* text)
+{
+    LineIndex* index = (LineIndex*)calloc(1, sizeof(LineIndex));
+    CHECK_MALLOC_PTR(index)
+    index->length = (int)strlen(text);
+
+    int capacity = 64;
+    index->starts = (int*)malloc(capacity * sizeof(int));
+    CHECK_MALLOC_PTR(index->starts)
+    index->starts[index->count++] = 0;
+
+    const char* end = text + index->length;
+    const char* p = text;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        if (index->count == capacity) {
+            capacity *= 2;
+            index->starts = (int*)realloc(index->starts, capacity * sizeof(int));
+            CHECK_MALLOC_PTR(index->starts)
+        }
+        index->starts[index->count++] = (int)(p - text);
+    }
+    return index;
+}
+
+int LineIndex_line (LineIndex* index, int offset)
+{
+    /* find the last line that starts at or before the offset */
+    int lo = 0;
+    int hi = index->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (index->starts[mid] <= offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo + 1;
+}
+
+int LineIndex_column (LineIndex* index, int offset)
+{
+    return offset - index->starts[LineIndex_line(index, offset) - 1] + 1;
+}
+
+void LineIndex_print_caret (LineIndex* index, const char* text, int offset, FILE* output)
+{
+    if (offset > index->length) {
+        offset = index->length;
+    }
+    int line = LineIndex_line(index, offset);
+    const char* start = text + index->starts[line - 1];
+    const char* eol = strchr(start, '\n');
+    int width = (eol != NULL ? (int)(eol - start) : (int)strlen(start));
+    if (width > 0 && start[width - 1] == '\r') {
+        width--;
+    }
+
+    fprintf(output, "%5d | %.*s\n", line, width, start);
+    fprintf(output, "      | ");
+    for (const char* p = start; p < text + offset; p++) {
+        fputc(*p == '\t' ? '\t' : ' ', output);
+    }
+    fprintf(output, "^\n");
+}
+
+void LineIndex_print_error_location (const char* text, TokenQueue* tokens, FILE* output)
+{
+    int offset = (int)strlen(text);
+    if (!TokenQueue_is_empty(tokens)) {
+        offset = TokenQueue_peek(tokens)->offset;
+    } else if (offset > 0 && text[offset-1] == '\n') {
+        offset--;   /* point at the end of the last line, not past it */
+    }
+    if (offset < 0) {
+        return;
+    }
+    LineIndex* index = LineIndex_new(text);
+    LineIndex_print_caret(index, text, offset, output);
+    LineIndex_free(index);
+}
+
+void LineIndex_free (LineIndex* index)
+{
+    free(index->starts);
+    free(index);
+}
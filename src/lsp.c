@@ -0,0 +1,924 @@
+/**
+ * @file lsp.c
+ * @brief Language server: incremental analysis for editors over JSON-RPC
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <strings.h>
+
+#include "lsp.h"
+#include "json.h"
+
+/**
+ * @brief JSON-RPC error codes
+ */
+#define PARSE_ERROR         -32700
+#define INVALID_REQUEST     -32600
+#define METHOD_NOT_FOUND    -32601
+#define INVALID_PARAMS      -32602
+
+/**
+ * @brief LSP symbol kinds
+ */
+#define SYMBOL_FUNCTION     12
+#define SYMBOL_VARIABLE     13
+#define SYMBOL_ARRAY        18
+
+/**
+ * @brief File opened by the client
+ */
+typedef struct OpenDocument
+{
+    char* uri;
+    Document* doc;
+    LineIndex* lines;       /**< @brief Line index of the current text (or @c NULL if stale) */
+} OpenDocument;
+
+/**
+ * @brief Handler for one method
+ *
+ * @param server Server
+ * @param params Message parameters (or @c NULL)
+ * @param result Stream for the JSON result of a request (left empty for a
+ * @c null result)
+ * @returns Error message for an @c INVALID_PARAMS response, or @c NULL
+ */
+typedef const char* (*MethodHandler) (LanguageServer* server, JsonValue* params, FILE* result);
+
+/*
+ * POSITIONS
+ */
+
+static LineIndex* line_index (OpenDocument* od)
+{
+    if (od->lines == NULL) {
+        od->lines = LineIndex_new(od->doc->text);
+    }
+    return od->lines;
+}
+
+/**
+ * @brief Find the end of a line (the offset of its newline, or the end of the
+ * text)
+ */
+static int line_end (OpenDocument* od, int line)
+{
+    LineIndex* lines = line_index(od);
+    return (line + 1 < lines->count ? lines->starts[line + 1] - 1 : od->doc->length);
+}
+
+/**
+ * @brief Advance over one UTF-8 character
+ *
+ * @returns Number of UTF-16 code units that the character takes
+ */
+static int next_char (const char* text, int* p, int end)
+{
+    unsigned char c = (unsigned char)text[(*p)++];
+    while (*p < end && (text[*p] & 0xC0) == 0x80) {
+        (*p)++;
+    }
+    return (c >= 0xF0 ? 2 : 1);
+}
+
+/**
+ * @brief Convert an LSP position to a byte offset (clamped to the text)
+ */
+static int position_to_offset (OpenDocument* od, JsonValue* position)
+{
+    LineIndex* lines = line_index(od);
+    int line = JsonValue_int(JsonValue_get(position, "line"), 0);
+    int character = JsonValue_int(JsonValue_get(position, "character"), 0);
+    if (line < 0) {
+        return 0;
+    }
+    if (line >= lines->count) {
+        return od->doc->length;
+    }
+    int p = lines->starts[line];
+    int end = line_end(od, line);
+    for (int units = 0; p < end && units < character; ) {
+        units += next_char(od->doc->text, &p, end);
+    }
+    return p;
+}
+
+static void print_position (FILE* out, OpenDocument* od, int offset)
+{
+    LineIndex* lines = line_index(od);
+    int line = LineIndex_line(lines, offset) - 1;
+    int character = 0;
+    for (int p = lines->starts[line]; p < offset; ) {
+        character += next_char(od->doc->text, &p, offset);
+    }
+    fprintf(out, "{\"line\":%d,\"character\":%d}", line, character);
+}
+
+static void print_range (FILE* out, OpenDocument* od, int start, int end)
+{
+    fputs("{\"start\":", out);
+    print_position(out, od, start);
+    fputs(",\"end\":", out);
+    print_position(out, od, end);
+    fputc('}', out);
+}
+
+static bool is_name_char (char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/**
+ * @brief Find the first occurrence of a name as a whole word in part of a
+ * text, skipping comments and string literals
+ *
+ * This locates the names in declarations, which the AST does not record
+ * positions for (a declaration's offset is that of its first token).
+ *
+ * @returns Offset of the name, or -1 if it does not occur
+ */
+static int find_name (const char* text, int start, int end, const char* name)
+{
+    size_t length = strlen(name);
+    for (int p = start; p < end; p++) {
+        if (text[p] == '/' && p + 1 < end && text[p+1] == '/') {
+            while (p < end && text[p] != '\n') {
+                p++;
+            }
+        } else if (text[p] == '"') {
+            for (p++; p < end && text[p] != '"' && text[p] != '\n'; p++) {
+                if (text[p] == '\\') {
+                    p++;
+                }
+            }
+        } else if (is_name_char(text[p]) && (p == 0 || !is_name_char(text[p-1]))) {
+            if (p + (int)length <= end && strncmp(text + p, name, length) == 0 &&
+                    (p + (int)length == end || !is_name_char(text[p + length]))) {
+                return p;
+            }
+            while (p + 1 < end && is_name_char(text[p+1])) {
+                p++;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Find the end of a variable declaration (just past its semicolon)
+ */
+static int vardecl_end (Document* doc, ASTNode* decl)
+{
+    const char* semicolon = memchr(doc->text + decl->source_offset, ';',
+                                   doc->length - decl->source_offset);
+    return (semicolon != NULL ? (int)(semicolon - doc->text) + 1 : doc->length);
+}
+
+/**
+ * @brief Collect the top-level declarations of a program in source order
+ *
+ * @returns Newly-allocated array of declarations
+ */
+static ASTNode** collect_declarations (ASTNode* program, int* count)
+{
+    NodeList* vars = program->program.variables;
+    NodeList* funcs = program->program.functions;
+    *count = vars->size + funcs->size;
+    ASTNode** decls = (ASTNode**)malloc((*count + 1) * sizeof(ASTNode*));
+    CHECK_MALLOC_PTR(decls)
+    ASTNode* var = vars->head;
+    ASTNode* func = funcs->head;
+    for (int i = 0; i < *count; i++) {
+        if (func == NULL || (var != NULL && var->source_offset < func->source_offset)) {
+            decls[i] = var;
+            var = var->next;
+        } else {
+            decls[i] = func;
+            func = func->next;
+        }
+    }
+    return decls;
+}
+
+/*
+ * MESSAGES
+ */
+
+/**
+ * @brief Write a message body with its header
+ */
+static void send_message (LanguageServer* server, const char* body, size_t length)
+{
+    fprintf(server->output, "Content-Length: %zu\r\n\r\n", length);
+    fwrite(body, 1, length, server->output);
+    fflush(server->output);
+}
+
+static void send_error (LanguageServer* server, JsonValue* id, int code, const char* message)
+{
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    CHECK_MALLOC_PTR(out)
+    fputs("{\"jsonrpc\":\"2.0\",\"id\":", out);
+    if (id != NULL) {
+        Json_print(out, id);
+    } else {
+        fputs("null", out);
+    }
+    fprintf(out, ",\"error\":{\"code\":%d,\"message\":", code);
+    Json_print_string(out, message, strlen(message));
+    fputs("}}", out);
+    fclose(out);
+    send_message(server, body, length);
+    free(body);
+}
+
+static OpenDocument* find_document (LanguageServer* server, JsonValue* params)
+{
+    const char* uri = JsonValue_string(JsonValue_get(JsonValue_get(params, "textDocument"), "uri"));
+    if (uri == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < server->ndocs; i++) {
+        if (strcmp(server->docs[i].uri, uri) == 0) {
+            return &server->docs[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Work out where a front-end error is, for a diagnostic
+ */
+static void locate_error (OpenDocument* od, int* start, int* end)
+{
+    Document* doc = od->doc;
+    const char* text = doc->text;
+    int offset = doc->error_offset;
+    if (offset >= 0) {
+        if (offset == doc->length && offset > 0 && text[offset-1] == '\n') {
+            offset--;   /* point at the end of the last line, not past it */
+        }
+        *start = *end = offset;
+        if (offset < doc->length && is_name_char(text[offset])) {
+            while (*end < doc->length && is_name_char(text[*end])) {
+                (*end)++;
+            }
+        } else if (offset < doc->length && text[offset] != '\n') {
+            (*end)++;
+        }
+        return;
+    }
+
+    /* lexer errors only give a line number (and the offending text) */
+    int line = 1;
+    const char* at = strstr(doc->error, " on line ");
+    if (at != NULL) {
+        line = atoi(at + 9);
+    }
+    LineIndex* lines = line_index(od);
+    if (line < 1 || line > lines->count) {
+        line = 1;
+    }
+    *start = lines->starts[line - 1];
+    *end = line_end(od, line - 1);
+    const char* quote = strstr(doc->error, ": \"");
+    const char* last = strrchr(doc->error, '"');
+    if (quote != NULL && last > quote + 3) {
+        int length = (int)(last - quote - 3);
+        for (int p = *start; p + length <= *end; p++) {
+            if (strncmp(text + p, quote + 3, length) == 0) {
+                *start = p;
+                *end = p + length;
+                break;
+            }
+        }
+    }
+}
+
+static void publish_diagnostics (LanguageServer* server, OpenDocument* od)
+{
+    char* body = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&body, &length);
+    CHECK_MALLOC_PTR(out)
+    fputs("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", out);
+    Json_print_string(out, od->uri, strlen(od->uri));
+    fputs(",\"diagnostics\":[", out);
+    if (od->doc != NULL && od->doc->tree == NULL) {
+        int start, end;
+        locate_error(od, &start, &end);
+        size_t message_length = strlen(od->doc->error);
+        while (message_length > 0 && od->doc->error[message_length-1] == '\n') {
+            message_length--;
+        }
+        fputs("{\"range\":", out);
+        print_range(out, od, start, end);
+        fputs(",\"severity\":1,\"source\":\"decaf\",\"message\":", out);
+        Json_print_string(out, od->doc->error, message_length);
+        fputc('}', out);
+    }
+    fputs("]}}", out);
+    fclose(out);
+    send_message(server, body, length);
+    free(body);
+}
+
+/*
+ * LIFECYCLE
+ */
+
+static const char* handle_initialize (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    fputs("{\"capabilities\":{"
+              "\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+              "\"definitionProvider\":true,"
+              "\"documentSymbolProvider\":true},"
+          "\"serverInfo\":{\"name\":\"decaf\"}}", result);
+    return NULL;
+}
+
+static const char* handle_ignored (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    return NULL;
+}
+
+static const char* handle_shutdown (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    server->shutdown = true;
+    return NULL;
+}
+
+static const char* handle_exit (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    server->exited = true;
+    return NULL;
+}
+
+/*
+ * DOCUMENT SYNCHRONIZATION
+ */
+
+static const char* handle_did_open (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    JsonValue* item = JsonValue_get(params, "textDocument");
+    const char* uri = JsonValue_string(JsonValue_get(item, "uri"));
+    const char* text = JsonValue_string(JsonValue_get(item, "text"));
+    if (uri == NULL || text == NULL) {
+        return "Missing document";
+    }
+    OpenDocument* od = find_document(server, params);
+    if (od != NULL) {
+        Document_replace(od->doc, text);
+    } else {
+        if (server->ndocs == server->doc_capacity) {
+            server->doc_capacity = (server->doc_capacity == 0 ? 8 : server->doc_capacity * 2);
+            server->docs = (OpenDocument*)realloc(server->docs,
+                    server->doc_capacity * sizeof(OpenDocument));
+            CHECK_MALLOC_PTR(server->docs)
+        }
+        od = &server->docs[server->ndocs++];
+        od->uri = strdup(uri);
+        CHECK_MALLOC_PTR(od->uri)
+        od->doc = Document_new(text);
+        od->doc->deferred = true;
+        od->lines = NULL;
+    }
+    if (od->lines != NULL) {
+        LineIndex_free(od->lines);
+        od->lines = NULL;
+    }
+    publish_diagnostics(server, od);
+    return NULL;
+}
+
+static const char* handle_did_change (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    OpenDocument* od = find_document(server, params);
+    JsonValue* changes = JsonValue_get(params, "contentChanges");
+    if (od == NULL || changes == NULL) {
+        return "Unknown document";
+    }
+    for (int i = 0; i < changes->size; i++) {
+        JsonValue* change = JsonValue_at(changes, i);
+        JsonValue* text = JsonValue_get(change, "text");
+        JsonValue* range = JsonValue_get(change, "range");
+        if (JsonValue_string(text) == NULL) {
+            continue;
+        }
+        if (range == NULL) {
+            Document_replace(od->doc, text->string);
+        } else {
+            int start = position_to_offset(od, JsonValue_get(range, "start"));
+            int end = position_to_offset(od, JsonValue_get(range, "end"));
+            if (end < start) {
+                end = start;
+            }
+            TextEdit edit = { start, end - start, text->length };
+            Document_edit(od->doc, edit, text->string);
+        }
+        if (od->lines != NULL) {
+            LineIndex_free(od->lines);
+            od->lines = NULL;
+        }
+    }
+    publish_diagnostics(server, od);
+    return NULL;
+}
+
+static const char* handle_did_close (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    OpenDocument* od = find_document(server, params);
+    if (od == NULL) {
+        return "Unknown document";
+    }
+    /* clear the file's diagnostics in the editor */
+    Document_free(od->doc);
+    od->doc = NULL;
+    publish_diagnostics(server, od);
+
+    if (od->lines != NULL) {
+        LineIndex_free(od->lines);
+    }
+    free(od->uri);
+    *od = server->docs[--server->ndocs];
+    return NULL;
+}
+
+/*
+ * GO TO DEFINITION
+ */
+
+/**
+ * @brief Declaration lookup state for @ref handle_definition
+ */
+typedef struct Resolver
+{
+    Document* doc;
+    const char* name;           /**< @brief Name to resolve */
+    int offset;                 /**< @brief Offset of the name being resolved */
+    NodeList** scopes;          /**< @brief Variables of the enclosing blocks */
+    int depth;
+    int capacity;
+    bool resolved;              /**< @brief Whether the name was found */
+    bool is_call;               /**< @brief Whether the name is a function call */
+    ASTNode* decl;              /**< @brief Local declaration (or @c NULL for a parameter or global) */
+} Resolver;
+
+static void enter_block (Resolver* resolver, ASTNode* node)
+{
+    if (resolver->depth == resolver->capacity) {
+        resolver->capacity = (resolver->capacity == 0 ? 16 : resolver->capacity * 2);
+        resolver->scopes = (NodeList**)realloc(resolver->scopes, resolver->capacity * sizeof(NodeList*));
+        CHECK_MALLOC_PTR(resolver->scopes)
+    }
+    resolver->scopes[resolver->depth++] = node->block.variables;
+}
+
+static void exit_block (Resolver* resolver, ASTNode* node)
+{
+    resolver->depth--;
+}
+
+/**
+ * @brief Check whether the name is a local variable's own declaration
+ */
+static void check_vardecl (Resolver* resolver, ASTNode* node)
+{
+    if (!resolver->resolved && node->source_offset <= resolver->offset &&
+            strcmp(node->vardecl.name, resolver->name) == 0 &&
+            find_name(resolver->doc->text, node->source_offset, resolver->offset + 1,
+                      resolver->name) == resolver->offset) {
+        resolver->resolved = true;
+        resolver->decl = node;
+    }
+}
+
+/**
+ * @brief Resolve a reference to a variable against the enclosing blocks
+ * (innermost first); if none declares it, it is a parameter or a global
+ */
+static void check_location (Resolver* resolver, ASTNode* node)
+{
+    if (resolver->resolved || node->source_offset != resolver->offset ||
+            strcmp(node->location.name, resolver->name) != 0) {
+        return;
+    }
+    resolver->resolved = true;
+    for (int i = resolver->depth - 1; i >= 0 && resolver->decl == NULL; i--) {
+        FOR_EACH (ASTNode*, var, resolver->scopes[i]) {
+            if (strcmp(var->vardecl.name, resolver->name) == 0) {
+                resolver->decl = var;
+                break;
+            }
+        }
+    }
+}
+
+static void check_funccall (Resolver* resolver, ASTNode* node)
+{
+    if (!resolver->resolved && node->source_offset == resolver->offset &&
+            strcmp(node->funccall.name, resolver->name) == 0) {
+        resolver->resolved = true;
+        resolver->is_call = true;
+    }
+}
+
+#define STATIC_VISITOR_TRAVERSE         resolve_name
+#define STATIC_VISITOR_STATE            Resolver*
+#define STATIC_PREVISIT_block           enter_block
+#define STATIC_POSTVISIT_block          exit_block
+#define STATIC_PREVISIT_vardecl         check_vardecl
+#define STATIC_PREVISIT_location        check_location
+#define STATIC_PREVISIT_funccall        check_funccall
+#include "static-visitor.h"
+
+static void print_location (FILE* out, OpenDocument* od, int start, int end)
+{
+    fputs("{\"uri\":", out);
+    Json_print_string(out, od->uri, strlen(od->uri));
+    fputs(",\"range\":", out);
+    print_range(out, od, start, end);
+    fputc('}', out);
+}
+
+static void print_declaration (FILE* out, OpenDocument* od, ASTNode* decl)
+{
+    const char* name = (decl->type == FUNCDECL ? decl->funcdecl.name : decl->vardecl.name);
+    int start = find_name(od->doc->text, decl->source_offset, od->doc->length, name);
+    if (start < 0) {
+        start = decl->source_offset;
+    }
+    print_location(out, od, start, start + (int)strlen(name));
+}
+
+static ASTNode* find_global (NodeList* decls, const char* name)
+{
+    FOR_EACH (ASTNode*, decl, decls) {
+        const char* decl_name = (decl->type == FUNCDECL ? decl->funcdecl.name : decl->vardecl.name);
+        if (strcmp(decl_name, name) == 0) {
+            return decl;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find the declaration of a function's parameter
+ *
+ * @returns Offset of the parameter's name, or -1 if it is not a parameter
+ */
+static int find_parameter (Document* doc, ASTNode* func, const char* name)
+{
+    FOR_EACH (Parameter*, param, func->funcdecl.parameters) {
+        if (strcmp(param->name, name) == 0) {
+            /* the parameter list starts after the function's name */
+            int header_end = func->funcdecl.body->source_offset;
+            int at = find_name(doc->text, func->source_offset, header_end, func->funcdecl.name);
+            return (at < 0 ? -1 : find_name(doc->text, at + (int)strlen(func->funcdecl.name),
+                                            header_end, name));
+        }
+    }
+    return -1;
+}
+
+static const char* handle_definition (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    OpenDocument* od = find_document(server, params);
+    if (od == NULL) {
+        return "Unknown document";
+    }
+    Document* doc = od->doc;
+    if (doc->tree == NULL) {
+        return NULL;
+    }
+
+    /* find the name under the cursor */
+    int start = position_to_offset(od, JsonValue_get(params, "position"));
+    while (start > 0 && is_name_char(doc->text[start-1])) {
+        start--;
+    }
+    int end = start;
+    while (end < doc->length && is_name_char(doc->text[end])) {
+        end++;
+    }
+    if (end == start || end - start >= MAX_ID_LEN) {
+        return NULL;
+    }
+    char name[MAX_ID_LEN];
+    memcpy(name, doc->text + start, end - start);
+    name[end - start] = '\0';
+
+    /* find the enclosing top-level declaration */
+    ASTNode* program = doc->tree;
+    ASTNode* outer = Document_declaration_at(doc, start);
+
+    ASTNode* decl = NULL;
+    bool is_call = false;
+    if (outer != NULL && outer->type == FUNCDECL) {
+        int param = -1;
+        ASTNode* body = outer->funcdecl.body;
+        if (start < body->source_offset) {
+            /* the function's own name or one of its parameters */
+            if (strcmp(outer->funcdecl.name, name) == 0) {
+                decl = outer;
+            } else {
+                param = find_parameter(doc, outer, name);
+                if (param != start) {
+                    return NULL;
+                }
+            }
+        } else {
+            Resolver resolver = { .doc = doc, .name = name, .offset = start };
+            resolve_name(&resolver, body);
+            free(resolver.scopes);
+            if (!resolver.resolved) {
+                return NULL;    /* not a reference (e.g., a keyword) */
+            }
+            decl = resolver.decl;
+            is_call = resolver.is_call;
+            if (decl == NULL && !is_call) {
+                param = find_parameter(doc, outer, name);
+            }
+        }
+        if (param >= 0) {
+            print_location(result, od, param, param + (int)strlen(name));
+            return NULL;
+        }
+    } else if (outer != NULL && strcmp(outer->vardecl.name, name) == 0) {
+        decl = outer;
+    }
+    if (decl == NULL) {
+        decl = find_global(is_call ? program->program.functions : program->program.variables, name);
+    }
+    if (decl != NULL) {
+        print_declaration(result, od, decl);
+    }
+    return NULL;
+}
+
+/*
+ * DOCUMENT SYMBOLS
+ */
+
+/**
+ * @brief Output state for @ref handle_document_symbol
+ */
+typedef struct SymbolWriter
+{
+    FILE* out;
+    OpenDocument* od;
+    int count;          /**< @brief Symbols written to the current list */
+} SymbolWriter;
+
+static void print_symbol (SymbolWriter* writer, const char* name, const char* detail, int kind,
+                          int start, int end)
+{
+    FILE* out = writer->out;
+    OpenDocument* od = writer->od;
+    int at = find_name(od->doc->text, start, end, name);
+    if (at < 0) {
+        at = start;
+    }
+    if (writer->count++ > 0) {
+        fputc(',', out);
+    }
+    fputs("{\"name\":", out);
+    Json_print_string(out, name, strlen(name));
+    fputs(",\"detail\":", out);
+    Json_print_string(out, detail, strlen(detail));
+    fprintf(out, ",\"kind\":%d,\"range\":", kind);
+    print_range(out, od, start, end);
+    fputs(",\"selectionRange\":", out);
+    print_range(out, od, at, at + (int)strlen(name));
+}
+
+static void print_variable_symbol (SymbolWriter* writer, ASTNode* node)
+{
+    char detail[64];
+    if (node->vardecl.is_array) {
+        snprintf(detail, sizeof(detail), "%s[%d]", DecafType_to_string(node->vardecl.type),
+                 node->vardecl.array_length);
+    } else {
+        snprintf(detail, sizeof(detail), "%s", DecafType_to_string(node->vardecl.type));
+    }
+    print_symbol(writer, node->vardecl.name, detail,
+                 (node->vardecl.is_array ? SYMBOL_ARRAY : SYMBOL_VARIABLE),
+                 node->source_offset, vardecl_end(writer->od->doc, node));
+    fputc('}', writer->out);
+}
+
+#define STATIC_VISITOR_TRAVERSE         print_local_symbols
+#define STATIC_VISITOR_STATE            SymbolWriter*
+#define STATIC_PREVISIT_vardecl         print_variable_symbol
+#include "static-visitor.h"
+
+static void print_function_symbol (SymbolWriter* writer, ASTNode* node, int end)
+{
+    /* e.g., "int (int, bool)" */
+    char detail[256];
+    int length = snprintf(detail, sizeof(detail), "%s (",
+                          DecafType_to_string(node->funcdecl.return_type));
+    FOR_EACH (Parameter*, param, node->funcdecl.parameters) {
+        if (length < (int)sizeof(detail)) {
+            length += snprintf(detail + length, sizeof(detail) - length, "%s%s",
+                               (param == node->funcdecl.parameters->head ? "" : ", "),
+                               DecafType_to_string(param->type));
+        }
+    }
+    if (length < (int)sizeof(detail)) {
+        snprintf(detail + length, sizeof(detail) - length, ")");
+    }
+    print_symbol(writer, node->funcdecl.name, detail, SYMBOL_FUNCTION, node->source_offset, end);
+
+    fputs(",\"children\":[", writer->out);
+    SymbolWriter locals = { writer->out, writer->od, 0 };
+    print_local_symbols(&locals, node->funcdecl.body);
+    fputs("]}", writer->out);
+}
+
+static const char* handle_document_symbol (LanguageServer* server, JsonValue* params, FILE* result)
+{
+    OpenDocument* od = find_document(server, params);
+    if (od == NULL) {
+        return "Unknown document";
+    }
+    Document* doc = od->doc;
+    if (doc->tree == NULL) {
+        return NULL;
+    }
+
+    Document_sync(doc);
+    int count;
+    ASTNode** decls = collect_declarations(doc->tree, &count);
+    SymbolWriter writer = { result, od, 0 };
+    fputc('[', result);
+    for (int i = 0; i < count; i++) {
+        if (decls[i]->type == VARDECL) {
+            print_variable_symbol(&writer, decls[i]);
+        } else {
+            /* a function extends to the next declaration (less trailing space) */
+            int end = (i + 1 < count ? decls[i+1]->source_offset : doc->length);
+            while (end > decls[i]->source_offset && isspace((unsigned char)doc->text[end-1])) {
+                end--;
+            }
+            print_function_symbol(&writer, decls[i], end);
+        }
+    }
+    fputc(']', result);
+    free(decls);
+    return NULL;
+}
+
+/*
+ * DISPATCH
+ */
+
+/**
+ * @brief Supported methods
+ */
+static const struct {
+    const char* method;
+    MethodHandler handler;
+} METHODS[] = {
+    { "initialize",                 handle_initialize },
+    { "initialized",                handle_ignored },
+    { "shutdown",                   handle_shutdown },
+    { "exit",                       handle_exit },
+    { "textDocument/didOpen",       handle_did_open },
+    { "textDocument/didChange",     handle_did_change },
+    { "textDocument/didClose",      handle_did_close },
+    { "textDocument/didSave",       handle_ignored },
+    { "textDocument/definition",    handle_definition },
+    { "textDocument/documentSymbol", handle_document_symbol },
+    { "$/cancelRequest",            handle_ignored },
+    { "$/setTrace",                 handle_ignored },
+};
+
+LanguageServer* LanguageServer_new (FILE* output)
+{
+    LanguageServer* server = (LanguageServer*)calloc(1, sizeof(LanguageServer));
+    CHECK_MALLOC_PTR(server)
+    server->output = output;
+    return server;
+}
+
+bool LanguageServer_handle (LanguageServer* server, const char* message, size_t length)
+{
+    JsonValue* request = Json_parse(message, length);
+    const char* method = JsonValue_string(JsonValue_get(request, "method"));
+    JsonValue* id = JsonValue_get(request, "id");
+    if (request == NULL || method == NULL) {
+        /* a response from the client needs no reply */
+        if (request == NULL || JsonValue_get(request, "result") == NULL) {
+            send_error(server, id, (request == NULL ? PARSE_ERROR : INVALID_REQUEST),
+                       (request == NULL ? "Parse error" : "Invalid request"));
+        }
+        Json_free(request);
+        return true;
+    }
+
+    MethodHandler handler = NULL;
+    for (size_t i = 0; i < sizeof(METHODS) / sizeof(METHODS[0]); i++) {
+        if (strcmp(METHODS[i].method, method) == 0) {
+            handler = METHODS[i].handler;
+            break;
+        }
+    }
+    if (server->shutdown && handler != handle_exit) {
+        if (id != NULL) {
+            send_error(server, id, INVALID_REQUEST, "Server is shutting down");
+        }
+    } else if (handler == NULL) {
+        if (id != NULL) {
+            send_error(server, id, METHOD_NOT_FOUND, "Method not found");
+        }
+    } else {
+        char* result = NULL;
+        size_t result_length = 0;
+        FILE* out = open_memstream(&result, &result_length);
+        CHECK_MALLOC_PTR(out)
+        const char* error = handler(server, JsonValue_get(request, "params"), out);
+        fclose(out);
+        if (id != NULL && error != NULL) {
+            send_error(server, id, INVALID_PARAMS, error);
+        } else if (id != NULL) {
+            char* body = NULL;
+            size_t body_length = 0;
+            out = open_memstream(&body, &body_length);
+            CHECK_MALLOC_PTR(out)
+            fputs("{\"jsonrpc\":\"2.0\",\"id\":", out);
+            Json_print(out, id);
+            fputs(",\"result\":", out);
+            fputs(result_length > 0 ? result : "null", out);
+            fputc('}', out);
+            fclose(out);
+            send_message(server, body, body_length);
+            free(body);
+        }
+        free(result);
+    }
+    Json_free(request);
+    return !server->exited;
+}
+
+Document* LanguageServer_document (LanguageServer* server, const char* uri)
+{
+    for (int i = 0; i < server->ndocs; i++) {
+        if (strcmp(server->docs[i].uri, uri) == 0) {
+            return server->docs[i].doc;
+        }
+    }
+    return NULL;
+}
+
+void LanguageServer_free (LanguageServer* server)
+{
+    for (int i = 0; i < server->ndocs; i++) {
+        Document_free(server->docs[i].doc);
+        if (server->docs[i].lines != NULL) {
+            LineIndex_free(server->docs[i].lines);
+        }
+        free(server->docs[i].uri);
+    }
+    free(server->docs);
+    free(server);
+}
+
+int LanguageServer_run (FILE* input, FILE* output)
+{
+    LanguageServer* server = LanguageServer_new(output);
+    char header[1024];
+    bool running = true;
+    while (running) {
+        /* headers end with an empty line; only Content-Length matters */
+        long length = -1;
+        bool ended = false;
+        while (fgets(header, sizeof(header), input) != NULL) {
+            if (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0) {
+                ended = true;
+                break;
+            }
+            if (strncasecmp(header, "Content-Length:", 15) == 0) {
+                length = strtol(header + 15, NULL, 10);
+            }
+        }
+        if (!ended || length < 0) {
+            break;
+        }
+        char* message = (char*)malloc(length + 1);
+        CHECK_MALLOC_PTR(message)
+        if (fread(message, 1, length, input) != (size_t)length) {
+            free(message);
+            break;
+        }
+        running = LanguageServer_handle(server, message, length);
+        free(message);
+    }
+    int status = (server->shutdown && server->exited ? EXIT_SUCCESS : EXIT_FAILURE);
+    LanguageServer_free(server);
+    return status;
+}
@@ -3,8 +3,26 @@
  * @brief Compiler driver
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <unistd.h>
+
 #include "p1-lexer.h"
 #include "p2-parser.h"
+#include "parlex.h"
+#include "lineindex.h"
+#include "server.h"
+#include "watch.h"
+#include "lsp.h"
+#include "stream.h"
+#include "emit.h"
+#include "ilocsim.h"
+#include "peephole.h"
+#include "codegen.h"
+#include "schedule.h"
+#include "tailcall.h"
+#include "interp.h"
 
 /**
  * @brief Error message buffer
@@ -27,6 +45,7 @@ void Error_throw_printf (const char* format, ...)
     /* delegate to vsnprintf for error message formatting */
     va_list args;
     va_start(args, format);
+    ErrorTrap_throw_va(format, args);   /* only returns if no trap is installed */
     vsnprintf(decaf_error_msg, MAX_ERROR_LEN, format, args);
     va_end(args);
 
@@ -35,28 +54,358 @@ void Error_throw_printf (const char* format, ...)
 }
 
 /**
- * @brief Read all text data from a file
+ * @brief Set by @ref stop_watching to end watch mode
+ */
+volatile sig_atomic_t watch_stop_requested = 0;
+
+/**
+ * @brief Signal handler that stops the compile server
+ */
+void stop_server (int signal)
+{
+    CompileServer_stop();
+}
+
+/**
+ * @brief Signal handler that ends watch mode
+ */
+void stop_watching (int signal)
+{
+    watch_stop_requested = 1;
+}
+
+/**
+ * @brief Call a handler on SIGINT and SIGTERM
+ *
+ * The handler is installed without @c SA_RESTART, so that the signal also
+ * interrupts any blocking system call in progress.
+ *
+ * @param handler Signal handler
+ */
+void handle_stop_signals (void (*handler)(int))
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+/**
+ * @brief Run a compile server until it is shut down or interrupted
+ *
+ * @param socket_path Path of the socket to listen on
+ * @param nworkers Number of worker threads (0 for one per processor)
+ * @returns Exit status
+ */
+int run_server (const char* socket_path, int nworkers)
+{
+    handle_stop_signals(stop_server);
+    return CompileServer_run(socket_path, nworkers);
+}
+
+/**
+ * @brief Recompile the sources in a directory tree whenever they change,
+ * until interrupted
+ *
+ * @param dir Directory to watch
+ * @param format Output format
+ * @returns Exit status
+ */
+int run_watch (const char* dir, WatchFormat format)
+{
+    handle_stop_signals(stop_watching);
+    Watcher* watcher = Watcher_new(dir, format, stdout);
+    if (watcher == NULL) {
+        return EXIT_FAILURE;
+    }
+    while (!watch_stop_requested && Watcher_poll(watcher, -1) >= 0) {
+        /* keep watching */
+    }
+    Watcher_free(watcher);
+    return (watch_stop_requested ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief Send a file (or standard input, for "-") to a compile server and
+ * copy the results to standard output and standard error
+ *
+ * @param socket_path Path of the server's socket
+ * @param command Request type
+ * @param filename File to compile (ignored for @c SHUTDOWN_COMMAND)
+ * @returns Exit status of the request, or -1 if the server could not be
+ * reached
+ */
+int run_client (const char* socket_path, ServerCommand command, const char* filename)
+{
+    ServerRequest request = { .command = command };
+    char* text = NULL;
+    char path[4096];
+    if (command == SHUTDOWN_COMMAND) {
+        request.text = "";
+    } else if (strcmp(filename, "-") == 0) {
+        text = read_file("/dev/stdin");
+        if (text == NULL) {
+            fprintf(stderr, "Could not read standard input\n");
+            return EXIT_FAILURE;
+        }
+        request.text = text;
+    } else if (filename[0] == '/') {
+        request.path = filename;
+    } else {
+        /* the server has its own working directory */
+        if (getcwd(path, sizeof(path)) == NULL ||
+                strlen(path) + strlen(filename) + 2 > sizeof(path)) {
+            fprintf(stderr, "Could not resolve file name: %s\n", filename);
+            return EXIT_FAILURE;
+        }
+        strcat(path, "/");
+        strcat(path, filename);
+        request.path = path;
+    }
+    int status = CompileClient_send(socket_path, &request, stdout, stderr);
+    free(text);
+    return status;
+}
+
+/**
+ * @brief Print the AST of a file (or standard input, for "-") one declaration
+ * at a time, without building the whole tree
  *
- * @param filename Name of file to read
- * @param text String buffer destination (must be #MAX_FILE_SIZE characters long)
- * @returns True if and only if the file read was successful.
+ * @param filename File to print
+ * @returns Exit status
  */
-bool read_file (const char* filename, char* text)
+int run_stream (const char* filename)
 {
-    FILE* input = fopen(filename, "r");
+    FILE* input = (strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r"));
     if (input == NULL) {
-        return false;
-    }
-    size_t nchars = 0;
-    char* p = text;
-    int c;
-    while (nchars < MAX_FILE_SIZE && (c = fgetc(input)) != EOF) {
-        *p++ = (char)c;
-        nchars++;
-    }
-    *p = '\0';
-    fclose(input);
-    return true;
+        fprintf(stderr, "Could not read file: %s", filename);
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    if (setjmp(decaf_error) == 0) {
+        PrintVisitor_stream(input, stdout);
+    } else {
+        /* the declarations before the error have already been printed */
+        fprintf(stderr, "%s", decaf_error_msg);
+        status = EXIT_FAILURE;
+    }
+    if (input != stdin) {
+        fclose(input);
+    }
+    return status;
+}
+
+/**
+ * @brief Run an ILOC program on the simulator
+ *
+ * A file whose name ends in ".decaf" is compiled to ILOC first (see
+ * codegen.h), after tail call elimination (see tailcall.h) with
+ * @c --tail-calls. Anything the program prints goes to standard output; the
+ * counts from the run (with @c --stats) go to standard error. With
+ * @c --optimize, the program is run through the peephole optimizer first, with
+ * @c --schedule its basic blocks are then reordered for the machine (see
+ * schedule.h), and with @c --print it is printed instead of run. A run stops
+ * with an error after @c --limit instructions (0 for no limit).
+ *
+ * @param argc Number of arguments (after "--iloc")
+ * @param argv Arguments: options, then the ILOC (or Decaf) file name
+ * @returns Exit status (-1 for bad arguments)
+ */
+int run_iloc (int argc, char** argv)
+{
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    bool stats = false;
+    bool optimize = false;
+    bool schedule = false;
+    bool tail_calls = false;
+    bool print = false;
+    int arg = 0;
+    for (; arg < argc - 1; arg++) {
+        if (strcmp(argv[arg], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[arg], "--optimize") == 0) {
+            optimize = true;
+        } else if (strcmp(argv[arg], "--schedule") == 0) {
+            schedule = true;
+        } else if (strcmp(argv[arg], "--tail-calls") == 0) {
+            tail_calls = true;
+        } else if (strcmp(argv[arg], "--print") == 0) {
+            print = true;
+        } else if (strcmp(argv[arg], "--memory") == 0 && arg + 2 < argc) {
+            config.memory_size = (size_t)atol(argv[++arg]) & ~(size_t)7;
+        } else if (strcmp(argv[arg], "--cache") == 0 && arg + 2 < argc) {
+            config.cache_lines = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--limit") == 0 && arg + 2 < argc) {
+            config.max_instructions = atol(argv[++arg]);
+        } else {
+            break;
+        }
+    }
+    if (arg != argc - 1 || config.memory_size <= (size_t)config.static_base ||
+            config.memory_size > INT32_MAX || config.cache_lines < 0 ||
+            config.max_instructions < 0) {
+        return -1;
+    }
+
+    char* text = read_file(argv[arg]);
+    if (text == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", argv[arg]);
+        return EXIT_FAILURE;
+    }
+    size_t length = strlen(argv[arg]);
+    bool decaf = (length > 6 && strcmp(argv[arg] + length - 6, ".decaf") == 0);
+    TokenQueue* volatile tokens = NULL;
+    ASTNode* volatile tree = NULL;
+    ILOCInsnList* volatile program = NULL;
+    ILOCStats counts;
+    PeepholeStats rewrites;
+    ScheduleStats reorders;
+    TailCallStats loops;
+    if (setjmp(decaf_error) == 0) {
+        if (decaf) {
+            tokens = lex(text);
+            tree = parse(tokens);
+            if (tail_calls) {
+                TailCall_transform(tree, &loops);
+            }
+            program = generate_code(tree);
+        } else {
+            program = ILOCInsnList_parse(text);
+        }
+        if (optimize) {
+            Peephole_optimize(program, peephole_rules, peephole_rule_count, &rewrites);
+        }
+        if (schedule) {
+            Schedule_blocks(program, &config, &reorders);
+        }
+        if (print) {
+            ILOCInsnList_print(program, stdout);
+        } else {
+            ILOCMachine_run(program, &config, stdout, &counts);
+        }
+    } else {
+        if (decaf && tokens == NULL) {
+            Regex_explain_error(decaf_error_msg);
+        }
+        fflush(stdout);
+        fprintf(stderr, "%s", decaf_error_msg);
+        if (program != NULL) ILOCInsnList_free(program);
+        if (tree    != NULL) ASTNode_free(tree);
+        if (tokens  != NULL) TokenQueue_free(tokens);
+        free(text);
+        return EXIT_FAILURE;
+    }
+    fflush(stdout);
+    if (stats && tail_calls && decaf) {
+        TailCallStats_print(&loops, stderr);
+    }
+    if (stats && optimize) {
+        PeepholeStats_print(&rewrites, peephole_rules, peephole_rule_count, stderr);
+    }
+    if (stats && schedule) {
+        ScheduleStats_print(&reorders, stderr);
+    }
+    if (stats && !print) {
+        ILOCStats_print(&counts, stderr);
+    }
+    ILOCInsnList_free(program);
+    if (tree   != NULL) ASTNode_free(tree);
+    if (tokens != NULL) TokenQueue_free(tokens);
+    free(text);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Run a Decaf program with the AST interpreter
+ *
+ * Anything the program prints goes to standard output; the counts from the run
+ * (with @c --stats) go to standard error. With @c --memoize, calls to pure
+ * functions are cached (see interp.h).
+ *
+ * @param argc Number of arguments (after "--eval")
+ * @param argv Arguments: options, then the Decaf file name
+ * @returns Exit status (-1 for bad arguments)
+ */
+int run_eval (int argc, char** argv)
+{
+    InterpConfig config;
+    InterpConfig_init(&config);
+    bool stats = false;
+    int arg = 0;
+    for (; arg < argc - 1; arg++) {
+        if (strcmp(argv[arg], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[arg], "--memoize") == 0) {
+            config.memoize = true;
+        } else {
+            break;
+        }
+    }
+    if (arg != argc - 1) {
+        return -1;
+    }
+
+    char* text = read_file(argv[arg]);
+    if (text == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", argv[arg]);
+        return EXIT_FAILURE;
+    }
+    TokenQueue* volatile tokens = NULL;
+    ASTNode* volatile tree = NULL;
+    InterpStats counts;
+    int status = EXIT_SUCCESS;
+    if (setjmp(decaf_error) == 0) {
+        tokens = lex(text);
+        tree = parse(tokens);
+        Interp_run(tree, &config, stdout, &counts);
+        fflush(stdout);
+        if (stats) {
+            InterpStats_print(&counts, stderr);
+        }
+    } else {
+        if (tokens == NULL) {
+            Regex_explain_error(decaf_error_msg);
+        }
+        fflush(stdout);
+        fprintf(stderr, "%s", decaf_error_msg);
+        status = EXIT_FAILURE;
+    }
+    if (tree   != NULL) ASTNode_free(tree);
+    if (tokens != NULL) TokenQueue_free(tokens);
+    free(text);
+    return status;
+}
+
+/**
+ * @brief Print usage information
+ *
+ * @param program Name of the executable
+ */
+void print_usage (const char* program)
+{
+    fprintf(stderr, "Usage: %s [--json|--sexp] <decaf-filename>\n", program);
+    fprintf(stderr, "       %s --no-graph <decaf-filename>\n", program);
+    fprintf(stderr, "       %s [--graph-function <name>] [--graph-depth <levels>]\n"
+                    "          [--graph-lines <first>-<last>] <decaf-filename>\n", program);
+    fprintf(stderr, "       %s --server <socket> [<workers>]\n", program);
+    fprintf(stderr, "       %s --client <socket> [--check] <decaf-filename>|-\n", program);
+    fprintf(stderr, "       %s --client <socket> --shutdown\n", program);
+    fprintf(stderr, "       %s --watch <directory> [--dot]\n", program);
+    fprintf(stderr, "       %s --stream <decaf-filename>|-\n", program);
+    fprintf(stderr, "       %s --lsp\n", program);
+    fprintf(stderr, "       %s --iloc [--stats] [--tail-calls] [--optimize] [--schedule]\n"
+                    "          [--print] [--memory <bytes>] [--cache <lines>]\n"
+                    "          [--limit <instructions>]\n"
+                    "          <iloc-filename>|<decaf-filename>\n",
+            program);
+    fprintf(stderr, "       %s --eval [--stats] [--memoize] <decaf-filename>\n", program);
+    fprintf(stderr, "If DECAF_SERVER is set to a server's socket, %s --no-graph\n"
+                    "<decaf-filename> uses that server when it is running (the server\n"
+                    "prints the AST only, so tree.dot and tree.png are not written).\n",
+            program);
 }
 
 /**
@@ -69,30 +418,135 @@ bool read_file (const char* filename, char* text)
  */
 int main(int argc, char** argv)
 {
-    /* check for filename */
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <decaf-filename>\n", argv[0]);
+    /* server mode */
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "--server") == 0) {
+        return run_server(argv[2], (argc == 4 ? atoi(argv[3]) : 0));
+    }
+
+    /* language server mode (JSON-RPC over standard input and output) */
+    if (argc == 2 && strcmp(argv[1], "--lsp") == 0) {
+        return LanguageServer_run(stdin, stdout);
+    }
+
+    /* streaming mode (text output only, one declaration in memory at a time) */
+    if (argc == 3 && strcmp(argv[1], "--stream") == 0) {
+        return run_stream(argv[2]);
+    }
+
+    /* ILOC simulator */
+    if (argc >= 3 && strcmp(argv[1], "--iloc") == 0) {
+        int status = run_iloc(argc - 2, argv + 2);
+        if (status == -1) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return status;
+    }
+
+    /* AST interpreter */
+    if (argc >= 3 && strcmp(argv[1], "--eval") == 0) {
+        int status = run_eval(argc - 2, argv + 2);
+        if (status == -1) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return status;
+    }
+
+    /* watch mode */
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "--watch") == 0) {
+        bool dot = (argc == 4 && strcmp(argv[3], "--dot") == 0);
+        if (argc == 4 && !dot) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return run_watch(argv[2], (dot ? WATCH_DOT : WATCH_TEXT));
+    }
+
+    /* client mode */
+    if (argc >= 4 && strcmp(argv[1], "--client") == 0) {
+        ServerCommand command = PRINT_COMMAND;
+        const char* filename = NULL;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--check") == 0) {
+                command = PARSE_COMMAND;
+            } else if (strcmp(argv[i], "--shutdown") == 0) {
+                command = SHUTDOWN_COMMAND;
+            } else {
+                filename = argv[i];
+            }
+        }
+        if (filename == NULL && command != SHUTDOWN_COMMAND) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        int status = run_client(argv[2], command, filename);
+        if (status == -1) {
+            fprintf(stderr, "Could not reach compile server: %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        return status;
+    }
+
+    /* check for options (output format or graph selection) and filename */
+    const char* format = NULL;
+    ASTGraphOptions graph = { NULL, 0, 0, 0 };
+    bool default_output = true;
+    bool write_graph = true;
+    int arg = 1;
+    for (; arg < argc - 1; arg++) {
+        if (strcmp(argv[arg], "--json") == 0 || strcmp(argv[arg], "--sexp") == 0) {
+            format = argv[arg];
+        } else if (strcmp(argv[arg], "--no-graph") == 0) {
+            write_graph = false;
+        } else if (strcmp(argv[arg], "--graph-function") == 0 && arg + 2 < argc) {
+            graph.function = argv[++arg];
+        } else if (strcmp(argv[arg], "--graph-depth") == 0 && arg + 2 < argc) {
+            graph.max_depth = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--graph-lines") == 0 && arg + 2 < argc &&
+                sscanf(argv[arg+1], "%d-%d", &graph.first_line, &graph.last_line) == 2) {
+            arg++;
+        } else {
+            break;
+        }
+        default_output = (format == NULL && graph.function == NULL && graph.max_depth == 0 &&
+                       graph.first_line == 0 && graph.last_line == 0);
+    }
+    if (argc < 2 || arg != argc - 1) {
+        print_usage(argv[0]);
         return EXIT_FAILURE;
     }
     char* filename = argv[argc-1];
 
+    /*
+     * use a running compile server if one is configured and the caller doesn't
+     * need the graph (the server only sends back the printed AST)
+     */
+    const char* server = getenv("DECAF_SERVER");
+    if (server != NULL && default_output && !write_graph) {
+        int status = run_client(server, PRINT_COMMAND, filename);
+        if (status != -1) {
+            return status;
+        }
+    }
+
     /* read file */
-    char text[MAX_FILE_SIZE];
-    if (!read_file(filename, text)) {
+    char* text = read_file(filename);
+    if (text == NULL) {
         fprintf(stderr, "Could not read file: %s", filename);
         exit(EXIT_FAILURE);
     }
 
     /* FRONT END */
 
-    TokenQueue* tokens = NULL;
-    ASTNode* tree = NULL;
+    TokenQueue* volatile tokens = NULL;
+    ASTNode* volatile tree = NULL;
 
     /* fatal errors are possible in the front end, so check for them */
     if (setjmp(decaf_error) == 0) {
 
-        /* PROJECT 1: lexer */
-        tokens = lex(text);
+        /* PROJECT 1: lexer (multithreaded for large inputs) */
+        tokens = lex_parallel(text, 0);
 
         /* PROJECT 2: parser */
         tree = parse(tokens);
@@ -101,30 +555,44 @@ int main(int argc, char** argv)
 
         /* handle fatal error: print message and clean up */
         fprintf(stderr, "%s", decaf_error_msg);
+        if (tokens   != NULL) LineIndex_print_error_location(text, tokens, stderr);
         if (tokens   != NULL) TokenQueue_free(tokens);
         if (tree     != NULL) ASTNode_free(tree);
+        free(text);
         exit(EXIT_FAILURE);
     }
 
-    /* clean up tokens (no longer needed) */
+    /* clean up tokens and source text (no longer needed) */
     TokenQueue_free(tokens);
     tokens = NULL;
+    free(text);
+
+    /* machine-readable output only */
+    if (format != NULL) {
+        if (strcmp(format, "--json") == 0) {
+            JsonVisitor_traverse(stdout, tree);
+        } else {
+            SExprVisitor_traverse(stdout, tree);
+        }
+        ASTNode_free(tree);
+        return EXIT_SUCCESS;
+    }
 
     /* set up parent links and calculate node depths */
-    NodeVisitor_traverse_and_free(SetParentVisitor_new(), tree);
-    NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), tree);
+    SetParentVisitor_traverse(tree);
+    CalcDepthVisitor_traverse(tree);
 
     /* 
      * output (disable attribute printing in this phase (keeps AST output
      * cleaner and the attributes aren't really important until the static
      * analysis phase)
      */
-    NodeVisitor_traverse_and_free(PrintVisitor_new(stdout), tree);
+    PrintVisitor_traverse(stdout, tree);
 
     /* generate graphical AST */
-    FILE* graph_file = fopen("tree.dot", "w");
+    FILE* graph_file = (write_graph ? fopen("tree.dot", "w") : NULL);
     if (graph_file != NULL) {
-        NodeVisitor_traverse_and_free(GenerateASTGraph_new(graph_file), tree);
+        GenerateASTGraph_traverse(graph_file, tree, &graph);
         fclose(graph_file);
         if (system("dot -Tpng -o tree.png tree.dot") == -1) {
             fprintf(stderr, "Could not generate AST image\n");
@@ -4,6 +4,7 @@
  */
 
 #include "p2-parser.h"
+#include "lltable.h"
 
 /*
  * helper functions
@@ -23,6 +24,20 @@ int get_next_token_line (TokenQueue* input)
     return TokenQueue_peek(input)->line;
 }
 
+/**
+ * @brief Look up the source offset of the next token in the queue.
+ * 
+ * @param input Token queue to examine
+ * @returns Byte offset (-1 if the token was not located in the source)
+ */
+int get_next_token_offset (TokenQueue* input)
+{
+    if (TokenQueue_is_empty(input)) {
+        Error_throw_printf("Unexpected end of input\n");
+    }
+    return TokenQueue_peek(input)->offset;
+}
+
 /**
  * @brief Check next token for a particular type and text and discard it
  * 
@@ -38,12 +53,13 @@ void match_and_discard_next_token (TokenQueue* input, TokenType type, const char
     if (TokenQueue_is_empty(input)) {
         Error_throw_printf("Unexpected end of input (expected \'%s\')\n", text);
     }
-    Token* token = TokenQueue_remove(input);
+    /* leave a mismatched token in the queue so the driver can point at it */
+    Token* token = TokenQueue_peek(input);
     if (token->type != type || !token_str_eq(token->text, text)) {
         Error_throw_printf("Expected \'%s\' but found '%s' on line %d\n",
-                text, token->text, get_next_token_line(input));
+                text, token->text, token->line);
     }
-    Token_free(token);
+    Token_free(TokenQueue_remove(input));
 }
 
 /**
@@ -94,6 +110,47 @@ bool check_next_token (TokenQueue* input, TokenType type, const char* text)
     return (token->type == type) && (token_str_eq(token->text, text));
 }
 
+/**
+ * @brief Look ahead at the kind of the next token
+ * 
+ * @param input Token queue to examine
+ * @returns Kind of the next token (@c TK_EOF if there are no more tokens)
+ */
+TokenKind next_token_kind (TokenQueue* input)
+{
+    Token* token = TokenQueue_peek(input);
+    return (token != NULL ? token->kind : TK_EOF);
+}
+
+/**
+ * @brief Look ahead at the kind of the token after the next one
+ * 
+ * @param input Token queue to examine
+ * @returns Kind of the second token (@c TK_EOF if there is no such token)
+ */
+TokenKind second_token_kind (TokenQueue* input)
+{
+    Token* token = TokenQueue_peek(input);
+    return (token != NULL && token->next != NULL ? token->next->kind : TK_EOF);
+}
+
+/**
+ * @brief Check that an integer literal token fits in 32 bits
+ *
+ * Throws an error if the literal overflowed while it was being decoded.
+ *
+ * @param token Integer literal token (@c DECLIT or @c HEXLIT)
+ * @returns Decoded value of the literal
+ */
+int get_int_literal_value (Token* token)
+{
+    if (token->overflow) {
+        Error_throw_printf("Integer literal '%s' out of range on line %d\n",
+                token->text, token->line);
+    }
+    return token->value;
+}
+
 /*
  * NODE-LEVEL PARSING FUNCTIONS
  */
@@ -103,6 +160,91 @@ ASTNode* parse_loc(TokenQueue* input);
 ASTNode* parse_expr(TokenQueue* input);
 ASTNode* parse_block(TokenQueue* input);
 
+/*
+ * PARTIAL RESULTS
+ *
+ * A syntax error unwinds straight to the trap in parse(), past every parsing
+ * function on the way. Each of them records the structures it has built but
+ * not yet handed to its caller (or to a bigger structure) here, and parse()
+ * frees whatever is still recorded when an error arrives.
+ */
+
+/**
+ * @brief Structure held by a parsing function
+ */
+typedef struct Held
+{
+    enum { HELD_NODE, HELD_TOKEN, HELD_LIST, HELD_PARAMS } kind;
+    void* item;             /**< @brief ASTNode, Token, NodeList or ParameterList */
+} Held;
+
+/**
+ * @brief Partial results stored inline before falling back to the heap
+ * (enough for about 20 levels of nesting)
+ */
+#define HELD_INLINE 64
+
+/**
+ * @brief Partial results of the parse running on this thread
+ */
+static _Thread_local Held held_storage[HELD_INLINE];
+static _Thread_local Held* held = NULL;
+static _Thread_local int nheld = 0;
+static _Thread_local int held_capacity = 0;
+
+/**
+ * @brief Record a partial result (freed if the parse fails)
+ */
+void hold_partial (int kind, void* item)
+{
+    if (held == NULL) {
+        held = held_storage;
+        held_capacity = HELD_INLINE;
+    } else if (nheld == held_capacity) {
+        held_capacity *= 2;
+        Held* more = (Held*)malloc(sizeof(Held) * held_capacity);
+        CHECK_MALLOC_PTR(more)
+        memcpy(more, held, sizeof(Held) * nheld);
+        if (held != held_storage) {
+            free(held);
+        }
+        held = more;
+    }
+    held[nheld].kind = kind;
+    held[nheld].item = item;
+    nheld++;
+}
+
+/**
+ * @brief Forget the partial results recorded since @c mark (they have been
+ * handed on)
+ */
+void release_partials (int mark)
+{
+    nheld = mark;
+}
+
+/**
+ * @brief Free the partial results recorded since @c mark, newest first
+ */
+void free_partials (int mark)
+{
+    while (nheld > mark) {
+        Held* h = &held[--nheld];
+        switch (h->kind) {
+            case HELD_NODE:     ASTNode_free((ASTNode*)h->item); break;
+            case HELD_TOKEN:    Token_free((Token*)h->item); break;
+            case HELD_LIST:     NodeList_free((NodeList*)h->item); break;
+            case HELD_PARAMS:   ParameterList_free((ParameterList*)h->item); break;
+        }
+    }
+    if (mark == 0 && held != held_storage) {
+        free(held);
+        held = NULL;
+        held_capacity = 0;
+    }
+}
+
 /**
  * @brief Parse and return a Decaf type
  * 
@@ -115,9 +257,9 @@ DecafType parse_type (TokenQueue* input)
         Error_throw_printf("Unexpected end of input (expected int, bool, or void)\n");
     }
 
-    Token* token = TokenQueue_remove(input);
+    Token* token = TokenQueue_peek(input);
     if (token->type != KEY) {
-        Error_throw_printf("Invalid type '%s' on line %d\n", token->text, get_next_token_line(input));
+        Error_throw_printf("Invalid type '%s' on line %d\n", token->text, token->line);
     }
     DecafType t = VOID;
     if (token_str_eq("int", token->text)) {
@@ -127,31 +269,33 @@ DecafType parse_type (TokenQueue* input)
     } else if (token_str_eq("void", token->text)) {
         t = VOID;
     } else {
-        Error_throw_printf("Invalid type '%s' on line %d\n", token->text, get_next_token_line(input));
+        Error_throw_printf("Invalid type '%s' on line %d\n", token->text, token->line);
     }
-    Token_free(token);
+    Token_free(TokenQueue_remove(input));
     return t;
 }
 
 /**
- * @brief Parse and return a Decaf identifier
+ * @brief Parse a Decaf identifier
+ * 
+ * The identifier token is removed from the queue and handed to the caller,
+ * so that its text can be passed straight to a node constructor without
+ * being copied into a temporary buffer first.
  * 
  * @param input Token queue to modify
- * @param buffer String buffer for parsed identifier (should be at least
- * @c MAX_TOKEN_LEN characters long)
+ * @returns Identifier token (the caller must free it with @ref Token_free)
  */
-void parse_id (TokenQueue* input, char* buffer)
+Token* parse_id (TokenQueue* input)
 {
     if (TokenQueue_is_empty(input)) {
         Error_throw_printf("Unexpected end of input (expected id token)\n");
     }
 
-    Token* token = TokenQueue_remove(input);
+    Token* token = TokenQueue_peek(input);
     if (token->type != ID) {
-        Error_throw_printf("Invalid ID '%s' on line %d\n", token->text, get_next_token_line(input));
+        Error_throw_printf("Invalid ID '%s' on line %d\n", token->text, token->line);
     }
-    snprintf(buffer, MAX_ID_LEN, "%s", token->text);
-    Token_free(token);
+    return TokenQueue_remove(input);
 }
 
 ASTNode* parse_vardecl(TokenQueue* input)
@@ -162,30 +306,36 @@ ASTNode* parse_vardecl(TokenQueue* input)
     }
     
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
     DecafType type = parse_type(input);
-
-    char* buffer = malloc (MAX_TOKEN_LEN);
-    parse_id(input, buffer);
+    int mark = nheld;
+    Token* id = parse_id(input);
+    hold_partial(HELD_TOKEN, id);
 
     ASTNode* n = NULL;
     // if next token is symbol -> VarDecl is an array assignment
     if (check_next_token(input, SYM, "[")) {
         match_and_discard_next_token(input, SYM, "[");
-        if (!check_next_token_type(input, DECLIT)) {
+        if (TokenQueue_is_empty(input)) {
+            Error_throw_printf("Unexpected end of input (expected array size)\n");
+        } else if (!check_next_token_type(input, DECLIT)) {
             Error_throw_printf("Invalid array size '%s' on line %d\n", TokenQueue_peek(input)->text, line);
         } else {
-            Token* token = TokenQueue_remove(input);
-            // convert dec string to int
-            int length = (int) strtol(token->text, NULL, 10);
-            n = VarDeclNode_new(buffer, type, true, length, line);
+            int length = get_int_literal_value(TokenQueue_peek(input));
+            Token_free(TokenQueue_remove(input));
+            n = VarDeclNode_new(id->text, type, true, length, line);
+            n->source_offset = offset;
+            hold_partial(HELD_NODE, n);
             match_and_discard_next_token(input, SYM, "]");
-            Token_free(token);
         }
     } else {
-        n = VarDeclNode_new(buffer, type, false, 1, line);
+        n = VarDeclNode_new(id->text, type, false, 1, line);
+        n->source_offset = offset;
+        hold_partial(HELD_NODE, n);
     }
     match_and_discard_next_token(input, SYM, ";");
-    free(buffer);
+    release_partials(mark);
+    Token_free(id);
     return n;
 }
 
@@ -197,10 +347,12 @@ ParameterList* parse_params(TokenQueue* input) {
 
     // parse first param
     ParameterList* params = ParameterList_new();
+    int mark = nheld;
+    hold_partial(HELD_PARAMS, params);
     DecafType type = parse_type(input);
-    char* buffer = malloc (MAX_TOKEN_LEN);
-    parse_id(input, buffer);
-    ParameterList_add_new(params, buffer, type);
+    Token* id = parse_id(input);
+    ParameterList_add_new(params, id->text, type);
+    Token_free(id);
 
     // if next token is "," then more params present -> keep parsing
     // and adding to param list until ")" is seen
@@ -208,62 +360,47 @@ ParameterList* parse_params(TokenQueue* input) {
         while (!check_next_token(input, SYM, ")")) {
             match_and_discard_next_token(input, SYM, ",");
             type = parse_type(input);
-            buffer = malloc (MAX_TOKEN_LEN);
-            parse_id(input, buffer);
-            ParameterList_add_new(params, buffer, type);
+            id = parse_id(input);
+            ParameterList_add_new(params, id->text, type);
+            Token_free(id);
         }
     }
 
-    free(buffer);
+    release_partials(mark);
     return params;
 }
 
-ASTNode* parse_lit(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input (expected DEC, HEX, STR, false, or true)\n");
-    }
+/**
+ * @brief Build a literal node from a literal token
+ *
+ * @param token @c DECLIT, @c HEXLIT, @c STRLIT, @c true or @c false token
+ * @returns Literal AST node
+ */
+ASTNode* build_literal (Token* token)
+{
+    int line = token->line;
+    ASTNode* n = NULL;
 
-    // get line number of literal
-    int line = get_next_token_line(input);
-    Token* token = NULL;
+    if (token->kind == TK_DECLIT || token->kind == TK_HEXLIT) {
+        n = LiteralNode_new_int(get_int_literal_value(token), line);
 
-    // check if next token type is DECLIT, HEXLIT, KEY, or STRLIT 
-    // and return corresponding node
-    ASTNode* n = NULL;
-    if (check_next_token_type(input, DECLIT)) {
-        token = TokenQueue_remove(input);
-        // convert dec string to int
-        int i = (int) strtol(token->text, NULL, 10); 
-        n = LiteralNode_new_int(i, line);
-    
-    } else if (check_next_token_type(input, HEXLIT)) {
-        token = TokenQueue_remove(input);
-        // convert hex string to int
-        int hex = (int) strtol(token->text, NULL, 16); 
-        n = LiteralNode_new_int(hex, line);
-
-    } else if (check_next_token_type(input, KEY)) {
-        if (check_next_token(input, KEY, "true")) {
-            n = LiteralNode_new_bool(true, line);
-            TokenQueue_remove(input);
-        } else {
-            n = LiteralNode_new_bool(false, line);
-            TokenQueue_remove(input);
-        }
+    } else if (token->kind == TK_TRUE || token->kind == TK_FALSE) {
+        n = LiteralNode_new_bool(token->kind == TK_TRUE, line);
 
     } else {
-        token = TokenQueue_remove(input);
         // remove surrounding quotes from string lit
-        char *p = token->text + 1;
+        char text[MAX_TOKEN_LEN];
+        snprintf(text, MAX_TOKEN_LEN, "%s", token->text);
+        char *p = text + 1;
         p[strlen(p)-1] = 0;
 
         // fixing escape characters
-        char *buffer = calloc(MAX_TOKEN_LEN, sizeof(char));
         char* p2 = strstr(p, "\\");
         int count = 0;
         int i = 0;
 
         if (p2) {
+            char buffer[MAX_TOKEN_LEN] = "";
             while (strstr( p2 + i, "\\")) {
             count++;
             i++;
@@ -294,11 +431,10 @@ ASTNode* parse_lit(TokenQueue* input) {
             }
             n = LiteralNode_new_string(buffer, line);
         } else {
-            return LiteralNode_new_string(p, line);
+            n = LiteralNode_new_string(p, line);
         }
-        
     }
-    Token_free(token);
+    n->source_offset = token->offset;
     return n;
 }
 
@@ -309,6 +445,8 @@ NodeList* parse_args(TokenQueue* input) {
 
     // get line number of args
     NodeList* args = NodeList_new();
+    int mark = nheld;
+    hold_partial(HELD_LIST, args);
     ASTNode* expr = parse_expr(input);
     NodeList_add(args, expr);
 
@@ -321,6 +459,7 @@ NodeList* parse_args(TokenQueue* input) {
             NodeList_add(args, expr);
         }
     }
+    release_partials(mark);
     return args;
 }
 
@@ -331,267 +470,322 @@ ASTNode* parse_funccall(TokenQueue* input) {
 
     // get line number of func call
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
 
     // parse func call id
-    char* buffer = malloc (MAX_TOKEN_LEN);
-    parse_id(input, buffer);
+    int mark = nheld;
+    Token* id = parse_id(input);
+    hold_partial(HELD_TOKEN, id);
     
     // get args of func call
-    NodeList* args  = NodeList_new();
+    NodeList* args;
     match_and_discard_next_token(input, SYM, "(");
     if (!check_next_token(input, SYM, ")")) {
         args = parse_args(input);
-    } 
+    } else {
+        args = NodeList_new();
+    }
+    hold_partial(HELD_LIST, args);
 
     match_and_discard_next_token(input, SYM, ")");
-    ASTNode* n = FuncCallNode_new(buffer, args, line);
+    ASTNode* n = FuncCallNode_new(id->text, args, line);
+    n->source_offset = offset;
 
-    free(buffer);
+    release_partials(mark);
+    Token_free(id);
     return n;
 }
 
-ASTNode* parse_base_expr(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input (expected another expression, location, function call, or literal");
-    }
-
-    // get line number of base expression
-    int line = get_next_token_line(input);
-    ASTNode* n = NULL;
-
-    // if next token is "(" then there is another expr and should parse expr
-    if (check_next_token(input, SYM, "(")) {
-        match_and_discard_next_token(input, SYM, "(");
-        n = parse_expr(input);
-        match_and_discard_next_token(input, SYM, ")");
+/*
+ * TABLE-DRIVEN EXPRESSION PARSING
+ *
+ * Expressions are parsed by an LL(1) engine rather than by one function per
+ * precedence level. The grammar lives in grammar.txt; tools/llgen turns it
+ * into the tables in expr-table.c (see lltable.h for the encoding). The engine
+ * keeps two stacks: grammar symbols still to be matched, and the values
+ * (subtrees, identifier tokens and argument lists) that the semantic actions
+ * combine into the same AST the recursive-descent parser used to build.
+ */
 
-    // if next token is ID and next next token is () then parse next token as FuncCall
-    } else if (check_next_token_type(input, ID) && token_str_eq(input->head->next->text, "(")) {
-        n = parse_funccall(input);
-    
-    // if next token is ID then parse next token as location   
-    } else if (check_next_token_type(input, ID)) {
-        n = parse_loc(input);
-
-    // if next token is literal then parse next token as Lit
-    } else if (check_next_token_type(input, DECLIT) || check_next_token_type(input, HEXLIT)
-                || check_next_token_type(input, STRLIT) || check_next_token(input, KEY, "true")
-                || check_next_token(input, KEY, "false")){
-        n = parse_lit(input);
-    
-    // If token doesn't match any statements above -> invalid base expr throw error
-    } else {
-        Token* t = TokenQueue_remove(input);
-        Error_throw_printf("Invalid base expression \'%s\' on line %d\n", t->text, line);
-        Token_free(t);
-    }
-    return n;
-}
+/**
+ * @brief Entry on the expression parser's symbol stack
+ */
+typedef struct ExprSymbol
+{
+    short symbol;       /**< @brief Encoded grammar symbol */
+    int line;           /**< @brief Line of the lookahead token when pushed */
+    int offset;         /**< @brief Offset of the lookahead token when pushed */
+} ExprSymbol;
 
-ASTNode* parse_neg(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input (expected unary operator: - or !)\n");
-    }
+/**
+ * @brief Entry on the expression parser's value stack
+ */
+typedef struct ExprValue
+{
+    ASTNode* node;      /**< @brief Subexpression (or @c NULL) */
+    Token* token;       /**< @brief Identifier token (or @c NULL) */
+    NodeList* list;     /**< @brief Argument list (or @c NULL) */
+    int line;           /**< @brief Line where the subexpression begins */
+    int offset;         /**< @brief Offset where the subexpression begins */
+} ExprValue;
 
-    // get line number of negate expression
-    int line = get_next_token_line(input);
-    ASTNode* root = NULL;
+/**
+ * @brief Stack entries stored inline before falling back to the heap
+ */
+#define EXPR_STACK_INLINE 64
 
-    if (check_next_token(input, SYM, "-") || check_next_token(input, SYM, "!")) {
-        ASTNode* new_root = NULL;
-        ASTNode* child = NULL;
+/**
+ * @brief Symbol and value stacks for one expression
+ */
+typedef struct ExprStacks
+{
+    ExprSymbol* symbols;
+    int nsymbols;
+    int symbol_capacity;
+    ExprValue* values;
+    int nvalues;
+    int value_capacity;
+    ExprSymbol symbol_storage[EXPR_STACK_INLINE];
+    ExprValue value_storage[EXPR_STACK_INLINE];
+} ExprStacks;
 
-        if (check_next_token(input, SYM, "-")) { 
-            match_and_discard_next_token(input, SYM, "-");
-            child = parse_base_expr(input);
-            new_root = UnaryOpNode_new(NEGOP, child, line);
-            root = new_root;
-        } else {
-            match_and_discard_next_token(input, SYM, "!");
-            child = parse_base_expr(input);
-            new_root = UnaryOpNode_new(NOTOP, child, line);
-            root = new_root;
-        }
+/**
+ * @brief Make room for one more element in a stack
+ *
+ * @param items Pointer to stack array (updated if it moves)
+ * @param capacity Pointer to capacity (updated if it grows)
+ * @param storage Inline storage (not freed)
+ * @param size Size of a stack element
+ */
+void grow_expr_stack (void** items, int* capacity, void* storage, size_t size)
+{
+    int new_capacity = *capacity * 2;
+    void* new_items = NULL;
+    if (*items == storage) {
+        new_items = malloc(new_capacity * size);
+        CHECK_MALLOC_PTR(new_items)
+        memcpy(new_items, *items, *capacity * size);
     } else {
-        root = parse_base_expr(input);
+        new_items = realloc(*items, new_capacity * size);
+        CHECK_MALLOC_PTR(new_items)
     }
-    return root;
+    *items = new_items;
+    *capacity = new_capacity;
 }
 
-ASTNode* parse_mult(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
-    }
-
-    // get line number of multiplicative expression
-    int line = get_next_token_line(input);
-    ASTNode* root = parse_neg(input);
-
-    while (check_next_token(input, SYM, "*") || check_next_token(input, SYM, "/")
-            || check_next_token(input, SYM, "%")) {
-        ASTNode* new_root = NULL;
-        ASTNode* right = NULL;
-        if (check_next_token(input, SYM, "*")) {
-            match_and_discard_next_token(input, SYM, "*");
-            right = parse_neg(input);
-            new_root = BinaryOpNode_new(MULOP, root, right, line);
-            root = new_root;
-        } else if (check_next_token(input, SYM, "/")) {
-            match_and_discard_next_token(input, SYM, "/");
-            right = parse_neg(input);
-            new_root = BinaryOpNode_new(DIVOP, root, right, line);
-            root = new_root;
-        } else {
-            match_and_discard_next_token(input, SYM, "%");
-            right = parse_neg(input);
-            new_root = BinaryOpNode_new(MODOP, root, right, line);
-            root = new_root;
-        }
+void push_expr_symbol (ExprStacks* st, short symbol, int line, int offset)
+{
+    if (st->nsymbols == st->symbol_capacity) {
+        grow_expr_stack((void**)&st->symbols, &st->symbol_capacity,
+                st->symbol_storage, sizeof(ExprSymbol));
     }
-    return root; 
+    st->symbols[st->nsymbols++] = (ExprSymbol){ symbol, line, offset };
 }
 
-ASTNode* parse_arith(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
+void push_expr_value (ExprStacks* st, ExprValue value)
+{
+    if (st->nvalues == st->value_capacity) {
+        grow_expr_stack((void**)&st->values, &st->value_capacity,
+                st->value_storage, sizeof(ExprValue));
     }
+    st->values[st->nvalues++] = value;
+}
 
-    // get line number of arithmetic expression
-    int line = get_next_token_line(input);
-    ASTNode* root = parse_mult(input);
-
-    while (check_next_token(input, SYM, "+") || check_next_token(input, SYM, "-")) {
-        ASTNode* new_root = NULL;
-        ASTNode* right = NULL;
-        if (check_next_token(input, SYM, "+")) {
-            match_and_discard_next_token(input, SYM, "+");
-            right = parse_mult(input);
-            new_root = BinaryOpNode_new(ADDOP, root, right, line);
-            root = new_root;
-        } else {
-            match_and_discard_next_token(input, SYM, "-");
-            right = parse_mult(input);
-            new_root = BinaryOpNode_new(SUBOP, root, right, line);
-            root = new_root;
-        }
-    }
-    return root;
+/**
+ * @brief Push a new subexpression onto the value stack
+ */
+void push_expr_node (ExprStacks* st, ASTNode* node, int line, int offset)
+{
+    node->source_offset = offset;
+    push_expr_value(st, (ExprValue){ .node = node, .line = line, .offset = offset });
 }
 
-ASTNode* parse_relational(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
+/**
+ * @brief Check whether the literal about to be matched is the operand of a
+ * unary minus (its token is on top of the symbol stack, with "@unop(NEGOP)"
+ * right under it)
+ */
+bool literal_is_negated (ExprStacks* st)
+{
+    if (st->nsymbols < 2) {
+        return false;
     }
+    short below = st->symbols[st->nsymbols - 2].symbol;
+    return !LL_IS_TERMINAL(below) && !LL_IS_NT(below) &&
+           ll_actions[LL_INDEX(below)].type == LL_UNOP && ll_actions[LL_INDEX(below)].arg == NEGOP;
+}
 
-    // get line number of relational expression
-    int line = get_next_token_line(input);
-    ASTNode* root = parse_arith(input);
-
-    while (check_next_token(input, SYM, "<") || check_next_token(input, SYM, "<=")
-            || check_next_token(input, SYM, ">") || check_next_token(input, SYM, ">=")) {
-        ASTNode* new_root = NULL;
-        ASTNode* right = NULL;
-        if (check_next_token(input, SYM, "<")) {
-            match_and_discard_next_token(input, SYM, "<");
-            right = parse_arith(input);
-            new_root = BinaryOpNode_new(LTOP, root, right, line);
-            root = new_root;
-        } else if (check_next_token(input, SYM, "<=")){
-            match_and_discard_next_token(input, SYM, "<=");
-            right = parse_arith(input);
-            new_root = BinaryOpNode_new(LEOP, root, right, line);
-            root = new_root;
-        } else if (check_next_token(input, SYM, ">")){
-            match_and_discard_next_token(input, SYM, ">");
-            right = parse_arith(input);
-            new_root = BinaryOpNode_new(GTOP, root, right, line);
-            root = new_root;
-        } else {
-            match_and_discard_next_token(input, SYM, ">=");
-            right = parse_arith(input);
-            new_root = BinaryOpNode_new(GEOP, root, right, line);
-            root = new_root;
+/**
+ * @brief Run a semantic action
+ *
+ * @param st Parser stacks
+ * @param action Action to run
+ * @param pos Action symbol (holds the position of the lookahead token when
+ * the action's production was chosen)
+ * @param lookahead Next token in the input
+ */
+void run_expr_action (ExprStacks* st, const LLAction* action, ExprSymbol pos, Token* lookahead)
+{
+    switch (action->type) {
+        case LL_BINOP: {
+            ExprValue right = st->values[--st->nvalues];
+            ExprValue left = st->values[--st->nvalues];
+            push_expr_node(st, BinaryOpNode_new(action->arg, left.node, right.node, left.line),
+                    left.line, left.offset);
+            break;
+        }
+        case LL_UNOP: {
+            ExprValue child = st->values[--st->nvalues];
+            push_expr_node(st, UnaryOpNode_new(action->arg, child.node, pos.line),
+                    pos.line, pos.offset);
+            break;
+        }
+        case LL_PAREN: {
+            /* the subexpression keeps its own line, but begins at the '(' */
+            ExprValue* top = &st->values[st->nvalues - 1];
+            top->line = pos.line;
+            top->offset = pos.offset;
+            break;
+        }
+        case LL_LIT: {
+            /* 2^31 is only in range negated: build -2^31 and drop the negation */
+            if (lookahead->overflow && lookahead->value == INT32_MIN && literal_is_negated(st)) {
+                ExprSymbol negation = st->symbols[st->nsymbols - 2];
+                st->symbols[st->nsymbols - 2] = st->symbols[st->nsymbols - 1];
+                st->nsymbols--;
+                push_expr_node(st, LiteralNode_new_int(INT32_MIN, negation.line),
+                        negation.line, negation.offset);
+                break;
+            }
+            ASTNode* n = build_literal(lookahead);
+            push_expr_node(st, n, lookahead->line, lookahead->offset);
+            break;
+        }
+        case LL_LOC: {
+            ExprValue id = st->values[--st->nvalues];
+            push_expr_node(st, LocationNode_new(id.token->text, NULL, id.line), id.line, id.offset);
+            Token_free(id.token);
+            break;
+        }
+        case LL_INDEX: {
+            ExprValue index = st->values[--st->nvalues];
+            ExprValue id = st->values[--st->nvalues];
+            push_expr_node(st, LocationNode_new(id.token->text, index.node, id.line), id.line, id.offset);
+            Token_free(id.token);
+            break;
+        }
+        case LL_ARGS:
+            push_expr_value(st, (ExprValue){ .list = NodeList_new() });
+            break;
+        case LL_ARG: {
+            ExprValue arg = st->values[--st->nvalues];
+            NodeList_add(st->values[st->nvalues - 1].list, arg.node);
+            break;
+        }
+        case LL_CALL: {
+            ExprValue args = st->values[--st->nvalues];
+            ExprValue id = st->values[--st->nvalues];
+            push_expr_node(st, FuncCallNode_new(id.token->text, args.list, id.line), id.line, id.offset);
+            Token_free(id.token);
+            break;
         }
     }
-    return root;
 }
 
-ASTNode* parse_equality(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
-    }
+/**
+ * @brief Run the LL(1) engine until the start symbol has been matched
+ *
+ * @param input Token queue to modify
+ * @param st Parser stacks (the result is left on the value stack)
+ */
+void run_expr_table (TokenQueue* input, ExprStacks* st)
+{
+    Token* lookahead = TokenQueue_peek(input);
+    push_expr_symbol(st, LL_NT(0), lookahead->line, lookahead->offset);
+
+    while (st->nsymbols > 0) {
+        ExprSymbol top = st->symbols[--st->nsymbols];
+        lookahead = TokenQueue_peek(input);
+        TokenKind kind = (lookahead != NULL ? lookahead->kind : TK_EOF);
+
+        if (LL_IS_TERMINAL(top.symbol)) {
+            /* match a token */
+            if (kind != LL_KIND(top.symbol)) {
+                if (lookahead == NULL) {
+                    Error_throw_printf("Unexpected end of input (expected \'%s\')\n",
+                            TokenKind_to_string(LL_KIND(top.symbol)));
+                }
+                Error_throw_printf("Expected \'%s\' but found '%s' on line %d\n",
+                        TokenKind_to_string(LL_KIND(top.symbol)), lookahead->text, lookahead->line);
+            }
+            Token* token = TokenQueue_remove(input);
+            if (top.symbol & LL_KEEP) {
+                push_expr_value(st, (ExprValue){ .token = token,
+                        .line = token->line, .offset = token->offset });
+            } else {
+                Token_free(token);
+            }
+
+        } else if (LL_IS_NT(top.symbol)) {
+            /* expand a nonterminal (pushing the right-hand side in reverse) */
+            int p = ll_table[LL_INDEX(top.symbol)][kind];
+            if (p == 0) {
+                if (lookahead == NULL) {
+                    Error_throw_printf("Unexpected end of input (expected expression)\n");
+                }
+                Error_throw_printf("Invalid expression \'%s\' on line %d\n",
+                        lookahead->text, lookahead->line);
+            }
+            const LLProduction* prod = &ll_productions[p];
+            for (int i = prod->length - 1; i >= 0; i--) {
+                push_expr_symbol(st, prod->rhs[i], lookahead->line, lookahead->offset);
+            }
 
-    // get line number of equality expression
-    int line = get_next_token_line(input);
-    ASTNode* root = parse_relational(input);
-
-    while (check_next_token(input, SYM, "==") || check_next_token(input, SYM, "!=")) {
-        ASTNode* new_root = NULL;
-        ASTNode* right = NULL;
-        if (check_next_token(input, SYM, "==")) {
-            match_and_discard_next_token(input, SYM, "==");
-            right = parse_relational(input);
-            new_root = BinaryOpNode_new(EQOP, root, right, line);
-            root = new_root;
         } else {
-            match_and_discard_next_token(input, SYM, "!=");
-            right = parse_relational(input);
-            new_root = BinaryOpNode_new(NEQOP, root, right, line);
-            root = new_root;
+            run_expr_action(st, &ll_actions[LL_INDEX(top.symbol)], top, lookahead);
         }
     }
-    return root;
 }
 
-ASTNode* parse_and(TokenQueue* input) {
+ASTNode* parse_expr(TokenQueue* input) {
     if (TokenQueue_is_empty(input)) {
         Error_throw_printf("Unexpected end of input\n");
     }
 
-    // get line number of logical OR expression
-    int line = get_next_token_line(input);
-    ASTNode* root = parse_equality(input);
-
-    while (check_next_token(input, SYM, "&&")) {
-        ASTNode* new_root = NULL;
-        ASTNode* right = NULL;
-        if (check_next_token(input, SYM, "&&")) {
-            match_and_discard_next_token(input, SYM, "&&");
-            right = parse_equality(input);
-            new_root = BinaryOpNode_new(ANDOP, root, right, line);
-            root = new_root;
+    ExprStacks st;
+    st.symbols = st.symbol_storage;
+    st.nsymbols = 0;
+    st.symbol_capacity = EXPR_STACK_INLINE;
+    st.values = st.value_storage;
+    st.nvalues = 0;
+    st.value_capacity = EXPR_STACK_INLINE;
+
+    /* on a syntax error, free partial results before passing the error on */
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    bool failed = false;
+    if (setjmp(trap.env) == 0) {
+        run_expr_table(input, &st);
+    } else {
+        failed = true;
+        for (int i = 0; i < st.nvalues; i++) {
+            if (st.values[i].node != NULL) ASTNode_free(st.values[i].node);
+            if (st.values[i].token != NULL) Token_free(st.values[i].token);
+            if (st.values[i].list != NULL) NodeList_free(st.values[i].list);
         }
     }
-    return root;
-}
+    ErrorTrap_pop(&trap);
 
-ASTNode* parse_or(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
+    ASTNode* n = (failed ? NULL : st.values[0].node);
+    if (st.symbols != st.symbol_storage) {
+        free(st.symbols);
     }
-
-    // get line number of logical OR expression
-    int line = get_next_token_line(input);
-    ASTNode* root = parse_and(input);
-
-    while (check_next_token(input, SYM, "||")) {
-        ASTNode* new_root = NULL;
-        ASTNode* right = NULL;
-        if (check_next_token(input, SYM, "||")) {
-            match_and_discard_next_token(input, SYM, "||");
-            right = parse_and(input);
-            new_root = BinaryOpNode_new(OROP, root, right, line);
-            root = new_root;
-        }
+    if (st.values != st.value_storage) {
+        free(st.values);
     }
-    return root;
-}
-
-ASTNode* parse_expr(TokenQueue* input) {
-    if (TokenQueue_is_empty(input)) {
-        Error_throw_printf("Unexpected end of input\n");
+    if (failed) {
+        Error_throw_printf("%s", trap.message);
     }
-    ASTNode* n = parse_or(input);
     return n;
 }
 
@@ -601,6 +795,7 @@ ASTNode* parse_conditional(TokenQueue* input) {
     }
 
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
 
     // grammar: if ‘(’ Expr ‘)’ Block (else Block)?
  
@@ -614,17 +809,23 @@ ASTNode* parse_conditional(TokenQueue* input) {
 
     Token_free(TokenQueue_remove(input));
     match_and_discard_next_token(input, SYM, "(");
+    int mark = nheld;
     condition = parse_expr(input);
+    hold_partial(HELD_NODE, condition);
     match_and_discard_next_token(input, SYM, ")");
 
     if_block = parse_block(input);
+    hold_partial(HELD_NODE, if_block);
 
     if (check_next_token(input, KEY, "else")) {
         match_and_discard_next_token(input, KEY, "else");
         else_block = parse_block(input);
     }
 
+    release_partials(mark);
     n = ConditionalNode_new(condition, if_block, else_block, line);
+
+    n->source_offset = offset;
     return n;
 }
 
@@ -635,23 +836,29 @@ ASTNode* parse_loc(TokenQueue* input) {
 
     // get line number of location
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
 
     // get name of location
-    char* buffer = malloc (MAX_TOKEN_LEN);
-    parse_id(input, buffer);
+    int mark = nheld;
+    Token* id = parse_id(input);
+    hold_partial(HELD_TOKEN, id);
 
     ASTNode* n = NULL;
     // if next token is SYM -> Loc is an array assignment
     if (check_next_token(input, SYM, "[")) {
         match_and_discard_next_token(input, SYM, "[");
         ASTNode* index = parse_expr(input);
-        n = LocationNode_new(buffer, index, line);
+        n = LocationNode_new(id->text, index, line);
+        n->source_offset = offset;
+        hold_partial(HELD_NODE, n);
         match_and_discard_next_token(input, SYM, "]");
     } else {
-        n = LocationNode_new(buffer, NULL, line);
+        n = LocationNode_new(id->text, NULL, line);
+        n->source_offset = offset;
     }
 
-    free(buffer);
+    release_partials(mark);
+    Token_free(id);
     return n;
 }
 
@@ -667,6 +874,7 @@ ASTNode* parse_while(TokenQueue* input) {
     // n = WhileLoopNode_new
 
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
     
     ASTNode* n = NULL;
     ASTNode* expr = NULL;
@@ -675,11 +883,15 @@ ASTNode* parse_while(TokenQueue* input) {
     Token_free(TokenQueue_remove(input));
 
     match_and_discard_next_token(input, SYM, "(");
+    int mark = nheld;
     expr = parse_expr(input);
+    hold_partial(HELD_NODE, expr);
 
     match_and_discard_next_token(input, SYM, ")");
     block = parse_block(input);
+    release_partials(mark);
     n = WhileLoopNode_new(expr, block, line);
+    n->source_offset = offset;
 
     return n;
 }
@@ -691,53 +903,76 @@ ASTNode* parse_statement(TokenQueue* input) {
 
     // get line number of statement
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
 
     ASTNode* n = NULL;
+    int mark = nheld;
     // check what kind of statement and return appropriate statement node
-    if (check_next_token(input, KEY, "break")) {
-       Token_free(TokenQueue_remove(input));
-        n = BreakNode_new(line);
-        match_and_discard_next_token(input, SYM, ";");
-
-    } else if (check_next_token(input, KEY, "continue")) {
-       Token_free(TokenQueue_remove(input));
-        n = ContinueNode_new(line);
-        match_and_discard_next_token(input, SYM, ";");
-
-    } else if (check_next_token(input, KEY, "return")) {
-        // get val from calling parse_expr
-        ASTNode* val = NULL;
-        Token_free(TokenQueue_remove(input));
-        // if ";" is not next token then parse return val
-        if (!check_next_token(input, SYM, ";")) {
-            val = parse_expr(input);
+    switch (next_token_kind(input)) {
+        case TK_BREAK:
+            Token_free(TokenQueue_remove(input));
+            n = BreakNode_new(line);
+            n->source_offset = offset;
+            hold_partial(HELD_NODE, n);
+            match_and_discard_next_token(input, SYM, ";");
+            break;
+
+        case TK_CONTINUE:
+            Token_free(TokenQueue_remove(input));
+            n = ContinueNode_new(line);
+            n->source_offset = offset;
+            hold_partial(HELD_NODE, n);
+            match_and_discard_next_token(input, SYM, ";");
+            break;
+
+        case TK_RETURN: {
+            // get val from calling parse_expr
+            ASTNode* val = NULL;
+            Token_free(TokenQueue_remove(input));
+            // if ";" is not next token then parse return val
+            if (next_token_kind(input) != TK_SEMICOLON) {
+                val = parse_expr(input);
+            }
+            n = ReturnNode_new(val, line);
+            n->source_offset = offset;
+            hold_partial(HELD_NODE, n);
+            match_and_discard_next_token(input, SYM, ";");
+            break;
         }
-        n = ReturnNode_new(val, line);
-        match_and_discard_next_token(input, SYM, ";");
 
-    } else if (check_next_token(input, KEY, "while")) {
-        n = parse_while(input);
-    
-    } else if (check_next_token(input, KEY, "if")) {
-        n = parse_conditional(input);
-    
-    // if next token is ID and next next token is () then parse next token as FuncCall
-    } else if (check_next_token_type(input, ID) && token_str_eq(input->head->next->text, "(")) {
-        n = parse_funccall(input);
-        match_and_discard_next_token(input, SYM, ";");
-
-    // parse location
-    } else if (check_next_token_type(input, ID)) {
-        ASTNode* loc = parse_loc(input);
-        match_and_discard_next_token(input, SYM, "=");
-        ASTNode* value = parse_expr(input);
-        n = AssignmentNode_new(loc, value, line);
-        match_and_discard_next_token(input, SYM, ";");
-    
-    // If token does not match any statements above -> invalid statement throw error
-    } else {
-        Error_throw_printf("Invalid statement on line %d\n", line);
+        case TK_WHILE:
+            n = parse_while(input);
+            break;
+
+        case TK_IF:
+            n = parse_conditional(input);
+            break;
+
+        case TK_ID:
+            if (second_token_kind(input) == TK_LPAREN) {
+                // ID followed by "(" is a FuncCall
+                n = parse_funccall(input);
+                hold_partial(HELD_NODE, n);
+                match_and_discard_next_token(input, SYM, ";");
+            } else {
+                // otherwise it is the location of an assignment
+                ASTNode* loc = parse_loc(input);
+                hold_partial(HELD_NODE, loc);
+                match_and_discard_next_token(input, SYM, "=");
+                ASTNode* value = parse_expr(input);
+                release_partials(mark);
+                n = AssignmentNode_new(loc, value, line);
+                n->source_offset = offset;
+                hold_partial(HELD_NODE, n);
+                match_and_discard_next_token(input, SYM, ";");
+            }
+            break;
+
+        // If token does not match any statements above -> invalid statement throw error
+        default:
+            Error_throw_printf("Invalid statement on line %d\n", line);
     }
+    release_partials(mark);
     return n;
 }
 
@@ -749,35 +984,39 @@ ASTNode* parse_block(TokenQueue* input) {
 
     // get line number of block
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
 
     match_and_discard_next_token(input, SYM, "{");
     NodeList* vars = NodeList_new();
     NodeList* stmnts = NodeList_new();
+    int mark = nheld;
+    hold_partial(HELD_LIST, vars);
+    hold_partial(HELD_LIST, stmnts);
     ASTNode* var = NULL;
     ASTNode* stmnt = NULL;
 
-    // if next toke is "}" then func body is empty just return
-    if (check_next_token(input, SYM, "}")) {
-        match_and_discard_next_token(input, SYM, "}");
-        return BlockNode_new(vars, stmnts, line);
-    } else {
-        // parse func body until another "}" is seen
-        while (!check_next_token(input, SYM, "}")) {
+    // parse func body until another "}" is seen
+    TokenKind kind;
+    while ((kind = next_token_kind(input)) != TK_RBRACE) {
+        switch (kind) {
             // if line of body starts with Type then parse VarDecl
-            if (check_next_token(input, KEY, "int") || check_next_token(input, KEY, "bool")
-                            || check_next_token(input, KEY, "void") ) {
+            case TK_INT:
+            case TK_BOOL:
+            case TK_VOID:
                 var = parse_vardecl(input);
                 NodeList_add(vars, var);
+                break;
             // if not parse statements
-            } else {
+            default:
                 stmnt = parse_statement(input);
                 NodeList_add(stmnts, stmnt);
-            }
         }
     }
 
     match_and_discard_next_token(input, SYM, "}");
+    release_partials(mark);
     ASTNode* n = BlockNode_new(vars, stmnts, line);
+    n->source_offset = offset;
     return n;
 }
 
@@ -790,54 +1029,100 @@ ASTNode* parse_funcdecl(TokenQueue* input) {
 
     // get line number of func decl
     int line = get_next_token_line(input);
+    int offset = get_next_token_offset(input);
 
     // get return type of func decl
     match_and_discard_next_token(input, KEY, "def");
     DecafType type = parse_type(input);
 
     // get func name
-    char* buffer = malloc (MAX_TOKEN_LEN);
-    parse_id(input, buffer);
+    int mark = nheld;
+    Token* id = parse_id(input);
+    hold_partial(HELD_TOKEN, id);
 
     // get params and body of func and create new funcdecl node
-    ParameterList* params = ParameterList_new();
+    ParameterList* params;
     match_and_discard_next_token(input, SYM, "(");
     if (!check_next_token(input, SYM, ")")) {
         params = parse_params(input);
+    } else {
+        params = ParameterList_new();
     }
+    hold_partial(HELD_PARAMS, params);
 
     match_and_discard_next_token(input, SYM, ")");
     ASTNode* body = parse_block(input);
-    ASTNode* n = FuncDeclNode_new(buffer, type, params, body, line);
+    release_partials(mark);
+    ASTNode* n = FuncDeclNode_new(id->text, type, params, body, line);
+    n->source_offset = offset;
 
-    free(buffer);
+    Token_free(id);
     return n;
 }
 
+ASTNode* parse_decl (TokenQueue* input)
+{
+    // checks next token to determine whether to parse VarDecl or FuncDecl
+    if (next_token_kind(input) == TK_DEF) {
+        return parse_funcdecl(input);
+    } else {
+        return parse_vardecl(input);
+    }
+}
+
 // Parses the program non terminal
 ASTNode* parse_program (TokenQueue* input)
 {
     NodeList* vars = NodeList_new();
     NodeList* funcs = NodeList_new();
+    int mark = nheld;
+    hold_partial(HELD_LIST, vars);
+    hold_partial(HELD_LIST, funcs);
 
     while (!TokenQueue_is_empty(input)) {
-        // checks next token to determine whether to parse VarDecl or FuncDecl
-        ASTNode* n = NULL;
-        if (check_next_token(input, KEY, "def")) {
-            n = parse_funcdecl(input);
-            NodeList_add(funcs, n);
-        } else {
-            n = parse_vardecl(input);
-            NodeList_add(vars, n);
-        }
+        ASTNode* n = parse_decl(input);
+        NodeList_add(n->type == FUNCDECL ? funcs : vars, n);
     }
+    release_partials(mark);
     return ProgramNode_new(vars, funcs);
 }
 
+/**
+ * @brief Run a parsing function, freeing its partial results if it fails
+ * before passing the error on
+ */
+ASTNode* parse_trapped (ASTNode* (*rule)(TokenQueue*), TokenQueue* input)
+{
+    int mark = nheld;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    bool failed = false;
+    ASTNode* n = NULL;
+    if (setjmp(trap.env) == 0) {
+        n = rule(input);
+    } else {
+        failed = true;
+    }
+    ErrorTrap_pop(&trap);
+
+    free_partials(mark);
+    if (failed && trap.out_of_memory) {
+        Error_out_of_memory();
+    } else if (failed) {
+        Error_throw_printf("%s", trap.message);
+    }
+    return n;
+}
+
+ASTNode* parse_declaration (TokenQueue* input)
+{
+    return parse_trapped(parse_decl, input);
+}
+
 ASTNode* parse (TokenQueue* input)
 {
     if (input == NULL) {
         Error_throw_printf("TokenQueue is NULL there are no tokens to parse\n");
     }
-    return parse_program(input);
-}
\ No newline at end of file
+    return parse_trapped(parse_program, input);
+}
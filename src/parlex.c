@@ -0,0 +1,208 @@
+/**
+ * @file parlex.c
+ * @brief Parallel lexing of large source files
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parlex.h"
+#include "p1-lexer.h"
+
+/**
+ * @brief Work item for a single lexer thread
+ */
+typedef struct LexChunk
+{
+    const char* start;      /**< @brief First character of the chunk */
+    int base;               /**< @brief Offset of the chunk in the full text */
+    size_t length;          /**< @brief Length of the chunk (in bytes) */
+    int newlines;           /**< @brief Number of newlines in the chunk */
+    TokenQueue* tokens;     /**< @brief Tokens (or @c NULL if lexing failed) */
+} LexChunk;
+
+/**
+ * @brief Count the newlines in a buffer
+ *
+ * @param text Buffer to scan
+ * @param length Length of buffer
+ * @returns Number of newline characters
+ */
+static int count_newlines (const char* text, size_t length)
+{
+    int count = 0;
+    const char* end = text + length;
+    const char* p = text;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+/**
+ * @brief Lex text sequentially and record token offsets
+ *
+ * A lexer error is rethrown, reworded if it was caused by an over-long token
+ * (see @ref Regex_explain_error).
+ *
+ * @param text String to lex
+ * @returns Newly-created queue of tokens
+ */
+static TokenQueue* lex_and_locate (const char* text)
+{
+    TokenQueue* tokens = NULL;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        tokens = lex(text);
+    }
+    ErrorTrap_pop(&trap);
+    if (tokens == NULL && trap.out_of_memory) {
+        Error_out_of_memory();
+    } else if (tokens == NULL) {
+        Regex_explain_error(trap.message);
+        Error_throw_printf("%s", trap.message);
+    }
+    TokenQueue_locate(tokens, text, 0);
+    return tokens;
+}
+
+/**
+ * @brief Thread entry point: lex a single chunk
+ *
+ * @param arg Pointer to the @ref LexChunk to process
+ * @returns Always @c NULL (results are stored in the chunk)
+ */
+static void* lex_chunk (void* arg)
+{
+    LexChunk* chunk = (LexChunk*)arg;
+    chunk->newlines = count_newlines(chunk->start, chunk->length);
+    chunk->tokens = NULL;
+
+    /* the lexer needs a NUL-terminated string */
+    char* text = (char*)malloc(chunk->length + 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    memcpy(text, chunk->start, chunk->length);
+    text[chunk->length] = '\0';
+
+    /* catch lexer errors here; the driver's jmp_buf belongs to another thread */
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        chunk->tokens = lex(text);
+        TokenQueue_locate(chunk->tokens, text, chunk->base);
+    } else {
+        chunk->tokens = NULL;
+    }
+    ErrorTrap_pop(&trap);
+
+    free(text);
+    return NULL;
+}
+
+TokenQueue* lex_parallel (const char* text, int nthreads)
+{
+    if (text == NULL) {
+        return lex(text);
+    }
+    size_t length = strlen(text);
+
+    if (nthreads <= 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpus > 0 ? (int)ncpus : 1);
+    }
+    if ((size_t)nthreads > length / PARALLEL_LEX_MIN_CHUNK) {
+        nthreads = (int)(length / PARALLEL_LEX_MIN_CHUNK);
+    }
+    if (length < PARALLEL_LEX_MIN_SIZE || nthreads <= 1) {
+        return lex_and_locate(text);
+    }
+
+    /* split into roughly equal chunks, each ending just after a newline */
+    LexChunk* chunks = (LexChunk*)calloc(nthreads, sizeof(LexChunk));
+    CHECK_MALLOC_PTR(chunks)
+    int nchunks = 0;
+    const char* end = text + length;
+    const char* start = text;
+    for (int i = 1; i <= nthreads && start < end; i++) {
+        const char* split = end;
+        if (i < nthreads) {
+            const char* target = text + (length / nthreads) * i;
+            if (target < start) {
+                target = start;
+            }
+            const char* nl = memchr(target, '\n', end - target);
+            split = (nl == NULL ? end : nl + 1);
+        }
+        chunks[nchunks].start = start;
+        chunks[nchunks].base = (int)(start - text);
+        chunks[nchunks].length = split - start;
+        nchunks++;
+        start = split;
+    }
+
+    /* lex chunks 1..n-1 on worker threads and chunk 0 on this thread */
+    pthread_t* threads = (pthread_t*)calloc(nchunks, sizeof(pthread_t));
+    CHECK_MALLOC_PTR(threads)
+    bool* started = (bool*)calloc(nchunks, sizeof(bool));
+    CHECK_MALLOC_PTR(started)
+    for (int i = 1; i < nchunks; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, lex_chunk, &chunks[i]) == 0);
+        if (!started[i]) {
+            lex_chunk(&chunks[i]);
+        }
+    }
+    lex_chunk(&chunks[0]);
+    for (int i = 1; i < nchunks; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    free(threads);
+    free(started);
+
+    /* check for errors; if any, re-lex sequentially to throw the proper error */
+    bool failed = false;
+    for (int i = 0; i < nchunks; i++) {
+        if (chunks[i].tokens == NULL) {
+            failed = true;
+        }
+    }
+    if (failed) {
+        for (int i = 0; i < nchunks; i++) {
+            if (chunks[i].tokens != NULL) {
+                TokenQueue_free(chunks[i].tokens);
+            }
+        }
+        free(chunks);
+        return lex_and_locate(text);
+    }
+
+    /* concatenate, shifting line numbers by a prefix sum of newline counts */
+    TokenQueue* result = chunks[0].tokens;
+    int line_offset = chunks[0].newlines;
+    for (int i = 1; i < nchunks; i++) {
+        TokenQueue* part = chunks[i].tokens;
+        for (Token* t = part->head; t != NULL; t = t->next) {
+            t->line += line_offset;
+        }
+        line_offset += chunks[i].newlines;
+        if (part->head != NULL) {
+            if (result->head == NULL) {
+                result->head = part->head;
+            } else {
+                result->tail->next = part->head;
+            }
+            result->tail = part->tail;
+        }
+        part->head = part->tail = NULL;
+        TokenQueue_free(part);
+    }
+    free(chunks);
+    return result;
+}
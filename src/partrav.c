@@ -0,0 +1,382 @@
+/**
+ * @file partrav.c
+ * @brief Parallel AST traversal
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "partrav.h"
+
+/**
+ * @brief Completion counter for the tasks spawned from one block
+ */
+typedef struct Join
+{
+    atomic_int pending;     /**< @brief Number of tasks not yet completed */
+    struct Join* next;      /**< @brief Next join allocated by the same worker */
+} Join;
+
+/**
+ * @brief Unit of work: a whole subtree or a run of statements
+ */
+typedef struct Task
+{
+    ASTNode* node;          /**< @brief Subtree to traverse (if @c first is @c NULL) */
+    ASTNode* first;         /**< @brief First statement of a run */
+    int count;              /**< @brief Number of statements in the run */
+    Join* join;             /**< @brief Counter to decrement when done (or @c NULL) */
+} Task;
+
+/**
+ * @brief Double-ended task queue owned by one worker
+ *
+ * The owner pushes and pops at the bottom; other workers steal from the top.
+ * Tasks are coarse (a function or a run of statements), so a lock per deque
+ * costs nothing measurable and keeps the scheduler easy to reason about.
+ */
+typedef struct TaskDeque
+{
+    pthread_mutex_t lock;
+    Task* tasks;
+    int capacity;
+    int top;                /**< @brief Index of the oldest task */
+    int bottom;             /**< @brief Index one past the newest task */
+} TaskDeque;
+
+struct Scheduler;
+
+/**
+ * @brief Per-thread scheduler state
+ */
+typedef struct Worker
+{
+    struct Scheduler* sched;
+    int index;
+    NodeVisitor* visitor;   /**< @brief This worker's private visitor */
+    TaskDeque deque;
+    Join* joins;            /**< @brief Joins allocated by this worker */
+    int next_victim;        /**< @brief Where to start looking for tasks to steal */
+    pthread_t thread;
+    bool started;
+} Worker;
+
+/**
+ * @brief Shared traversal state
+ */
+typedef struct Scheduler
+{
+    ParallelTraversal* traversal;
+    Worker* workers;
+    int nworkers;
+    atomic_int pending;         /**< @brief Tasks spawned but not yet completed */
+    atomic_bool failed;         /**< @brief Set when any callback throws */
+    pthread_mutex_t error_lock;
+    char error[MAX_ERROR_LEN];  /**< @brief First error message */
+} Scheduler;
+
+static void TaskDeque_push (TaskDeque* deque, Task task)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom == deque->capacity) {
+        if (deque->top > 0) {
+            /* slide the live tasks back to the start */
+            memmove(deque->tasks, deque->tasks + deque->top,
+                    (deque->bottom - deque->top) * sizeof(Task));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        }
+        if (deque->bottom == deque->capacity) {
+            deque->capacity = (deque->capacity == 0 ? 16 : deque->capacity * 2);
+            deque->tasks = (Task*)realloc(deque->tasks, deque->capacity * sizeof(Task));
+            CHECK_MALLOC_PTR(deque->tasks)
+        }
+    }
+    deque->tasks[deque->bottom++] = task;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static bool TaskDeque_pop (TaskDeque* deque, Task* task)
+{
+    bool found = false;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *task = deque->tasks[--deque->bottom];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool TaskDeque_steal (TaskDeque* deque, Task* task)
+{
+    bool found = false;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        *task = deque->tasks[deque->top++];
+        found = true;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/**
+ * @brief Add a task to a worker's deque
+ */
+static void spawn (Worker* worker, Task task)
+{
+    atomic_fetch_add(&worker->sched->pending, 1);
+    if (task.join != NULL) {
+        atomic_fetch_add(&task.join->pending, 1);
+    }
+    TaskDeque_push(&worker->deque, task);
+}
+
+/**
+ * @brief Find a task: the newest one on our own deque, or else the oldest
+ * one on someone else's
+ */
+static bool find_task (Worker* worker, Task* task)
+{
+    if (TaskDeque_pop(&worker->deque, task)) {
+        return true;
+    }
+    Scheduler* sched = worker->sched;
+    for (int i = 0; i < sched->nworkers; i++) {
+        int victim = (worker->next_victim + i) % sched->nworkers;
+        if (victim != worker->index && TaskDeque_steal(&sched->workers[victim].deque, task)) {
+            worker->next_victim = victim;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void visit_statements (Worker* worker, ASTNode* block);
+
+/*
+ * The per-worker traversal is generated by static-visitor.h: callbacks go
+ * through the worker's own visitor, and block statements go through
+ * visit_statements so that large blocks can be split into tasks.
+ */
+#define STATIC_VISITOR_TRAVERSE             traverse_subtree
+#define STATIC_VISITOR_STATE                Worker*
+#define STATIC_VISITOR_DISPATCH(WHEN,TYPE)  NODEVISITOR_ ## WHEN (state->visitor, node, TYPE)
+#define STATIC_VISITOR_STATEMENTS           visit_statements
+#include "static-visitor.h"
+
+static void run_task (Worker* worker, Task* task)
+{
+    if (task->first == NULL) {
+        traverse_subtree(worker, task->node);
+    } else {
+        ASTNode* stmt = task->first;
+        for (int i = 0; i < task->count; i++) {
+            traverse_subtree(worker, stmt);
+            stmt = stmt->next;
+        }
+    }
+    if (task->join != NULL) {
+        atomic_fetch_sub(&task->join->pending, 1);
+    }
+    atomic_fetch_sub(&worker->sched->pending, 1);
+}
+
+/**
+ * @brief Abandon the current task if another worker has already failed
+ */
+static void check_failed (Worker* worker)
+{
+    if (atomic_load(&worker->sched->failed)) {
+        Error_throw_printf("Parallel traversal aborted\n");
+    }
+}
+
+static void visit_statements (Worker* worker, ASTNode* block)
+{
+    int split = worker->sched->traversal->block_split;
+    int size = NodeList_size(block->block.statements);
+    if (split <= 0 || size <= split) {
+        FOR_EACH (ASTNode*, stmt, block->block.statements) {
+            traverse_subtree(worker, stmt);
+        }
+        return;
+    }
+
+    Join* join = (Join*)calloc(1, sizeof(Join));
+    CHECK_MALLOC_PTR(join)
+    join->next = worker->joins;
+    worker->joins = join;
+
+    /* spawn runs in reverse so that this worker pops the first run first */
+    ASTNode** starts = (ASTNode**)malloc(((size + split - 1) / split) * sizeof(ASTNode*));
+    CHECK_MALLOC_PTR(starts)
+    int nruns = 0;
+    int i = 0;
+    FOR_EACH (ASTNode*, stmt, block->block.statements) {
+        if (i++ % split == 0) {
+            starts[nruns++] = stmt;
+        }
+    }
+    for (int r = nruns - 1; r >= 0; r--) {
+        int count = (r == nruns - 1 ? size - r * split : split);
+        spawn(worker, (Task){ .first = starts[r], .count = count, .join = join });
+    }
+    free(starts);
+
+    /* help out until every run of this block is done */
+    Task task;
+    while (atomic_load(&join->pending) > 0) {
+        check_failed(worker);
+        if (find_task(worker, &task)) {
+            run_task(worker, &task);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * @brief Run tasks until there are none left anywhere
+ */
+static void work (Worker* worker, ASTNode* unused)
+{
+    Task task;
+    while (atomic_load(&worker->sched->pending) > 0) {
+        check_failed(worker);
+        if (find_task(worker, &task)) {
+            run_task(worker, &task);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * @brief Visit the program node and globals, then spawn a task per function
+ */
+static void start (Worker* worker, ASTNode* tree)
+{
+    if (tree->type != PROGRAM) {
+        spawn(worker, (Task){ .node = tree });
+        return;
+    }
+    ASTNode* node = tree;
+    NODEVISITOR_PREVISIT(worker->visitor, node, program)
+    FOR_EACH (ASTNode*, var, tree->program.variables) {
+        traverse_subtree(worker, var);
+    }
+    Scheduler* sched = worker->sched;
+    int i = 0;
+    FOR_EACH (ASTNode*, func, tree->program.functions) {
+        spawn(&sched->workers[i++ % sched->nworkers], (Task){ .node = func });
+    }
+}
+
+static void finish (Worker* worker, ASTNode* tree)
+{
+    if (tree->type == PROGRAM) {
+        ASTNode* node = tree;
+        NODEVISITOR_POSTVISIT(worker->visitor, node, program)
+    }
+}
+
+/**
+ * @brief Run part of the traversal, catching (and recording) any error
+ */
+static void run_trapped (Worker* worker, void (*body)(Worker*, ASTNode*), ASTNode* tree)
+{
+    Scheduler* sched = worker->sched;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        body(worker, tree);
+    } else {
+        pthread_mutex_lock(&sched->error_lock);
+        if (!atomic_load(&sched->failed)) {
+            snprintf(sched->error, MAX_ERROR_LEN, "%s", trap.message);
+            atomic_store(&sched->failed, true);
+        }
+        pthread_mutex_unlock(&sched->error_lock);
+    }
+    ErrorTrap_pop(&trap);
+}
+
+static void* worker_main (void* arg)
+{
+    run_trapped((Worker*)arg, work, NULL);
+    return NULL;
+}
+
+void NodeVisitor_traverse_parallel (ParallelTraversal* traversal, ASTNode* tree)
+{
+    int nthreads = traversal->nthreads;
+    if (nthreads <= 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpus > 0 ? (int)ncpus : 1);
+    }
+
+    Scheduler sched;
+    sched.traversal = traversal;
+    sched.nworkers = nthreads;
+    sched.workers = (Worker*)calloc(nthreads, sizeof(Worker));
+    CHECK_MALLOC_PTR(sched.workers)
+    atomic_init(&sched.pending, 0);
+    atomic_init(&sched.failed, false);
+    pthread_mutex_init(&sched.error_lock, NULL);
+    sched.error[0] = '\0';
+    for (int i = 0; i < nthreads; i++) {
+        Worker* worker = &sched.workers[i];
+        worker->sched = &sched;
+        worker->index = i;
+        worker->next_victim = (i + 1) % nthreads;
+        pthread_mutex_init(&worker->deque.lock, NULL);
+        worker->visitor = traversal->create(traversal->context, i);
+    }
+
+    /* worker 0 is the calling thread; the others start once there is work */
+    Worker* main_worker = &sched.workers[0];
+    run_trapped(main_worker, start, tree);
+    if (!atomic_load(&sched.failed)) {
+        for (int i = 1; i < nthreads; i++) {
+            Worker* worker = &sched.workers[i];
+            worker->started = (pthread_create(&worker->thread, NULL, worker_main, worker) == 0);
+        }
+        run_trapped(main_worker, work, NULL);
+        for (int i = 1; i < nthreads; i++) {
+            if (sched.workers[i].started) {
+                pthread_join(sched.workers[i].thread, NULL);
+            }
+        }
+    }
+    if (!atomic_load(&sched.failed)) {
+        run_trapped(main_worker, finish, tree);
+    }
+
+    /* reduce (unless there was an error) and clean up */
+    bool failed = atomic_load(&sched.failed);
+    for (int i = 0; i < nthreads; i++) {
+        Worker* worker = &sched.workers[i];
+        if (!failed && traversal->reduce != NULL) {
+            traversal->reduce(traversal->context, worker->visitor);
+        }
+        NodeVisitor_free(worker->visitor);
+        free(worker->deque.tasks);
+        pthread_mutex_destroy(&worker->deque.lock);
+        while (worker->joins != NULL) {
+            Join* next = worker->joins->next;
+            free(worker->joins);
+            worker->joins = next;
+        }
+    }
+    free(sched.workers);
+    pthread_mutex_destroy(&sched.error_lock);
+
+    if (failed) {
+        Error_throw_printf("%s", sched.error);
+    }
+}
@@ -0,0 +1,555 @@
+/**
+ * @file peephole.c
+ * @brief Peephole optimization of ILOC code
+ */
+
+#include "peephole.h"
+
+/*
+ * Shorthand for the rule table
+ */
+#define V(N)        PP_VAR(N)
+#define C(K)        PP_INT(K)
+#define INSN(OP, ...)   { OP, { __VA_ARGS__ } }
+#define ANY_INSN        { PP_ANY, { { 0 } } }
+
+#define SINGLE_USE(N)   { PP_SINGLE_USE, (N), 0 }
+#define UNUSED(N)       { PP_UNUSED, (N), 0 }
+#define DIFFERENT(M,N)  { PP_DIFFERENT, (M), (N) }
+
+/*
+ * Operands are in text order, e.g. storeAI V0 => [V1+V2] and
+ * loadAI [V1+V2] => V3. Every rule makes the code cheaper: it removes an
+ * instruction, or replaces a load or multiplication with a move or constant,
+ * or an immediate add with a move.
+ */
+const PeepholeRule peephole_rules[] = {
+
+    /* moves and jumps that do nothing */
+    { "self_move", 1,
+      { INSN(ILOC_I2I, V(0), V(0)) },
+      0, { { 0 } }, { { 0 } } },
+    { "jump_to_next", 2,
+      { INSN(ILOC_JUMP, V(0)), INSN(ILOC_LABEL, V(0)) },
+      1, { INSN(ILOC_LABEL, V(0)) }, { { 0 } } },
+    { "dead_definition", 1,
+      { INSN(PP_DEFINES, V(0)) },
+      0, { { 0 } }, { UNUSED(0) } },
+
+    /* values that are already in a register */
+    { "store_load", 2,
+      { INSN(ILOC_STORE, V(0), V(1)), INSN(ILOC_LOAD, V(1), V(2)) },
+      2, { INSN(ILOC_STORE, V(0), V(1)), INSN(ILOC_I2I, V(0), V(2)) }, { { 0 } } },
+    { "store_load_ai", 2,
+      { INSN(ILOC_STORE_AI, V(0), V(1), V(2)), INSN(ILOC_LOAD_AI, V(1), V(2), V(3)) },
+      2, { INSN(ILOC_STORE_AI, V(0), V(1), V(2)), INSN(ILOC_I2I, V(0), V(3)) }, { { 0 } } },
+    { "store_load_ao", 2,
+      { INSN(ILOC_STORE_AO, V(0), V(1), V(2)), INSN(ILOC_LOAD_AO, V(1), V(2), V(3)) },
+      2, { INSN(ILOC_STORE_AO, V(0), V(1), V(2)), INSN(ILOC_I2I, V(0), V(3)) }, { { 0 } } },
+    { "load_load_ai", 2,
+      { INSN(ILOC_LOAD_AI, V(0), V(1), V(2)), INSN(ILOC_LOAD_AI, V(0), V(1), V(3)) },
+      2, { INSN(ILOC_LOAD_AI, V(0), V(1), V(2)), INSN(ILOC_I2I, V(2), V(3)) },
+      { DIFFERENT(0, 2) } },
+    { "load_store_ai", 2,
+      { INSN(ILOC_LOAD_AI, V(0), V(1), V(2)), INSN(ILOC_STORE_AI, V(2), V(0), V(1)) },
+      1, { INSN(ILOC_LOAD_AI, V(0), V(1), V(2)) },
+      { DIFFERENT(0, 2) } },
+
+    /* copy propagation */
+    { "move_into", 2,
+      { INSN(PP_DEFINES, V(0)), INSN(ILOC_I2I, V(0), V(1)) },
+      1, { INSN(PP_COPY, C(0), V(0), V(1)) },
+      { SINGLE_USE(0) } },
+    { "move_from", 2,
+      { INSN(ILOC_I2I, V(0), V(1)), INSN(PP_USES, V(1)) },
+      1, { INSN(PP_COPY, C(1), V(1), V(0)) },
+      { SINGLE_USE(1) } },
+
+    /* constants into immediate forms */
+    { "fold_add", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_ADD, V(2), V(1), V(3)) },
+      1, { INSN(ILOC_ADD_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_add_left", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_ADD, V(1), V(2), V(3)) },
+      1, { INSN(ILOC_ADD_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_sub", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_SUB, V(2), V(1), V(3)) },
+      1, { INSN(ILOC_SUB_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_mult", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_MULT, V(2), V(1), V(3)) },
+      1, { INSN(ILOC_MULT_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_mult_left", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_MULT, V(1), V(2), V(3)) },
+      1, { INSN(ILOC_MULT_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+
+    /* the same, with an unrelated instruction in between (a single-use
+     * register has only the one definition, so the middle cannot change it) */
+    { "fold_add_across", 3,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), ANY_INSN, INSN(ILOC_ADD, V(2), V(1), V(3)) },
+      2, { INSN(PP_COPY, C(1)), INSN(ILOC_ADD_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_sub_across", 3,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), ANY_INSN, INSN(ILOC_SUB, V(2), V(1), V(3)) },
+      2, { INSN(PP_COPY, C(1)), INSN(ILOC_SUB_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_mult_across", 3,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), ANY_INSN, INSN(ILOC_MULT, V(2), V(1), V(3)) },
+      2, { INSN(PP_COPY, C(1)), INSN(ILOC_MULT_I, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+
+    /* constants into addresses */
+    { "constant_offset_load", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_LOAD_AO, V(2), V(1), V(3)) },
+      1, { INSN(ILOC_LOAD_AI, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "constant_base_load", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_LOAD_AO, V(1), V(2), V(3)) },
+      1, { INSN(ILOC_LOAD_AI, V(2), V(0), V(3)) },
+      { SINGLE_USE(1) } },
+    { "constant_offset_store", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_STORE_AO, V(2), V(3), V(1)) },
+      1, { INSN(ILOC_STORE_AI, V(2), V(3), V(0)) },
+      { SINGLE_USE(1) } },
+    { "constant_base_store", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_STORE_AO, V(2), V(1), V(3)) },
+      1, { INSN(ILOC_STORE_AI, V(2), V(3), V(0)) },
+      { SINGLE_USE(1) } },
+    { "offset_load", 2,
+      { INSN(ILOC_ADD_I, V(0), V(1), V(2)), INSN(ILOC_LOAD_AI, V(2), V(3), V(4)) },
+      1, { INSN(ILOC_LOAD_AI, V(0), PP_SUM(1, 3), V(4)) },
+      { SINGLE_USE(2) } },
+    { "offset_store", 2,
+      { INSN(ILOC_ADD_I, V(0), V(1), V(2)), INSN(ILOC_STORE_AI, V(3), V(2), V(4)) },
+      1, { INSN(ILOC_STORE_AI, V(3), V(0), PP_SUM(1, 4)) },
+      { SINGLE_USE(2) } },
+
+    /* constant folding */
+    { "fold_constant_add", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_ADD_I, V(1), V(2), V(3)) },
+      1, { INSN(ILOC_LOAD_I, PP_SUM(0, 2), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_constant_mult", 2,
+      { INSN(ILOC_LOAD_I, V(0), V(1)), INSN(ILOC_MULT_I, V(1), V(2), V(3)) },
+      1, { INSN(ILOC_LOAD_I, PP_PRODUCT(0, 2), V(3)) },
+      { SINGLE_USE(1) } },
+    { "fold_add_add", 2,
+      { INSN(ILOC_ADD_I, V(0), V(1), V(2)), INSN(ILOC_ADD_I, V(2), V(3), V(4)) },
+      1, { INSN(ILOC_ADD_I, V(0), PP_SUM(1, 3), V(4)) },
+      { SINGLE_USE(2) } },
+    { "fold_mult_mult", 2,
+      { INSN(ILOC_MULT_I, V(0), V(1), V(2)), INSN(ILOC_MULT_I, V(2), V(3), V(4)) },
+      1, { INSN(ILOC_MULT_I, V(0), PP_PRODUCT(1, 3), V(4)) },
+      { SINGLE_USE(2) } },
+
+    /* algebraic identities */
+    { "add_zero", 1,
+      { INSN(ILOC_ADD_I, V(0), C(0), V(1)) },
+      1, { INSN(ILOC_I2I, V(0), V(1)) }, { { 0 } } },
+    { "sub_zero", 1,
+      { INSN(ILOC_SUB_I, V(0), C(0), V(1)) },
+      1, { INSN(ILOC_I2I, V(0), V(1)) }, { { 0 } } },
+    { "mult_one", 1,
+      { INSN(ILOC_MULT_I, V(0), C(1), V(1)) },
+      1, { INSN(ILOC_I2I, V(0), V(1)) }, { { 0 } } },
+    { "mult_zero", 1,
+      { INSN(ILOC_MULT_I, V(0), C(0), V(1)) },
+      1, { INSN(ILOC_LOAD_I, C(0), V(1)) }, { { 0 } } },
+};
+
+const int peephole_rule_count = sizeof(peephole_rules) / sizeof(peephole_rules[0]);
+
+/**
+ * @brief How many times each register is written and read in the whole
+ * program (indexed by register number plus three, for the special registers)
+ */
+typedef struct UseCounts
+{
+    int* defs;      /**< @brief Writes of each register */
+    int* uses;      /**< @brief Reads of each register */
+    long nregs;     /**< @brief Number of entries */
+} UseCounts;
+
+#define REG_INDEX(R) ((R) + 3)
+
+static void UseCounts_update (UseCounts* counts, ILOCInsn* insn, int delta)
+{
+    long regs[ILOC_MAX_OPERANDS];
+    int n = ILOCInsn_sources(insn, regs);
+    for (int i = 0; i < n; i++) {
+        counts->uses[REG_INDEX(regs[i])] += delta;
+    }
+    long reg;
+    if (ILOCInsn_destination(insn, &reg)) {
+        counts->defs[REG_INDEX(reg)] += delta;
+    }
+}
+
+static void UseCounts_init (UseCounts* counts, ILOCInsnList* list)
+{
+    long max_reg = 0;
+    FOR_EACH (ILOCInsn*, insn, list) {
+        for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+            if (insn->operands[i].type == OPERAND_REG && insn->operands[i].value > max_reg) {
+                max_reg = insn->operands[i].value;
+            }
+        }
+    }
+    counts->nregs = REG_INDEX(max_reg) + 1;
+    counts->defs = (int*)calloc(counts->nregs, sizeof(int));
+    CHECK_MALLOC_PTR(counts->defs)
+    counts->uses = (int*)calloc(counts->nregs, sizeof(int));
+    CHECK_MALLOC_PTR(counts->uses)
+    FOR_EACH (ILOCInsn*, insn, list) {
+        UseCounts_update(counts, insn, 1);
+    }
+}
+
+/**
+ * @brief State of a match attempt
+ */
+typedef struct Match
+{
+    ILOCOperand vars[PEEPHOLE_MAX_VARS];    /**< @brief Bound variables (shallow copies) */
+    bool bound[PEEPHOLE_MAX_VARS];          /**< @brief Which variables are bound */
+} Match;
+
+static bool ILOCOperand_equals (const ILOCOperand* a, const ILOCOperand* b)
+{
+    if (a->type != b->type) {
+        return false;
+    }
+    if (a->type == OPERAND_LABEL || a->type == OPERAND_STR) {
+        return strcmp(a->name, b->name) == 0;
+    }
+    return a->value == b->value;
+}
+
+static bool match_operand (Match* match, const PeepholeOperand* pattern, const ILOCOperand* operand)
+{
+    switch (pattern->kind) {
+        case PP_OPERAND_VAR:
+            if (operand->type == OPERAND_NONE) {
+                return false;
+            }
+            if (match->bound[pattern->a]) {
+                return ILOCOperand_equals(&match->vars[pattern->a], operand);
+            }
+            match->vars[pattern->a] = *operand;
+            match->bound[pattern->a] = true;
+            return true;
+        case PP_OPERAND_INT:
+            return operand->type == OPERAND_INT && operand->value == pattern->a;
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Whether an instruction only writes its destination register (so it
+ * can be removed or retargeted); division is excluded because it can trap
+ */
+static bool is_pure_definition (ILOCInsn* insn)
+{
+    switch (insn->opcode) {
+        case ILOC_ADD: case ILOC_SUB: case ILOC_MULT: case ILOC_AND: case ILOC_OR:
+        case ILOC_ADD_I: case ILOC_SUB_I: case ILOC_MULT_I:
+        case ILOC_NOT: case ILOC_NEG: case ILOC_I2I:
+        case ILOC_CMP_LT: case ILOC_CMP_LE: case ILOC_CMP_EQ:
+        case ILOC_CMP_GE: case ILOC_CMP_GT: case ILOC_CMP_NE:
+        case ILOC_LOAD_I: case ILOC_LOAD: case ILOC_LOAD_AI: case ILOC_LOAD_AO:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool match_insn (Match* match, const PeepholeInsn* pattern, ILOCInsn* insn)
+{
+    long regs[ILOC_MAX_OPERANDS];
+    ILOCOperand reg_operand = { .type = OPERAND_REG };
+    switch (pattern->opcode) {
+        case PP_DEFINES:
+            if (!is_pure_definition(insn) || !ILOCInsn_destination(insn, &reg_operand.value)) {
+                return false;
+            }
+            return match_operand(match, &pattern->operands[0], &reg_operand);
+        case PP_ANY:
+            return insn->opcode != ILOC_LABEL;
+        case PP_USES:
+            for (int i = 0, n = ILOCInsn_sources(insn, regs); i < n; i++) {
+                reg_operand.value = regs[i];
+                Match attempt = *match;
+                if (match_operand(&attempt, &pattern->operands[0], &reg_operand)) {
+                    *match = attempt;
+                    return true;
+                }
+            }
+            return false;
+        default:
+            if ((int)insn->opcode != pattern->opcode) {
+                return false;
+            }
+            for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+                if (!match_operand(match, &pattern->operands[i], &insn->operands[i])) {
+                    return false;
+                }
+            }
+            return true;
+    }
+}
+
+static bool check_condition (Match* match, const PeepholeCondition* condition, UseCounts* counts)
+{
+    const ILOCOperand* a = &match->vars[condition->a];
+    switch (condition->kind) {
+        case PP_SINGLE_USE:
+            return a->type == OPERAND_REG && a->value >= 0 &&
+                   counts->defs[REG_INDEX(a->value)] == 1 && counts->uses[REG_INDEX(a->value)] == 1;
+        case PP_UNUSED:
+            return a->type == OPERAND_REG && a->value >= 0 && counts->uses[REG_INDEX(a->value)] == 0;
+        case PP_DIFFERENT:
+            return !ILOCOperand_equals(a, &match->vars[condition->b]);
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Try a rule on the window of instructions ending at the top of the
+ * stack
+ */
+static bool match_rule (Match* match, const PeepholeRule* rule, ILOCInsn** window, UseCounts* counts)
+{
+    memset(match, 0, sizeof(Match));
+    for (int i = 0; i < rule->length; i++) {
+        if (!match_insn(match, &rule->match[i], window[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!check_condition(match, &rule->conditions[i], counts)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Fold two constants with the simulator's 32-bit wraparound (see
+ * ilocsim.h), so that folding does not change what the code computes
+ */
+#define FOLD(A, OP, B) ((long)(int32_t)(uint32_t)((unsigned long)(A) OP (unsigned long)(B)))
+
+static ILOCOperand build_operand (Match* match, const PeepholeOperand* template)
+{
+    ILOCOperand none = { .type = OPERAND_NONE };
+    switch (template->kind) {
+        case PP_OPERAND_VAR: {
+            ILOCOperand* var = &match->vars[template->a];
+            if (var->type == OPERAND_LABEL) {
+                return ILOCOperand_label(var->name);
+            } else if (var->type == OPERAND_STR) {
+                return ILOCOperand_str(var->name);
+            }
+            return *var;
+        }
+        case PP_OPERAND_INT:
+            return ILOCOperand_int(template->a);
+        case PP_OPERAND_SUM:
+            return ILOCOperand_int(FOLD(match->vars[template->a].value, +, match->vars[template->b].value));
+        case PP_OPERAND_PRODUCT:
+            return ILOCOperand_int(FOLD(match->vars[template->a].value, *, match->vars[template->b].value));
+        default:
+            return none;
+    }
+}
+
+static ILOCInsn* build_insn (Match* match, const PeepholeInsn* template, ILOCInsn** window)
+{
+    if (template->opcode == PP_COPY) {
+        ILOCInsn* copy = ILOCInsn_copy(window[template->operands[0].a]);
+        if (template->operands[1].kind != PP_OPERAND_VAR) {
+            return copy;
+        }
+        long from = match->vars[template->operands[1].a].value;
+        long to = match->vars[template->operands[2].a].value;
+        for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+            if (copy->operands[i].type == OPERAND_REG && copy->operands[i].value == from) {
+                copy->operands[i].value = to;
+            }
+        }
+        return copy;
+    }
+    ILOCInsn* insn = ILOCInsn_new((ILOCOpcode)template->opcode,
+            build_operand(match, &template->operands[0]),
+            build_operand(match, &template->operands[1]),
+            build_operand(match, &template->operands[2]));
+    insn->source_line = window[0]->source_line;
+    return insn;
+}
+
+/**
+ * @brief Rules to try for each opcode at the top of the stack, in table order
+ * (rules that end with a wildcard are listed under every opcode)
+ */
+typedef struct RuleIndex
+{
+    int count[NUM_ILOC_OPCODES];                        /**< @brief Number of rules per opcode */
+    int rules[NUM_ILOC_OPCODES][PEEPHOLE_MAX_RULES];    /**< @brief Rule numbers */
+} RuleIndex;
+
+static void RuleIndex_init (RuleIndex* index, const PeepholeRule* rules, int nrules)
+{
+    for (int op = 0; op < NUM_ILOC_OPCODES; op++) {
+        index->count[op] = 0;
+        for (int r = 0; r < nrules; r++) {
+            int last = rules[r].match[rules[r].length - 1].opcode;
+            if (last == op || last >= NUM_ILOC_OPCODES) {
+                index->rules[op][index->count[op]++] = r;
+            }
+        }
+    }
+}
+
+/**
+ * @brief One pass over the code (see the file comment in peephole.h)
+ *
+ * @returns Number of rules fired
+ */
+static long Peephole_pass (ILOCInsnList* list, const PeepholeRule* rules, RuleIndex* index,
+                           UseCounts* counts, PeepholeStats* stats)
+{
+    int capacity = list->size + PEEPHOLE_WINDOW;
+    ILOCInsn** stack = (ILOCInsn**)malloc(sizeof(ILOCInsn*) * capacity);
+    CHECK_MALLOC_PTR(stack)
+    int top = 0;
+    long fired = 0;
+    ILOCInsn* input = list->head;
+    Match match;
+
+    while (input != NULL) {
+        if (top == capacity) {
+            capacity *= 2;
+            stack = (ILOCInsn**)realloc(stack, sizeof(ILOCInsn*) * capacity);
+            CHECK_MALLOC_PTR(stack)
+        }
+        stack[top++] = input;
+        input = input->next;
+
+        ILOCOpcode opcode = stack[top - 1]->opcode;
+        for (int i = 0; i < index->count[opcode]; i++) {
+            int r = index->rules[opcode][i];
+            const PeepholeRule* rule = &rules[r];
+            if (rule->length > top || !match_rule(&match, rule, stack + top - rule->length, counts)) {
+                continue;
+            }
+
+            /* build the replacement and push it back onto the input */
+            ILOCInsn** window = stack + top - rule->length;
+            ILOCInsn* replacement[PEEPHOLE_WINDOW];
+            for (int i = 0; i < rule->replacement_length; i++) {
+                replacement[i] = build_insn(&match, &rule->replacement[i], window);
+                UseCounts_update(counts, replacement[i], 1);
+            }
+            for (int i = rule->replacement_length - 1; i >= 0; i--) {
+                replacement[i]->next = input;
+                input = replacement[i];
+            }
+            for (int i = 0; i < rule->length; i++) {
+                UseCounts_update(counts, window[i], -1);
+                ILOCInsn_free(window[i]);
+            }
+            top -= rule->length;
+
+            /* back up so the instructions before the rewrite are tried again
+             * (e.g., the definition of a register that has just become dead) */
+            for (int i = 0; i < PEEPHOLE_WINDOW - 1 && top > 0; i++) {
+                top--;
+                stack[top]->next = input;
+                input = stack[top];
+            }
+            stats->fired[r]++;
+            fired++;
+            break;
+        }
+    }
+
+    /* relink the list */
+    list->head = (top > 0 ? stack[0] : NULL);
+    list->tail = (top > 0 ? stack[top - 1] : NULL);
+    list->size = top;
+    for (int i = 0; i < top; i++) {
+        stack[i]->next = (i + 1 < top ? stack[i + 1] : NULL);
+    }
+    free(stack);
+    return fired;
+}
+
+static int count_instructions (ILOCInsnList* list)
+{
+    int count = 0;
+    FOR_EACH (ILOCInsn*, insn, list) {
+        count += (insn->opcode != ILOC_LABEL);
+    }
+    return count;
+}
+
+void Peephole_optimize (ILOCInsnList* list, const PeepholeRule* rules, int nrules,
+                        PeepholeStats* stats)
+{
+    PeepholeStats local;
+    if (stats == NULL) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(PeepholeStats));
+    stats->before = count_instructions(list);
+    if (nrules > PEEPHOLE_MAX_RULES) {
+        nrules = PEEPHOLE_MAX_RULES;
+    }
+
+    RuleIndex* index = (RuleIndex*)malloc(sizeof(RuleIndex));
+    CHECK_MALLOC_PTR(index)
+    RuleIndex_init(index, rules, nrules);
+    UseCounts counts;
+    UseCounts_init(&counts, list);
+    long fired;
+    do {
+        fired = Peephole_pass(list, rules, index, &counts, stats);
+        stats->rewrites += fired;
+        stats->passes++;
+    } while (fired > 0);
+    free(counts.defs);
+    free(counts.uses);
+    free(index);
+
+    stats->after = count_instructions(list);
+}
+
+void PeepholeStats_print (PeepholeStats* stats, const PeepholeRule* rules, int nrules,
+                          FILE* output)
+{
+    fprintf(output, "instructions: %d -> %d (%ld rewrites in %d passes)\n",
+            stats->before, stats->after, stats->rewrites, stats->passes);
+
+    /* selection sort by count (there are only a few dozen rules) */
+    bool printed[PEEPHOLE_MAX_RULES] = { false };
+    for (int n = 0; n < nrules && n < PEEPHOLE_MAX_RULES; n++) {
+        int best = -1;
+        for (int r = 0; r < nrules && r < PEEPHOLE_MAX_RULES; r++) {
+            if (!printed[r] && stats->fired[r] > 0 &&
+                    (best < 0 || stats->fired[r] > stats->fired[best])) {
+                best = r;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        printed[best] = true;
+        fprintf(output, "  %-24s %8ld\n", rules[best].name, stats->fired[best]);
+    }
+}
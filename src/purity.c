@@ -0,0 +1,199 @@
+/**
+ * @file purity.c
+ * @brief Interprocedural purity analysis
+ */
+
+#include "purity.h"
+
+/**
+ * @brief Purity analysis state
+ */
+typedef struct Purity
+{
+    ASTNode** funcs;        /**< @brief Functions of the program */
+    int nfuncs;             /**< @brief Number of functions */
+    bool* pure;             /**< @brief Whether each function is (still) considered pure */
+
+    int** callees;          /**< @brief Functions each function calls (indices into @c funcs) */
+    int* ncallees;          /**< @brief Entries in each @c callees list */
+    int* callee_capacity;   /**< @brief Allocated entries in each @c callees list */
+
+    int current;            /**< @brief Function being scanned */
+    const char** names;     /**< @brief Parameters and locals in scope */
+    int nnames;             /**< @brief Number of names in scope */
+    int name_capacity;      /**< @brief Allocated names */
+} Purity;
+
+static int find_function (Purity* p, const char* name)
+{
+    for (int i = 0; i < p->nfuncs; i++) {
+        if (strcmp(p->funcs[i]->funcdecl.name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void add_name (Purity* p, const char* name)
+{
+    if (p->nnames == p->name_capacity) {
+        p->name_capacity = (p->name_capacity == 0 ? 16 : p->name_capacity * 2);
+        p->names = (const char**)realloc(p->names, sizeof(const char*) * p->name_capacity);
+        CHECK_MALLOC_PTR(p->names)
+    }
+    p->names[p->nnames++] = name;
+}
+
+static bool is_local (Purity* p, const char* name)
+{
+    for (int i = p->nnames - 1; i >= 0; i--) {
+        if (strcmp(p->names[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void add_callee (Purity* p, int callee)
+{
+    int f = p->current;
+    for (int i = 0; i < p->ncallees[f]; i++) {
+        if (p->callees[f][i] == callee) {
+            return;
+        }
+    }
+    if (p->ncallees[f] == p->callee_capacity[f]) {
+        p->callee_capacity[f] = (p->callee_capacity[f] == 0 ? 4 : p->callee_capacity[f] * 2);
+        p->callees[f] = (int*)realloc(p->callees[f], sizeof(int) * p->callee_capacity[f]);
+        CHECK_MALLOC_PTR(p->callees[f])
+    }
+    p->callees[f][p->ncallees[f]++] = callee;
+}
+
+/**
+ * @brief Check a subtree of the current function for global accesses and
+ * prints, and record its calls
+ *
+ * @returns False if the subtree makes the function impure by itself
+ */
+static bool scan (Purity* p, ASTNode* node)
+{
+    if (node == NULL) {
+        return true;
+    }
+    switch (node->type) {
+        case BLOCK: {
+            int outer_names = p->nnames;
+            FOR_EACH (ASTNode*, var, node->block.variables) {
+                add_name(p, var->vardecl.name);
+            }
+            bool pure = true;
+            FOR_EACH (ASTNode*, stmt, node->block.statements) {
+                if (!scan(p, stmt)) {
+                    pure = false;
+                    break;
+                }
+            }
+            p->nnames = outer_names;
+            return pure;
+        }
+        case ASSIGNMENT:
+            return scan(p, node->assignment.location) && scan(p, node->assignment.value);
+        case CONDITIONAL:
+            return scan(p, node->conditional.condition) && scan(p, node->conditional.if_block) &&
+                   scan(p, node->conditional.else_block);
+        case WHILELOOP:
+            return scan(p, node->whileloop.condition) && scan(p, node->whileloop.body);
+        case RETURNSTMT:
+            return scan(p, node->funcreturn.value);
+        case BINARYOP:
+            return scan(p, node->binaryop.left) && scan(p, node->binaryop.right);
+        case UNARYOP:
+            return scan(p, node->unaryop.child);
+        case LOCATION:
+            return is_local(p, node->location.name) && scan(p, node->location.index);
+        case FUNCCALL: {
+            int callee = find_function(p, node->funccall.name);
+            if (callee < 0) {
+                return false;       /* print_* (or a function that does not exist) */
+            }
+            add_callee(p, callee);
+            FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
+                if (!scan(p, arg)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+void Purity_analyze (ASTNode* tree, PurityStats* stats)
+{
+    Purity p;
+    memset(&p, 0, sizeof(Purity));
+    p.nfuncs = tree->program.functions->size;
+    p.funcs = (ASTNode**)malloc(sizeof(ASTNode*) * (p.nfuncs + 1));
+    p.pure = (bool*)calloc(p.nfuncs + 1, sizeof(bool));
+    p.callees = (int**)calloc(p.nfuncs + 1, sizeof(int*));
+    p.ncallees = (int*)calloc(p.nfuncs + 1, sizeof(int));
+    p.callee_capacity = (int*)calloc(p.nfuncs + 1, sizeof(int));
+    CHECK_MALLOC_PTR(p.funcs)
+    CHECK_MALLOC_PTR(p.pure)
+    CHECK_MALLOC_PTR(p.callees)
+    CHECK_MALLOC_PTR(p.ncallees)
+    CHECK_MALLOC_PTR(p.callee_capacity)
+    int n = 0;
+    FOR_EACH (ASTNode*, func, tree->program.functions) {
+        p.funcs[n++] = func;
+    }
+
+    /* each function on its own */
+    for (int f = 0; f < p.nfuncs; f++) {
+        p.current = f;
+        p.nnames = 0;
+        FOR_EACH (Parameter*, param, p.funcs[f]->funcdecl.parameters) {
+            add_name(&p, param->name);
+        }
+        p.pure[f] = scan(&p, p.funcs[f]->funcdecl.body);
+    }
+
+    /* then drop callers of impure functions until nothing changes */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int f = 0; f < p.nfuncs; f++) {
+            for (int i = 0; p.pure[f] && i < p.ncallees[f]; i++) {
+                if (!p.pure[p.callees[f][i]]) {
+                    p.pure[f] = false;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    int pure = 0;
+    for (int f = 0; f < p.nfuncs; f++) {
+        ASTNode_set_int_attribute(p.funcs[f], "pure", p.pure[f]);
+        pure += p.pure[f];
+        free(p.callees[f]);
+    }
+    if (stats != NULL) {
+        stats->functions = p.nfuncs;
+        stats->pure = pure;
+    }
+
+    free(p.funcs);
+    free(p.pure);
+    free(p.callees);
+    free(p.ncallees);
+    free(p.callee_capacity);
+    free(p.names);
+}
+
+bool Purity_is_pure (ASTNode* func)
+{
+    return ASTNode_has_attribute(func, "pure") && ASTNode_get_int_attribute(func, "pure") != 0;
+}
@@ -0,0 +1,415 @@
+/**
+ * @file relex.c
+ * @brief Incremental re-lexing after a text edit
+ */
+
+#include "relex.h"
+#include "p1-lexer.h"
+
+/**
+ * @brief Count the newlines in part of a buffer
+ *
+ * @param text Buffer to scan
+ * @param start First offset to scan
+ * @param end One past the last offset to scan
+ * @returns Number of newline characters in [start, end)
+ */
+static int count_newlines (const char* text, int start, int end)
+{
+    int count = 0;
+    const char* p = text + start;
+    const char* stop = text + end;
+    while (p < stop && (p = memchr(p, '\n', stop - p)) != NULL) {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+/**
+ * @brief Apply a chunk's pending shift to its tokens
+ *
+ * The pending shifts of the chunk's ancestors must have been pushed down.
+ */
+static void sync_chunk (TokenChunk* chunk)
+{
+    if (chunk->offset_shift == 0 && chunk->line_shift == 0) {
+        return;
+    }
+    for (Token* t = chunk->first; t != chunk->last->next; t = t->next) {
+        t->offset += chunk->offset_shift;
+        t->line += chunk->line_shift;
+    }
+    chunk->offset_shift = 0;
+    chunk->line_shift = 0;
+}
+
+/**
+ * @brief Shift every chunk in a subtree (lazily)
+ */
+static void shift_tree (TokenChunk* tree, int offset, int line)
+{
+    if (tree != NULL) {
+        tree->offset_shift += offset;
+        tree->line_shift += line;
+        tree->pending_offset += offset;
+        tree->pending_line += line;
+    }
+}
+
+/**
+ * @brief Pass a chunk's pending subtree shift on to its children
+ */
+static void push_down (TokenChunk* chunk)
+{
+    if (chunk->pending_offset != 0 || chunk->pending_line != 0) {
+        shift_tree(chunk->left, chunk->pending_offset, chunk->pending_line);
+        shift_tree(chunk->right, chunk->pending_offset, chunk->pending_line);
+        chunk->pending_offset = 0;
+        chunk->pending_line = 0;
+    }
+}
+
+/**
+ * @brief Split a tree into the chunks that start before an offset and the rest
+ */
+static void split (TokenChunk* tree, int offset, TokenChunk** before, TokenChunk** after)
+{
+    if (tree == NULL) {
+        *before = *after = NULL;
+        return;
+    }
+    push_down(tree);
+    if (tree->first->offset + tree->offset_shift < offset) {
+        split(tree->right, offset, &tree->right, after);
+        *before = tree;
+    } else {
+        split(tree->left, offset, before, &tree->left);
+        *after = tree;
+    }
+}
+
+/**
+ * @brief Join two trees, all of whose chunks in @p a come before those in @p b
+ */
+static TokenChunk* merge (TokenChunk* a, TokenChunk* b)
+{
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (a->priority > b->priority) {
+        push_down(a);
+        a->right = merge(a->right, b);
+        return a;
+    }
+    push_down(b);
+    b->left = merge(a, b->left);
+    return b;
+}
+
+/**
+ * @brief Remove the first chunk of a tree
+ *
+ * @returns The chunk (with its pending shift), or @c NULL if the tree is empty
+ */
+static TokenChunk* pop_first (TokenChunk** tree)
+{
+    TokenChunk* chunk = *tree;
+    if (chunk == NULL) {
+        return NULL;
+    }
+    push_down(chunk);
+    if (chunk->left != NULL) {
+        return pop_first(&chunk->left);
+    }
+    *tree = chunk->right;
+    chunk->right = NULL;
+    return chunk;
+}
+
+/**
+ * @brief Remove the last chunk of a tree
+ *
+ * @returns The chunk (with its pending shift), or @c NULL if the tree is empty
+ */
+static TokenChunk* pop_last (TokenChunk** tree)
+{
+    TokenChunk* chunk = *tree;
+    if (chunk == NULL) {
+        return NULL;
+    }
+    push_down(chunk);
+    if (chunk->right != NULL) {
+        return pop_last(&chunk->right);
+    }
+    *tree = chunk->left;
+    chunk->left = NULL;
+    return chunk;
+}
+
+/**
+ * @brief First token of the first chunk of a tree (or @c NULL)
+ */
+static Token* first_token (TokenChunk* tree)
+{
+    while (tree != NULL && tree->left != NULL) {
+        tree = tree->left;
+    }
+    return (tree != NULL ? tree->first : NULL);
+}
+
+/**
+ * @brief Last token of the last chunk of a tree (or @c NULL)
+ */
+static Token* last_token (TokenChunk* tree)
+{
+    while (tree != NULL && tree->right != NULL) {
+        tree = tree->right;
+    }
+    return (tree != NULL ? tree->last : NULL);
+}
+
+/**
+ * @brief Number of tokens in a chunk
+ */
+static int chunk_size (TokenChunk* chunk)
+{
+    int size = 0;
+    for (Token* t = chunk->first; t != chunk->last->next; t = t->next) {
+        size++;
+    }
+    return size;
+}
+
+/**
+ * @brief Split a run of tokens into chunks and add them after a tree
+ *
+ * @param index Index (for the chunk count and priorities)
+ * @param tree Chunks before the run
+ * @param first First token of the run
+ * @param count Number of tokens in the run
+ * @returns The tree with the new chunks (with no pending shifts) at the end
+ */
+static TokenChunk* append_chunks (TokenIndex* index, TokenChunk* tree, Token* first, int count)
+{
+    int nparts = (count + TOKEN_CHUNK_SIZE - 1) / TOKEN_CHUNK_SIZE;
+    Token* t = first;
+    for (int i = 0; i < nparts; i++) {
+        TokenChunk* chunk = (TokenChunk*)calloc(1, sizeof(TokenChunk));
+        CHECK_MALLOC_PTR(chunk)
+        chunk->first = t;
+        int size = count / nparts + (i < count % nparts);
+        for (int j = 1; j < size; j++) {
+            t = t->next;
+        }
+        chunk->last = t;
+        t = t->next;
+        index->seed = index->seed * 1103515245u + 12345u;
+        chunk->priority = index->seed >> 8;
+        index->nchunks++;
+        tree = merge(tree, chunk);
+    }
+    return tree;
+}
+
+/**
+ * @brief Apply all pending shifts in a tree to the tokens
+ */
+static void sync_tree (TokenChunk* tree)
+{
+    if (tree != NULL) {
+        push_down(tree);
+        sync_chunk(tree);
+        sync_tree(tree->left);
+        sync_tree(tree->right);
+    }
+}
+
+/**
+ * @brief Deallocate the chunks of a tree
+ */
+static void free_tree (TokenChunk* tree)
+{
+    if (tree != NULL) {
+        free_tree(tree->left);
+        free_tree(tree->right);
+        free(tree);
+    }
+}
+
+TokenIndex* TokenIndex_new (TokenQueue* tokens)
+{
+    TokenIndex* index = (TokenIndex*)malloc(sizeof(TokenIndex));
+    CHECK_MALLOC_PTR(index)
+    index->tokens = tokens;
+    index->nchunks = 0;
+    index->seed = 1;
+    index->root = append_chunks(index, NULL, tokens->head, TokenQueue_size(tokens));
+    return index;
+}
+
+void TokenIndex_sync (TokenIndex* index)
+{
+    sync_tree(index->root);
+}
+
+void TokenIndex_free (TokenIndex* index)
+{
+    TokenIndex_sync(index);
+    free_tree(index->root);
+    free(index);
+}
+
+int relex (TokenIndex* index, const char* old_text, const char* new_text, TextEdit edit)
+{
+    TokenQueue* tokens = index->tokens;
+
+    /*
+     * Find the restart point: the last token that begins before the edit
+     * (the edit might extend it) or the beginning of the text. Everything
+     * before that token is unaffected by the edit. The tree is split around
+     * the chunk that holds it.
+     */
+    TokenChunk* before;
+    TokenChunk* after;
+    split(index->root, edit.offset, &before, &after);
+    TokenChunk* chunk = pop_last(&before);
+    Token* keep = NULL;         /* last token kept as-is */
+    Token* restart = NULL;      /* first token that is re-scanned */
+    if (chunk != NULL) {
+        sync_chunk(chunk);
+        restart = last_token(before);
+        for (Token* t = chunk->first; t != chunk->last->next && t->offset < edit.offset; t = t->next) {
+            keep = restart;
+            restart = t;
+        }
+    }
+    int start = (restart != NULL ? restart->offset : 0);
+    int start_line = (restart != NULL ? restart->line : 1);
+
+    /*
+     * The re-scanned region ends at the first line boundary after the edit;
+     * all text after that is identical (modulo a shift) in both versions, and
+     * a line boundary is always a token boundary, so the streams are back in
+     * sync there.
+     */
+    int delta = edit.new_length - edit.old_length;
+    int new_end = edit.offset + edit.new_length;
+    const char* nl = strchr(new_text + new_end, '\n');
+    int new_stop = (nl != NULL ? (int)(nl - new_text) + 1 : new_end + (int)strlen(new_text + new_end));
+    int old_stop = new_stop - delta;
+
+    /* lex the region; do this before touching the queue in case it throws */
+    int region_len = new_stop - start;
+    char* region = (char*)malloc(region_len + 1);
+    CHECK_MALLOC_PTR(region)
+    memcpy(region, new_text + start, region_len);
+    region[region_len] = '\0';
+    TokenQueue* fresh = NULL;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        fresh = lex(region);
+        ErrorTrap_pop(&trap);
+    } else {
+        ErrorTrap_pop(&trap);
+        free(region);
+        index->root = merge(merge(before, chunk), after);
+        Regex_explain_error(trap.message);
+        Error_throw_printf("%s", trap.message);
+    }
+    TokenQueue_locate(fresh, region, start);
+    free(region);
+    int rescanned = 0;
+    for (Token* t = fresh->head; t != NULL; t = t->next) {
+        t->line += start_line - 1;
+        rescanned++;
+    }
+
+    /* drop the stale tokens, taking (and syncing) each chunk they are in */
+    int line_delta = count_newlines(new_text, start, new_stop)
+                   - count_newlines(old_text, start, old_stop);
+    if (chunk == NULL) {
+        chunk = pop_first(&after);
+    }
+    if (chunk != NULL) {
+        sync_chunk(chunk);
+    }
+    Token* t = (keep != NULL ? keep->next : tokens->head);
+    while (t != NULL && t->offset < old_stop) {
+        Token* stale = t;
+        bool chunk_done = (t == chunk->last);
+        t = t->next;
+        Token_free(stale);
+        if (chunk_done) {
+            free(chunk);
+            index->nchunks--;
+            chunk = pop_first(&after);
+            if (chunk != NULL) {
+                sync_chunk(chunk);
+            }
+        }
+    }
+    Token* rest = t;
+
+    /* shift the rest of the last chunk taken now, and the later chunks lazily */
+    if (chunk != NULL) {
+        for (; t != chunk->last->next; t = t->next) {
+            t->offset += delta;
+            t->line += line_delta;
+        }
+        free(chunk);
+        index->nchunks--;
+    }
+    shift_tree(after, delta, line_delta);
+
+    /* splice: kept prefix, fresh tokens, shifted suffix */
+    Token* tail = keep;
+    if (fresh->head != NULL) {
+        if (keep != NULL) {
+            keep->next = fresh->head;
+        } else {
+            tokens->head = fresh->head;
+        }
+        tail = fresh->tail;
+    }
+    if (tail != NULL) {
+        tail->next = rest;
+    } else {
+        tokens->head = rest;
+    }
+    if (rest == NULL) {
+        tokens->tail = tail;
+    }
+    fresh->head = fresh->tail = NULL;
+    TokenQueue_free(fresh);
+
+    /*
+     * Re-chunk the tokens between the untouched chunks, taking in neighboring
+     * chunks while there are too few of them to fill half a chunk.
+     */
+    Token* previous = last_token(before);
+    Token* from = (previous != NULL ? previous->next : tokens->head);
+    Token* stop = first_token(after);
+    int count = 0;
+    for (Token* u = from; u != stop; u = u->next) {
+        count++;
+    }
+    while (count < TOKEN_CHUNK_SIZE / 2 && (after != NULL || before != NULL)) {
+        TokenChunk* neighbor = (after != NULL ? pop_first(&after) : pop_last(&before));
+        sync_chunk(neighbor);
+        count += chunk_size(neighbor);
+        if (neighbor->first == stop) {
+            stop = neighbor->last->next;
+        } else {
+            from = neighbor->first;
+        }
+        free(neighbor);
+        index->nchunks--;
+    }
+    index->root = merge(append_chunks(index, before, from, count), after);
+    return rescanned;
+}
@@ -0,0 +1,660 @@
+/**
+ * @file schedule.c
+ * @brief List scheduling of ILOC basic blocks
+ */
+
+#include <limits.h>
+
+#include "schedule.h"
+
+/**
+ * @brief Number of special registers (stored below the virtual registers)
+ */
+#define NUM_SPECIAL_REGS 3
+
+/**
+ * @brief No instruction (e.g., a register not written yet in this block)
+ */
+#define NO_NODE (-1)
+
+/**
+ * @brief Memory key base for addresses that are a known constant
+ */
+#define KEY_ABSOLUTE LONG_MIN
+
+/**
+ * @brief Memory key base for addresses that could be anything
+ */
+#define KEY_UNKNOWN (LONG_MIN + 1)
+
+/**
+ * @brief Dependence between two instructions of a block
+ */
+typedef struct Edge
+{
+    int from;       /**< @brief Instruction that must issue first */
+    int to;         /**< @brief Instruction that depends on it */
+    int latency;    /**< @brief Cycles between their issues */
+} Edge;
+
+/**
+ * @brief Address of a load or store, as far as the scheduler can tell
+ *
+ * Two keys with the same base and version refer to the same base address, so
+ * their offsets tell whether they are the same word.
+ */
+typedef struct MemoryKey
+{
+    long base;      /**< @brief Base register (or @ref KEY_ABSOLUTE or @ref KEY_UNKNOWN) */
+    long version;   /**< @brief Instruction that wrote the base register in this block (or @ref NO_NODE) */
+    long offset;    /**< @brief Offset from the base (or the address itself) */
+} MemoryKey;
+
+/**
+ * @brief Scheduling state (arrays are reused from block to block)
+ */
+typedef struct Scheduler
+{
+    const ILOCMachineConfig* config;    /**< @brief Machine model */
+    ILOCInsn** block;                   /**< @brief Instructions of the current block */
+
+    /* per register (indexed by register number + NUM_SPECIAL_REGS) */
+    int* last_def;          /**< @brief Last instruction that wrote the register */
+    int* def_latency;       /**< @brief Cycles until that write is ready */
+    int* first_reader;      /**< @brief Reads since that write (index into the reader lists) */
+    long* ready;            /**< @brief Cycle when the register is ready (for estimates) */
+
+    /* per instruction of the current block */
+    int* reader_node;       /**< @brief Reader list entries: instruction */
+    int* reader_next;       /**< @brief Reader list entries: next entry */
+    int nreaders;           /**< @brief Reader list entries in use */
+    int* stamp;             /**< @brief Last instruction that got an edge from this one */
+    int* stamp_edge;        /**< @brief That edge */
+    MemoryKey* keys;        /**< @brief Addresses of loads and stores */
+    int* run_prev;          /**< @brief Store before a run of stores with the same base */
+    int* loads;             /**< @brief Loads since the last store */
+    int* npreds;            /**< @brief Predecessors that have not issued yet */
+    long* priority;         /**< @brief Latency-weighted path to the end of the block */
+    long* earliest;         /**< @brief Earliest cycle that the predecessors allow */
+    int* succ_start;        /**< @brief First successor edge of each instruction */
+    Edge* succs;            /**< @brief Edges sorted by source */
+    int* ready_heap;        /**< @brief Instructions that can issue now */
+    int* wait_heap;         /**< @brief Instructions waiting for an operand */
+    ILOCInsn** order;       /**< @brief New order */
+
+    Edge* edges;            /**< @brief Edges in the order they were found */
+    int nedges;             /**< @brief Edges in use */
+    int edge_capacity;      /**< @brief Edges allocated */
+
+    int* table;             /**< @brief Hash table from memory keys to their last store */
+    int table_capacity;     /**< @brief Slots allocated (a power of two) */
+    int table_mask;         /**< @brief Slots used in the current block, minus one */
+} Scheduler;
+
+static int reg_index (long reg)
+{
+    return (int)(reg + NUM_SPECIAL_REGS);
+}
+
+static bool is_terminator (ILOCOpcode opcode)
+{
+    return opcode == ILOC_JUMP || opcode == ILOC_CBR ||
+           opcode == ILOC_CALL || opcode == ILOC_RETURN;
+}
+
+static bool is_store (ILOCOpcode opcode)
+{
+    return opcode == ILOC_STORE || opcode == ILOC_STORE_AI ||
+           opcode == ILOC_STORE_AO || opcode == ILOC_PUSH;
+}
+
+static bool is_load (ILOCOpcode opcode)
+{
+    return opcode == ILOC_LOAD || opcode == ILOC_LOAD_AI ||
+           opcode == ILOC_LOAD_AO || opcode == ILOC_POP;
+}
+
+/**
+ * @brief Forget everything about the registers that a block used
+ */
+static void reset_registers (Scheduler* s, ILOCInsn** insns, int n)
+{
+    for (int i = 0; i < n; i++) {
+        long regs[ILOC_MAX_OPERANDS + 2];
+        int count = ILOCInsn_sources(insns[i], regs);
+        if (ILOCInsn_destination(insns[i], &regs[count])) {
+            count++;
+        }
+        regs[count++] = ILOC_SP;
+        for (int j = 0; j < count; j++) {
+            int r = reg_index(regs[j]);
+            s->last_def[r] = NO_NODE;
+            s->first_reader[r] = NO_NODE;
+            s->ready[r] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Estimate the cycles a block takes, with the simulator's timing model
+ */
+static long estimate (Scheduler* s, ILOCInsn** insns, int n)
+{
+    long clock = 0;
+    long finish = 0;
+    for (int i = 0; i < n; i++) {
+        ILOCInsn* insn = insns[i];
+        long latency = s->config->latencies[insn->opcode];
+        if (!s->config->pipelined) {
+            clock += latency;
+            finish = clock;
+            continue;
+        }
+        long regs[ILOC_MAX_OPERANDS];
+        int count = ILOCInsn_sources(insn, regs);
+        long issue = clock;
+        for (int j = 0; j < count; j++) {
+            long ready = s->ready[reg_index(regs[j])];
+            issue = (ready > issue ? ready : issue);
+        }
+        long done = issue + latency;
+        long dest;
+        if (ILOCInsn_destination(insn, &dest)) {
+            s->ready[reg_index(dest)] = done;
+        }
+        switch (insn->opcode) {
+            case ILOC_PUSH: case ILOC_POP: case ILOC_CALL: case ILOC_RETURN:
+                s->ready[reg_index(ILOC_SP)] = issue + 1;
+                /* fall through */
+            case ILOC_JUMP: case ILOC_CBR:
+                clock = (insn->opcode == ILOC_PUSH || insn->opcode == ILOC_POP ? issue + 1 : done);
+                break;
+            default:
+                clock = issue + 1;
+                break;
+        }
+        finish = (done > finish ? done : finish);
+    }
+    reset_registers(s, insns, n);
+    return (clock > finish ? clock : finish);
+}
+
+
+/*
+ * DEPENDENCE DAG
+ */
+
+static void add_edge (Scheduler* s, int from, int to, int latency)
+{
+    if (from == NO_NODE || from == to) {
+        return;
+    }
+    if (s->stamp[from] == to) {
+        Edge* edge = &s->edges[s->stamp_edge[from]];
+        edge->latency = (latency > edge->latency ? latency : edge->latency);
+        return;
+    }
+    if (s->nedges == s->edge_capacity) {
+        s->edge_capacity *= 2;
+        s->edges = (Edge*)realloc(s->edges, sizeof(Edge) * s->edge_capacity);
+        s->succs = (Edge*)realloc(s->succs, sizeof(Edge) * s->edge_capacity);
+        CHECK_MALLOC_PTR(s->edges)
+        CHECK_MALLOC_PTR(s->succs)
+    }
+    Edge edge = { .from = from, .to = to, .latency = latency };
+    s->stamp[from] = to;
+    s->stamp_edge[from] = s->nedges;
+    s->edges[s->nedges++] = edge;
+}
+
+static void add_reader (Scheduler* s, long reg, int node)
+{
+    int r = reg_index(reg);
+    s->reader_node[s->nreaders] = node;
+    s->reader_next[s->nreaders] = s->first_reader[r];
+    s->first_reader[r] = s->nreaders++;
+}
+
+/**
+ * @brief Record a register write: it must follow earlier reads (or, if there
+ * are none, the earlier write)
+ */
+static void add_def (Scheduler* s, long reg, int node, int latency)
+{
+    int r = reg_index(reg);
+    bool read = false;
+    for (int e = s->first_reader[r]; e != NO_NODE; e = s->reader_next[e]) {
+        if (s->reader_node[e] != node) {
+            add_edge(s, s->reader_node[e], node, 0);
+            read = true;
+        }
+    }
+    if (!read) {
+        add_edge(s, s->last_def[r], node, 0);
+    }
+    s->last_def[r] = node;
+    s->def_latency[r] = latency;
+    s->first_reader[r] = NO_NODE;
+}
+
+static MemoryKey memory_key (Scheduler* s, int node)
+{
+    ILOCInsn* insn = s->block[node];
+    MemoryKey key = { .base = KEY_UNKNOWN, .version = node, .offset = 0 };
+    switch (insn->opcode) {
+        case ILOC_LOAD:     key.base = insn->operands[0].value; break;
+        case ILOC_LOAD_AI:  key.base = insn->operands[0].value;
+                            key.offset = insn->operands[1].value; break;
+        case ILOC_STORE:    key.base = insn->operands[1].value; break;
+        case ILOC_STORE_AI: key.base = insn->operands[1].value;
+                            key.offset = insn->operands[2].value; break;
+        default:
+            return key;
+    }
+    int def = s->last_def[reg_index(key.base)];
+    if (def != NO_NODE && s->block[def]->opcode == ILOC_LOAD_I) {
+        key.base = KEY_ABSOLUTE;
+        key.version = 0;
+        key.offset += s->block[def]->operands[0].value;
+    } else {
+        key.version = def;
+    }
+    return key;
+}
+
+static bool same_base (MemoryKey a, MemoryKey b)
+{
+    return a.base == b.base && a.version == b.version;
+}
+
+static int* table_slot (Scheduler* s, MemoryKey key)
+{
+    unsigned long hash = (unsigned long)key.base * 0x9E3779B97F4A7C15UL;
+    hash ^= (unsigned long)key.version * 0xC2B2AE3D27D4EB4FUL;
+    hash ^= (unsigned long)key.offset * 0x165667B19E3779F9UL;
+    hash ^= hash >> 29;
+    int i = (int)(hash & (unsigned long)s->table_mask);
+    while (s->table[i] != NO_NODE) {
+        MemoryKey other = s->keys[s->table[i]];
+        if (same_base(key, other) && key.offset == other.offset) {
+            break;
+        }
+        i = (i + 1) & s->table_mask;
+    }
+    return &s->table[i];
+}
+
+/**
+ * @brief Build the dependence DAG of the current block
+ */
+static void build_dag (Scheduler* s, int n)
+{
+    int last_store = NO_NODE;
+    int last_print = NO_NODE;
+    int nloads = 0;
+    s->nedges = 0;
+    s->nreaders = 0;
+
+    /* size the store table for this block */
+    int nstores = 0;
+    for (int i = 0; i < n; i++) {
+        nstores += (is_store(s->block[i]->opcode) ? 1 : 0);
+        s->stamp[i] = NO_NODE;
+    }
+    int slots = 16;
+    while (slots < 2 * nstores) {
+        slots *= 2;
+    }
+    if (slots > s->table_capacity) {
+        free(s->table);
+        s->table = (int*)malloc(sizeof(int) * slots);
+        CHECK_MALLOC_PTR(s->table)
+        s->table_capacity = slots;
+    }
+    s->table_mask = slots - 1;
+    for (int i = 0; i < slots; i++) {
+        s->table[i] = NO_NODE;
+    }
+
+    for (int i = 0; i < n; i++) {
+        ILOCInsn* insn = s->block[i];
+
+        /* registers read */
+        long regs[ILOC_MAX_OPERANDS];
+        int count = ILOCInsn_sources(insn, regs);
+        for (int j = 0; j < count; j++) {
+            int r = reg_index(regs[j]);
+            add_edge(s, s->last_def[r], i, s->def_latency[r]);
+            add_reader(s, regs[j], i);
+        }
+
+        /* memory */
+        if (is_load(insn->opcode)) {
+            MemoryKey key = memory_key(s, i);
+            if (key.base == KEY_UNKNOWN) {
+                add_edge(s, last_store, i, 0);
+            } else {
+                add_edge(s, *table_slot(s, key), i, 0);
+                if (last_store != NO_NODE) {
+                    add_edge(s, (same_base(s->keys[last_store], key) ?
+                                 s->run_prev[last_store] : last_store), i, 0);
+                }
+            }
+            s->loads[nloads++] = i;
+        } else if (is_store(insn->opcode)) {
+            MemoryKey key = memory_key(s, i);
+            s->keys[i] = key;
+            add_edge(s, last_store, i, 0);
+            for (int j = 0; j < nloads; j++) {
+                add_edge(s, s->loads[j], i, 0);
+            }
+            nloads = 0;
+            s->run_prev[i] = (last_store != NO_NODE && same_base(s->keys[last_store], key) ?
+                              s->run_prev[last_store] : last_store);
+            if (key.base != KEY_UNKNOWN) {
+                *table_slot(s, key) = i;
+            }
+            last_store = i;
+        } else if (insn->opcode == ILOC_PRINT) {
+            add_edge(s, last_print, i, 0);
+            last_print = i;
+        }
+
+        /* registers written */
+        long dest;
+        if (ILOCInsn_destination(insn, &dest)) {
+            add_def(s, dest, i, s->config->latencies[insn->opcode]);
+        }
+        if (insn->opcode == ILOC_PUSH || insn->opcode == ILOC_POP) {
+            add_def(s, ILOC_SP, i, 1);
+        }
+    }
+    reset_registers(s, s->block, n);
+
+    /* successor lists (counting sort by source) and critical paths */
+    for (int i = 0; i < n; i++) {
+        s->succ_start[i + 1] = 0;
+        s->npreds[i] = 0;
+    }
+    s->succ_start[0] = 0;
+    for (int e = 0; e < s->nedges; e++) {
+        s->succ_start[s->edges[e].from + 1]++;
+        s->npreds[s->edges[e].to]++;
+    }
+    for (int i = 0; i < n; i++) {
+        s->succ_start[i + 1] += s->succ_start[i];
+        s->stamp[i] = s->succ_start[i];     /* next free successor slot */
+    }
+    for (int e = 0; e < s->nedges; e++) {
+        s->succs[s->stamp[s->edges[e].from]++] = s->edges[e];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        long priority = s->config->latencies[s->block[i]->opcode];
+        for (int e = s->succ_start[i]; e < s->succ_start[i + 1]; e++) {
+            long path = s->succs[e].latency + s->priority[s->succs[e].to];
+            priority = (path > priority ? path : priority);
+        }
+        s->priority[i] = priority;
+    }
+}
+
+
+/*
+ * ISSUE
+ */
+
+/**
+ * @brief Heap order of the ready list: longest path first, then program order
+ */
+static bool ready_before (Scheduler* s, int a, int b)
+{
+    if (s->priority[a] != s->priority[b]) {
+        return s->priority[a] > s->priority[b];
+    }
+    return a < b;
+}
+
+/**
+ * @brief Heap order of the waiting list: earliest cycle first, then program order
+ */
+static bool wait_before (Scheduler* s, int a, int b)
+{
+    if (s->earliest[a] != s->earliest[b]) {
+        return s->earliest[a] < s->earliest[b];
+    }
+    return a < b;
+}
+
+typedef bool (*HeapOrder) (Scheduler* s, int a, int b);
+
+static void heap_push (Scheduler* s, int* heap, int* size, int node, HeapOrder before)
+{
+    int i = (*size)++;
+    while (i > 0 && before(s, node, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = node;
+}
+
+static int heap_pop (Scheduler* s, int* heap, int* size, HeapOrder before)
+{
+    int top = heap[0];
+    int last = heap[--(*size)];
+    int i = 0;
+    while (2 * i + 1 < *size) {
+        int child = 2 * i + 1;
+        if (child + 1 < *size && before(s, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!before(s, heap[child], last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/**
+ * @brief Issue the block's instructions one per cycle into @c order
+ */
+static void issue (Scheduler* s, int n)
+{
+    int end = (is_terminator(s->block[n - 1]->opcode) ? n - 1 : n);
+    int nready = 0;
+    int nwaiting = 0;
+    for (int i = 0; i < end; i++) {
+        s->earliest[i] = 0;
+        if (s->npreds[i] == 0) {
+            heap_push(s, s->wait_heap, &nwaiting, i, wait_before);
+        }
+    }
+
+    long cycle = 0;
+    int count = 0;
+    while (count < end) {
+        while (nwaiting > 0 && s->earliest[s->wait_heap[0]] <= cycle) {
+            int node = heap_pop(s, s->wait_heap, &nwaiting, wait_before);
+            heap_push(s, s->ready_heap, &nready, node, ready_before);
+        }
+        if (nready == 0) {
+            cycle = s->earliest[s->wait_heap[0]];
+            continue;
+        }
+        int node = heap_pop(s, s->ready_heap, &nready, ready_before);
+        s->order[count++] = s->block[node];
+        for (int e = s->succ_start[node]; e < s->succ_start[node + 1]; e++) {
+            int next = s->succs[e].to;
+            long earliest = cycle + s->succs[e].latency;
+            s->earliest[next] = (earliest > s->earliest[next] ? earliest : s->earliest[next]);
+            if (--s->npreds[next] == 0 && next < end) {
+                heap_push(s, s->wait_heap, &nwaiting, next, wait_before);
+            }
+        }
+        cycle++;
+    }
+    if (end < n) {
+        s->order[count] = s->block[end];
+    }
+}
+
+static void schedule_block (Scheduler* s, ILOCInsn** insns, int n, ScheduleStats* stats)
+{
+    stats->blocks++;
+    stats->instructions += n;
+    stats->largest_block = (n > stats->largest_block ? n : stats->largest_block);
+
+    s->block = insns;
+    build_dag(s, n);
+    stats->edges += s->nedges;
+
+    long before = estimate(s, insns, n);
+    issue(s, n);
+    long after = estimate(s, s->order, n);
+    if (after < before) {
+        memcpy(insns, s->order, sizeof(ILOCInsn*) * n);
+        stats->reordered++;
+    } else {
+        after = before;
+    }
+    stats->cycles_before += before;
+    stats->cycles_after += after;
+}
+
+void Schedule_blocks (ILOCInsnList* list, const ILOCMachineConfig* config, ScheduleStats* stats)
+{
+    ILOCMachineConfig defaults;
+    if (config == NULL) {
+        ILOCMachineConfig_init(&defaults);
+        config = &defaults;
+    }
+    ScheduleStats unused;
+    if (stats == NULL) {
+        stats = &unused;
+    }
+    memset(stats, 0, sizeof(ScheduleStats));
+    int size = list->size;
+    if (size == 0) {
+        return;
+    }
+
+    /* flatten the list and size the register arrays */
+    ILOCInsn** all = (ILOCInsn**)malloc(sizeof(ILOCInsn*) * size);
+    CHECK_MALLOC_PTR(all)
+    long max_reg = -1;
+    int n = 0;
+    FOR_EACH (ILOCInsn*, insn, list) {
+        all[n++] = insn;
+        for (int i = 0; i < ILOC_MAX_OPERANDS; i++) {
+            if (insn->operands[i].type == OPERAND_REG && insn->operands[i].value > max_reg) {
+                max_reg = insn->operands[i].value;
+            }
+        }
+    }
+
+    Scheduler s;
+    memset(&s, 0, sizeof(Scheduler));
+    s.config = config;
+    int nregs = (int)max_reg + 1 + NUM_SPECIAL_REGS;
+    s.last_def = (int*)malloc(sizeof(int) * nregs);
+    s.def_latency = (int*)calloc(nregs, sizeof(int));
+    s.first_reader = (int*)malloc(sizeof(int) * nregs);
+    s.ready = (long*)calloc(nregs, sizeof(long));
+    CHECK_MALLOC_PTR(s.last_def)
+    CHECK_MALLOC_PTR(s.def_latency)
+    CHECK_MALLOC_PTR(s.first_reader)
+    CHECK_MALLOC_PTR(s.ready)
+    for (int r = 0; r < nregs; r++) {
+        s.last_def[r] = s.first_reader[r] = NO_NODE;
+    }
+    s.reader_node = (int*)malloc(sizeof(int) * size * ILOC_MAX_OPERANDS);
+    s.reader_next = (int*)malloc(sizeof(int) * size * ILOC_MAX_OPERANDS);
+    s.stamp = (int*)malloc(sizeof(int) * size);
+    s.stamp_edge = (int*)malloc(sizeof(int) * size);
+    s.keys = (MemoryKey*)malloc(sizeof(MemoryKey) * size);
+    s.run_prev = (int*)malloc(sizeof(int) * size);
+    s.loads = (int*)malloc(sizeof(int) * size);
+    s.npreds = (int*)malloc(sizeof(int) * size);
+    s.priority = (long*)malloc(sizeof(long) * size);
+    s.earliest = (long*)malloc(sizeof(long) * size);
+    s.succ_start = (int*)malloc(sizeof(int) * (size + 1));
+    s.ready_heap = (int*)malloc(sizeof(int) * size);
+    s.wait_heap = (int*)malloc(sizeof(int) * size);
+    s.order = (ILOCInsn**)malloc(sizeof(ILOCInsn*) * size);
+    s.edge_capacity = 4 * size;
+    s.edges = (Edge*)malloc(sizeof(Edge) * s.edge_capacity);
+    s.succs = (Edge*)malloc(sizeof(Edge) * s.edge_capacity);
+    CHECK_MALLOC_PTR(s.reader_node)
+    CHECK_MALLOC_PTR(s.reader_next)
+    CHECK_MALLOC_PTR(s.stamp)
+    CHECK_MALLOC_PTR(s.stamp_edge)
+    CHECK_MALLOC_PTR(s.keys)
+    CHECK_MALLOC_PTR(s.run_prev)
+    CHECK_MALLOC_PTR(s.loads)
+    CHECK_MALLOC_PTR(s.npreds)
+    CHECK_MALLOC_PTR(s.priority)
+    CHECK_MALLOC_PTR(s.earliest)
+    CHECK_MALLOC_PTR(s.succ_start)
+    CHECK_MALLOC_PTR(s.ready_heap)
+    CHECK_MALLOC_PTR(s.wait_heap)
+    CHECK_MALLOC_PTR(s.order)
+    CHECK_MALLOC_PTR(s.edges)
+    CHECK_MALLOC_PTR(s.succs)
+
+    /* blocks start after a label or a control transfer */
+    int i = 0;
+    while (i < size) {
+        if (all[i]->opcode == ILOC_LABEL) {
+            i++;
+            continue;
+        }
+        int start = i;
+        while (i < size && all[i]->opcode != ILOC_LABEL) {
+            if (is_terminator(all[i++]->opcode)) {
+                break;
+            }
+        }
+        schedule_block(&s, all + start, i - start, stats);
+    }
+
+    /* relink the list in the new order */
+    list->head = all[0];
+    for (int k = 0; k < size - 1; k++) {
+        all[k]->next = all[k + 1];
+    }
+    all[size - 1]->next = NULL;
+    list->tail = all[size - 1];
+
+    free(s.last_def);
+    free(s.def_latency);
+    free(s.first_reader);
+    free(s.ready);
+    free(s.reader_node);
+    free(s.reader_next);
+    free(s.stamp);
+    free(s.stamp_edge);
+    free(s.keys);
+    free(s.run_prev);
+    free(s.loads);
+    free(s.npreds);
+    free(s.priority);
+    free(s.earliest);
+    free(s.succ_start);
+    free(s.ready_heap);
+    free(s.wait_heap);
+    free(s.order);
+    free(s.edges);
+    free(s.succs);
+    free(s.table);
+    free(all);
+}
+
+void ScheduleStats_print (ScheduleStats* stats, FILE* output)
+{
+    fprintf(output, "blocks: %d (%d reordered), instructions: %d, largest block: %d\n",
+            stats->blocks, stats->reordered, stats->instructions, stats->largest_block);
+    fprintf(output, "dependences: %ld\n", stats->edges);
+    fprintf(output, "estimated cycles: %ld -> %ld\n", stats->cycles_before, stats->cycles_after);
+}
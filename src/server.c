@@ -0,0 +1,483 @@
+/**
+ * @file server.c
+ * @brief Persistent compile server and its client
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "p1-lexer.h"
+#include "p2-parser.h"
+#include "parlex.h"
+#include "lineindex.h"
+#include "visitor.h"
+
+/**
+ * @brief Maximum length of a request or response header line
+ */
+#define MAX_HEADER_LEN 64
+
+int compile_source (const char* text, ServerCommand command, FILE* output, FILE* errors)
+{
+    TokenQueue* volatile tokens = NULL;
+    ASTNode* tree = NULL;
+    int status = EXIT_SUCCESS;
+
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        tokens = lex_parallel(text, 1);
+        tree = parse(tokens);
+    } else {
+        fprintf(errors, "%s", trap.message);
+        if (tokens != NULL) {
+            LineIndex_print_error_location(text, tokens, errors);
+        }
+        tree = NULL;
+        status = EXIT_FAILURE;
+    }
+    ErrorTrap_pop(&trap);
+
+    if (tokens != NULL) {
+        TokenQueue_free(tokens);
+    }
+    if (tree != NULL) {
+        if (command == PRINT_COMMAND) {
+            SetParentVisitor_traverse(tree);
+            CalcDepthVisitor_traverse(tree);
+            PrintVisitor_traverse(output, tree);
+        }
+        ASTNode_free(tree);
+    }
+    return status;
+}
+
+/*
+ * SOCKET I/O
+ */
+
+/**
+ * @brief Buffered reader for a socket
+ */
+typedef struct SocketReader
+{
+    int fd;
+    char buffer[4096];
+    size_t start;       /**< @brief Index of the first unread byte */
+    size_t end;         /**< @brief Index one past the last buffered byte */
+} SocketReader;
+
+static bool SocketReader_fill (SocketReader* reader)
+{
+    ssize_t n;
+    do {
+        n = recv(reader->fd, reader->buffer, sizeof(reader->buffer), 0);
+    } while (n < 0 && errno == EINTR);
+    reader->start = 0;
+    reader->end = (n > 0 ? (size_t)n : 0);
+    return n > 0;
+}
+
+/**
+ * @brief Read a line (without its newline) into a fixed-size buffer
+ *
+ * @returns False on end of input or if the line does not fit
+ */
+static bool SocketReader_line (SocketReader* reader, char* line, size_t size)
+{
+    size_t length = 0;
+    while (true) {
+        if (reader->start == reader->end && !SocketReader_fill(reader)) {
+            return false;
+        }
+        char c = reader->buffer[reader->start++];
+        if (c == '\n') {
+            line[length] = '\0';
+            return true;
+        }
+        if (length + 1 == size) {
+            return false;
+        }
+        line[length++] = c;
+    }
+}
+
+/**
+ * @brief Read exactly @p length bytes into memory (if @p dest is not
+ * @c NULL) or into a file stream
+ *
+ * @returns False on end of input
+ */
+static bool SocketReader_bytes (SocketReader* reader, char* dest, FILE* output, size_t length)
+{
+    while (length > 0) {
+        if (reader->start == reader->end && !SocketReader_fill(reader)) {
+            return false;
+        }
+        size_t n = reader->end - reader->start;
+        if (n > length) {
+            n = length;
+        }
+        if (dest != NULL) {
+            memcpy(dest, reader->buffer + reader->start, n);
+            dest += n;
+        } else {
+            fwrite(reader->buffer + reader->start, 1, n, output);
+        }
+        reader->start += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool send_all (int fd, const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+static bool set_address (struct sockaddr_un* address, const char* socket_path)
+{
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, socket_path);
+    return true;
+}
+
+/*
+ * SERVER
+ */
+
+/**
+ * @brief Set when the server should stop accepting connections
+ */
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * @brief Listening socket of the running server (or -1)
+ */
+static volatile sig_atomic_t listen_socket = -1;
+
+void CompileServer_stop ()
+{
+    stop_requested = 1;
+    int fd = listen_socket;
+    if (fd >= 0) {
+        shutdown(fd, SHUT_RDWR);    /* wakes up the blocked accept call */
+    }
+}
+
+/**
+ * @brief Bounded queue of accepted connections waiting for a worker
+ */
+typedef struct ConnectionQueue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    int* fds;
+    int capacity;
+    int head;           /**< @brief Index of the oldest connection */
+    int count;
+    bool closed;        /**< @brief No more connections will be added */
+} ConnectionQueue;
+
+static void ConnectionQueue_push (ConnectionQueue* queue, int fd)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->fds[(queue->head + queue->count++) % queue->capacity] = fd;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Wait for a connection
+ *
+ * @returns Socket, or -1 once the queue is closed and empty
+ */
+static int ConnectionQueue_pop (ConnectionQueue* queue)
+{
+    int fd = -1;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count > 0) {
+        fd = queue->fds[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return fd;
+}
+
+static void ConnectionQueue_close (ConnectionQueue* queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Send a response with the contents of two memory streams
+ */
+static void send_response (int fd, int status, char* output, size_t output_length,
+                           char* errors, size_t errors_length)
+{
+    char header[MAX_HEADER_LEN];
+    int length = snprintf(header, MAX_HEADER_LEN, "%d %zu %zu\n", status, output_length, errors_length);
+    if (send_all(fd, header, length)) {
+        if (send_all(fd, output, output_length)) {
+            send_all(fd, errors, errors_length);
+        }
+    }
+}
+
+/**
+ * @brief Read one request from a connection, run it and send the response
+ */
+static void handle_connection (int fd)
+{
+    SocketReader reader = { .fd = fd };
+    char header[MAX_HEADER_LEN];
+    char command[MAX_HEADER_LEN];
+    size_t length = 0;
+    char* payload = NULL;
+
+    char* output = NULL;
+    size_t output_length = 0;
+    char* errors = NULL;
+    size_t errors_length = 0;
+    FILE* output_stream = open_memstream(&output, &output_length);
+    FILE* errors_stream = open_memstream(&errors, &errors_length);
+    if (output_stream == NULL || errors_stream == NULL) {
+        /* out of memory; drop the connection */
+        if (output_stream != NULL) {
+            fclose(output_stream);
+        }
+        if (errors_stream != NULL) {
+            fclose(errors_stream);
+        }
+        free(output);
+        free(errors);
+        return;
+    }
+    int status = EXIT_FAILURE;
+
+    if (!SocketReader_line(&reader, header, MAX_HEADER_LEN) ||
+            sscanf(header, "%s %zu", command, &length) != 2 || length > MAX_REQUEST_SIZE) {
+        fprintf(errors_stream, "Invalid request\n");
+    } else {
+        payload = (char*)malloc(length + 1);
+        CHECK_MALLOC_PTR(payload)
+        if (!SocketReader_bytes(&reader, payload, NULL, length)) {
+            fprintf(errors_stream, "Incomplete request\n");
+        } else {
+            payload[length] = '\0';
+            ServerCommand kind = (strncmp(command, "PRINT", 5) == 0 ? PRINT_COMMAND : PARSE_COMMAND);
+            if (strcmp(command, "PARSE") == 0 || strcmp(command, "PRINT") == 0) {
+                status = compile_source(payload, kind, output_stream, errors_stream);
+            } else if (strcmp(command, "PARSEFILE") == 0 || strcmp(command, "PRINTFILE") == 0) {
+                char* text = read_file(payload);
+                if (text == NULL) {
+                    fprintf(errors_stream, "Could not read file: %s\n", payload);
+                } else {
+                    status = compile_source(text, kind, output_stream, errors_stream);
+                    free(text);
+                }
+            } else if (strcmp(command, "SHUTDOWN") == 0) {
+                status = EXIT_SUCCESS;
+                CompileServer_stop();
+            } else {
+                fprintf(errors_stream, "Unknown request: %s\n", command);
+            }
+        }
+    }
+
+    fclose(output_stream);
+    fclose(errors_stream);
+    send_response(fd, status, output, output_length, errors, errors_length);
+    free(output);
+    free(errors);
+    free(payload);
+}
+
+static void* worker_main (void* arg)
+{
+    ConnectionQueue* queue = (ConnectionQueue*)arg;
+    int fd;
+    while ((fd = ConnectionQueue_pop(queue)) != -1) {
+        handle_connection(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int CompileServer_run (const char* socket_path, int nworkers)
+{
+    if (nworkers <= 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = (ncpus > 0 ? (int)ncpus : 1);
+    }
+
+    struct sockaddr_un address;
+    if (!set_address(&address, socket_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return EXIT_FAILURE;
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(socket_path);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    stop_requested = 0;
+    listen_socket = fd;
+
+    ConnectionQueue queue;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+    queue.capacity = nworkers * SERVER_QUEUE_PER_WORKER;
+    queue.fds = (int*)malloc(queue.capacity * sizeof(int));
+    CHECK_MALLOC_PTR(queue.fds)
+    queue.head = 0;
+    queue.count = 0;
+    queue.closed = false;
+
+    /* workers leave termination signals to this thread, so that they
+     * interrupt the accept call below */
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    pthread_t* workers = (pthread_t*)calloc(nworkers, sizeof(pthread_t));
+    CHECK_MALLOC_PTR(workers)
+    int nstarted = 0;
+    for (int i = 0; i < nworkers; i++) {
+        if (pthread_create(&workers[nstarted], NULL, worker_main, &queue) == 0) {
+            nstarted++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (nstarted == 0) {
+        /* handle requests on this thread instead */
+        queue.capacity = 1;
+    }
+
+    while (!stop_requested) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (!stop_requested) {
+                perror("accept");
+            }
+            break;
+        }
+        if (nstarted == 0) {
+            handle_connection(client);
+            close(client);
+        } else {
+            ConnectionQueue_push(&queue, client);
+        }
+    }
+
+    /* finish the queued requests */
+    listen_socket = -1;
+    ConnectionQueue_close(&queue);
+    for (int i = 0; i < nstarted; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    close(fd);
+    unlink(socket_path);
+    free(workers);
+    free(queue.fds);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_cond_destroy(&queue.not_full);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * CLIENT
+ */
+
+int CompileClient_send (const char* socket_path, ServerRequest* request, FILE* output, FILE* errors)
+{
+    struct sockaddr_un address;
+    if (!set_address(&address, socket_path)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    const char* command = "SHUTDOWN";
+    const char* payload = "";
+    if (request->command != SHUTDOWN_COMMAND) {
+        bool print = (request->command == PRINT_COMMAND);
+        if (request->path != NULL) {
+            command = (print ? "PRINTFILE" : "PARSEFILE");
+            payload = request->path;
+        } else {
+            command = (print ? "PRINT" : "PARSE");
+            payload = request->text;
+        }
+    }
+    char header[MAX_HEADER_LEN];
+    size_t length = strlen(payload);
+    int header_length = snprintf(header, MAX_HEADER_LEN, "%s %zu\n", command, length);
+
+    int status = -1;
+    if (send_all(fd, header, header_length) && send_all(fd, payload, length)) {
+        SocketReader reader = { .fd = fd };
+        int response_status;
+        size_t output_length, errors_length;
+        if (SocketReader_line(&reader, header, MAX_HEADER_LEN) &&
+                sscanf(header, "%d %zu %zu", &response_status, &output_length, &errors_length) == 3 &&
+                SocketReader_bytes(&reader, NULL, output, output_length) &&
+                SocketReader_bytes(&reader, NULL, errors, errors_length)) {
+            status = response_status;
+        }
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file stream.c
+ * @brief Streaming front end for very large inputs
+ */
+
+#include "stream.h"
+#include "p1-lexer.h"
+#include "p2-parser.h"
+
+/**
+ * @brief State of a stream being parsed
+ */
+typedef struct StreamState
+{
+    FILE* input;            /**< @brief Source text stream */
+    char* buffer;           /**< @brief Text read but not yet lexed */
+    size_t size;            /**< @brief Number of bytes in @c buffer */
+    size_t capacity;        /**< @brief Size of @c buffer (in bytes) */
+    int base;               /**< @brief Offset of @c buffer in the whole text */
+    int lines;              /**< @brief Number of newlines before @c buffer */
+    bool eof;               /**< @brief Whether the input has all been read */
+    TokenQueue* tokens;     /**< @brief Tokens lexed but not yet parsed */
+    Token* boundary;        /**< @brief Last start of a declaration followed by another token (or @c NULL) */
+    int depth;              /**< @brief Brace depth after the last token queued */
+    bool at_start;          /**< @brief Whether the last token queued follows a top-level @c ; */
+} StreamState;
+
+/**
+ * @brief Read until the buffer holds at least one complete line
+ *
+ * @returns Length of the text to lex next (everything up to the last newline,
+ * or the rest of the input at the end), or 0 if there is nothing left
+ */
+static size_t read_lines (StreamState* state)
+{
+    size_t scanned = 0;
+    while (!state->eof) {
+        if (state->capacity < state->size + STREAM_CHUNK_SIZE + 1) {
+            state->capacity = (state->size + STREAM_CHUNK_SIZE + 1) * 2;
+            state->buffer = (char*)realloc(state->buffer, state->capacity);
+            CHECK_MALLOC_PTR(state->buffer)
+        }
+        size_t n = fread(state->buffer + state->size, 1, STREAM_CHUNK_SIZE, state->input);
+        state->size += n;
+        state->eof = (n < STREAM_CHUNK_SIZE);
+
+        /* look for the last newline in the new text */
+        for (size_t i = state->size; i > scanned; i--) {
+            if (state->buffer[i - 1] == '\n') {
+                return (state->eof ? state->size : i);
+            }
+        }
+        scanned = state->size;
+    }
+    return state->size;
+}
+
+/**
+ * @brief Lex the start of the buffer and append the tokens to the queue
+ *
+ * Tokens are given offsets and line numbers in the whole text, as are the
+ * line numbers in error messages.
+ *
+ * @param state Stream state
+ * @param length Number of bytes to lex (a whole number of lines)
+ */
+static void lex_lines (StreamState* state, size_t length)
+{
+    /* the lexer needs a NUL-terminated string */
+    char saved = state->buffer[length];
+    state->buffer[length] = '\0';
+
+    TokenQueue* tokens = NULL;
+    char message[MAX_ERROR_LEN];
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        tokens = lex(state->buffer);
+    } else {
+        Regex_explain_error(trap.message);
+        Error_move_line(message, trap.message, state->lines);
+    }
+    ErrorTrap_pop(&trap);
+    if (tokens == NULL) {
+        Error_throw_printf("%s", message);
+    }
+
+    TokenQueue_locate(tokens, state->buffer, state->base);
+    Token* prev = state->tokens->tail;
+    for (Token* t = tokens->head; t != NULL; t = t->next) {
+        t->line += state->lines;
+        if (prev != NULL && (prev->kind == TK_DEF || state->at_start)) {
+            state->boundary = prev;
+        }
+
+        /* outside any braces, a semicolon can only end a global variable */
+        state->at_start = (prev != NULL && prev->kind == TK_SEMICOLON && state->depth == 0);
+        state->depth += (t->kind == TK_LBRACE) - (t->kind == TK_RBRACE);
+        prev = t;
+    }
+    for (const char* p = state->buffer; (p = memchr(p, '\n', state->buffer + length - p)) != NULL; p++) {
+        state->lines++;
+    }
+    state->buffer[length] = saved;
+
+    /* move the tokens to the end of the queue */
+    if (tokens->head != NULL) {
+        if (state->tokens->head == NULL) {
+            state->tokens->head = tokens->head;
+        } else {
+            state->tokens->tail->next = tokens->head;
+        }
+        state->tokens->tail = tokens->tail;
+    }
+    free(tokens);
+
+    /* keep the rest of the text for next time */
+    memmove(state->buffer, state->buffer + length, state->size - length);
+    state->size -= length;
+    state->base += (int)length;
+}
+
+void parse_stream (FILE* input, DeclarationHandler handler, void* data)
+{
+    /* the state changes inside the trap, so it cannot be a local variable */
+    StreamState* state = (StreamState*)calloc(1, sizeof(StreamState));
+    CHECK_MALLOC_PTR(state)
+    state->input = input;
+    state->tokens = TokenQueue_new();
+
+    volatile bool failed = false;
+    char message[MAX_ERROR_LEN];
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        size_t length;
+        while ((length = read_lines(state)) > 0) {
+            lex_lines(state, length);
+
+            /* everything before the boundary is a run of whole declarations */
+            while (state->boundary != NULL && state->tokens->head != state->boundary) {
+                handler(parse_declaration(state->tokens), data);
+            }
+        }
+        while (!TokenQueue_is_empty(state->tokens)) {
+            handler(parse_declaration(state->tokens), data);
+        }
+    } else {
+        failed = true;
+        snprintf(message, MAX_ERROR_LEN, "%s", trap.message);
+    }
+    ErrorTrap_pop(&trap);
+
+    TokenQueue_free(state->tokens);
+    free(state->buffer);
+    free(state);
+    if (failed) {
+        Error_throw_printf("%s", message);
+    }
+}
+
+/**
+ * @brief Destination for @ref PrintVisitor_stream
+ */
+typedef struct PrintStream
+{
+    FILE* output;       /**< @brief File stream for the print output */
+    ASTNode* program;   /**< @brief Empty program node */
+} PrintStream;
+
+/**
+ * @brief Declaration handler for @ref PrintVisitor_stream
+ *
+ * The declaration is given the (empty) program node as its parent so that the
+ * depths, and so the indentation, match those in the full tree.
+ */
+static void print_declaration (ASTNode* decl, void* data)
+{
+    PrintStream* stream = (PrintStream*)data;
+    ASTNode_set_attribute(decl, "parent", (void*)stream->program, NULL);
+    SetParentVisitor_traverse(decl);
+    CalcDepthVisitor_traverse(decl);
+    PrintVisitor_traverse(stream->output, decl);
+    ASTNode_free(decl);
+}
+
+void PrintVisitor_stream (FILE* input, FILE* output)
+{
+    PrintStream stream = { output, ProgramNode_new(NodeList_new(), NodeList_new()) };
+    CalcDepthVisitor_traverse(stream.program);
+    PrintVisitor_traverse(output, stream.program);
+
+    volatile bool failed = false;
+    char message[MAX_ERROR_LEN];
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        parse_stream(input, print_declaration, &stream);
+    } else {
+        failed = true;
+        snprintf(message, MAX_ERROR_LEN, "%s", trap.message);
+    }
+    ErrorTrap_pop(&trap);
+
+    ASTNode_free(stream.program);
+    if (failed) {
+        Error_throw_printf("%s", message);
+    }
+}
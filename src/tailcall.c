@@ -0,0 +1,605 @@
+/**
+ * @file tailcall.c
+ * @brief Tail call elimination
+ */
+
+#include "tailcall.h"
+
+/**
+ * @brief Function whose tail calls become jumps to the top of a loop
+ */
+typedef struct Target
+{
+    ASTNode* func;                  /**< @brief Original declaration */
+    int state;                      /**< @brief Value of the state variable that selects its body */
+    int nparams;                    /**< @brief Number of parameters */
+    char (*names)[MAX_ID_LEN];      /**< @brief Variables that hold the parameters in the loop */
+    char (*temps)[MAX_ID_LEN];      /**< @brief Temporaries for the arguments ("" until needed) */
+} Target;
+
+/**
+ * @brief Tail call elimination state
+ */
+typedef struct TailCalls
+{
+    ASTNode* program;               /**< @brief Program being transformed */
+    TailCallStats* stats;           /**< @brief Statistics */
+    int next_name;                  /**< @brief Number for the next generated name */
+
+    /* while collecting tail calls */
+    int* callees;                   /**< @brief Functions tail-called (indices into @c funcs) */
+    int ncallees;                   /**< @brief Entries in @c callees */
+    int callee_capacity;            /**< @brief Allocated entries */
+    ASTNode** funcs;                /**< @brief Functions of the program */
+    int nfuncs;                     /**< @brief Number of functions */
+
+    /* while rewriting tail calls */
+    Target targets[2];              /**< @brief Functions in the loop being built */
+    int ntargets;                   /**< @brief Number of targets (0 while collecting) */
+    char state[MAX_ID_LEN];         /**< @brief State variable ("" for a single function) */
+    NodeList* temps;                /**< @brief Declarations of the temporaries */
+
+    bool is_void;                   /**< @brief Current function returns nothing */
+    NodeList** scopes;              /**< @brief Variables of the enclosing blocks */
+    int nscopes;                    /**< @brief Number of enclosing blocks */
+    int scope_capacity;             /**< @brief Allocated scopes */
+} TailCalls;
+
+static void fresh_name (TailCalls* tc, char* name)
+{
+    snprintf(name, MAX_ID_LEN, "_tail%d", tc->next_name++);
+}
+
+static int find_function (TailCalls* tc, const char* name)
+{
+    for (int i = 0; i < tc->nfuncs; i++) {
+        if (strcmp(tc->funcs[i]->funcdecl.name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool is_shadowed (TailCalls* tc, const char* name)
+{
+    for (int i = 0; i < tc->nscopes; i++) {
+        FOR_EACH (ASTNode*, var, tc->scopes[i]) {
+            if (strcmp(var->vardecl.name, name) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Rename references to a variable (or, if @c to is @c NULL, just look
+ * for them), skipping blocks that declare a local of the same name
+ *
+ * @returns True if there were any references
+ */
+static bool rename_var (ASTNode* node, const char* from, const char* to)
+{
+    if (node == NULL) {
+        return false;
+    }
+    bool found = false;
+    switch (node->type) {
+        case BLOCK:
+            FOR_EACH (ASTNode*, var, node->block.variables) {
+                if (strcmp(var->vardecl.name, from) == 0) {
+                    return false;
+                }
+            }
+            FOR_EACH (ASTNode*, stmt, node->block.statements) {
+                found = rename_var(stmt, from, to) || found;
+            }
+            return found;
+        case ASSIGNMENT:
+            found = rename_var(node->assignment.location, from, to);
+            return rename_var(node->assignment.value, from, to) || found;
+        case CONDITIONAL:
+            found = rename_var(node->conditional.condition, from, to);
+            found = rename_var(node->conditional.if_block, from, to) || found;
+            return rename_var(node->conditional.else_block, from, to) || found;
+        case WHILELOOP:
+            found = rename_var(node->whileloop.condition, from, to);
+            return rename_var(node->whileloop.body, from, to) || found;
+        case RETURNSTMT:
+            return rename_var(node->funcreturn.value, from, to);
+        case BINARYOP:
+            found = rename_var(node->binaryop.left, from, to);
+            return rename_var(node->binaryop.right, from, to) || found;
+        case UNARYOP:
+            return rename_var(node->unaryop.child, from, to);
+        case LOCATION:
+            found = rename_var(node->location.index, from, to);
+            if (strcmp(node->location.name, from) == 0) {
+                if (to != NULL) {
+                    snprintf(node->location.name, MAX_ID_LEN, "%s", to);
+                }
+                found = true;
+            }
+            return found;
+        case FUNCCALL:
+            FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
+                found = rename_var(arg, from, to) || found;
+            }
+            return found;
+        default:
+            return false;
+    }
+}
+
+static ASTNode* default_value (DecafType type, int line)
+{
+    return (type == BOOL ? LiteralNode_new_bool(false, line) : LiteralNode_new_int(0, line));
+}
+
+static void add_assignment (NodeList* stmts, const char* name, ASTNode* value, int line)
+{
+    NodeList_add(stmts, AssignmentNode_new(LocationNode_new(name, NULL, line), value, line));
+}
+
+/**
+ * @brief Check that every local of a body can be reset with one assignment at
+ * the top of its block (no arrays, and none in a block inside a loop)
+ */
+static bool can_reset_locals (ASTNode* block, bool in_loop)
+{
+    FOR_EACH (ASTNode*, var, block->block.variables) {
+        if (in_loop || var->vardecl.is_array) {
+            return false;
+        }
+    }
+    FOR_EACH (ASTNode*, stmt, block->block.statements) {
+        if (stmt->type == CONDITIONAL) {
+            if (!can_reset_locals(stmt->conditional.if_block, in_loop) ||
+                    (stmt->conditional.else_block != NULL &&
+                     !can_reset_locals(stmt->conditional.else_block, in_loop))) {
+                return false;
+            }
+        } else if (stmt->type == WHILELOOP && !can_reset_locals(stmt->whileloop.body, true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Start each block of a looping body by setting its locals to their
+ * default values, as a new call would (see @ref can_reset_locals)
+ */
+static void reset_locals (ASTNode* block)
+{
+    NodeList* stmts = block->block.statements;
+    FOR_EACH (ASTNode*, stmt, stmts) {
+        if (stmt->type == CONDITIONAL) {
+            reset_locals(stmt->conditional.if_block);
+            if (stmt->conditional.else_block != NULL) {
+                reset_locals(stmt->conditional.else_block);
+            }
+        }
+    }
+    if (block->block.variables->size == 0) {
+        return;
+    }
+    NodeList* resets = NodeList_new();
+    FOR_EACH (ASTNode*, var, block->block.variables) {
+        add_assignment(resets, var->vardecl.name,
+                       default_value(var->vardecl.type, var->source_line), var->source_line);
+    }
+    resets->tail->next = stmts->head;
+    stmts->head = resets->head;
+    if (stmts->tail == NULL) {
+        stmts->tail = resets->tail;
+    }
+    stmts->size += resets->size;
+    free(resets);
+}
+
+/**
+ * @brief Build the statements that replace a tail call to a loop target:
+ * assign the arguments to its parameters, select its body and continue
+ *
+ * @returns Statements, or @c NULL if the call can't be replaced
+ */
+static NodeList* jump_to (TailCalls* tc, ASTNode* call)
+{
+    Target* target = NULL;
+    for (int t = 0; t < tc->ntargets; t++) {
+        if (strcmp(tc->targets[t].func->funcdecl.name, call->funccall.name) == 0) {
+            target = &tc->targets[t];
+        }
+    }
+    NodeList* args = call->funccall.arguments;
+    if (target == NULL || args->size != target->nparams) {
+        return NULL;
+    }
+    for (int i = 0; i < target->nparams; i++) {
+        if (is_shadowed(tc, target->names[i])) {
+            return NULL;
+        }
+    }
+
+    /* take the arguments out of the call */
+    ASTNode** values = (ASTNode**)malloc(sizeof(ASTNode*) * (target->nparams + 1));
+    CHECK_MALLOC_PTR(values)
+    int nchanged = 0;
+    int i = 0;
+    for (ASTNode* arg = args->head; arg != NULL; i++) {
+        values[i] = arg;
+        arg = arg->next;
+        values[i]->next = NULL;
+        bool same = (values[i]->type == LOCATION && values[i]->location.index == NULL &&
+                     strcmp(values[i]->location.name, target->names[i]) == 0);
+        if (same) {
+            ASTNode_free(values[i]);
+            values[i] = NULL;
+        } else {
+            nchanged++;
+        }
+    }
+    args->head = args->tail = NULL;
+    args->size = 0;
+
+    /* evaluate every changed argument before assigning any parameter */
+    int line = call->source_line;
+    NodeList* stmts = NodeList_new();
+    Parameter* param = target->func->funcdecl.parameters->head;
+    for (i = 0; i < target->nparams; i++, param = param->next) {
+        if (values[i] == NULL) {
+            continue;
+        }
+        if (nchanged == 1) {
+            add_assignment(stmts, target->names[i], values[i], line);
+            continue;
+        }
+        if (target->temps[i][0] == '\0') {
+            fresh_name(tc, target->temps[i]);
+            NodeList_add(tc->temps, VarDeclNode_new(target->temps[i], param->type, false, 1, line));
+        }
+        add_assignment(stmts, target->temps[i], values[i], line);
+    }
+    for (i = 0; nchanged > 1 && i < target->nparams; i++) {
+        if (values[i] != NULL) {
+            add_assignment(stmts, target->names[i],
+                           LocationNode_new(target->temps[i], NULL, line), line);
+        }
+    }
+    if (tc->state[0] != '\0') {
+        add_assignment(stmts, tc->state, LiteralNode_new_int(target->state, line), line);
+    }
+    NodeList_add(stmts, ContinueNode_new(line));
+    free(values);
+    tc->stats->rewritten++;
+    return stmts;
+}
+
+/**
+ * @brief Replace a statement with a list of statements
+ *
+ * @returns Last of the new statements
+ */
+static ASTNode* splice (NodeList* list, ASTNode* prev, ASTNode* stmt, NodeList* replacement)
+{
+    ASTNode* last = replacement->tail;
+    last->next = stmt->next;
+    if (prev != NULL) {
+        prev->next = replacement->head;
+    } else {
+        list->head = replacement->head;
+    }
+    if (list->tail == stmt) {
+        list->tail = last;
+    }
+    list->size += replacement->size - 1;
+    free(replacement);
+    stmt->next = NULL;
+    ASTNode_free(stmt);
+    return last;
+}
+
+/**
+ * @brief Find the tail calls in a block: record them (if there are no loop
+ * targets) or replace the ones to loop targets with jumps
+ *
+ * @param tc State
+ * @param block Block to search
+ * @param tail Whether the end of the block is the end of the function
+ * @param in_loop Whether the block is inside a @c while loop
+ */
+static void walk_block (TailCalls* tc, ASTNode* block, bool tail, bool in_loop)
+{
+    if (tc->nscopes == tc->scope_capacity) {
+        tc->scope_capacity = (tc->scope_capacity == 0 ? 16 : tc->scope_capacity * 2);
+        tc->scopes = (NodeList**)realloc(tc->scopes, sizeof(NodeList*) * tc->scope_capacity);
+        CHECK_MALLOC_PTR(tc->scopes)
+    }
+    tc->scopes[tc->nscopes++] = block->block.variables;
+
+    NodeList* list = block->block.statements;
+    ASTNode* prev = NULL;
+    ASTNode* stmt = list->head;
+    while (stmt != NULL) {
+        ASTNode* next = stmt->next;
+        ASTNode* call = NULL;
+        if (stmt->type == RETURNSTMT && stmt->funcreturn.value != NULL &&
+                stmt->funcreturn.value->type == FUNCCALL) {
+            call = stmt->funcreturn.value;
+        } else if (stmt->type == FUNCCALL && tc->is_void &&
+                ((tail && next == NULL) ||
+                 (next != NULL && next->type == RETURNSTMT && next->funcreturn.value == NULL))) {
+            call = stmt;
+        }
+
+        if (call != NULL && find_function(tc, call->funccall.name) >= 0) {
+            if (tc->ntargets == 0) {
+                tc->stats->tail_calls++;
+                if (!in_loop) {
+                    if (tc->ncallees == tc->callee_capacity) {
+                        tc->callee_capacity = (tc->callee_capacity == 0 ? 16 : tc->callee_capacity * 2);
+                        tc->callees = (int*)realloc(tc->callees, sizeof(int) * tc->callee_capacity);
+                        CHECK_MALLOC_PTR(tc->callees)
+                    }
+                    tc->callees[tc->ncallees++] = find_function(tc, call->funccall.name);
+                }
+            } else if (!in_loop) {
+                NodeList* jump = jump_to(tc, call);
+                if (jump != NULL) {
+                    stmt = splice(list, prev, stmt, jump);
+                }
+            }
+        } else if (stmt->type == CONDITIONAL) {
+            walk_block(tc, stmt->conditional.if_block, tail && next == NULL, in_loop);
+            if (stmt->conditional.else_block != NULL) {
+                walk_block(tc, stmt->conditional.else_block, tail && next == NULL, in_loop);
+            }
+        } else if (stmt->type == WHILELOOP) {
+            walk_block(tc, stmt->whileloop.body, false, true);
+        }
+        prev = stmt;
+        stmt = next;
+    }
+    tc->nscopes--;
+}
+
+/**
+ * @brief Set up a loop target whose parameters keep their names (or get new
+ * ones, if @c rename is set)
+ */
+static void add_target (TailCalls* tc, ASTNode* func, bool rename)
+{
+    Target* target = &tc->targets[tc->ntargets];
+    target->func = func;
+    target->state = tc->ntargets++;
+    target->nparams = func->funcdecl.parameters->size;
+    target->names = calloc(target->nparams + 1, MAX_ID_LEN);
+    target->temps = calloc(target->nparams + 1, MAX_ID_LEN);
+    CHECK_MALLOC_PTR(target->names)
+    CHECK_MALLOC_PTR(target->temps)
+    int i = 0;
+    FOR_EACH (Parameter*, param, func->funcdecl.parameters) {
+        if (rename) {
+            fresh_name(tc, target->names[i]);
+            rename_var(func->funcdecl.body, param->name, target->names[i]);
+        } else {
+            snprintf(target->names[i], MAX_ID_LEN, "%s", param->name);
+        }
+        i++;
+    }
+}
+
+static void clear_targets (TailCalls* tc)
+{
+    for (int t = 0; t < tc->ntargets; t++) {
+        free(tc->targets[t].names);
+        free(tc->targets[t].temps);
+    }
+    tc->ntargets = 0;
+    tc->state[0] = '\0';
+}
+
+/**
+ * @brief Rewrite the tail calls in one target's body
+ */
+static void rewrite_body (TailCalls* tc, Target* target)
+{
+    tc->is_void = (target->func->funcdecl.return_type == VOID);
+    walk_block(tc, target->func->funcdecl.body, true, false);
+}
+
+/**
+ * @brief Reset a target's locals at the top of each iteration and end its
+ * body with a @c break, so that falling off the end still leaves the loop
+ */
+static ASTNode* loop_body (Target* target)
+{
+    ASTNode* body = target->func->funcdecl.body;
+    reset_locals(body);
+    NodeList_add(body->block.statements, BreakNode_new(target->func->source_line));
+    return body;
+}
+
+/**
+ * @brief Turn a function that tail-calls itself into a loop
+ */
+static void make_loop (TailCalls* tc, ASTNode* func)
+{
+    int line = func->source_line;
+    if (!can_reset_locals(func->funcdecl.body, false)) {
+        return;
+    }
+    tc->temps = NodeList_new();
+    add_target(tc, func, false);
+    int rewritten = tc->stats->rewritten;
+    rewrite_body(tc, &tc->targets[0]);
+    if (tc->stats->rewritten == rewritten) {
+        /* every self call had a shadowed parameter */
+        NodeList_free(tc->temps);
+        clear_targets(tc);
+        return;
+    }
+
+    NodeList* stmts = NodeList_new();
+    NodeList_add(stmts, WhileLoopNode_new(LiteralNode_new_bool(true, line),
+                                          loop_body(&tc->targets[0]), line));
+    func->funcdecl.body = BlockNode_new(tc->temps, stmts, line);
+    tc->stats->loops++;
+    clear_targets(tc);
+}
+
+/**
+ * @brief Make the body of a wrapper that calls the merged function
+ */
+static ASTNode* wrapper_body (TailCalls* tc, const char* merged, ASTNode* func, int state)
+{
+    int line = func->source_line;
+    NodeList* args = NodeList_new();
+    NodeList_add(args, LiteralNode_new_int(state, line));
+    for (int t = 0; t < tc->ntargets; t++) {
+        FOR_EACH (Parameter*, param, tc->targets[t].func->funcdecl.parameters) {
+            NodeList_add(args, (tc->targets[t].func == func ? LocationNode_new(param->name, NULL, line)
+                                                            : default_value(param->type, line)));
+        }
+    }
+    ASTNode* call = FuncCallNode_new(merged, args, line);
+    NodeList* stmts = NodeList_new();
+    NodeList_add(stmts, (func->funcdecl.return_type == VOID ? call : ReturnNode_new(call, line)));
+    return BlockNode_new(NodeList_new(), stmts, line);
+}
+
+/**
+ * @brief Merge two functions that tail-call each other into one loop
+ *
+ * @returns False (with nothing changed) if the merge isn't possible
+ */
+static bool merge (TailCalls* tc, ASTNode* first, ASTNode* second)
+{
+    if (first->funcdecl.return_type != second->funcdecl.return_type ||
+            !can_reset_locals(first->funcdecl.body, false) ||
+            !can_reset_locals(second->funcdecl.body, false)) {
+        return false;
+    }
+
+    /* the first function's parameters must not capture globals of the second */
+    FOR_EACH (Parameter*, param, first->funcdecl.parameters) {
+        bool own = false;
+        FOR_EACH (Parameter*, other, second->funcdecl.parameters) {
+            own = own || strcmp(param->name, other->name) == 0;
+        }
+        if (!own && rename_var(second->funcdecl.body, param->name, NULL)) {
+            return false;
+        }
+    }
+
+    int line = first->source_line;
+    tc->temps = NodeList_new();
+    add_target(tc, first, false);
+    add_target(tc, second, true);
+    fresh_name(tc, tc->state);
+    char name[MAX_ID_LEN];
+    fresh_name(tc, name);
+
+    /* while (true) { if (state == 0) { first } else { second } } */
+    ASTNode* condition = BinaryOpNode_new(EQOP, LocationNode_new(tc->state, NULL, line),
+                                          LiteralNode_new_int(0, line), line);
+    rewrite_body(tc, &tc->targets[0]);
+    rewrite_body(tc, &tc->targets[1]);
+    NodeList* branch = NodeList_new();
+    NodeList_add(branch, ConditionalNode_new(condition, loop_body(&tc->targets[0]),
+                                             loop_body(&tc->targets[1]), line));
+    NodeList* stmts = NodeList_new();
+    NodeList_add(stmts, WhileLoopNode_new(LiteralNode_new_bool(true, line),
+                                          BlockNode_new(NodeList_new(), branch, line), line));
+
+    ParameterList* params = ParameterList_new();
+    ParameterList_add_new(params, tc->state, INT);
+    for (int t = 0; t < tc->ntargets; t++) {
+        int i = 0;
+        FOR_EACH (Parameter*, param, tc->targets[t].func->funcdecl.parameters) {
+            ParameterList_add_new(params, tc->targets[t].names[i++], param->type);
+        }
+    }
+    NodeList_add(tc->program->program.functions,
+                 FuncDeclNode_new(name, first->funcdecl.return_type, params,
+                                  BlockNode_new(tc->temps, stmts, line), line));
+
+    first->funcdecl.body = wrapper_body(tc, name, first, 0);
+    second->funcdecl.body = wrapper_body(tc, name, second, 1);
+    tc->stats->loops++;
+    tc->stats->merged++;
+    clear_targets(tc);
+    return true;
+}
+
+void TailCall_transform (ASTNode* tree, TailCallStats* stats)
+{
+    TailCallStats unused;
+    if (stats == NULL) {
+        stats = &unused;
+    }
+    memset(stats, 0, sizeof(TailCallStats));
+
+    TailCalls tc;
+    memset(&tc, 0, sizeof(TailCalls));
+    tc.program = tree;
+    tc.stats = stats;
+    tc.nfuncs = tree->program.functions->size;
+    tc.funcs = (ASTNode**)malloc(sizeof(ASTNode*) * (tc.nfuncs + 1));
+    CHECK_MALLOC_PTR(tc.funcs)
+    int n = 0;
+    FOR_EACH (ASTNode*, func, tree->program.functions) {
+        tc.funcs[n++] = func;
+    }
+
+    /* find which functions each one tail-calls (outside loops) */
+    int* first_callee = (int*)malloc(sizeof(int) * (tc.nfuncs + 1));
+    CHECK_MALLOC_PTR(first_callee)
+    for (int f = 0; f < tc.nfuncs; f++) {
+        first_callee[f] = tc.ncallees;
+        tc.is_void = (tc.funcs[f]->funcdecl.return_type == VOID);
+        walk_block(&tc, tc.funcs[f]->funcdecl.body, true, false);
+    }
+    first_callee[tc.nfuncs] = tc.ncallees;
+
+    /* merge mutually recursive pairs, then loop the self-recursive functions */
+    bool* done = (bool*)calloc(tc.nfuncs + 1, sizeof(bool));
+    CHECK_MALLOC_PTR(done)
+    for (int f = 0; f < tc.nfuncs; f++) {
+        for (int c = first_callee[f]; c < first_callee[f + 1] && !done[f]; c++) {
+            int g = tc.callees[c];
+            if (g == f || done[g]) {
+                continue;
+            }
+            for (int d = first_callee[g]; d < first_callee[g + 1]; d++) {
+                if (tc.callees[d] == f) {
+                    if (merge(&tc, tc.funcs[f], tc.funcs[g])) {
+                        done[f] = done[g] = true;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    for (int f = 0; f < tc.nfuncs; f++) {
+        for (int c = first_callee[f]; c < first_callee[f + 1] && !done[f]; c++) {
+            if (tc.callees[c] == f) {
+                make_loop(&tc, tc.funcs[f]);
+                done[f] = true;
+            }
+        }
+    }
+
+    free(done);
+    free(first_callee);
+    free(tc.funcs);
+    free(tc.callees);
+    free(tc.scopes);
+}
+
+void TailCallStats_print (TailCallStats* stats, FILE* output)
+{
+    fprintf(output, "tail calls: %d (%d rewritten), loops: %d (%d merged pairs)\n",
+            stats->tail_calls, stats->rewritten, stats->loops, stats->merged);
+}
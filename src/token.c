@@ -1,31 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+
 #include "token.h"
 
+/*
+ * Compiled-regex cache
+ *
+ * The lexer compiles all of its patterns at the start of every lex() call and
+ * frees them at the end. Since the patterns never change, compiled regexes are
+ * kept for the lifetime of the process instead: Regex_free returns a regex to
+ * a per-pattern pool and Regex_new hands it out again.
+ *
+ * Each pool holds as many instances as have ever been in use at once, so
+ * concurrent lexers (see parlex.c) each get their own copy; glibc serializes
+ * regexec calls on a single regex_t with an internal lock.
+ */
+
+/**
+ * @brief Cached compiled regex (the @c Regex handed out is the first member)
+ */
+typedef struct CachedRegex
+{
+    Regex regex;                    /**< @brief Compiled regex */
+    struct RegexPool* pool;         /**< @brief Pool that owns this instance */
+    struct CachedRegex* next_free;  /**< @brief Next idle instance in the pool */
+} CachedRegex;
+
+/**
+ * @brief All cached instances of a single pattern
+ */
+typedef struct RegexPool
+{
+    char* pattern;                  /**< @brief Source of the regex */
+    CachedRegex* free_list;         /**< @brief Idle compiled instances */
+    struct RegexPool* next;         /**< @brief Next pool in the cache */
+} RegexPool;
+
+/**
+ * @brief List of pools (one per distinct pattern; there are only a dozen)
+ */
+static RegexPool* regex_cache = NULL;
+
+/**
+ * @brief Protects @ref regex_cache and every pool's free list
+ */
+static pthread_mutex_t regex_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Text at which the current lexer found a token too long for its
+ * buffer (on this thread; see @ref Regex_match)
+ */
+static _Thread_local const char* overlong_token = NULL;
+
 Regex* Regex_new (const char* regex)
 {
-    Regex* r = (Regex*)calloc(1, sizeof(Regex));
-    CHECK_MALLOC_PTR(r)
-    /* regcomp initializes a regex_t, for which Regex is just a typedef */
-    regcomp(r, regex, REG_EXTENDED);
-    return r;
+    overlong_token = NULL;      /* every lex() starts by getting its regexes */
+
+    pthread_mutex_lock(&regex_cache_lock);
+    RegexPool* pool = regex_cache;
+    while (pool != NULL && strcmp(pool->pattern, regex) != 0) {
+        pool = pool->next;
+    }
+    if (pool == NULL) {
+        pool = (RegexPool*)calloc(1, sizeof(RegexPool));
+        CHECK_MALLOC_PTR(pool)
+        pool->pattern = (char*)malloc(strlen(regex) + 1);
+        CHECK_MALLOC_PTR(pool->pattern)
+        strcpy(pool->pattern, regex);
+        pool->next = regex_cache;
+        regex_cache = pool;
+    }
+    CachedRegex* cached = pool->free_list;
+    if (cached != NULL) {
+        pool->free_list = cached->next_free;
+    }
+    pthread_mutex_unlock(&regex_cache_lock);
+
+    if (cached == NULL) {
+        /* first use (or all instances busy): compile outside the lock */
+        cached = (CachedRegex*)calloc(1, sizeof(CachedRegex));
+        CHECK_MALLOC_PTR(cached)
+        cached->pool = pool;
+        /* regcomp initializes a regex_t, for which Regex is just a typedef */
+        regcomp(&cached->regex, regex, REG_EXTENDED);
+    }
+    return &cached->regex;
 }
 
 bool Regex_match (Regex *regex, const char *text, char *match)
 {
     /* only save one element becase, we only care about the whole-regex match */
     regmatch_t matches[1];
-    if (regexec(regex, text, 1, matches, 0) == 0) {
+    int flags = 0;
+    if (text == overlong_token) {
+        return false;           /* the lexer is giving up on this token (see below) */
+    }
+#ifdef REG_STARTEND
+    /*
+     * No token spans a line boundary, so limit the search to the rest of the
+     * current line (including the newline itself). Otherwise regexec calls
+     * strlen on the entire remaining input for every match, which makes
+     * lexing quadratic in the size of the file. Nothing longer than a token
+     * is kept either, so look no further than that: on a long line, both
+     * finding the newline and an unanchored alternative (such as the one for
+     * decimal literals) would otherwise scan the rest of the line every time.
+     * A match that reaches the end of a full window (with no newline or NUL
+     * inside it) may go on past it, so it is at least #MAX_TOKEN_LEN long and
+     * is refused below rather than accepted.
+     */
+    size_t limit = strnlen(text, MAX_TOKEN_LEN);
+    const char* eol = (const char*)memchr(text, '\n', limit);
+    matches[0].rm_so = 0;
+    matches[0].rm_eo = (eol != NULL ? (eol - text) + 1 : (regoff_t)limit);
+    flags = REG_STARTEND;
+#endif
+    if (regexec(regex, text, 1, matches, flags) == 0) {
 
-        /* save the match into the given string buffer */
-        snprintf(match, matches[0].rm_eo+1, "%s", text);
+        /*
+         * The lexer advances by strlen(match), so a match that does not fit
+         * in its buffer cannot be cut short (the rest of a long comment would
+         * be lexed as code). Throwing from here would leak the lexer's tokens
+         * and regexes, so fail this and every other pattern at this position
+         * instead: the lexer then cleans up and reports an invalid token on
+         * the right line, and Regex_explain_error gives the real reason.
+         */
+        size_t len = (size_t)matches[0].rm_eo;
+        if (len >= MAX_TOKEN_LEN) {
+            overlong_token = text;
+            return false;
+        }
+
+        /*
+         * save the match into the given string buffer (copy only the matched
+         * prefix; formatting with "%s" would scan the rest of the input)
+         */
+        memcpy(match, text, len);
+        match[len] = '\0';
         return true;
     }
     return false;
 }
 
+void Regex_explain_error (char* message)
+{
+    if (overlong_token == NULL) {
+        return;
+    }
+    overlong_token = NULL;
+    const char* at = strstr(message, " line ");
+    if (strncmp(message, "Invalid token", 13) == 0 && at != NULL) {
+        long line = strtol(at + 6, NULL, 10);
+        snprintf(message, MAX_ERROR_LEN, "Token too long on line %ld (at most %d characters)\n",
+                 line, MAX_TOKEN_LEN - 1);
+    }
+}
+
 void Regex_free (Regex* regex)
 {
-    regfree(regex); /* clean up regex_t structure */
-    free(regex);
+    /* return to the pool rather than calling regfree */
+    CachedRegex* cached = (CachedRegex*)regex;
+    pthread_mutex_lock(&regex_cache_lock);
+    cached->next_free = cached->pool->free_list;
+    cached->pool->free_list = cached;
+    pthread_mutex_unlock(&regex_cache_lock);
+}
+
+void Regex_cache_clear ()
+{
+    pthread_mutex_lock(&regex_cache_lock);
+    while (regex_cache != NULL) {
+        RegexPool* pool = regex_cache;
+        regex_cache = pool->next;
+        while (pool->free_list != NULL) {
+            CachedRegex* cached = pool->free_list;
+            pool->free_list = cached->next_free;
+            regfree(&cached->regex);
+            free(cached);
+        }
+        free(pool->pattern);
+        free(pool);
+    }
+    pthread_mutex_unlock(&regex_cache_lock);
 }
 
 const char* TokenType_to_string (TokenType type)
@@ -41,19 +197,110 @@ const char* TokenType_to_string (TokenType type)
     return "INVALID";
 }
 
+/**
+ * @brief Spellings of keyword and symbol kinds (indexed by @ref TokenKind)
+ */
+static const char* const token_kind_text[NUM_TOKEN_KINDS] = {
+    [TK_EOF] = "end of input", [TK_OTHER] = "unknown token",
+    [TK_ID] = "identifier", [TK_DECLIT] = "decimal literal",
+    [TK_HEXLIT] = "hex literal", [TK_STRLIT] = "string literal",
+    [TK_DEF] = "def", [TK_IF] = "if", [TK_ELSE] = "else", [TK_WHILE] = "while",
+    [TK_RETURN] = "return", [TK_BREAK] = "break", [TK_CONTINUE] = "continue",
+    [TK_INT] = "int", [TK_BOOL] = "bool", [TK_VOID] = "void",
+    [TK_TRUE] = "true", [TK_FALSE] = "false",
+    [TK_LPAREN] = "(", [TK_RPAREN] = ")", [TK_LBRACKET] = "[", [TK_RBRACKET] = "]",
+    [TK_LBRACE] = "{", [TK_RBRACE] = "}", [TK_COMMA] = ",", [TK_SEMICOLON] = ";",
+    [TK_ASSIGN] = "=", [TK_OR] = "||", [TK_AND] = "&&", [TK_EQ] = "==",
+    [TK_NE] = "!=", [TK_LT] = "<", [TK_LE] = "<=", [TK_GT] = ">", [TK_GE] = ">=",
+    [TK_PLUS] = "+", [TK_MINUS] = "-", [TK_TIMES] = "*", [TK_DIV] = "/",
+    [TK_MOD] = "%", [TK_NOT] = "!"
+};
+
+TokenKind TokenKind_classify (TokenType type, const char* text)
+{
+    switch (type) {
+        case ID:        return TK_ID;
+        case DECLIT:    return TK_DECLIT;
+        case HEXLIT:    return TK_HEXLIT;
+        case STRLIT:    return TK_STRLIT;
+        case KEY:
+            for (TokenKind k = TK_DEF; k <= TK_FALSE; k++) {
+                if (token_str_eq(text, token_kind_text[k])) {
+                    return k;
+                }
+            }
+            break;
+        case SYM:
+            for (TokenKind k = TK_LPAREN; k <= TK_NOT; k++) {
+                if (token_str_eq(text, token_kind_text[k])) {
+                    return k;
+                }
+            }
+            break;
+    }
+    return TK_OTHER;
+}
+
+const char* TokenKind_to_string (TokenKind kind)
+{
+    if (kind < 0 || kind >= NUM_TOKEN_KINDS) {
+        return "INVALID";
+    }
+    return token_kind_text[kind];
+}
+
 bool token_str_eq (const char* str1, const char* str2)
 {
     return strncmp(str1, str2, MAX_TOKEN_LEN) == 0;
 }
 
+/**
+ * @brief Decode the value of an integer literal token
+ *
+ * A literal of exactly 2^31 overflows, but keeps @c INT32_MIN as its value so
+ * that the parser can accept it after a unary minus.
+ *
+ * @param token Token with @c type and @c text already set
+ */
+static void decode_int_literal (Token* token)
+{
+    int base = (token->type == HEXLIT ? 16 : 10);
+    const char* p = token->text + (token->type == HEXLIT ? 2 : 0);   /* skip "0x" */
+    int64_t value = 0;
+    token->overflow = false;
+    for (; *p != '\0'; p++) {
+        int digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (*p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else {
+            digit = *p - 'A' + 10;
+        }
+        value = value * base + digit;
+        if (value > (int64_t)INT32_MAX + 1) {
+            token->overflow = true;
+            token->value = 0;
+            return;
+        }
+    }
+    token->overflow = (value > INT32_MAX);
+    token->value = (token->overflow ? INT32_MIN : (int)value);
+}
+
 Token* Token_new (TokenType type, const char* text, int line)
 {
     Token* token = (Token*)calloc(1, sizeof(Token));
     CHECK_MALLOC_PTR(token)
     token->type = type;
     snprintf(token->text, MAX_TOKEN_LEN, "%s", text);
+    token->kind = TokenKind_classify(type, token->text);
     token->line = line;
+    token->offset = -1;
     token->next = NULL;
+    if (type == DECLIT || type == HEXLIT) {
+        decode_int_literal(token);
+    }
     return token;
 }
 
@@ -117,6 +364,37 @@ size_t TokenQueue_size (TokenQueue* queue)
     return size;
 }
 
+void TokenQueue_locate (TokenQueue* queue, const char* text, int base)
+{
+    const char* p = text;
+    for (Token* t = queue->head; t != NULL; t = t->next) {
+
+        /* skip whitespace and comments (the only text between tokens) */
+        while (true) {
+            if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+                p++;
+            } else if (p[0] == '/' && p[1] == '/') {
+                while (*p != '\0' && *p != '\n') {
+                    p++;
+                }
+            } else {
+                break;
+            }
+        }
+
+        size_t len = strlen(t->text);
+        if (strncmp(p, t->text, len) != 0) {
+            /* text doesn't match the tokens; leave the rest unknown */
+            for (; t != NULL; t = t->next) {
+                t->offset = -1;
+            }
+            return;
+        }
+        t->offset = base + (int)(p - text);
+        p += len;
+    }
+}
+
 void TokenQueue_print (TokenQueue* queue, FILE* out)
 {
     for (Token* t = queue->head; t != NULL; t = t->next) {
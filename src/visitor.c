@@ -1,4 +1,5 @@
 #include "visitor.h"
+#include "writer.h"
 
 
 /*
@@ -52,131 +53,18 @@ NodeVisitor* NodeVisitor_new()
     return v;
 }
 
-#define PREVISIT(TYPE)  if (visitor->previsit_ ## TYPE != NULL)  { visitor->previsit_ ## TYPE (visitor, node); } \
-                                                           else  { visitor->previsit_default  (visitor, node); }
-#define POSTVISIT(TYPE) if (visitor->postvisit_ ## TYPE != NULL) { visitor->postvisit_ ## TYPE(visitor, node); } \
-                                                           else  { visitor->postvisit_default (visitor, node); }
+/*
+ * The traversal itself is generated by static-visitor.h (see there); for a
+ * general visitor, every callback is looked up in the visitor structure.
+ */
+#define STATIC_VISITOR_TRAVERSE             NodeVisitor_traverse_dynamic
+#define STATIC_VISITOR_STATE                NodeVisitor*
+#define STATIC_VISITOR_DISPATCH(WHEN,TYPE)  NODEVISITOR_ ## WHEN (state, node, TYPE)
+#include "static-visitor.h"
 
 void NodeVisitor_traverse (NodeVisitor* visitor, ASTNode* node)
 {
-    switch (node->type)
-    {
-        case PROGRAM:
-            PREVISIT(program)
-            FOR_EACH(ASTNode*, var, node->program.variables) {
-                NodeVisitor_traverse(visitor, var);
-            }
-            FOR_EACH(ASTNode*, func, node->program.functions) {
-                NodeVisitor_traverse(visitor, func);
-            }
-            POSTVISIT(program)
-            break;
-
-        case VARDECL:
-            PREVISIT(vardecl)
-            POSTVISIT(vardecl)
-            break;
-
-        case FUNCDECL:
-            PREVISIT(funcdecl)
-            NodeVisitor_traverse(visitor, node->funcdecl.body);
-            POSTVISIT(funcdecl)
-            break;
-
-        case BLOCK:
-            PREVISIT(block)
-            FOR_EACH (ASTNode*, var, node->block.variables) {
-                NodeVisitor_traverse(visitor, var);
-            }
-            FOR_EACH (ASTNode*, stmt, node->block.statements) {
-                NodeVisitor_traverse(visitor, stmt);
-            }
-            POSTVISIT(block)
-            break;
-
-        case ASSIGNMENT:
-            PREVISIT(assignment)
-            NodeVisitor_traverse(visitor, node->assignment.location);
-            NodeVisitor_traverse(visitor, node->assignment.value);
-            POSTVISIT(assignment)
-            break;
-
-        case CONDITIONAL:
-            PREVISIT(conditional)
-            NodeVisitor_traverse(visitor, node->conditional.condition);
-            NodeVisitor_traverse(visitor, node->conditional.if_block);
-            if (node->conditional.else_block != NULL) {
-                NodeVisitor_traverse(visitor, node->conditional.else_block);
-            }
-            POSTVISIT(conditional)
-            break;
-
-        case WHILELOOP:
-            PREVISIT(whileloop)
-            NodeVisitor_traverse(visitor, node->whileloop.condition);
-            NodeVisitor_traverse(visitor, node->whileloop.body);
-            POSTVISIT(whileloop)
-            break;
-
-        case RETURNSTMT:
-            PREVISIT(return)
-            if (node->funcreturn.value != NULL) {
-                NodeVisitor_traverse(visitor, node->funcreturn.value);
-            }
-            POSTVISIT(return)
-            break;
-
-        case BREAKSTMT:
-            PREVISIT(break)
-            POSTVISIT(break)
-            break;
-
-        case CONTINUESTMT:
-            PREVISIT(continue)
-            POSTVISIT(continue)
-            break;
-
-        case BINARYOP:
-            PREVISIT(binaryop)
-            NodeVisitor_traverse(visitor, node->binaryop.left);
-            if (visitor->invisit_binaryop != NULL) {
-                visitor->invisit_binaryop(visitor, node);
-            }
-            NodeVisitor_traverse(visitor, node->binaryop.right);
-            POSTVISIT(binaryop)
-            break;
-
-        case UNARYOP:
-            PREVISIT(unaryop)
-            NodeVisitor_traverse(visitor, node->unaryop.child);
-            POSTVISIT(unaryop)
-            break;
-
-        case LOCATION:
-            PREVISIT(location)
-            if (node->location.index != NULL) {
-                NodeVisitor_traverse(visitor, node->location.index);
-            }
-            POSTVISIT(location)
-            break;
-
-        case FUNCCALL:
-            PREVISIT(funccall)
-            FOR_EACH (ASTNode*, arg, node->funccall.arguments) {
-                NodeVisitor_traverse(visitor, arg);
-            }
-            POSTVISIT(funccall)
-            break;
-
-        case LITERAL:
-            PREVISIT(literal)
-            POSTVISIT(literal)
-            break;
-
-        default:
-            Error_throw_printf("ERROR: Unhandled node traversal\n");
-            break;
-    }
+    NodeVisitor_traverse_dynamic(visitor, node);
 }
 
 void NodeVisitor_traverse_and_free (NodeVisitor* visitor, ASTNode* node)
@@ -314,7 +202,7 @@ void PrintVisitor_visit_literal (NodeVisitor* visitor, ASTNode* node)
             break;
         case STR:
             fprintf(OUTFILE, "Literal type=string value=\"");
-            print_escaped_string(node->literal.string, stdout);
+            print_escaped_string(node->literal.string, OUTFILE);
             fprintf(OUTFILE, "\" [line %d]", node->source_line);
             break;
         case VOID:
@@ -349,116 +237,226 @@ NodeVisitor* PrintVisitor_new (FILE* output)
     return v;
 }
 
+#define STATIC_VISITOR_TRAVERSE         PrintVisitor_traverse_node
+#define STATIC_VISITOR_STATE            NodeVisitor*
+#define STATIC_PREVISIT_program         PrintVisitor_visit_program
+#define STATIC_PREVISIT_vardecl         PrintVisitor_visit_vardecl
+#define STATIC_PREVISIT_funcdecl        PrintVisitor_visit_funcdecl
+#define STATIC_PREVISIT_block           PrintVisitor_visit_block
+#define STATIC_PREVISIT_assignment      PrintVisitor_visit_assignment
+#define STATIC_PREVISIT_conditional     PrintVisitor_visit_conditional
+#define STATIC_PREVISIT_whileloop       PrintVisitor_visit_whileloop
+#define STATIC_PREVISIT_return          PrintVisitor_visit_return
+#define STATIC_PREVISIT_break           PrintVisitor_visit_break
+#define STATIC_PREVISIT_continue        PrintVisitor_visit_continue
+#define STATIC_PREVISIT_binaryop        PrintVisitor_visit_binaryop
+#define STATIC_PREVISIT_unaryop         PrintVisitor_visit_unaryop
+#define STATIC_PREVISIT_location        PrintVisitor_visit_location
+#define STATIC_PREVISIT_funccall        PrintVisitor_visit_funccall
+#define STATIC_PREVISIT_literal         PrintVisitor_visit_literal
+#include "static-visitor.h"
+
+void PrintVisitor_traverse (FILE* output, ASTNode* tree)
+{
+    /* the callbacks only use the "data" field */
+    NodeVisitor visitor = { .data = (void*)output };
+    PrintVisitor_traverse_node(&visitor, tree);
+}
+
 
 /*
  * AST VISITOR: GRAPH OUTPUT (requires 'dot' utility in GraphViz)
  */
 
-void GenerateASTGraph_assign_dotid (NodeVisitor* visitor, ASTNode* node)
-{
-    static int next_id = 0;
-    ASTNode_set_attribute(node, "dotid", (void*)(long)next_id, dummy_free);
-    next_id++;
+/**
+ * @brief State of a DOT graph being generated
+ *
+ * Nodes are numbered in the order they are written, by a counter that belongs
+ * to this traversal (so every graph starts at 0 and two graphs can be written
+ * at once), and each node's edge from its parent is written along with it.
+ * The only other state is the number of the nearest written ancestor at each
+ * level of the current path.
+ */
+typedef struct ASTGraph
+{
+    Writer writer;              /**< @brief Buffered output */
+    ASTGraphOptions options;    /**< @brief Which nodes to include */
+    int next_id;                /**< @brief Number of the next node written */
+    int depth;                  /**< @brief Depth of the current node (the root is 0) */
+    int* ids;                   /**< @brief Nearest written node at or above each depth (-1 if none) */
+    int capacity;               /**< @brief Size of @c ids */
+} ASTGraph;
+
+static ASTGraph* ASTGraph_new (FILE* output, const ASTGraphOptions* options)
+{
+    ASTGraph* graph = (ASTGraph*)calloc(1, sizeof(ASTGraph));
+    CHECK_MALLOC_PTR(graph)
+    Writer_init(&graph->writer, output);
+    if (options != NULL) {
+        graph->options = *options;
+    }
+    return graph;
 }
 
-#define GET_ID(NODE) ((int)(long)ASTNode_get_attribute(NODE, "dotid"))
-#define GEN_LINK(PARENT,CHILD) fprintf(OUTFILE, "%d -> %d;\n", GET_ID(PARENT), GET_ID(CHILD))
+static void ASTGraph_free (void* data)
+{
+    ASTGraph* graph = (ASTGraph*)data;
+    Writer_flush(&graph->writer);
+    free(graph->ids);
+    free(graph);
+}
 
-void GenerateASTGraph_generate_dot (NodeVisitor* visitor, ASTNode* node)
+/**
+ * @brief Check for the attributes that are only there to support other
+ * visitors (or that cannot be printed)
+ */
+static bool hidden_attribute (Attribute* attr)
 {
-    /*
-     * This is a bit of an anti-pattern here; rather than properly use the
-     * visitor functions, we just have a generic print function. That's ok here
-     * because we have to handle every kind of node anyway and not much of what
-     * we do is type-specific.
-     */
+    return attr->dot_printer == NULL ||
+           (attr->key[0] == 'd' && strcmp(attr->key, "depth") == 0) ||
+           (attr->key[0] == 'p' && strcmp(attr->key, "parent") == 0);
+}
 
-    /* generate label */
-    int id = GET_ID(node);
-    fprintf(OUTFILE, "%d [shape=box, label=\"%s", id, NodeType_to_string(node->type));
+static void ASTGraph_write_node (ASTGraph* graph, ASTNode* node, int id)
+{
+    Writer* writer = &graph->writer;
+    Writer_int(writer, id);
+    Writer_literal(writer, " [shape=box, label=\"");
+    Writer_puts(writer, NodeType_to_string(node->type));
     switch (node->type) {
-        case VARDECL:  fprintf(OUTFILE, " name='%s'", node->vardecl.name);  break;
-        case FUNCDECL: fprintf(OUTFILE, " name='%s'", node->funcdecl.name); break;
-        case FUNCCALL: fprintf(OUTFILE, " name='%s'", node->funccall.name); break;
-        case BINARYOP: fprintf(OUTFILE, " op='%s'",   BinaryOpToString(node->binaryop.operator)); break;
-        case UNARYOP:  fprintf(OUTFILE, " op='%s'",   UnaryOpToString (node->unaryop.operator));  break;
-        case LOCATION: fprintf(OUTFILE, " name='%s'", node->location.name); break;
+        case VARDECL:  Writer_literal(writer, " name='"); Writer_puts(writer, node->vardecl.name);  Writer_putc(writer, '\''); break;
+        case FUNCDECL: Writer_literal(writer, " name='"); Writer_puts(writer, node->funcdecl.name); Writer_putc(writer, '\''); break;
+        case FUNCCALL: Writer_literal(writer, " name='"); Writer_puts(writer, node->funccall.name); Writer_putc(writer, '\''); break;
+        case BINARYOP: Writer_literal(writer, " op='");   Writer_puts(writer, BinaryOpToString(node->binaryop.operator)); Writer_putc(writer, '\''); break;
+        case UNARYOP:  Writer_literal(writer, " op='");   Writer_puts(writer, UnaryOpToString (node->unaryop.operator));  Writer_putc(writer, '\''); break;
+        case LOCATION: Writer_literal(writer, " name='"); Writer_puts(writer, node->location.name); Writer_putc(writer, '\''); break;
         case LITERAL: {
             switch (node->literal.type) {
-                case INT:  fprintf(OUTFILE, " value=%d", node->literal.integer); break;
-                case BOOL: fprintf(OUTFILE, " value=%s", (node->literal.boolean ? "true" : "false")); break;
-                case STR:  fprintf(OUTFILE, " value='"); print_doubly_escaped_string(node->literal.string, OUTFILE); fprintf(OUTFILE, "'"); break;
+                case INT:  Writer_literal(writer, " value="); Writer_int(writer, node->literal.integer); break;
+                case BOOL: Writer_literal(writer, " value="); Writer_puts(writer, (node->literal.boolean ? "true" : "false")); break;
+                case STR:
+                    Writer_literal(writer, " value='");
+                    Writer_flush(writer);
+                    print_doubly_escaped_string(node->literal.string, writer->output);
+                    Writer_putc(writer, '\'');
+                    break;
                 default:   break;
             } break;
         }
         default: break;
     }
     for (Attribute* attr = node->attributes; attr != NULL; attr = attr->next) {
-        if (strncmp(attr->key, "dotid", 10) != 0 &&
-            strncmp(attr->key, "depth", 10) != 0 &&
-            strncmp(attr->key, "parent", 10) != 0) {
-            fprintf(OUTFILE, "\\n%s: ", attr->key);
-            attr->dot_printer(attr->value, OUTFILE);
+        if (!hidden_attribute(attr)) {
+            Writer_literal(writer, "\\n");
+            Writer_puts(writer, attr->key);
+            Writer_literal(writer, ": ");
+            Writer_flush(writer);
+            attr->dot_printer(attr->value, writer->output);
         }
     }
-    fprintf(OUTFILE, "\"];\n");
-
-    /* create any edges */
-    switch (node->type)
-    {
-        case PROGRAM:
-            FOR_EACH(ASTNode*, var,  node->program.variables) { GEN_LINK(node, var); }
-            FOR_EACH(ASTNode*, func, node->program.functions) { GEN_LINK(node, func); } break;
-        case FUNCDECL:
-            GEN_LINK(node, node->funcdecl.body); break;
-        case BLOCK:
-            FOR_EACH(ASTNode*, var,  node->block.variables)  { GEN_LINK(node, var); }
-            FOR_EACH(ASTNode*, stmt, node->block.statements) { GEN_LINK(node, stmt); } break;
-        case ASSIGNMENT:
-            GEN_LINK(node, node->assignment.location);
-            GEN_LINK(node, node->assignment.value); break;
-        case CONDITIONAL:
-            GEN_LINK(node, node->conditional.condition);
-            GEN_LINK(node, node->conditional.if_block);
-            if (node->conditional.else_block != NULL) { GEN_LINK(node, node->conditional.else_block); } break;
-        case WHILELOOP:
-            GEN_LINK(node, node->whileloop.condition);
-            GEN_LINK(node, node->whileloop.body); break;
-        case RETURNSTMT:
-            if (node->funcreturn.value != NULL) { GEN_LINK(node, node->funcreturn.value); } break;
-        case BINARYOP:
-            GEN_LINK(node, node->binaryop.left);
-            GEN_LINK(node, node->binaryop.right); break;
-        case UNARYOP:
-            GEN_LINK(node, node->unaryop.child); break;
-        case FUNCCALL:
-            FOR_EACH(ASTNode*, arg, node->funccall.arguments) { GEN_LINK(node, arg); } break;
-        case LOCATION:
-            if (node->location.index != NULL) { GEN_LINK(node, node->location.index); } break;
-        default:
-            break;
+    Writer_literal(writer, "\"];\n");
+}
+
+static void ASTGraph_previsit (ASTGraph* graph, ASTNode* node)
+{
+    int depth = graph->depth++;
+    if (depth == graph->capacity) {
+        graph->capacity = (graph->capacity == 0 ? 32 : graph->capacity * 2);
+        graph->ids = (int*)realloc(graph->ids, graph->capacity * sizeof(int));
+        CHECK_MALLOC_PTR(graph->ids)
+    }
+    int parent = (depth > 0 ? graph->ids[depth - 1] : -1);
+    ASTGraphOptions* options = &graph->options;
+    if ((options->max_depth > 0 && depth >= options->max_depth) ||
+            (options->first_line > 0 && node->source_line < options->first_line) ||
+            (options->last_line > 0 && node->source_line > options->last_line)) {
+        graph->ids[depth] = parent;     /* descendants attach to the nearest written ancestor */
+        return;
+    }
+
+    int id = graph->next_id++;
+    graph->ids[depth] = id;
+    ASTGraph_write_node(graph, node, id);
+    if (parent >= 0) {
+        Writer_int(&graph->writer, parent);
+        Writer_literal(&graph->writer, " -> ");
+        Writer_int(&graph->writer, id);
+        Writer_literal(&graph->writer, ";\n");
+    }
+}
+
+static void ASTGraph_postvisit (ASTGraph* graph, ASTNode* node)
+{
+    graph->depth--;
+}
+
+/**
+ * @brief Check whether a node is below the depth limit (in which case none of
+ * its subtree is written, so there is no need to walk it)
+ */
+static bool ASTGraph_too_deep (ASTGraph* graph, ASTNode* node)
+{
+    return graph->options.max_depth > 0 && graph->depth >= graph->options.max_depth;
+}
+
+#define STATIC_VISITOR_TRAVERSE         ASTGraph_traverse_node
+#define STATIC_VISITOR_STATE            ASTGraph*
+#define STATIC_PREVISIT_default         ASTGraph_previsit
+#define STATIC_POSTVISIT_default        ASTGraph_postvisit
+#define STATIC_VISITOR_PRUNE            ASTGraph_too_deep
+#include "static-visitor.h"
+
+void GenerateASTGraph_traverse (FILE* output, ASTNode* tree, const ASTGraphOptions* options)
+{
+    ASTGraph* graph = ASTGraph_new(output, options);
+    Writer_literal(&graph->writer, "digraph AST {\n");
+    if (graph->options.function != NULL && tree->type == PROGRAM) {
+        FOR_EACH(ASTNode*, func, tree->program.functions) {
+            if (strcmp(func->funcdecl.name, graph->options.function) == 0) {
+                ASTGraph_traverse_node(graph, func);
+                break;
+            }
+        }
+    } else {
+        ASTGraph_traverse_node(graph, tree);
     }
+    Writer_literal(&graph->writer, "}\n");
+    ASTGraph_free(graph);
+}
+
+#define GRAPH ((ASTGraph*)visitor->data)
+
+void GenerateASTGraph_previsit (NodeVisitor* visitor, ASTNode* node)
+{
+    ASTGraph_previsit(GRAPH, node);
+}
+
+void GenerateASTGraph_postvisit (NodeVisitor* visitor, ASTNode* node)
+{
+    ASTGraph_postvisit(GRAPH, node);
 }
 
 void GenerateASTGraph_initialize (NodeVisitor* visitor, ASTNode* node)
 {
-    fprintf(OUTFILE, "digraph AST {\n");
-    GenerateASTGraph_assign_dotid(visitor, node);
+    Writer_literal(&GRAPH->writer, "digraph AST {\n");
+    ASTGraph_previsit(GRAPH, node);
 }
 
 void GenerateASTGraph_finalize (NodeVisitor* visitor, ASTNode* node)
 {
-    GenerateASTGraph_generate_dot(visitor, node);
-    fprintf(OUTFILE, "}\n");
+    ASTGraph_postvisit(GRAPH, node);
+    Writer_literal(&GRAPH->writer, "}\n");
+    Writer_flush(&GRAPH->writer);
 }
 
 NodeVisitor* GenerateASTGraph_new (FILE* output)
 {
     NodeVisitor* v = NodeVisitor_new();
-    /* use "data" field to store FILE* output pointer */
-    v->data = (void*)output;
-    v->previsit_default      = GenerateASTGraph_assign_dotid;
-    v->postvisit_default     = GenerateASTGraph_generate_dot;
+    /* the output is buffered until the program node has been visited */
+    v->data = ASTGraph_new(output, NULL);
+    v->dtor = ASTGraph_free;
+    v->previsit_default      = GenerateASTGraph_previsit;
+    v->postvisit_default     = GenerateASTGraph_postvisit;
     v->previsit_program      = GenerateASTGraph_initialize;
     v->postvisit_program     = GenerateASTGraph_finalize;
     return v;
@@ -564,6 +562,26 @@ NodeVisitor* SetParentVisitor_new()
     return v;
 }
 
+#define STATIC_VISITOR_TRAVERSE         SetParentVisitor_traverse_node
+#define STATIC_VISITOR_STATE            NodeVisitor*
+#define STATIC_PREVISIT_program         SetParentVisitor_visit_program
+#define STATIC_PREVISIT_funcdecl        SetParentVisitor_visit_funcdecl
+#define STATIC_PREVISIT_block           SetParentVisitor_visit_block
+#define STATIC_PREVISIT_assignment      SetParentVisitor_visit_assignment
+#define STATIC_PREVISIT_conditional     SetParentVisitor_visit_conditional
+#define STATIC_PREVISIT_whileloop       SetParentVisitor_visit_whileloop
+#define STATIC_PREVISIT_return          SetParentVisitor_visit_return
+#define STATIC_PREVISIT_binaryop        SetParentVisitor_visit_binaryop
+#define STATIC_PREVISIT_unaryop         SetParentVisitor_visit_unaryop
+#define STATIC_PREVISIT_location        SetParentVisitor_visit_location
+#define STATIC_PREVISIT_funccall        SetParentVisitor_visit_funccall
+#include "static-visitor.h"
+
+void SetParentVisitor_traverse (ASTNode* tree)
+{
+    SetParentVisitor_traverse_node(NULL, tree);
+}
+
 
 /*
  * AST VISITOR: DEPTH CALCULATION
@@ -588,3 +606,14 @@ NodeVisitor* CalcDepthVisitor_new ()
     v->previsit_default  = CalcDepthVisitor_visit_nonprogram;
     return v;
 }
+
+#define STATIC_VISITOR_TRAVERSE         CalcDepthVisitor_traverse_node
+#define STATIC_VISITOR_STATE            NodeVisitor*
+#define STATIC_PREVISIT_default         CalcDepthVisitor_visit_nonprogram
+#define STATIC_PREVISIT_program         CalcDepthVisitor_visit_program
+#include "static-visitor.h"
+
+void CalcDepthVisitor_traverse (ASTNode* tree)
+{
+    CalcDepthVisitor_traverse_node(NULL, tree);
+}
@@ -0,0 +1,463 @@
+/**
+ * @file watch.c
+ * @brief Watch mode: recompile Decaf sources as they change
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "watch.h"
+#include "lineindex.h"
+#include "visitor.h"
+
+/**
+ * @brief Events of interest in watched directories
+ *
+ * Files are only reread once they are closed after writing or renamed into
+ * place (the two ways editors save), not on every write.
+ */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | \
+                      IN_DELETE_SELF)
+
+/**
+ * @brief Directory with an @c inotify watch
+ */
+typedef struct WatchedDir
+{
+    int wd;             /**< @brief Watch descriptor */
+    char* path;
+} WatchedDir;
+
+/**
+ * @brief Source file with a resident document
+ */
+typedef struct WatchedFile
+{
+    char* path;
+    Document* doc;
+} WatchedFile;
+
+static char* join_path (const char* dir, const char* name)
+{
+    char* path = (char*)malloc(strlen(dir) + strlen(name) + 2);
+    CHECK_MALLOC_PTR(path)
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static bool is_source (const char* name)
+{
+    size_t length = strlen(name);
+    return name[0] != '.' && length > 6 && strcmp(name + length - 6, ".decaf") == 0;
+}
+
+static double now_ms ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static WatchedFile* find_file (Watcher* watcher, const char* path)
+{
+    for (int i = 0; i < watcher->nfiles; i++) {
+        if (strcmp(watcher->files[i].path, path) == 0) {
+            return &watcher->files[i];
+        }
+    }
+    return NULL;
+}
+
+static WatchedDir* find_dir (Watcher* watcher, int wd)
+{
+    for (int i = 0; i < watcher->ndirs; i++) {
+        if (watcher->dirs[i].wd == wd) {
+            return &watcher->dirs[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Write the header and output for an updated file
+ */
+static void emit (Watcher* watcher, WatchedFile* file, double elapsed)
+{
+    FILE* output = watcher->output;
+    Document* doc = file->doc;
+    if (doc->tree == NULL) {
+        fprintf(output, "== %s (error after %.2f ms) ==\n%s", file->path, elapsed, doc->error);
+        int offset = doc->error_offset;
+        if (offset == doc->length && offset > 0 && doc->text[offset-1] == '\n') {
+            offset--;   /* point at the end of the last line, not past it */
+        }
+        if (offset >= 0) {
+            LineIndex* index = LineIndex_new(doc->text);
+            LineIndex_print_caret(index, doc->text, offset, output);
+            LineIndex_free(index);
+        }
+    } else {
+        ASTNode* tree = doc->tree;
+        fprintf(output, "== %s (reparsed %d of %d declarations in %.2f ms) ==\n", file->path,
+                doc->reparsed, tree->program.variables->size + tree->program.functions->size, elapsed);
+        if (watcher->format == WATCH_DOT) {
+            GenerateASTGraph_traverse(output, tree, NULL);
+        } else {
+            SetParentVisitor_traverse(tree);
+            CalcDepthVisitor_traverse(tree);
+            PrintVisitor_traverse(output, tree);
+        }
+    }
+    fflush(output);
+}
+
+static bool remove_file (Watcher* watcher, const char* path)
+{
+    WatchedFile* file = find_file(watcher, path);
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(watcher->output, "== %s (removed) ==\n", path);
+    fflush(watcher->output);
+    Document_free(file->doc);
+    free(file->path);
+    *file = watcher->files[--watcher->nfiles];
+    return true;
+}
+
+/**
+ * @brief Reread a file and update (or create) its document
+ *
+ * @returns True if there was any output
+ */
+static bool update_file (Watcher* watcher, const char* path)
+{
+    char* text = read_file(path);
+    if (text == NULL) {
+        return remove_file(watcher, path);
+    }
+
+    double start = now_ms();
+    WatchedFile* file = find_file(watcher, path);
+    if (file == NULL) {
+        if (watcher->nfiles == watcher->file_capacity) {
+            watcher->file_capacity = (watcher->file_capacity == 0 ? 16 : watcher->file_capacity * 2);
+            watcher->files = (WatchedFile*)realloc(watcher->files,
+                    watcher->file_capacity * sizeof(WatchedFile));
+            CHECK_MALLOC_PTR(watcher->files)
+        }
+        file = &watcher->files[watcher->nfiles++];
+        file->path = strdup(path);
+        CHECK_MALLOC_PTR(file->path)
+        file->doc = Document_new(text);
+    } else {
+        /* replace the span between the common prefix and the common suffix */
+        Document* doc = file->doc;
+        int old_length = doc->length;
+        int new_length = (int)strlen(text);
+        int prefix = 0;
+        while (prefix < old_length && prefix < new_length && doc->text[prefix] == text[prefix]) {
+            prefix++;
+        }
+        if (prefix == old_length && prefix == new_length) {
+            free(text);
+            return false;   /* saved without changes */
+        }
+        int suffix = 0;
+        while (suffix < old_length - prefix && suffix < new_length - prefix &&
+               doc->text[old_length - 1 - suffix] == text[new_length - 1 - suffix]) {
+            suffix++;
+        }
+        TextEdit edit = { prefix, old_length - prefix - suffix, new_length - prefix - suffix };
+        Document_edit(doc, edit, text + prefix);
+    }
+    emit(watcher, file, now_ms() - start);
+    free(text);
+    return true;
+}
+
+/**
+ * @brief Forget a directory that was moved away or deleted: remove the
+ * resident files under it and stop watching it and its subdirectories
+ *
+ * If it was only moved within the tree, it is watched (and its files
+ * compiled) again under the new path when the other half of the move arrives.
+ *
+ * @returns Number of files removed
+ */
+static int forget_dir (Watcher* watcher, const char* path)
+{
+    size_t length = strlen(path);
+    int count = 0;
+    for (int i = 0; i < watcher->nfiles; ) {
+        const char* file = watcher->files[i].path;
+        if (strncmp(file, path, length) == 0 && file[length] == '/') {
+            count += remove_file(watcher, file);    /* moves the last file to i */
+        } else {
+            i++;
+        }
+    }
+    for (int i = 0; i < watcher->ndirs; ) {
+        WatchedDir* dir = &watcher->dirs[i];
+        if (strncmp(dir->path, path, length) == 0 &&
+                (dir->path[length] == '/' || dir->path[length] == '\0')) {
+            inotify_rm_watch(watcher->fd, dir->wd);
+            free(dir->path);
+            *dir = watcher->dirs[--watcher->ndirs];
+        } else {
+            i++;
+        }
+    }
+    return count;
+}
+
+static int watch_dir (Watcher* watcher, const char* path);
+
+/**
+ * @brief Compile every source file in a directory (that has changed, for one
+ * seen before) and watch its subdirectories
+ *
+ * Symbolic links to directories are not followed, so a link back up the tree
+ * cannot make it endless (a link to a source file is read like the file).
+ *
+ * @returns Number of files compiled
+ */
+static int scan_dir (Watcher* watcher, const char* path)
+{
+    int count = 0;
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char* child = join_path(path, entry->d_name);
+        struct stat info;
+        if (lstat(child, &info) == 0) {
+            if (S_ISDIR(info.st_mode)) {
+                count += watch_dir(watcher, child);
+            } else if (is_source(entry->d_name) &&
+                       (S_ISREG(info.st_mode) ||
+                        (S_ISLNK(info.st_mode) && stat(child, &info) == 0 && S_ISREG(info.st_mode)))) {
+                count += update_file(watcher, child);
+            }
+        }
+        free(child);
+    }
+    closedir(dir);
+    return count;
+}
+
+/**
+ * @brief Watch a directory and its subdirectories, compiling every source
+ * file in them
+ *
+ * A directory that is already watched is not scanned again (this happens
+ * when @ref rescan finds it a second time).
+ *
+ * @returns Number of files compiled
+ */
+static int watch_dir (Watcher* watcher, const char* path)
+{
+    int wd = inotify_add_watch(watcher->fd, path, WATCH_EVENTS);
+    if (wd < 0) {
+        return 0;
+    }
+    WatchedDir* known = find_dir(watcher, wd);
+    if (known != NULL) {
+        free(known->path);
+        known->path = strdup(path);
+        CHECK_MALLOC_PTR(known->path)
+        return 0;
+    }
+    if (watcher->ndirs == watcher->dir_capacity) {
+        watcher->dir_capacity = (watcher->dir_capacity == 0 ? 8 : watcher->dir_capacity * 2);
+        watcher->dirs = (WatchedDir*)realloc(watcher->dirs, watcher->dir_capacity * sizeof(WatchedDir));
+        CHECK_MALLOC_PTR(watcher->dirs)
+    }
+    watcher->dirs[watcher->ndirs].wd = wd;
+    watcher->dirs[watcher->ndirs].path = strdup(path);
+    CHECK_MALLOC_PTR(watcher->dirs[watcher->ndirs].path)
+    watcher->ndirs++;
+    return scan_dir(watcher, path);
+}
+
+/**
+ * @brief Catch up after the kernel's event queue overflowed (and events were
+ * lost): reread every resident file and rescan every watched directory
+ *
+ * Only files that were deleted or really changed produce output.
+ *
+ * @returns Number of files updated or removed
+ */
+static int rescan (Watcher* watcher)
+{
+    int count = 0;
+    int nfiles = watcher->nfiles;
+    char** paths = (char**)malloc((nfiles + 1) * sizeof(char*));
+    CHECK_MALLOC_PTR(paths)
+    for (int i = 0; i < nfiles; i++) {
+        paths[i] = strdup(watcher->files[i].path);
+        CHECK_MALLOC_PTR(paths[i])
+    }
+    for (int i = 0; i < nfiles; i++) {
+        count += update_file(watcher, paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+
+    /* new directories are appended (and scanned) as they are found */
+    int ndirs = watcher->ndirs;
+    for (int i = 0; i < ndirs; i++) {
+        count += scan_dir(watcher, watcher->dirs[i].path);
+    }
+    return count;
+}
+
+Watcher* Watcher_new (const char* dir, WatchFormat format, FILE* output)
+{
+    struct stat info;
+    if (stat(dir, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        fprintf(stderr, "Not a directory: %s\n", dir);
+        return NULL;
+    }
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        perror("inotify_init1");
+        return NULL;
+    }
+
+    Watcher* watcher = (Watcher*)calloc(1, sizeof(Watcher));
+    CHECK_MALLOC_PTR(watcher)
+    watcher->fd = fd;
+    watcher->format = format;
+    watcher->output = output;
+
+    /* strip trailing slashes so that reported paths are tidy */
+    char* root = strdup(dir);
+    CHECK_MALLOC_PTR(root)
+    for (size_t n = strlen(root); n > 1 && root[n-1] == '/'; n--) {
+        root[n-1] = '\0';
+    }
+    watch_dir(watcher, root);
+    free(root);
+    return watcher;
+}
+
+int Watcher_poll (Watcher* watcher, int timeout)
+{
+    struct pollfd pending = { .fd = watcher->fd, .events = POLLIN };
+    int ready = poll(&pending, 1, timeout);
+    if (ready < 0) {
+        if (errno != EINTR) {
+            perror("poll");
+        }
+        return -1;
+    }
+    if (ready == 0) {
+        return 0;
+    }
+
+    /*
+     * Drain every queued event first and then update each changed file once,
+     * since a single save often produces several events.
+     */
+    union {
+        struct inotify_event event;
+        char bytes[16 * 1024];
+    } buffer;
+    char** changed = NULL;
+    int nchanged = 0;
+    int count = 0;
+    bool overflow = false;
+    ssize_t length;
+    while ((length = read(watcher->fd, buffer.bytes, sizeof(buffer.bytes))) > 0) {
+        for (char* p = buffer.bytes; p < buffer.bytes + length; ) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+
+            WatchedDir* dir = find_dir(watcher, event->wd);
+            if (dir == NULL) {
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                char* path = strdup(dir->path);     /* forget_dir frees dir->path */
+                CHECK_MALLOC_PTR(path)
+                count += forget_dir(watcher, path);
+                free(path);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            char* path = join_path(dir->path, event->name);
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    count += watch_dir(watcher, path);
+                } else if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+                    count += forget_dir(watcher, path);
+                }
+                free(path);
+            } else if (is_source(event->name) && !(event->mask & IN_CREATE)) {
+                bool seen = false;
+                for (int i = 0; i < nchanged && !seen; i++) {
+                    seen = (strcmp(changed[i], path) == 0);
+                }
+                if (seen) {
+                    free(path);
+                } else {
+                    changed = (char**)realloc(changed, (nchanged + 1) * sizeof(char*));
+                    CHECK_MALLOC_PTR(changed)
+                    changed[nchanged++] = path;
+                }
+            } else {
+                free(path);
+            }
+        }
+    }
+
+    for (int i = 0; i < nchanged; i++) {
+        count += update_file(watcher, changed[i]);
+        free(changed[i]);
+    }
+    free(changed);
+    if (overflow) {
+        count += rescan(watcher);
+    }
+    return count;
+}
+
+Document* Watcher_document (Watcher* watcher, const char* path)
+{
+    WatchedFile* file = find_file(watcher, path);
+    return (file != NULL ? file->doc : NULL);
+}
+
+void Watcher_free (Watcher* watcher)
+{
+    for (int i = 0; i < watcher->nfiles; i++) {
+        Document_free(watcher->files[i].doc);
+        free(watcher->files[i].path);
+    }
+    for (int i = 0; i < watcher->ndirs; i++) {
+        free(watcher->dirs[i].path);
+    }
+    free(watcher->files);
+    free(watcher->dirs);
+    close(watcher->fd);
+    free(watcher);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file writer.c
+ * @brief Buffered output for machine-readable dumps
+ */
+
+#include "writer.h"
+
+void Writer_init (Writer* writer, FILE* output)
+{
+    writer->output = output;
+    writer->used = 0;
+}
+
+void Writer_flush (Writer* writer)
+{
+    fwrite(writer->buffer, 1, writer->used, writer->output);
+    writer->used = 0;
+}
+
+void Writer_write (Writer* writer, const char* text, size_t length)
+{
+    if (writer->used + length > WRITER_BUFFER_SIZE) {
+        Writer_flush(writer);
+        if (length > WRITER_BUFFER_SIZE) {
+            fwrite(text, 1, length, writer->output);
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->used, text, length);
+    writer->used += length;
+}
+
+void Writer_puts (Writer* writer, const char* text)
+{
+    Writer_write(writer, text, strlen(text));
+}
+
+void Writer_int (Writer* writer, long long value)
+{
+    /* digits are generated backwards into the end of a small buffer */
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    unsigned long long magnitude = (value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value);
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    Writer_write(writer, p, digits + sizeof(digits) - p);
+}
+
+void Writer_json_string (Writer* writer, const char* text, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    Writer_putc(writer, '"');
+    const char* run = text;
+    const char* end = text + length;
+    for (const char* p = text; p < end; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        /* write the run of characters that need no escaping in one piece */
+        Writer_write(writer, run, p - run);
+        run = p + 1;
+        switch (c) {
+            case '"':  Writer_literal(writer, "\\\""); break;
+            case '\\': Writer_literal(writer, "\\\\"); break;
+            case '\n': Writer_literal(writer, "\\n"); break;
+            case '\r': Writer_literal(writer, "\\r"); break;
+            case '\t': Writer_literal(writer, "\\t"); break;
+            default: {
+                char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                Writer_write(writer, escape, sizeof(escape));
+                break;
+            }
+        }
+    }
+    Writer_write(writer, run, end - run);
+    Writer_putc(writer, '"');
+}
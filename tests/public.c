@@ -5,6 +5,8 @@
  * This file provides a few basic sanity test cases and a location to add new tests.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "testsuite.h"
 
 #ifndef SKIP_IN_DOXYGEN
@@ -69,6 +71,7 @@ TEST_INVALID(D_invalid_brackets, "[]")
 TEST_INVALID(D_invalid_braces, "{}")
 TEST_INVALID(D_invalid_broken_assign, "b=")
 TEST_INVALID_MAIN(C_invalid_return_break, "return break;")
+TEST_INVALID(C_invalid_trailing_id, "def int main() { a")
 TEST_INVALID_EXPR(B_invalid_add, "3++8")
 
 /*
@@ -80,50 +83,2448 @@ TEST_INT_LITERAL(C_hexlit, "0x10", 16)
 TEST_STR_LITERAL(C_strlit, "\"abc\"", "abc")
 TEST_STR_LITERAL(A_newline, "\"ab\\nc\"", "ab\nc")
 
-#endif
+/*
+ * Test integer literal range checking (values are decoded by the lexer).
+ */
 
-/**
- * @brief Register all test cases
- * 
- * @param s Test suite to which the tests should be added
+TEST_INT_LITERAL(B_declit_max, "2147483647", 2147483647)
+TEST_INT_LITERAL(B_hexlit_max, "0x7fffffff", 2147483647)
+TEST_INVALID_EXPR(B_declit_overflow, "2147483648")
+TEST_INVALID_EXPR(B_hexlit_overflow, "0x80000000")
+TEST_INT_LITERAL(B_declit_min, "-2147483648", -2147483647 - 1)
+TEST_INT_LITERAL(B_hexlit_min, "-0x80000000", -2147483647 - 1)
+TEST_INVALID_EXPR(B_declit_min_paren, "-(2147483648)")
+TEST_INVALID_EXPR(B_declit_min_sub, "1 - 2147483648")
+TEST_INVALID(B_array_size_overflow, "int a[99999999999];")
+
+/*
+ * test expression precedence, associativity and line numbers
  */
-void public_tests (Suite *s)
+START_TEST(B_expr_tree)
 {
-    TCase *tc = tcase_create ("Public");
+    ASTNode* ast = run_parser("def int main() { return (1 +\n 2) * -a - f(x[0], 3); }");
+    ck_assert_ptr_ne(ast, NULL);
+    ASTNode* ret = ast->program.functions->head->funcdecl.body->block.statements->head;
+    ASTNode* sub = ret->funcreturn.value;
+    ck_assert(sub->type == BINARYOP && sub->binaryop.operator == SUBOP);
+    ASTNode* mul = sub->binaryop.left;
+    ck_assert(mul->type == BINARYOP && mul->binaryop.operator == MULOP);
+    ck_assert(mul->binaryop.left->binaryop.operator == ADDOP);
+    ck_assert_int_eq(mul->binaryop.left->binaryop.right->source_line, 2);
+    ck_assert(mul->binaryop.right->type == UNARYOP);
+    ASTNode* call = sub->binaryop.right;
+    ck_assert(call->type == FUNCCALL);
+    ck_assert_int_eq(call->funccall.arguments->size, 2);
+    ck_assert(call->funccall.arguments->head->type == LOCATION);
+    ck_assert_ptr_ne(call->funccall.arguments->head->location.index, NULL);
+    ASTNode_free(ast);
+}
+END_TEST
 
-    TEST(D_empty);
-    TEST(D_trivial);
-    TEST(D_int_var);
-    TEST(D_bool_var);
+TEST_INVALID_EXPR(B_invalid_double_neg, "--a")
+TEST_INVALID_EXPR(B_invalid_trailing_arg, "f(a,)")
 
-    TEST(D_invalid_vardecl_no_type);
-    TEST(D_invalid_vardecl_no_semicolon);
-    TEST(D_invalid_parens);
-    TEST(D_invalid_brackets);
-    TEST(D_invalid_braces);
-    TEST(D_invalid_broken_assign);
+/*
+ * test that a comment too long for the lexer's buffer is rejected rather than
+ * cut short (the rest of it used to be lexed as code)
+ */
+START_TEST(B_long_comment)
+{
+    char text[512];
+    char comment[420];
+    memset(comment, 'a', sizeof(comment));
+    comment[253] = '\0';
+    snprintf(text, sizeof(text), "def int main() {\n  //%s\n  return 0;\n}\n", comment);
+    ck_assert(valid_program(text));
 
-    TEST(C_void_func);
-    TEST(C_assign);
-    TEST(C_break);
-    TEST(C_continue);
-    TEST(C_return);
-    TEST(C_return_val);
-    TEST(C_invalid_return_break);
-    TEST(C_declit);
-    TEST(C_hexlit);
-    TEST(C_strlit);
+    comment[253] = 'a';
+    comment[sizeof(comment) - 1] = '\0';
+    snprintf(text, sizeof(text), "def int main() {\n  //%s return 0;\n}\n", comment);
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        TokenQueue_free(lex_parallel(text, 1));
+        ck_assert_msg(false, "expected an error");
+    }
+    ErrorTrap_pop(&trap);
+    ck_assert_str_eq(trap.message, "Token too long on line 2 (at most 255 characters)\n");
+}
+END_TEST
 
-    TEST(B_param_func);
-    TEST(B_conditional);
-    TEST(B_whileloop);
-    TEST(B_add_expr);
-    TEST(B_add_expr_bool);
-    TEST(B_neg_expr);
-    TEST(B_invalid_add);
+/* the same with code at the end of the comment (also a fuzzing seed) */
+TEST_INVALID_MAIN(B_long_comment_code, "int x; x = 1;\n//"
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+    " x = 7;\n return x;")
 
-    TEST(A_arrays);
-    TEST(A_newline);
+/*
+ * Test that the parallel lexer produces exactly the same token stream as the
+ * sequential one (including line numbers) and fails on the same inputs.
+ */
+
+static char* make_large_program (size_t min_size)
+{
+    const char* func = "def int f() {\n"
+                       "    int a; // comment with \"quotes\" and { braces\n"
+                       "    a = 0x1F + 42;\n"
+                       "    print_str(\"tab\\t and \\\"quote\\\"\");\n"
+                       "\n"
+                       "    return a;\n"
+                       "}\n";
+    size_t len = strlen(func);
+    size_t count = min_size / len + 1;
+    char* text = malloc(count * len + 1);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(text + i * len, func, len);
+    }
+    text[count * len] = '\0';
+    return text;
+}
+
+START_TEST(A_parallel_lex_matches)
+{
+    char* text = make_large_program(PARALLEL_LEX_MIN_SIZE * 2);
+    TokenQueue* seq = lex(text);
+    TokenQueue* par = lex_parallel(text, 4);
+    ck_assert_int_eq(TokenQueue_size(seq), TokenQueue_size(par));
+    Token* b = par->head;
+    for (Token* a = seq->head; a != NULL; a = a->next, b = b->next) {
+        ck_assert_int_eq(a->type, b->type);
+        ck_assert_int_eq(a->line, b->line);
+        ck_assert_str_eq(a->text, b->text);
+    }
+    TokenQueue_free(seq);
+    TokenQueue_free(par);
+    free(text);
+}
+END_TEST
+
+START_TEST(A_parallel_lex_error)
+{
+    char* text = make_large_program(PARALLEL_LEX_MIN_SIZE * 2);
+    text[strlen(text) - 10] = '@';
+    extern jmp_buf decaf_error;
+    volatile bool thrown = false;
+    if (setjmp(decaf_error) == 0) {
+        lex_parallel(text, 4);
+    } else {
+        thrown = true;
+    }
+    ck_assert(thrown);
+    free(text);
+}
+END_TEST
+
+/*
+ * Test that incremental re-lexing produces the same tokens (including
+ * offsets and line numbers) as lexing the edited text from scratch, and that
+ * it only re-scans the edited line.
+ */
+
+static void assert_same_tokens (TokenQueue* tokens, const char* text)
+{
+    TokenQueue* expected = lex(text);
+    TokenQueue_locate(expected, text, 0);
+    ck_assert_int_eq(TokenQueue_size(tokens), TokenQueue_size(expected));
+    Token* b = expected->head;
+    for (Token* a = tokens->head; a != NULL; a = a->next, b = b->next) {
+        ck_assert_int_eq(a->type, b->type);
+        ck_assert_int_eq(a->line, b->line);
+        ck_assert_int_eq(a->offset, b->offset);
+        ck_assert_str_eq(a->text, b->text);
+    }
+    if (expected->tail != NULL) {
+        ck_assert_str_eq(tokens->tail->text, expected->tail->text);
+    }
+    TokenQueue_free(expected);
+}
+
+static char* apply_edit (const char* old_text, int offset, int old_length, const char* insert)
+{
+    size_t old_len = strlen(old_text);
+    int new_length = (int)strlen(insert);
+    char* new_text = malloc(old_len + new_length + 1);
+    memcpy(new_text, old_text, offset);
+    memcpy(new_text + offset, insert, new_length);
+    strcpy(new_text + offset + new_length, old_text + offset + old_length);
+    return new_text;
+}
+
+static void check_relex (const char* old_text, int offset, int old_length,
+                         const char* insert, int max_rescanned)
+{
+    int new_length = (int)strlen(insert);
+    char* new_text = apply_edit(old_text, offset, old_length, insert);
+
+    TokenQueue* tokens = lex(old_text);
+    TokenQueue_locate(tokens, old_text, 0);
+    TokenIndex* index = TokenIndex_new(tokens);
+    TextEdit edit = { offset, old_length, new_length };
+    int rescanned = relex(index, old_text, new_text, edit);
+    ck_assert_int_le(rescanned, max_rescanned);
+    TokenIndex_free(index);
+    assert_same_tokens(tokens, new_text);
+    TokenQueue_free(tokens);
+    free(new_text);
+}
+
+START_TEST(A_relex_edits)
+{
+    const char* text = "def int main() {\n"
+                       "    int abc; // note\n"
+                       "    abc = 12 + 3;\n"
+                       "    return abc;\n"
+                       "}\n";
+    check_relex(text, 29, 0, "d", 4);                       /* extend identifier */
+    check_relex(text, 50, 2, "1234", 6);                    /* replace literal */
+    check_relex(text, 46, 0, "\n\n    abc = 0;", 12);       /* insert lines */
+    check_relex(text, 17, 20, "", 8);                       /* delete a line */
+    check_relex(text, 0, 0, "int g;\n", 9);                 /* insert at start */
+    check_relex(text, (int)strlen(text), 0, "int z;", 4);   /* append at end */
+}
+END_TEST
+
+/*
+ * test that an indexed queue stays exact through many edits of a large file,
+ * and that the tokens after an edit are only shifted when synced
+ */
+START_TEST(A_relex_indexed)
+{
+    char* text = make_large_program(20000);
+    TokenQueue* tokens = lex(text);
+    TokenQueue_locate(tokens, text, 0);
+    TokenIndex* index = TokenIndex_new(tokens);
+    ck_assert(index->nchunks > 50);
+    ck_assert_int_le(index->nchunks, TokenQueue_size(tokens) / (TOKEN_CHUNK_SIZE / 2));
+
+    /* insert a statement, insert a token or delete a line, at a line start */
+    unsigned seed = 7;
+    for (int i = 0; i < 300; i++) {
+        seed = seed * 1103515245 + 12345;
+        int length = (int)strlen(text);
+        int offset = (int)((seed >> 8) % length);
+        while (offset > 0 && text[offset - 1] != '\n') {
+            offset--;
+        }
+        const char* insert = (i % 3 == 0 ? "    x = 1;\n" : i % 3 == 1 ? "q " : "");
+        int old_length = 0;
+        if (i % 3 == 2) {
+            const char* newline = strchr(text + offset, '\n');
+            old_length = (newline != NULL ? (int)(newline - text) + 1 : length) - offset;
+        }
+        char* new_text = apply_edit(text, offset, old_length, insert);
+        TextEdit edit = { offset, old_length, (int)strlen(insert) };
+        ck_assert_int_le(relex(index, text, new_text, edit), 30);
+        free(text);
+        text = new_text;
+    }
+    ck_assert_int_le(index->nchunks, TokenQueue_size(tokens) / (TOKEN_CHUNK_SIZE / 2));
+    TokenIndex_sync(index);
+    assert_same_tokens(tokens, text);
+
+    /* an invalid token leaves the queue and the index as they were */
+    int line_start = (int)(strchr(text, '\n') - text) + 1;
+    char* bad_text = apply_edit(text, line_start, 0, "$");
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        relex(index, text, bad_text, (TextEdit){ line_start, 0, 1 });
+        ck_assert_msg(false, "expected an error");
+    }
+    ErrorTrap_pop(&trap);
+    free(bad_text);
+    assert_same_tokens(tokens, text);
+
+    /* an edit at the start leaves the last token alone until the sync */
+    int old_offset = tokens->tail->offset;
+    char* new_text = apply_edit(text, 0, 0, "int g;\n");
+    relex(index, text, new_text, (TextEdit){ 0, 0, 7 });
+    ck_assert_int_eq(tokens->tail->offset, old_offset);
+    TokenIndex_free(index);
+    ck_assert_int_eq(tokens->tail->offset, old_offset + 7);
+    assert_same_tokens(tokens, new_text);
+
+    TokenQueue_free(tokens);
+    free(text);
+    free(new_text);
+}
+END_TEST
+
+/*
+ * test line/column lookups and node source offsets
+ */
+START_TEST(A_line_index)
+{
+    const char* text = "int a;\n\ndef void f() {\n  a = 1;\n}";
+    LineIndex* index = LineIndex_new(text);
+    ck_assert_int_eq(index->count, 5);
+    ck_assert_int_eq(LineIndex_line(index, 0), 1);
+    ck_assert_int_eq(LineIndex_line(index, 6), 1);     /* first newline */
+    ck_assert_int_eq(LineIndex_line(index, 7), 2);     /* empty line */
+    ck_assert_int_eq(LineIndex_line(index, 8), 3);
+    ck_assert_int_eq(LineIndex_column(index, 17), 10); /* 'f' */
+    ck_assert_int_eq(LineIndex_line(index, 25), 4);
+    ck_assert_int_eq(LineIndex_column(index, 25), 3);  /* 'a' */
+    ck_assert_int_eq(LineIndex_line(index, 1000), 5);
+
+    TokenQueue* tokens = lex(text);
+    TokenQueue_locate(tokens, text, 0);
+    ASTNode* ast = parse(tokens);
+    ASTNode* func = ast->program.functions->head;
+    ASTNode* assign = func->funcdecl.body->block.statements->head;
+    ck_assert_int_eq(ast->program.variables->head->source_offset, 0);
+    ck_assert_int_eq(func->source_offset, 8);
+    ck_assert_int_eq(assign->source_offset, 25);
+    ck_assert_int_eq(assign->assignment.value->source_offset, 29);
+    ck_assert_int_eq(LineIndex_line(index, assign->source_offset), assign->source_line);
+    ASTNode_free(ast);
+    TokenQueue_free(tokens);
+    LineIndex_free(index);
+}
+END_TEST
+
+/*
+ * read the whole contents of a temporary file (for comparing visitor output)
+ */
+static char* read_tmpfile (FILE* file)
+{
+    long length = ftell(file);
+    char* text = (char*)calloc(length + 1, 1);
+    rewind(file);
+    ck_assert_int_eq(fread(text, 1, length, file), length);
+    fclose(file);
+    return text;
+}
+
+/*
+ * test that the statically dispatched visitors match the general ones
+ */
+START_TEST(A_static_visitors)
+{
+    const char* text = "int g[4]; def int f(int a) { if (a < 1) { return -a; } "
+                       "while (true) { g[a] = f(a - 1) * 2; break; } return 0; }";
+    TokenQueue* tokens = lex(text);
+    ASTNode* dynamic = parse(tokens);
+    TokenQueue_free(tokens);
+    tokens = lex(text);
+    ASTNode* fixed = parse(tokens);
+    TokenQueue_free(tokens);
+
+    NodeVisitor_traverse_and_free(SetParentVisitor_new(), dynamic);
+    NodeVisitor_traverse_and_free(CalcDepthVisitor_new(), dynamic);
+    FILE* expected = tmpfile();
+    NodeVisitor_traverse_and_free(PrintVisitor_new(expected), dynamic);
+
+    SetParentVisitor_traverse(fixed);
+    CalcDepthVisitor_traverse(fixed);
+    FILE* actual = tmpfile();
+    PrintVisitor_traverse(actual, fixed);
+
+    char* expected_text = read_tmpfile(expected);
+    char* actual_text = read_tmpfile(actual);
+    ck_assert(strstr(actual_text, "      Return [line 1]\n") != NULL);
+    ck_assert_str_eq(actual_text, expected_text);
+
+    free(expected_text);
+    free(actual_text);
+    ASTNode_free(dynamic);
+    ASTNode_free(fixed);
+}
+END_TEST
+
+/*
+ * parallel traversal helpers: each worker counts nodes and function calls
+ * (and throws on a call to "boom"); the reduction adds up the counts
+ */
+static void count_node (NodeVisitor* visitor, ASTNode* node)
+{
+    ((long*)visitor->data)[0]++;
+}
+
+static void count_call (NodeVisitor* visitor, ASTNode* node)
+{
+    if (strcmp(node->funccall.name, "boom") == 0) {
+        Error_throw_printf("boom on line %d\n", node->source_line);
+    }
+    ((long*)visitor->data)[0]++;
+    ((long*)visitor->data)[1]++;
+}
+
+static NodeVisitor* counter_new (void* context, int worker)
+{
+    NodeVisitor* v = NodeVisitor_new();
+    v->data = calloc(2, sizeof(long));
+    v->dtor = free;
+    v->previsit_default = count_node;
+    v->previsit_funccall = count_call;
+    return v;
+}
+
+static void counter_reduce (void* context, NodeVisitor* visitor)
+{
+    ((long*)context)[0] += ((long*)visitor->data)[0];
+    ((long*)context)[1] += ((long*)visitor->data)[1];
+}
+
+/*
+ * test that a parallel traversal visits every node exactly once and that
+ * errors in worker threads reach the caller
+ */
+START_TEST(A_parallel_traversal)
+{
+    const char* text = "int g; def void f() { g = 1; h(); h(); h(); h(); h(); h(); h(); } "
+                       "def int h() { while (true) { h(); break; } return g; } "
+                       "def void k(int a) { if (a > 0) { k(a - 1); f(); } }";
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+
+    long expected[2] = { 0 };
+    NodeVisitor* sequential = counter_new(NULL, 0);
+    NodeVisitor_traverse(sequential, tree);
+    counter_reduce(expected, sequential);
+    NodeVisitor_free(sequential);
+    ck_assert_int_eq(expected[1], 10);
+
+    for (int nthreads = 1; nthreads <= 4; nthreads++) {
+        for (int split = 0; split <= 2; split++) {
+            long counts[2] = { 0 };
+            ParallelTraversal traversal = { counter_new, counter_reduce, counts, nthreads, split };
+            NodeVisitor_traverse_parallel(&traversal, tree);
+            ck_assert_int_eq(counts[0], expected[0]);
+            ck_assert_int_eq(counts[1], expected[1]);
+        }
+    }
+    ASTNode_free(tree);
+
+    tokens = lex("def void f() { g(); g(); boom(); g(); } def void g() { }");
+    tree = parse(tokens);
+    TokenQueue_free(tokens);
+    long counts[2] = { 0 };
+    ParallelTraversal traversal = { counter_new, counter_reduce, counts, 3, 1 };
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        NodeVisitor_traverse_parallel(&traversal, tree);
+        ck_assert_msg(false, "expected an error");
+    } else {
+        ck_assert_str_eq(trap.message, "boom on line 1\n");
+    }
+    ErrorTrap_pop(&trap);
+    ck_assert_int_eq(counts[0], 0);
+    ASTNode_free(tree);
+}
+END_TEST
+
+/*
+ * source used by the document and index tests
+ */
+static const char* document_text =
+    "int a;\n"
+    "def int f(int x) {\n"
+    "  a = x;\n"
+    "  return g(x);\n"
+    "}\n"
+    "int b[3];\n"
+    "def int g(int y) {\n"
+    "  return y + a;\n"
+    "}\n"
+    "def void h() {\n"
+    "  b[0] = f(1);\n"
+    "}\n";
+
+/*
+ * print an AST (after computing parents and depths) to a string
+ */
+static char* print_tree (ASTNode* tree)
+{
+    FILE* output = tmpfile();
+    SetParentVisitor_traverse(tree);
+    CalcDepthVisitor_traverse(tree);
+    PrintVisitor_traverse(output, tree);
+    return read_tmpfile(output);
+}
+
+/*
+ * check that a document's AST matches a fresh parse of its text
+ */
+static void check_document (Document* doc)
+{
+    ck_assert(doc->tree != NULL);
+    ck_assert_str_eq(doc->error, "");
+    TokenQueue* tokens = lex(doc->text);
+    TokenQueue_locate(tokens, doc->text, 0);
+    ASTNode* fresh = parse(tokens);
+    char* expected = print_tree(fresh);
+    char* actual = print_tree(doc->tree);
+    ck_assert_str_eq(actual, expected);
+    ck_assert_int_eq(doc->tree->program.functions->tail->source_offset,
+                     fresh->program.functions->tail->source_offset);
+    free(expected);
+    free(actual);
+    ASTNode_free(fresh);
+    TokenQueue_free(tokens);
+}
+
+/*
+ * replace the first occurrence of a string in a document
+ */
+static void edit_document (Document* doc, const char* old, const char* replacement)
+{
+    const char* at = strstr(doc->text, old);
+    ck_assert(at != NULL);
+    TextEdit edit = { (int)(at - doc->text), (int)strlen(old), (int)strlen(replacement) };
+    Document_edit(doc, edit, replacement);
+}
+
+/*
+ * test that a new document parses every declaration
+ */
+START_TEST(A_document_new)
+{
+    Document* doc = Document_new(document_text);
+    check_document(doc);
+    ck_assert_int_eq(doc->reparsed, 5);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * test that editing a function body reparses only that function
+ */
+START_TEST(A_document_edit_function)
+{
+    Document* doc = Document_new(document_text);
+    edit_document(doc, "return y + a;", "int a;\n  a = y;\n  return a;");
+    ck_assert_int_eq(doc->reparsed, 1);
+    check_document(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * test inserting a declaration and changing a global's type
+ */
+START_TEST(A_document_add_declaration)
+{
+    Document* doc = Document_new(document_text);
+    edit_document(doc, "int b[3];", "int b[3];\ndef bool k() { return true; }");
+    check_document(doc);
+    edit_document(doc, "int a;\n", "bool a;\n");
+    check_document(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * test that an unbalanced brace makes the region swallow the next declaration
+ */
+START_TEST(A_document_unbalanced_brace)
+{
+    Document* doc = Document_new(document_text);
+    edit_document(doc, "b[0] = f(1);\n}", "b[0] = f(1);\n");
+    ck_assert(doc->tree == NULL);
+    ck_assert(strlen(doc->error) > 0);
+    edit_document(doc, "f(1);\n", "f(1);\n}");
+    check_document(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * test that an invalid token drops the tokens until it is fixed
+ */
+START_TEST(A_document_invalid_token)
+{
+    Document* doc = Document_new(document_text);
+    edit_document(doc, "a = x;", "a = $x;");
+    ck_assert(doc->tree == NULL);
+    ck_assert(doc->tokens == NULL);
+    edit_document(doc, "$", "");
+    check_document(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * test deleting a whole declaration
+ */
+START_TEST(A_document_delete_function)
+{
+    Document* doc = Document_new(document_text);
+    edit_document(doc, "def int f(int x) {\n  a = x;\n  return g(x);\n}\n", "");
+    check_document(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * test that deferred positions catch up on request
+ */
+START_TEST(A_document_deferred)
+{
+    Document* doc = Document_new(document_text);
+    doc->deferred = true;
+    edit_document(doc, "int a;\n", "int a;\n\n\n");
+    int offset = (int)(strstr(doc->text, "b[0]") - doc->text);
+    int line = 1;
+    for (int i = 0; i < offset; i++) {
+        line += (doc->text[i] == '\n');
+    }
+    ASTNode* h = Document_declaration_at(doc, offset);
+    ck_assert_str_eq(h->funcdecl.name, "h");
+    ck_assert_int_eq(h->funcdecl.body->block.statements->head->source_line, line);
+    Document_sync(doc);
+    check_document(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * check that a document's index gives the same results as a fresh one
+ */
+static void check_index (Document* doc)
+{
+    const char* names[] = { "a", "b", "f", "g", "h", "x", "y" };
+    NodeType named[] = { VARDECL, FUNCDECL, LOCATION, FUNCCALL, ASSIGNMENT };
+    ASTIndex* index = Document_index(doc);
+    ASTIndex* fresh = ASTIndex_new(doc->tree);
+    ck_assert_int_eq(index->size, fresh->size);
+    for (int type = 0; type < NUM_NODE_TYPES; type++) {
+        ck_assert_int_eq(ASTQuery_count(ASTIndex_by_type(index, type)),
+                         ASTQuery_count(ASTIndex_by_type(fresh, type)));
+    }
+    for (int line = 0; line < 20; line++) {
+        ck_assert_int_eq(ASTQuery_count(ASTIndex_by_line(index, line)),
+                         ASTQuery_count(ASTIndex_by_line(fresh, line)));
+    }
+    for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        for (int j = 0; j < sizeof(named) / sizeof(named[0]); j++) {
+            for (IndexScope scope = ANY_SCOPE; scope <= LOCAL_SCOPE; scope++) {
+                ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, named[j], names[i], scope)),
+                                 ASTQuery_count(ASTIndex_by_name(fresh, named[j], names[i], scope)));
+            }
+        }
+    }
+    ASTIndex_free(fresh);
+}
+
+/*
+ * test index queries, and that the index stays current across edits
+ */
+START_TEST(A_ast_index)
+{
+    Document* doc = Document_new(document_text);
+    ASTIndex* index = Document_index(doc);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_type(index, FUNCDECL)), 3);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, FUNCCALL, "g", ANY_SCOPE)), 1);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, ASSIGNMENT, "a", GLOBAL_SCOPE)), 1);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, LOCATION, "x", LOCAL_SCOPE)), 2);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, LOCATION, "x", GLOBAL_SCOPE)), 0);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, LOCATION, "nothing", ANY_SCOPE)), 0);
+
+    /* line 3 is "a = x;" */
+    ASTQuery query = ASTIndex_by_line(index, 3);
+    ck_assert_int_eq(ASTQuery_count(query), 3);
+    int assignments = 0;
+    for (ASTNode* node = ASTQuery_next(&query); node != NULL; node = ASTQuery_next(&query)) {
+        ck_assert_int_eq(node->source_line, 3);
+        assignments += (node->type == ASSIGNMENT);
+    }
+    ck_assert_int_eq(assignments, 1);
+    ck_assert_str_eq(ASTIndex_name(index, ASTIndex_intern(index, "f")), "f");
+    check_index(doc);
+
+    /* shadow the global in g; h moves down two lines */
+    edit_document(doc, "return y + a;", "int a;\n  a = y;\n  return a;");
+    ck_assert_ptr_eq(Document_index(doc), index);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, ASSIGNMENT, "a", GLOBAL_SCOPE)), 1);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, ASSIGNMENT, "a", LOCAL_SCOPE)), 1);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_line(index, 11)), 0);
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, FUNCCALL, "f", ANY_SCOPE)), 1);
+    query = ASTIndex_by_name(index, FUNCCALL, "f", ANY_SCOPE);
+    ck_assert_int_eq(ASTQuery_next(&query)->source_line, 13);
+    check_index(doc);
+
+    edit_document(doc, "def int f(int x) {\n  a = x;\n  return g(x);\n}\n", "");
+    ck_assert_int_eq(ASTQuery_count(ASTIndex_by_name(index, FUNCDECL, "f", ANY_SCOPE)), 0);
+    check_index(doc);
+
+    /* the index is rebuilt after a full reparse */
+    edit_document(doc, "return a;\n}\n", "return a;\n");
+    ck_assert_ptr_eq(Document_index(doc), NULL);
+    edit_document(doc, "return a;\n", "return a;\n}\n");
+    check_index(doc);
+    Document_free(doc);
+}
+END_TEST
+
+/*
+ * thread entry point for running a compile server in the test process
+ */
+static void* run_test_server (void* socket_path)
+{
+    return (void*)(long)CompileServer_run((const char*)socket_path, 2);
+}
+
+/*
+ * send a request to a compile server and capture its results
+ */
+static int send_request (const char* socket_path, ServerRequest request, char** output, char** errors)
+{
+    FILE* output_file = tmpfile();
+    FILE* errors_file = tmpfile();
+    int status = CompileClient_send(socket_path, &request, output_file, errors_file);
+    *output = read_tmpfile(output_file);
+    *errors = read_tmpfile(errors_file);
+    return status;
+}
+
+/*
+ * send several print requests at once
+ */
+static void* send_print_requests (void* socket_path)
+{
+    long failures = 0;
+    for (int i = 0; i < 5; i++) {
+        ServerRequest request = { PRINT_COMMAND, NULL, "def int f(int x) { return x + 1; }" };
+        char* output;
+        char* errors;
+        if (send_request((const char*)socket_path, request, &output, &errors) != EXIT_SUCCESS ||
+                strstr(output, "FuncDecl name=\"f\"") == NULL) {
+            failures++;
+        }
+        free(output);
+        free(errors);
+    }
+    return (void*)failures;
+}
+
+/*
+ * test the compile server and client against the in-process compiler
+ */
+START_TEST(A_compile_server)
+{
+    char socket_path[64];
+    char source_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/decaf-test-%d.sock", (int)getpid());
+    snprintf(source_path, sizeof(source_path), "/tmp/decaf-test-%d.decaf", (int)getpid());
+    pthread_t server;
+    ck_assert_int_eq(pthread_create(&server, NULL, run_test_server, socket_path), 0);
+
+    /* wait for the server to start listening */
+    char* output;
+    char* errors;
+    ServerRequest check = { PARSE_COMMAND, NULL, "int a;" };
+    int status = -1;
+    for (int tries = 0; status == -1 && tries < 100000; tries++) {
+        FILE* ignored = tmpfile();
+        status = CompileClient_send(socket_path, &check, ignored, ignored);
+        fclose(ignored);
+        sched_yield();
+    }
+    ck_assert_int_eq(status, EXIT_SUCCESS);
+
+    /* inline source gives the same output as compiling locally */
+    const char* text = "int g[4];\ndef int f(int a) {\n  g[a] = f(a - 1) * 2;\n  return 0;\n}\n";
+    FILE* expected_file = tmpfile();
+    ck_assert_int_eq(compile_source(text, PRINT_COMMAND, expected_file, stderr), EXIT_SUCCESS);
+    char* expected = read_tmpfile(expected_file);
+    ck_assert_int_eq(send_request(socket_path, (ServerRequest){ PRINT_COMMAND, NULL, text },
+                                  &output, &errors), EXIT_SUCCESS);
+    ck_assert_str_eq(output, expected);
+    ck_assert_str_eq(errors, "");
+    free(output);
+    free(errors);
+
+    /* so does a file */
+    FILE* source = fopen(source_path, "w");
+    ck_assert_ptr_ne(source, NULL);
+    fputs(text, source);
+    fclose(source);
+    ck_assert_int_eq(send_request(socket_path, (ServerRequest){ PRINT_COMMAND, source_path, NULL },
+                                  &output, &errors), EXIT_SUCCESS);
+    ck_assert_str_eq(output, expected);
+    remove(source_path);
+    free(output);
+    free(errors);
+    free(expected);
+
+    /* errors are reported with their location */
+    ck_assert_int_eq(send_request(socket_path, (ServerRequest){ PARSE_COMMAND, NULL, "int a;\nint b" },
+                                  &output, &errors), EXIT_FAILURE);
+    ck_assert_str_eq(output, "");
+    ck_assert(strstr(errors, "    2 | int b\n") != NULL);
+    free(output);
+    free(errors);
+    ck_assert_int_eq(send_request(socket_path, (ServerRequest){ PARSE_COMMAND, source_path, NULL },
+                                  &output, &errors), EXIT_FAILURE);
+    ck_assert(strstr(errors, "Could not read file") != NULL);
+    free(output);
+    free(errors);
+
+    /* concurrent clients */
+    pthread_t clients[4];
+    for (int i = 0; i < 4; i++) {
+        ck_assert_int_eq(pthread_create(&clients[i], NULL, send_print_requests, socket_path), 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        void* failures;
+        pthread_join(clients[i], &failures);
+        ck_assert_int_eq((long)failures, 0);
+    }
+
+    /* shutdown */
+    ck_assert_int_eq(send_request(socket_path, (ServerRequest){ SHUTDOWN_COMMAND, NULL, "" },
+                                  &output, &errors), EXIT_SUCCESS);
+    free(output);
+    free(errors);
+    void* result;
+    pthread_join(server, &result);
+    ck_assert_int_eq((long)result, EXIT_SUCCESS);
+    ck_assert_int_ne(access(socket_path, F_OK), 0);
+}
+END_TEST
+
+/*
+ * overwrite a file with new contents
+ */
+static void write_file (const char* path, const char* text)
+{
+    FILE* file = fopen(path, "w");
+    ck_assert_ptr_ne(file, NULL);
+    fputs(text, file);
+    fclose(file);
+}
+
+/*
+ * test that watch mode recompiles only the files (and declarations) that
+ * change
+ */
+START_TEST(A_watch_mode)
+{
+    char dir[64];
+    char path_a[80];
+    char path_b[80];
+    snprintf(dir, sizeof(dir), "/tmp/decaf-watch-%d", (int)getpid());
+    snprintf(path_a, sizeof(path_a), "%s/a.decaf", dir);
+    snprintf(path_b, sizeof(path_b), "%s/b.decaf", dir);
+    ck_assert_int_eq(mkdir(dir, 0700), 0);
+    write_file(path_a, "int a;\ndef int f() {\n  return 1;\n}\ndef int g() {\n  return 2;\n}\n");
+    write_file(path_b, "int b;\n");
+
+    FILE* output = tmpfile();
+    Watcher* watcher = Watcher_new(dir, WATCH_TEXT, output);
+    ck_assert_ptr_ne(watcher, NULL);
+    ck_assert_int_eq(watcher->nfiles, 2);
+    Document* doc = Watcher_document(watcher, path_a);
+    ck_assert_ptr_ne(doc, NULL);
+    ck_assert_int_eq(doc->reparsed, 3);
+
+    /* change one function */
+    write_file(path_a, "int a;\ndef int f() {\n  return 1;\n}\ndef int g() {\n  return 2 + a;\n}\n");
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 1);
+    ck_assert_ptr_eq(Watcher_document(watcher, path_a), doc);
+    ck_assert_int_eq(doc->reparsed, 1);
+    ck_assert_int_eq(doc->tree->program.functions->tail->funcdecl.body->
+                     block.statements->head->funcreturn.value->type, BINARYOP);
+
+    /* saving without changes produces no output */
+    write_file(path_b, "int b;\n");
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 0);
+
+    /* errors, then deletion */
+    write_file(path_b, "int b");
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 1);
+    ck_assert_ptr_eq(Watcher_document(watcher, path_b)->tree, NULL);
+    remove(path_b);
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 1);
+    ck_assert_ptr_eq(Watcher_document(watcher, path_b), NULL);
+
+    char* text = read_tmpfile(output);
+    ck_assert(strstr(text, "(reparsed 1 of 3 declarations in ") != NULL);
+    ck_assert(strstr(text, "Unexpected end of input") != NULL);
+    ck_assert(strstr(text, "b.decaf (removed) ==\n") != NULL);
+    free(text);
+
+    Watcher_free(watcher);
+    remove(path_a);
+    rmdir(dir);
+}
+END_TEST
+
+/*
+ * test that a symbolic link back up the tree does not make watch mode compile
+ * the same files over and over
+ */
+START_TEST(A_watch_symlink_loop)
+{
+    char dir[64];
+    char path[96];
+    char sub[80];
+    snprintf(dir, sizeof(dir), "/tmp/decaf-watch-loop-%d", (int)getpid());
+    snprintf(path, sizeof(path), "%s/a.decaf", dir);
+    snprintf(sub, sizeof(sub), "%s/sub", dir);
+    ck_assert_int_eq(mkdir(dir, 0700), 0);
+    ck_assert_int_eq(mkdir(sub, 0700), 0);
+    write_file(path, "int a;\n");
+    char loop[96];
+    snprintf(loop, sizeof(loop), "%s/loop", sub);
+    ck_assert_int_eq(symlink("..", loop), 0);
+
+    FILE* output = tmpfile();
+    Watcher* watcher = Watcher_new(dir, WATCH_TEXT, output);
+    ck_assert_ptr_ne(watcher, NULL);
+    ck_assert_int_eq(watcher->nfiles, 1);
+    ck_assert_int_eq(watcher->ndirs, 2);
+    Watcher_free(watcher);
+    fclose(output);
+
+    remove(loop);
+    remove(path);
+    rmdir(sub);
+    rmdir(dir);
+}
+END_TEST
+
+/*
+ * test that watch mode follows a directory that is renamed or deleted
+ * (without keeping the files under the old path)
+ */
+START_TEST(A_watch_rename_dir)
+{
+    char dir[64];
+    char sub[80];
+    char moved[80];
+    char old_path[96];
+    char new_path[96];
+    snprintf(dir, sizeof(dir), "/tmp/decaf-watch-rename-%d", (int)getpid());
+    snprintf(sub, sizeof(sub), "%s/sub", dir);
+    snprintf(moved, sizeof(moved), "%s/moved", dir);
+    snprintf(old_path, sizeof(old_path), "%s/n.decaf", sub);
+    snprintf(new_path, sizeof(new_path), "%s/n.decaf", moved);
+    ck_assert_int_eq(mkdir(dir, 0700), 0);
+    ck_assert_int_eq(mkdir(sub, 0700), 0);
+    write_file(old_path, "int n;\n");
+
+    FILE* output = tmpfile();
+    Watcher* watcher = Watcher_new(dir, WATCH_TEXT, output);
+    ck_assert_ptr_ne(watcher, NULL);
+    ck_assert_int_eq(watcher->nfiles, 1);
+
+    ck_assert_int_eq(rename(sub, moved), 0);
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 2);    /* removed, then compiled */
+    ck_assert_int_eq(watcher->nfiles, 1);
+    ck_assert_int_eq(watcher->ndirs, 2);
+    ck_assert_ptr_eq(Watcher_document(watcher, old_path), NULL);
+    ck_assert_ptr_ne(Watcher_document(watcher, new_path), NULL);
+
+    remove(new_path);
+    rmdir(moved);
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 1);
+    ck_assert_int_eq(watcher->nfiles, 0);
+    ck_assert_int_eq(watcher->ndirs, 1);
+    Watcher_free(watcher);
+
+    char* text = read_tmpfile(output);
+    ck_assert(strstr(text, "sub/n.decaf (removed) ==\n") != NULL);
+    ck_assert(strstr(text, "moved/n.decaf (removed) ==\n") != NULL);
+    free(text);
+    rmdir(dir);
+}
+END_TEST
+
+/*
+ * test that watch mode catches up after the kernel drops events
+ */
+START_TEST(A_watch_overflow)
+{
+    long limit = 16384;
+    FILE* proc = fopen("/proc/sys/fs/inotify/max_queued_events", "r");
+    if (proc != NULL) {
+        ck_assert_int_eq(fscanf(proc, "%ld", &limit), 1);
+        fclose(proc);
+    }
+    char dir[64];
+    char path_a[96];
+    char noise[2][96];
+    char sub[80];
+    char path_n[96];
+    snprintf(dir, sizeof(dir), "/tmp/decaf-watch-overflow-%d", (int)getpid());
+    snprintf(path_a, sizeof(path_a), "%s/a.decaf", dir);
+    snprintf(noise[0], sizeof(noise[0]), "%s/x.txt", dir);
+    snprintf(noise[1], sizeof(noise[1]), "%s/y.txt", dir);
+    snprintf(sub, sizeof(sub), "%s/sub", dir);
+    snprintf(path_n, sizeof(path_n), "%s/n.decaf", sub);
+    ck_assert_int_eq(mkdir(dir, 0700), 0);
+    write_file(path_a, "int a;\n");
+
+    FILE* output = tmpfile();
+    Watcher* watcher = Watcher_new(dir, WATCH_TEXT, output);
+    ck_assert_ptr_ne(watcher, NULL);
+
+    /* fill the queue (alternating, so that the kernel can't merge events) */
+    for (long i = 0; i <= limit; i++) {
+        write_file(noise[i % 2], "");
+    }
+    write_file(path_a, "int a; int b;\n");
+    ck_assert_int_eq(mkdir(sub, 0700), 0);
+    write_file(path_n, "int n;\n");
+
+    ck_assert_int_eq(Watcher_poll(watcher, 1000), 2);
+    ck_assert_int_eq(Watcher_document(watcher, path_a)->tree->program.variables->size, 2);
+    ck_assert_ptr_ne(Watcher_document(watcher, path_n), NULL);
+    ck_assert_int_eq(watcher->ndirs, 2);
+    Watcher_free(watcher);
+    fclose(output);
+
+    remove(path_n);
+    rmdir(sub);
+    remove(noise[0]);
+    remove(noise[1]);
+    remove(path_a);
+    rmdir(dir);
+}
+END_TEST
+
+/*
+ * library callbacks: count tokens, and count nodes (skipping function bodies)
+ */
+static void count_token (const DecafToken* token, void* count)
+{
+    (*(int*)count)++;
+}
+
+static int count_outer_node (const DecafNode* node, void* count)
+{
+    (*(int*)count)++;
+    return strcmp(node->type, "Block") == 0;
+}
+
+/*
+ * test the embeddable library interface
+ */
+START_TEST(A_library_api)
+{
+    const char* text = "int a; def int f(int x) { return g(x) + a; } trailing garbage";
+    size_t length = strstr(text, " trailing") - text;
+    DecafContext* context = DecafContext_new();
+    ck_assert_ptr_ne(context, NULL);
+
+    int tokens = 0;
+    ck_assert_int_eq(DecafContext_lex(context, text, length, count_token, &tokens), DECAF_OK);
+    ck_assert_int_eq(tokens, 20);
+
+    DecafTree* tree = NULL;
+    ck_assert_int_eq(DecafContext_parse(context, text, length, &tree), DECAF_OK);
+    ck_assert_str_eq(DecafContext_error(context), "");
+    int nodes = 0;
+    ck_assert_int_eq(DecafTree_traverse(tree, count_outer_node, &nodes), DECAF_OK);
+    ck_assert_int_eq(nodes, 4);     /* program, vardecl, funcdecl, block */
+
+    char* output = NULL;
+    size_t output_length = 0;
+    ck_assert_int_eq(DecafTree_serialize(tree, DECAF_FORMAT_TEXT, &output, &output_length), DECAF_OK);
+    ck_assert_int_eq(output_length, strlen(output));
+    ck_assert(strstr(output, "        FuncCall name=\"g\" [line 1]\n") != NULL);
+    Decaf_free(output);
+    ck_assert_int_eq(DecafTree_serialize(tree, DECAF_FORMAT_DOT, &output, NULL), DECAF_OK);
+    ck_assert(strncmp(output, "digraph", 7) == 0);
+    Decaf_free(output);
+    DecafTree_free(tree);
+
+    /* errors are returned, not thrown */
+    ck_assert_int_eq(DecafContext_parse(context, text, strlen(text), &tree), DECAF_PARSE_ERROR);
+    ck_assert_ptr_eq(tree, NULL);
+    ck_assert_int_eq(DecafContext_error_offset(context), length + 1);
+    ck_assert(strlen(DecafContext_error(context)) > 0);
+    ck_assert_int_eq(DecafContext_lex(context, "int $;", 6, count_token, &tokens), DECAF_LEX_ERROR);
+    ck_assert_int_eq(DecafContext_parse(context, NULL, 1, &tree), DECAF_INVALID_ARGUMENT);
+    ck_assert_int_eq(DecafContext_parse(NULL, "", 0, &tree), DECAF_INVALID_ARGUMENT);
+    ck_assert_int_eq(DecafContext_parse(context, "", 0, &tree), DECAF_OK);
+    DecafTree_free(tree);
+    DecafContext_free(context);
+}
+END_TEST
+
+/*
+ * send one message to a language server and return what it wrote
+ */
+static char* lsp_send (LanguageServer* server, const char* message)
+{
+    server->output = tmpfile();
+    ck_assert(LanguageServer_handle(server, message, strlen(message)));
+    return read_tmpfile(server->output);
+}
+
+/*
+ * send a textDocument/didChange that replaces part of a line
+ */
+static char* lsp_change (LanguageServer* server, int line, int start, int end, const char* text)
+{
+    char message[512];
+    snprintf(message, sizeof(message), "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\","
+             "\"params\":{\"textDocument\":{\"uri\":\"file:///t.decaf\"},\"contentChanges\":[{\"range\":"
+             "{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}},"
+             "\"text\":\"%s\"}]}}", line, start, line, end, text);
+    return lsp_send(server, message);
+}
+
+/*
+ * send a textDocument/definition request
+ */
+static char* lsp_definition (LanguageServer* server, int line, int character)
+{
+    char message[512];
+    snprintf(message, sizeof(message), "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"textDocument/definition\","
+             "\"params\":{\"textDocument\":{\"uri\":\"file:///t.decaf\"},\"position\":"
+             "{\"line\":%d,\"character\":%d}}}", line, character);
+    return lsp_send(server, message);
+}
+
+/*
+ * test the language server with a scripted client: diagnostics follow
+ * incremental edits, and lookups see the edited text
+ */
+START_TEST(A_language_server)
+{
+    LanguageServer* server = LanguageServer_new(NULL);
+    char* out = lsp_send(server, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}");
+    ck_assert(strncmp(out, "Content-Length: ", 16) == 0);
+    ck_assert(strstr(out, "\"definitionProvider\":true") != NULL);
+    free(out);
+
+    out = lsp_send(server, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":"
+                   "{\"textDocument\":{\"uri\":\"file:///t.decaf\",\"text\":\"int a;\\ndef int f(int x) {\\n"
+                   "  a = x;\\n  return g(x);\\n}\\ndef int g(int y) {\\n  return y + a;\\n}\\n\"}}}");
+    ck_assert(strstr(out, "\"diagnostics\":[]") != NULL);
+    free(out);
+
+    /* break the first function, then fix it */
+    out = lsp_change(server, 2, 7, 8, "");
+    ck_assert(strstr(out, "\"range\":{\"start\":{\"line\":3,\"character\":2},"
+                          "\"end\":{\"line\":3,\"character\":8}},\"severity\":1") != NULL);
+    free(out);
+    out = lsp_change(server, 2, 7, 7, ";");
+    ck_assert(strstr(out, "\"diagnostics\":[]") != NULL);
+    free(out);
+
+    /* move everything down two lines; "a" in g is the global */
+    free(lsp_change(server, 0, 0, 0, "\\n\\n"));
+    ck_assert_int_eq(LanguageServer_document(server, "file:///t.decaf")->tree->
+                     program.functions->tail->source_line, 8);
+    out = lsp_definition(server, 8, 13);
+    ck_assert(strstr(out, "\"range\":{\"start\":{\"line\":2,\"character\":4},"
+                          "\"end\":{\"line\":2,\"character\":5}}") != NULL);
+    free(out);
+    out = lsp_definition(server, 4, 6);
+    ck_assert(strstr(out, "\"range\":{\"start\":{\"line\":3,\"character\":14},"
+                          "\"end\":{\"line\":3,\"character\":15}}") != NULL);
+    free(out);
+    out = lsp_send(server, "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"textDocument/documentSymbol\","
+                   "\"params\":{\"textDocument\":{\"uri\":\"file:///t.decaf\"}}}");
+    ck_assert(strstr(out, "{\"name\":\"g\",\"detail\":\"int (int)\",\"kind\":12,\"range\":"
+                          "{\"start\":{\"line\":7,\"character\":0}") != NULL);
+    free(out);
+
+    out = lsp_send(server, "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"unknown\"}");
+    ck_assert(strstr(out, "\"code\":-32601") != NULL);
+    free(out);
+    free(lsp_send(server, "{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"shutdown\"}"));
+    const char* exit = "{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}";
+    ck_assert(!LanguageServer_handle(server, exit, strlen(exit)));
+    ck_assert(server->shutdown);
+    LanguageServer_free(server);
+}
+END_TEST
+
+/*
+ * streaming helper: write text to a temporary file and print it with
+ * PrintVisitor_stream (returns NULL and copies the message on an error)
+ */
+static char* print_stream (const char* text, char* message)
+{
+    FILE* input = tmpfile();
+    fputs(text, input);
+    rewind(input);
+    FILE* output = tmpfile();
+    volatile bool failed = false;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        PrintVisitor_stream(input, output);
+    } else {
+        failed = true;
+        snprintf(message, MAX_ERROR_LEN, "%s", trap.message);
+    }
+    ErrorTrap_pop(&trap);
+    fclose(input);
+    char* printed = read_tmpfile(output);
+    if (failed) {
+        free(printed);
+        return NULL;
+    }
+    return printed;
+}
+
+/*
+ * streaming helper: count declarations and note how much of the input had
+ * been read when the first one was handed on
+ */
+typedef struct StreamProgress
+{
+    FILE* input;
+    long first;
+    int count;
+} StreamProgress;
+
+static void note_progress (ASTNode* decl, void* data)
+{
+    StreamProgress* progress = (StreamProgress*)data;
+    if (progress->count++ == 0) {
+        progress->first = ftell(progress->input);
+    }
+    ASTNode_free(decl);
+}
+
+/*
+ * test that printing one declaration at a time matches printing the whole
+ * tree, across several chunks of input
+ */
+START_TEST(A_streaming_print)
+{
+    size_t capacity = 4 * STREAM_CHUNK_SIZE;
+    char* text = (char*)malloc(capacity);
+    size_t length = sprintf(text, "int g;\nbool h[8];\n");
+    for (int i = 0; length + 200 < capacity; i++) {
+        length += sprintf(text + length, "def int f%d(int a)\n{\n  if (a > %d) { return f%d(a - 1); }\n"
+                                         "  g = h[a] + 1;\n  return g;\n}\n", i, i, i);
+    }
+
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+    char* expected = print_tree(tree);
+    ASTNode_free(tree);
+    char message[MAX_ERROR_LEN];
+    char* actual = print_stream(text, message);
+    ck_assert_ptr_ne(actual, NULL);
+    ck_assert_str_eq(actual, expected);
+    free(actual);
+    free(expected);
+
+    /* an error in a later chunk is reported with its line in the whole file */
+    char* brace = strrchr(text, '}');
+    *brace = ' ';
+    ck_assert_ptr_eq(print_stream(text, message), NULL);
+    char expected_message[MAX_ERROR_LEN];
+    tokens = lex(text);
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        parse(tokens);
+        ck_assert_msg(false, "expected an error");
+    }
+    ErrorTrap_pop(&trap);
+    snprintf(expected_message, MAX_ERROR_LEN, "%s", trap.message);
+    TokenQueue_free(tokens);
+    ck_assert_str_eq(message, expected_message);
+
+    int line = 1;
+    for (const char* p = text; p < text + length - 10; p++) {
+        line += (*p == '\n');
+    }
+    text[length - 10] = '$';
+    ck_assert_ptr_eq(print_stream(text, message), NULL);
+    snprintf(expected_message, MAX_ERROR_LEN, "Invalid token on line %d: \"$", line);
+    ck_assert(strncmp(message, expected_message, strlen(expected_message)) == 0);
+
+    /* globals alone are also handed on before the rest has been read */
+    length = 0;
+    int globals = 0;
+    for (; length + 20 < capacity; globals++) {
+        length += sprintf(text + length, "int g%d;\n", globals);
+    }
+    FILE* input = tmpfile();
+    fputs(text, input);
+    rewind(input);
+    StreamProgress progress = { input, 0, 0 };
+    parse_stream(input, note_progress, &progress);
+    fclose(input);
+    ck_assert_int_eq(progress.count, globals);
+    ck_assert_int_le(progress.first, STREAM_CHUNK_SIZE);
+    free(text);
+}
+END_TEST
+
+/*
+ * test the JSON and S-expression output formats
+ */
+START_TEST(A_json_sexp_output)
+{
+    TokenQueue* tokens = lex("int g[4];\ndef bool f(int a, bool b) {\n"
+                             "  if (a < -1) { print_str(\"x\\\"y\"); }\n  return !b;\n}\n");
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+
+    FILE* output = tmpfile();
+    SExprVisitor_traverse(output, tree);
+    char* sexp = read_tmpfile(output);
+    ck_assert_str_eq(sexp, "(Program :line 1 (VarDecl :line 1 :name \"g\" :type int :is_array true :array_length 4) "
+        "(FuncDecl :line 2 :name \"f\" :return_type bool :parameters ((\"a\" int) (\"b\" bool)) (Block :line 2 "
+        "(Conditional :line 3 (BinaryOp :line 3 :op \"<\" (Location :line 3 :name \"a\") (UnaryOp :line 3 :op \"-\" "
+        "(Literal :line 3 :type int :value 1))) (Block :line 3 (FuncCall :line 3 :name \"print_str\" "
+        "(Literal :line 3 :type str :value \"x\\\"y\")))) (Return :line 4 (UnaryOp :line 4 :op \"!\" "
+        "(Location :line 4 :name \"b\"))))))\n");
+    free(sexp);
+
+    output = tmpfile();
+    JsonVisitor_traverse(output, tree);
+    char* json = read_tmpfile(output);
+    JsonValue* program = Json_parse(json, strlen(json));
+    ck_assert_ptr_ne(program, NULL);
+    ck_assert_str_eq(JsonValue_string(JsonValue_get(program, "node")), "Program");
+    JsonValue* func = JsonValue_at(JsonValue_get(program, "children"), 1);
+    ck_assert_str_eq(JsonValue_string(JsonValue_get(func, "return_type")), "bool");
+    JsonValue* param = JsonValue_at(JsonValue_get(func, "parameters"), 1);
+    ck_assert_str_eq(JsonValue_string(JsonValue_get(param, "name")), "b");
+    JsonValue* cond = JsonValue_at(JsonValue_get(JsonValue_at(JsonValue_get(func, "children"), 0), "children"), 0);
+    ck_assert_int_eq(JsonValue_int(JsonValue_get(cond, "line"), 0), 3);
+    JsonValue* call = JsonValue_at(JsonValue_get(JsonValue_at(JsonValue_get(cond, "children"), 1), "children"), 0);
+    JsonValue* literal = JsonValue_at(JsonValue_get(call, "children"), 0);
+    ck_assert_str_eq(JsonValue_string(JsonValue_get(literal, "value")), "x\"y");
+    ck_assert_int_eq(JsonValue_get(JsonValue_get(program, "children")->items, "is_array")->boolean, true);
+    Json_free(program);
+    free(json);
+    ASTNode_free(tree);
+
+    /* output much larger than the writer's buffer */
+    char* text = (char*)malloc(4 * WRITER_BUFFER_SIZE);
+    size_t length = 0;
+    for (int i = 0; length + 100 < 4 * WRITER_BUFFER_SIZE; i++) {
+        length += sprintf(text + length, "def int f%d() { return %d; }\n", i, -i);
+    }
+    tokens = lex(text);
+    tree = parse(tokens);
+    TokenQueue_free(tokens);
+    output = tmpfile();
+    JsonVisitor_traverse(output, tree);
+    json = read_tmpfile(output);
+    ck_assert(strlen(json) > 2 * WRITER_BUFFER_SIZE);
+    program = Json_parse(json, strlen(json));
+    ck_assert_ptr_ne(program, NULL);
+    ck_assert_int_eq(JsonValue_get(program, "children")->size, tree->program.functions->size);
+    Json_free(program);
+    free(json);
+    free(text);
+    ASTNode_free(tree);
+}
+END_TEST
+
+/*
+ * write a DOT graph with GenerateASTGraph_traverse to a string
+ */
+static char* graph_tree (ASTNode* tree, const ASTGraphOptions* options)
+{
+    FILE* output = tmpfile();
+    GenerateASTGraph_traverse(output, tree, options);
+    return read_tmpfile(output);
+}
+
+/*
+ * count the lines of a DOT graph that contain a string
+ */
+static int count_graph_lines (const char* graph, const char* text)
+{
+    int count = 0;
+    for (const char* line = graph; line != NULL && *line != '\0'; line = strchr(line, '\n') + 1) {
+        const char* end = strchr(line, '\n');
+        const char* found = strstr(line, text);
+        count += (found != NULL && found < end);
+    }
+    return count;
+}
+
+/*
+ * test DOT output numbering and node selection
+ */
+START_TEST(A_graph_options)
+{
+    TokenQueue* tokens = lex("int g;\ndef int f(int a) {\n  return a + 1;\n}\n"
+                             "def void h() {\n  f(2);\n  g = 3;\n}\n");
+    ASTNode* tree = parse(tokens);
+    TokenQueue_free(tokens);
+    SetParentVisitor_traverse(tree);
+    CalcDepthVisitor_traverse(tree);
+    ASTNode_set_int_attribute(tree->program.variables->head, "reg", 7);
+
+    /* the same graph from the dynamic visitor and from repeated calls */
+    char* graph = graph_tree(tree, NULL);
+    FILE* output = tmpfile();
+    NodeVisitor* visitor = GenerateASTGraph_new(output);
+    NodeVisitor_traverse(visitor, tree);
+    ck_assert_int_eq(ftell(output), strlen(graph));     /* complete before the visitor is freed */
+    NodeVisitor_free(visitor);
+    char* dynamic = read_tmpfile(output);
+    ck_assert_str_eq(dynamic, graph);
+    char* again = graph_tree(tree, NULL);
+    ck_assert_str_eq(again, graph);
+    ck_assert(strncmp(graph, "digraph AST {\n0 [shape=box, label=\"Program\"];\n", 45) == 0);
+    ck_assert(strstr(graph, "1 [shape=box, label=\"VarDecl name='g'\\nreg: 7\"];\n0 -> 1;\n") != NULL);
+    ck_assert_int_eq(count_graph_lines(graph, "depth"), 0);
+    ck_assert_int_eq(count_graph_lines(graph, "label="), 15);
+    ck_assert_int_eq(count_graph_lines(graph, " -> "), 14);
+    free(graph);
+    free(dynamic);
+    free(again);
+
+    ASTGraphOptions options = { .function = "h" };
+    graph = graph_tree(tree, &options);
+    ck_assert(strncmp(graph, "digraph AST {\n0 [shape=box, label=\"FuncDecl name='h'\"];\n", 55) == 0);
+    ck_assert_int_eq(count_graph_lines(graph, "label="), 7);
+    ck_assert_int_eq(count_graph_lines(graph, "name='f'"), 1);
+    free(graph);
+
+    options = (ASTGraphOptions){ .max_depth = 2 };
+    graph = graph_tree(tree, &options);
+    ck_assert_int_eq(count_graph_lines(graph, "label="), 4);    /* program and its declarations */
+    free(graph);
+
+    /* the statements of h, attached to its function declaration */
+    options = (ASTGraphOptions){ .first_line = 5, .last_line = 7 };
+    graph = graph_tree(tree, &options);
+    ck_assert_int_eq(count_graph_lines(graph, "label="), 7);
+    ck_assert_int_eq(count_graph_lines(graph, "label=\"Program\""), 0);
+    ck_assert_int_eq(count_graph_lines(graph, " -> "), 6);
+    free(graph);
+
+    options = (ASTGraphOptions){ .function = "missing" };
+    graph = graph_tree(tree, &options);
+    ck_assert_str_eq(graph, "digraph AST {\n}\n");
+    free(graph);
+    ASTNode_free(tree);
+}
+END_TEST
+
+/*
+ * parse and run ILOC, returning the error message (or NULL)
+ */
+static char iloc_error[MAX_ERROR_LEN];
+static const char* try_iloc (const char* text, const ILOCMachineConfig* config,
+                             FILE* output, ILOCStats* stats)
+{
+    ILOCInsnList* volatile program = NULL;
+    const char* volatile message = NULL;
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        program = ILOCInsnList_parse(text);
+        ILOCMachine_run(program, config, output, stats);
+    } else {
+        snprintf(iloc_error, MAX_ERROR_LEN, "%s", trap.message);
+        message = iloc_error;
+    }
+    ErrorTrap_pop(&trap);
+    if (program != NULL) {
+        ILOCInsnList_free(program);
+    }
+    return message;
+}
+
+/*
+ * recursive factorial of 5, as printed by ILOCInsnList_print
+ */
+static const char* iloc_fact =
+    "main:\n"
+    "    loadI 5 => r0\n"
+    "    push r0\n"
+    "    call fact\n"
+    "    addI sp, 8 => sp\n"
+    "    print ret\n"
+    "    print \"!\\n\"\n"
+    "    return\n"
+    "fact:\n"
+    "    push bp\n"
+    "    i2i sp => bp\n"
+    "    loadAI [bp+16] => r1\n"
+    "    loadI 1 => r2\n"
+    "    cmp_LE r1, r2 => r3\n"
+    "    cbr r3 => l0, l1\n"
+    "l0:\n"
+    "    loadI 1 => ret\n"
+    "    jump l2\n"
+    "l1:\n"
+    "    subI r1, 1 => r4\n"
+    "    push r4\n"
+    "    call fact\n"
+    "    addI sp, 8 => sp\n"
+    "    loadAI [bp+16] => r5\n"
+    "    mult r5, ret => ret\n"
+    "l2:\n"
+    "    i2i bp => sp\n"
+    "    pop => bp\n"
+    "    return\n";
+
+/*
+ * sum of 1024 words, one load per iteration
+ */
+static const char* iloc_loop =
+    "main:\n"
+    "    loadI 256 => r0\n"
+    "    loadI 0 => r1\n"
+    "l0:\n"
+    "    load [r0] => r2\n"
+    "    add r1, r2 => r1\n"
+    "    addI r0, 8 => r0\n"
+    "    loadI 8448 => r3\n"
+    "    cmp_LT r0, r3 => r4\n"
+    "    cbr r4 => l0, l1\n"
+    "l1:\n"
+    "    i2i r1 => ret\n";
+
+/*
+ * run the factorial program and return what it printed
+ */
+static char* run_fact (const ILOCMachineConfig* config, ILOCStats* stats)
+{
+    ILOCInsnList* program = ILOCInsnList_parse(iloc_fact);
+    FILE* output = tmpfile();
+    ILOCMachine_run(program, config, output, stats);
+    ILOCInsnList_free(program);
+    return read_tmpfile(output);
+}
+
+/*
+ * test that printing ILOC round-trips
+ */
+START_TEST(A_iloc_print)
+{
+    ILOCInsnList* program = ILOCInsnList_parse(iloc_fact);
+    ck_assert_int_eq(program->size, 29);
+    FILE* output = tmpfile();
+    ILOCInsnList_print(program, output);
+    char* printed = read_tmpfile(output);
+    ck_assert_str_eq(printed, iloc_fact);
+    free(printed);
+    ILOCInsnList_free(program);
+}
+END_TEST
+
+/*
+ * test the registers an instruction reads and writes
+ */
+START_TEST(A_iloc_operands)
+{
+    long regs[ILOC_MAX_OPERANDS];
+    long reg = 0;
+    ILOCInsn* store = ILOCInsn_new(ILOC_STORE_AI, ILOCOperand_reg(1),
+            ILOCOperand_reg(ILOC_BP), ILOCOperand_int(-8));
+    ck_assert_int_eq(ILOCInsn_sources(store, regs), 2);
+    ck_assert_int_eq(regs[1], ILOC_BP);
+    ck_assert(!ILOCInsn_destination(store, &reg));
+    ILOCInsn_free(store);
+
+    ILOCInsnList* program = ILOCInsnList_parse(iloc_fact);
+    ck_assert(ILOCInsn_destination(program->head->next, &reg));    /* loadI 5 => r0 */
+    ck_assert_int_eq(reg, 0);
+    ILOCInsnList_free(program);
+}
+END_TEST
+
+/*
+ * test running 5! with five calls
+ */
+START_TEST(A_iloc_run)
+{
+    ILOCStats stats;
+    char* printed = run_fact(NULL, &stats);
+    ck_assert_str_eq(printed, "120!\n");
+    free(printed);
+    ck_assert_int_eq(stats.result, 120);
+    ck_assert_int_eq(stats.counts[ILOC_CALL], 5);
+    ck_assert_int_eq(stats.counts[ILOC_MULT], 4);
+    ck_assert_int_eq(stats.counts[ILOC_LABEL], 0);
+    ck_assert_int_eq(stats.instructions, 7 + 4 * 15 + 11);
+    ck_assert_int_eq(stats.max_stack, 5 * 24 + 8);
+    ck_assert_int_eq(stats.cache_misses, 0);
+}
+END_TEST
+
+/*
+ * test that the pipelined machine overlaps some work
+ */
+START_TEST(A_iloc_pipeline)
+{
+    ILOCStats stats, serial;
+    free(run_fact(NULL, &stats));
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    config.pipelined = false;
+    free(run_fact(&config, &serial));
+    ck_assert_int_eq(serial.instructions, stats.instructions);
+    ck_assert(serial.cycles > stats.cycles);
+    ck_assert(stats.cycles >= stats.instructions);
+}
+END_TEST
+
+/*
+ * test the opcode histogram, most frequent opcode first
+ */
+START_TEST(A_iloc_stats_print)
+{
+    ILOCStats stats;
+    free(run_fact(NULL, &stats));
+    FILE* output = tmpfile();
+    ILOCStats_print(&stats, output);
+    char* printed = read_tmpfile(output);
+    ck_assert(strstr(printed, "instructions: 78\n") != NULL);
+    ck_assert(strstr(printed, "\n  push ") < strstr(printed, "\n  mult "));
+    free(printed);
+}
+END_TEST
+
+/*
+ * test that a cache only adds cycles, for the misses
+ */
+START_TEST(A_iloc_cache)
+{
+    ILOCStats stats, cached;
+    ck_assert_ptr_eq(try_iloc(iloc_loop, NULL, stdout, &stats), NULL);
+    ck_assert_int_eq(stats.loads, 1024);
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    config.cache_lines = 16;
+    ck_assert_ptr_eq(try_iloc(iloc_loop, &config, stdout, &cached), NULL);
+    ck_assert_int_eq(cached.cache_misses, 1024 / 8);
+    ck_assert_int_eq(cached.cycles, stats.cycles + 128 * config.miss_penalty);
+}
+END_TEST
+
+/*
+ * test errors in ILOC text
+ */
+START_TEST(A_iloc_parse_errors)
+{
+    ck_assert_str_eq(try_iloc("main:\n    frob r1\n", NULL, stdout, NULL),
+            "Invalid ILOC on line 2: unknown opcode frob\n");
+    ck_assert_str_eq(try_iloc("main:\n    jump nowhere\n", NULL, stdout, NULL),
+            "Invalid ILOC on line 2: undefined label nowhere\n");
+}
+END_TEST
+
+/*
+ * test errors while running ILOC
+ */
+START_TEST(A_iloc_run_errors)
+{
+    ck_assert_str_eq(try_iloc("main:\n    loadI 0 => r0\n    div r0, r0 => r1\n", NULL, stdout, NULL),
+            "ILOC error on line 3: division by zero\n");
+    ck_assert_str_eq(try_iloc("main:\n    load [r0] => r1\n", NULL, stdout, NULL),
+            "ILOC error on line 2: memory access out of bounds at address 0\n");
+    ck_assert_str_eq(try_iloc("f:\n    return\n", NULL, stdout, NULL),
+            "ILOC error: no main function\n");
+}
+END_TEST
+
+/*
+ * test that a run stops after the instruction limit
+ */
+START_TEST(A_iloc_limit)
+{
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    config.max_instructions = 1000;
+    ck_assert(strstr(try_iloc("main:\nl0:\n    jump l0\n", &config, stdout, NULL),
+            "more than 1000 instructions") != NULL);
+    config.max_instructions = 0;            /* no limit */
+    ILOCStats stats;
+    ck_assert_ptr_eq(try_iloc(iloc_loop, &config, stdout, &stats), NULL);
+    ck_assert(stats.instructions > 1000);
+}
+END_TEST
+
+/*
+ * optimize ILOC text and return the printed result
+ */
+static char* peephole_text (const char* text, const PeepholeRule* rules, int nrules,
+                            PeepholeStats* stats)
+{
+    ILOCInsnList* program = ILOCInsnList_parse(text);
+    Peephole_optimize(program, rules, nrules, stats);
+    FILE* output = tmpfile();
+    ILOCInsnList_print(program, output);
+    ILOCInsnList_free(program);
+    return read_tmpfile(output);
+}
+
+/*
+ * unoptimized code with stores, copies, constants and dead definitions
+ */
+static const char* peephole_naive =
+    "main:\n"
+    "    loadI 5 => r9\n"
+    "    storeAI r9 => [bp-8]\n"
+    "    loadAI [bp-8] => r0\n"
+    "    loadI 0 => r1\n"
+    "    add r0, r1 => r2\n"
+    "    i2i r2 => r3\n"
+    "    storeAI r3 => [bp-16]\n"
+    "    loadAI [bp-16] => r4\n"
+    "    loadI 8 => r5\n"
+    "    loadI 256 => r6\n"
+    "    loadAO [r6+r5] => r7\n"
+    "    mult r4, r7 => r8\n"
+    "    i2i r8 => ret\n"
+    "    jump l0\n"
+    "l0:\n"
+    "    not r8 => r10\n"
+    "    not r10 => r11\n"
+    "    return\n";
+
+/*
+ * test that stored values are forwarded, constants folded and dead code
+ * removed by the default rules
+ */
+START_TEST(A_peephole_default_rules)
+{
+    PeepholeStats stats;
+    char* optimized = peephole_text(peephole_naive, peephole_rules, peephole_rule_count, &stats);
+    ck_assert_str_eq(optimized,
+        "main:\n"
+        "    loadI 5 => r9\n"
+        "    storeAI r9 => [bp-8]\n"
+        "    storeAI r9 => [bp-16]\n"
+        "    i2i r9 => r4\n"
+        "    loadI 8 => r5\n"
+        "    loadAI [r5+256] => r7\n"
+        "    mult r4, r7 => ret\n"
+        "l0:\n"
+        "    return\n");
+    ck_assert_int_eq(stats.before, 17);
+    ck_assert_int_eq(stats.after, 8);
+    ck_assert_int_eq(stats.passes, 2);      /* "mult" only moves into ret once r8's other use is gone */
+    ck_assert_int_eq(stats.rewrites, 12);
+    free(optimized);
+}
+END_TEST
+
+/*
+ * test that the optimized code computes the same thing, with fewer
+ * instructions
+ */
+START_TEST(A_peephole_same_result)
+{
+    char* optimized = peephole_text(peephole_naive, peephole_rules, peephole_rule_count, NULL);
+    ILOCStats before, after;
+    ck_assert_ptr_eq(try_iloc(peephole_naive, NULL, stdout, &before), NULL);
+    ck_assert_ptr_eq(try_iloc(optimized, NULL, stdout, &after), NULL);
+    ck_assert_int_eq(after.result, before.result);
+    ck_assert_int_eq(after.instructions, 8);
+    ck_assert_int_eq(after.loads, 2);       /* the global and the return address */
+    free(optimized);
+}
+END_TEST
+
+/*
+ * test the rewrite counts, most frequent rule first
+ */
+START_TEST(A_peephole_stats_print)
+{
+    PeepholeStats stats;
+    free(peephole_text(peephole_naive, peephole_rules, peephole_rule_count, &stats));
+    FILE* output = tmpfile();
+    PeepholeStats_print(&stats, peephole_rules, peephole_rule_count, output);
+    char* printed = read_tmpfile(output);
+    ck_assert(strncmp(printed, "instructions: 17 -> 8 (12 rewrites in 2 passes)\n", 48) == 0);
+    ck_assert(strstr(printed, "  fold_add ") != NULL);
+    ck_assert(strstr(printed, "  dead_definition ") < strstr(printed, "  fold_add "));
+    ck_assert(strstr(printed, "  mult_zero ") == NULL);
+    free(printed);
+}
+END_TEST
+
+/*
+ * test that a constant moves into an add across an unrelated instruction, but
+ * not when the constant's register is used again
+ */
+START_TEST(A_peephole_constant_operand)
+{
+    char* optimized = peephole_text("main:\n    loadI 3 => r0\n    loadAI [bp-8] => r1\n"
+                                    "    add r1, r0 => r2\n    print r2\n",
+                                    peephole_rules, peephole_rule_count, NULL);
+    ck_assert_str_eq(optimized, "main:\n    loadAI [bp-8] => r1\n    addI r1, 3 => r2\n"
+                                "    print r2\n");
+    free(optimized);
+    const char* shared = "main:\n    loadI 3 => r0\n    add r0, r0 => r1\n    print r1\n";
+    optimized = peephole_text(shared, peephole_rules, peephole_rule_count, NULL);
+    ck_assert_str_eq(optimized, shared);
+    free(optimized);
+}
+END_TEST
+
+/*
+ * test a custom rule table
+ */
+START_TEST(A_peephole_custom_rules)
+{
+    const PeepholeRule double_negation[] = {
+        { "double_negation", 2,
+          { { ILOC_NEG, { PP_VAR(0), PP_VAR(1) } }, { ILOC_NEG, { PP_VAR(1), PP_VAR(2) } } },
+          1, { { ILOC_I2I, { PP_VAR(0), PP_VAR(2) } } },
+          { { PP_SINGLE_USE, 1, 0 } } }
+    };
+    PeepholeStats stats;
+    char* optimized = peephole_text("main:\n    neg r0 => r1\n    neg r1 => r2\n    addI r2, 0 => r3\n",
+                                    double_negation, 1, &stats);
+    ck_assert_str_eq(optimized, "main:\n    i2i r0 => r2\n    addI r2, 0 => r3\n");
+    ck_assert_int_eq(stats.fired[0], 1);
+    free(optimized);
+}
+END_TEST
+
+/*
+ * run a list of instructions and return what it printed
+ */
+static char* run_program (ILOCInsnList* program, ILOCStats* stats)
+{
+    FILE* output = tmpfile();
+    ILOCMachine_run(program, NULL, output, stats);
+    return read_tmpfile(output);
+}
+
+/*
+ * a block whose loads can move up past stores to other words
+ */
+static const char* schedule_block =
+    "main:\n"
+    "    loadI 256 => r9\n"
+    "    loadI 6 => r0\n"
+    "    storeAI r0 => [r9+0]\n"
+    "    loadI 7 => r1\n"
+    "    storeAI r1 => [r9+8]\n"
+    "    loadAI [r9+0] => r2\n"
+    "    addI r2, 1 => r3\n"
+    "    loadAI [r9+8] => r4\n"
+    "    mult r3, r4 => r5\n"
+    "    addI bp, -8 => r8\n"
+    "    store r5 => [r8]\n"
+    "    loadAI [r9+8] => r6\n"
+    "    add r5, r6 => ret\n"
+    "    return\n";
+
+/*
+ * schedule ILOC text and return the printed result
+ */
+static char* schedule_text (const char* text, const ILOCMachineConfig* config, ScheduleStats* stats)
+{
+    ILOCInsnList* program = ILOCInsnList_parse(text);
+    Schedule_blocks(program, config, stats);
+    FILE* output = tmpfile();
+    ILOCInsnList_print(program, output);
+    ILOCInsnList_free(program);
+    return read_tmpfile(output);
+}
+
+/*
+ * test that loads move up past stores to other words, but never past a store
+ * that might write the same word ([r8] could be anywhere)
+ */
+START_TEST(A_schedule_block)
+{
+    ScheduleStats stats;
+    char* scheduled = schedule_text(schedule_block, NULL, &stats);
+    ck_assert_str_eq(scheduled,
+        "main:\n"
+        "    loadI 256 => r9\n"
+        "    loadI 6 => r0\n"
+        "    storeAI r0 => [r9+0]\n"
+        "    loadI 7 => r1\n"
+        "    loadAI [r9+0] => r2\n"
+        "    storeAI r1 => [r9+8]\n"
+        "    loadAI [r9+8] => r4\n"
+        "    addI r2, 1 => r3\n"
+        "    addI bp, -8 => r8\n"
+        "    mult r3, r4 => r5\n"
+        "    store r5 => [r8]\n"
+        "    loadAI [r9+8] => r6\n"
+        "    add r5, r6 => ret\n"
+        "    return\n");
+    ck_assert_int_eq(stats.blocks, 1);
+    ck_assert_int_eq(stats.reordered, 1);
+    ck_assert_int_eq(stats.largest_block, 14);
+    ck_assert_int_eq(stats.cycles_before, 21);
+    ck_assert_int_eq(stats.cycles_after, 18);
+    free(scheduled);
+}
+END_TEST
+
+/*
+ * test that for a single block, the estimates are exactly what the simulator
+ * counts
+ */
+START_TEST(A_schedule_estimates)
+{
+    char* scheduled = schedule_text(schedule_block, NULL, NULL);
+    ILOCStats before, after;
+    ck_assert_ptr_eq(try_iloc(schedule_block, NULL, stdout, &before), NULL);
+    ck_assert_ptr_eq(try_iloc(scheduled, NULL, stdout, &after), NULL);
+    ck_assert_int_eq(before.cycles, 21);
+    ck_assert_int_eq(after.cycles, 18);
+    ck_assert_int_eq(after.result, before.result);
+    free(scheduled);
+}
+END_TEST
+
+/*
+ * test that without a pipeline, there is nothing to gain
+ */
+START_TEST(A_schedule_serial)
+{
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    config.pipelined = false;
+    ScheduleStats stats;
+    char* scheduled = schedule_text(schedule_block, &config, &stats);
+    ck_assert_str_eq(scheduled, schedule_block);
+    ck_assert_int_eq(stats.reordered, 0);
+    ck_assert_int_eq(stats.cycles_after, stats.cycles_before);
+    free(scheduled);
+}
+END_TEST
+
+/*
+ * test that scheduled generated code computes the same results in fewer
+ * cycles
+ */
+START_TEST(A_schedule_generated)
+{
+    TokenQueue* tokens = lex(
+        "int a[8];\n"
+        "def int square(int x) { return x * x; }\n"
+        "def int main() {\n"
+        "    int i; int s;\n"
+        "    i = 0; s = 0;\n"
+        "    while (i < 8) { a[i] = square(i) % 5; i = i + 1; }\n"
+        "    i = 0;\n"
+        "    while (true) {\n"
+        "        if (i >= 8) { break; }\n"
+        "        s = s * 3 + a[i] * a[7 - i];\n"
+        "        i = i + 1;\n"
+        "    }\n"
+        "    print_int(s); print_str(\" \"); print_bool(s > 100 || false);\n"
+        "    return s;\n"
+        "}\n");
+    ASTNode* tree = parse(tokens);
+    ILOCInsnList* original = generate_code(tree);
+    ILOCInsnList* program = generate_code(tree);
+    ScheduleStats stats;
+    Schedule_blocks(program, NULL, &stats);
+    ILOCStats before, after;
+    char* expected = run_program(original, &before);
+    char* printed = run_program(program, &after);
+    ck_assert_str_eq(expected, "1164 true");
+    ck_assert_str_eq(printed, expected);
+    ck_assert_int_eq(before.result, 1164);
+    ck_assert_int_eq(after.result, 1164);
+    ck_assert_int_eq(after.instructions, before.instructions);
+    ck_assert(after.cycles < before.cycles);
+    ck_assert(stats.cycles_after < stats.cycles_before);
+
+    free(printed);
+    free(expected);
+    ILOCInsnList_free(original);
+    ILOCInsnList_free(program);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+/*
+ * test the scheduling summary
+ */
+START_TEST(A_schedule_stats_print)
+{
+    ScheduleStats stats;
+    free(schedule_text(schedule_block, NULL, &stats));
+    FILE* output = tmpfile();
+    ScheduleStats_print(&stats, output);
+    char* printed = read_tmpfile(output);
+    ck_assert(strncmp(printed, "blocks: ", 8) == 0);
+    ck_assert(strstr(printed, "estimated cycles: ") != NULL);
+    free(printed);
+}
+END_TEST
+
+/*
+ * compile a Decaf program (optionally after tail call elimination) and run it
+ */
+static char* run_decaf (const char* text, TailCallStats* loops, ILOCStats* stats)
+{
+    TokenQueue* tokens = lex(text);
+    ASTNode* tree = parse(tokens);
+    if (loops != NULL) {
+        TailCall_transform(tree, loops);
+    }
+    ILOCInsnList* program = generate_code(tree);
+    char* printed = run_program(program, stats);
+    ILOCInsnList_free(program);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+    return printed;
+}
+
+/*
+ * a program whose arithmetic overflows 32 bits, and what it prints
+ */
+static const char* overflow_program =
+    "def int main() {\n"
+    "    int x;\n"
+    "    x = 2147483647;\n"
+    "    x = x + 1;\n"
+    "    print_int(x); print_str(\" \");\n"
+    "    print_int(x - 1); print_str(\" \");\n"
+    "    print_int(-x); print_str(\" \");\n"
+    "    print_int(x * -1); print_str(\" \");\n"
+    "    print_int(x / -1); print_str(\" \");\n"
+    "    print_int(x % -1); print_str(\" \");\n"
+    "    print_int(65536 * 65536); print_str(\" \");\n"
+    "    print_int(2147483647 + 1);\n"
+    "    return 0;\n"
+    "}\n";
+static const char* overflow_output =
+    "-2147483648 2147483647 -2147483648 -2147483648 -2147483648 0 0 -2147483648";
+
+/*
+ * test that ILOC arithmetic wraps around to 32 bits like Decaf's int, also
+ * after the optimizer folds constants
+ */
+START_TEST(A_iloc_wraparound)
+{
+    char* printed = run_decaf(overflow_program, NULL, NULL);
+    ck_assert_str_eq(printed, overflow_output);
+    free(printed);
+
+    TokenQueue* tokens = lex(overflow_program);
+    ASTNode* tree = parse(tokens);
+    ILOCInsnList* program = generate_code(tree);
+    Peephole_optimize(program, peephole_rules, peephole_rule_count, NULL);
+    printed = run_program(program, NULL);
+    ck_assert_str_eq(printed, overflow_output);
+    free(printed);
+    ILOCInsnList_free(program);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+
+    /* every address must fit in a register */
+    tokens = lex("int a[300000000];\nint b;\ndef int main() { return b; }\n");
+    tree = parse(tokens);
+    ErrorTrap trap;
+    ErrorTrap_push(&trap);
+    if (setjmp(trap.env) == 0) {
+        ILOCInsnList_free(generate_code(tree));
+        ck_assert_msg(false, "expected an error");
+    }
+    ErrorTrap_pop(&trap);
+    ck_assert_str_eq(trap.message, "Global variables too large on line 1\n");
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+    ILOCMachineConfig config;
+    ILOCMachineConfig_init(&config);
+    config.memory_size = (size_t)1 << 32;
+    ck_assert(strstr(try_iloc("main:\n    return\n", &config, stdout, NULL), "too large") != NULL);
+}
+END_TEST
+
+/*
+ * test that self and mutual tail recursion become loops
+ */
+START_TEST(A_tail_calls)
+{
+    const char* format =
+        "int g;\n"
+        "def int sum(int n, int acc) { if (n == 0) { return acc; } return sum(n - 1, acc + n); }\n"
+        "def bool is_even(int n) { if (n == 0) { return true; } return is_odd(n - 1); }\n"
+        "def bool is_odd(int n) { if (n == 0) { return false; } return is_even(n - 1); }\n"
+        "def void count(int n) { if (n > 0) { g = g + 1; count(n - 1); } }\n"
+        "def int main() {\n"
+        "    g = 0; count(%d);\n"
+        "    print_int(sum(%d, 0)); print_str(\" \"); print_bool(is_even(%d));\n"
+        "    return g + sum(3, 0);\n"
+        "}\n";
+    char text[1024];
+
+    /* same output, fewer calls */
+    snprintf(text, sizeof(text), format, 100, 100, 100);
+    ILOCStats before, after;
+    TailCallStats loops;
+    char* expected = run_decaf(text, NULL, &before);
+    char* printed = run_decaf(text, &loops, &after);
+    ck_assert_str_eq(expected, "5050 true");
+    ck_assert_str_eq(printed, expected);
+    ck_assert_int_eq(before.result, 106);
+    ck_assert_int_eq(after.result, 106);
+    ck_assert_int_eq(loops.tail_calls, 4);
+    ck_assert_int_eq(loops.rewritten, 4);
+    ck_assert_int_eq(loops.loops, 3);
+    ck_assert_int_eq(loops.merged, 1);
+    ck_assert(after.counts[ILOC_CALL] < before.counts[ILOC_CALL] / 10);
+    ck_assert(after.max_stack < before.max_stack / 10);
+    free(expected);
+    free(printed);
+
+    /* deep recursion runs in constant stack space */
+    snprintf(text, sizeof(text), format, 200000, 200000, 200001);
+    printed = run_decaf(text, &loops, &after);
+    ck_assert_str_eq(printed, "-1474736480 false");     /* 20000100000 wraps around */
+    ck_assert_int_eq(after.result, 200006);
+    ck_assert(after.max_stack < 256);
+
+    FILE* output = tmpfile();
+    TailCallStats_print(&loops, output);
+    free(printed);
+    printed = read_tmpfile(output);
+    ck_assert_str_eq(printed, "tail calls: 4 (4 rewritten), loops: 3 (1 merged pairs)\n");
+    free(printed);
+
+    /* each iteration starts with fresh locals, as each call did */
+    const char* fresh[] = {
+        "def int f(int n, int acc) { int t; if (n == 0) { return acc + t; } t = 5; return f(n - 1, acc + 1); }\n"
+        "def int main() { print_int(f(3, 0)); return 0; }\n",
+        "def int h(int n) { if (n > 0) { int u; if (u != 0) { return 100; } u = 1; return h(n - 1); } return 0; }\n"
+        "def int main() { print_int(h(3)); return 0; }\n",
+        "def int k(int n) { if (n == 0) { return 0; } if (true) { bool u; if (u) { return 100; } u = true; }\n"
+        "    return k(n - 1); }\n"
+        "def int main() { print_int(k(3)); return 0; }\n",
+        "def int a(int n) { int v; if (n == 0) { return v; } v = 7; return b(n - 1); }\n"
+        "def int b(int n) { bool w; if (w) { return 50; } w = true; return a(n); }\n"
+        "def int main() { print_int(a(3)); return 0; }\n",
+    };
+    for (int i = 0; i < 4; i++) {
+        expected = run_decaf(fresh[i], NULL, &before);
+        printed = run_decaf(fresh[i], &loops, &after);
+        ck_assert_str_eq(expected, (i == 0 ? "3" : "0"));
+        ck_assert_str_eq(printed, expected);
+        ck_assert_int_eq(loops.loops, 1);
+        free(expected);
+        free(printed);
+    }
+
+    /* a local inside a while loop can't be reset at the top of the body */
+    TokenQueue* tokens = lex(
+        "def int f(int n) { if (n == 0) { return 0; } while (n > 9) { int t; t = t + 1; n = n - t; }\n"
+        "    return f(n - 1); }\n"
+        "def int main() { return f(3); }\n");
+    ASTNode* tree = parse(tokens);
+    TailCall_transform(tree, &loops);
+    ck_assert_int_eq(loops.tail_calls, 2);
+    ck_assert_int_eq(loops.loops, 0);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+
+    /* a tail call inside a loop is left alone */
+    tokens = lex(
+        "def int f(int n) { while (n > 5) { return f(n - 1); } return n; }\n"
+        "def int main() { return f(9); }\n");
+    tree = parse(tokens);
+    TailCall_transform(tree, &loops);
+    ck_assert_int_eq(loops.tail_calls, 2);      /* including main's */
+    ck_assert_int_eq(loops.rewritten, 0);
+    ck_assert_int_eq(loops.loops, 0);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+/*
+ * find a function declaration by name
+ */
+static ASTNode* find_function (ASTNode* tree, const char* name)
+{
+    FOR_EACH (ASTNode*, func, tree->program.functions) {
+        if (strcmp(func->funcdecl.name, name) == 0) {
+            return func;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * test purity analysis and memoized interpretation
+ */
+START_TEST(A_memoization)
+{
+    TokenQueue* tokens = lex(
+        "int g;\n"
+        "def int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n"
+        "def bool even(int n) { if (n == 0) { return true; } return odd(n - 1); }\n"
+        "def bool odd(int n) { if (n == 0) { return false; } return even(n - 1); }\n"
+        "def int reads(int n) { return n + g; }\n"
+        "def int writes(int n) { int t; t = n; g = t; return t; }\n"
+        "def int prints(int n) { print_int(n); return n; }\n"
+        "def int caller(int n) { return fib(n) + reads(n); }\n"
+        "def int main() {\n"
+        "    int a[2];\n"
+        "    a[1] = fib(25); g = writes(2);\n"
+        "    print_int(a[1]); print_str(\" \"); print_bool(even(7)); print_str(\" \");\n"
+        "    print_int(caller(10)); print_str(\" \"); print_int(prints(3) + fib(25));\n"
+        "    return a[1] % 1000;\n"
+        "}\n");
+    ASTNode* tree = parse(tokens);
+
+    PurityStats purity;
+    Purity_analyze(tree, &purity);
+    ck_assert_int_eq(purity.functions, 8);
+    ck_assert_int_eq(purity.pure, 3);
+    ck_assert(Purity_is_pure(find_function(tree, "fib")));
+    ck_assert(Purity_is_pure(find_function(tree, "even")));
+    ck_assert(Purity_is_pure(find_function(tree, "odd")));
+    ck_assert(!Purity_is_pure(find_function(tree, "reads")));
+    ck_assert(!Purity_is_pure(find_function(tree, "writes")));
+    ck_assert(!Purity_is_pure(find_function(tree, "prints")));
+    ck_assert(!Purity_is_pure(find_function(tree, "caller")));
+    ck_assert(!Purity_is_pure(find_function(tree, "main")));
+
+    /* same output as the generated code, with or without the cache */
+    ILOCInsnList* program = generate_code(tree);
+    ILOCStats compiled;
+    char* expected = run_program(program, &compiled);
+    ck_assert_str_eq(expected, "75025 false 67 375028");
+    ILOCInsnList_free(program);
+
+    InterpConfig config;
+    InterpConfig_init(&config);
+    InterpStats plain, memoized;
+    FILE* output = tmpfile();
+    ck_assert_int_eq(Interp_run(tree, &config, output, &plain), compiled.result);
+    char* printed = read_tmpfile(output);
+    ck_assert_str_eq(printed, expected);
+    free(printed);
+    ck_assert_int_eq(plain.memo_lookups, 0);
+
+    config.memoize = true;
+    output = tmpfile();
+    ck_assert_int_eq(Interp_run(tree, &config, output, &memoized), compiled.result);
+    printed = read_tmpfile(output);
+    ck_assert_str_eq(printed, expected);
+    free(printed);
+
+    /* fib(25) runs its body once per argument (the second time, not at all) */
+    ck_assert(plain.calls > 400000);
+    ck_assert_int_eq(memoized.calls, 26 + 8 + 5);
+    ck_assert_int_eq(memoized.memo_entries, 26 + 8);
+    ck_assert_int_eq(memoized.memo_lookups, 2 * 24 + 3 + 8);
+    ck_assert_int_eq(memoized.memo_hits, memoized.memo_lookups - memoized.memo_entries);
+    ck_assert(memoized.steps * 100 < plain.steps);
+
+    /* a full cache just stops growing */
+    config.max_memo_entries = 5;
+    output = tmpfile();
+    Interp_run(tree, &config, output, &memoized);
+    printed = read_tmpfile(output);
+    ck_assert_str_eq(printed, expected);
+    free(printed);
+    ck_assert_int_eq(memoized.memo_entries, 5);
+
+    output = tmpfile();
+    InterpStats_print(&memoized, output);
+    printed = read_tmpfile(output);
+    ck_assert(strstr(printed, "pure functions: 3 of 8\n") != NULL);
+    ck_assert(strstr(printed, "memo lookups: ") != NULL);
+    free(printed);
+
+    free(expected);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+/*
+ * test that the interpreter's arithmetic wraps around to 32 bits, exactly as
+ * the ILOC simulator's does
+ */
+START_TEST(A_interp_wraparound)
+{
+    TokenQueue* tokens = lex(overflow_program);
+    ASTNode* tree = parse(tokens);
+    InterpConfig config;
+    InterpConfig_init(&config);
+    FILE* output = tmpfile();
+    Interp_run(tree, &config, output, NULL);
+    char* printed = read_tmpfile(output);
+    ck_assert_str_eq(printed, overflow_output);
+    free(printed);
+    ASTNode_free(tree);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+#ifdef ALLOC_COUNTING
+/*
+ * test that identifiers are passed from tokens to nodes without any
+ * intermediate heap allocations
+ */
+START_TEST(A_parse_allocations)
+{
+    TokenQueue* tokens = lex("def int f(int a, bool b) { int x; x = g(a, b); return x; }");
+    size_t before = alloc_count;
+    ASTNode* ast = parse(tokens);
+    size_t allocs = alloc_count - before;
+
+    /* program + 2 lists, funcdecl + parameter list + 2 parameters,
+     * block + 2 lists, vardecl, assignment + location, funccall + arg list
+     * + 2 locations, return + location */
+    ck_assert_int_eq(allocs, 19);
+    ASTNode_free(ast);
+    TokenQueue_free(tokens);
+}
+END_TEST
+
+/*
+ * test that a syntax error frees everything the parser had built so far
+ */
+START_TEST(A_parse_error_frees)
+{
+    const char* texts[] = {
+        "int g;\ndef int f(int a, bool b) { return a; }\n"
+        "def int main() { int a; if (a > 0) { while (true) { a = f(a, true; } } }",
+        "def int main() { if (true) { return 1; } else { int y; x[3] = ; } }",
+        "def int main() { int x; x = 2147483648; }",
+        "def int f(int a, bool) { }",
+        "def int main() { break }",
+        "def int main() { g(1, 2",
+    };
+    TokenQueue_free(lex(texts[0]));     /* fill the regex cache first */
+    for (int i = 0; i < 6; i++) {
+        long before = live_blocks;
+        TokenQueue* tokens = lex(texts[i]);
+        ErrorTrap trap;
+        ErrorTrap_push(&trap);
+        if (setjmp(trap.env) == 0) {
+            parse(tokens);
+            ck_assert_msg(false, "expected an error");
+        }
+        ErrorTrap_pop(&trap);
+        TokenQueue_free(tokens);
+        ck_assert_int_eq(live_blocks, before);
+    }
+}
+END_TEST
+#endif
+
+#endif
+
+/**
+ * @brief Register all test cases
+ * 
+ * @param s Test suite to which the tests should be added
+ */
+void public_tests (Suite *s)
+{
+    TCase *tc = tcase_create ("Public");
+
+    TEST(D_empty);
+    TEST(D_trivial);
+    TEST(D_int_var);
+    TEST(D_bool_var);
+
+    TEST(D_invalid_vardecl_no_type);
+    TEST(D_invalid_vardecl_no_semicolon);
+    TEST(D_invalid_parens);
+    TEST(D_invalid_brackets);
+    TEST(D_invalid_braces);
+    TEST(D_invalid_broken_assign);
+
+    TEST(C_void_func);
+    TEST(C_assign);
+    TEST(C_break);
+    TEST(C_continue);
+    TEST(C_return);
+    TEST(C_return_val);
+    TEST(C_invalid_return_break);
+    TEST(C_invalid_trailing_id);
+    TEST(C_declit);
+    TEST(C_hexlit);
+    TEST(C_strlit);
+
+    TEST(B_param_func);
+    TEST(B_conditional);
+    TEST(B_whileloop);
+    TEST(B_add_expr);
+    TEST(B_add_expr_bool);
+    TEST(B_neg_expr);
+    TEST(B_invalid_add);
+    TEST(B_declit_max);
+    TEST(B_hexlit_max);
+    TEST(B_declit_overflow);
+    TEST(B_hexlit_overflow);
+    TEST(B_declit_min);
+    TEST(B_hexlit_min);
+    TEST(B_declit_min_paren);
+    TEST(B_declit_min_sub);
+    TEST(B_array_size_overflow);
+    TEST(B_expr_tree);
+    TEST(B_invalid_double_neg);
+    TEST(B_invalid_trailing_arg);
+    TEST(B_long_comment);
+    TEST(B_long_comment_code);
+
+    TEST(A_arrays);
+    TEST(A_newline);
+    TEST(A_parallel_lex_matches);
+    TEST(A_parallel_lex_error);
+    TEST(A_relex_edits);
+    TEST(A_relex_indexed);
+    TEST(A_line_index);
+    TEST(A_static_visitors);
+    TEST(A_parallel_traversal);
+    TEST(A_document_new);
+    TEST(A_document_edit_function);
+    TEST(A_document_add_declaration);
+    TEST(A_document_unbalanced_brace);
+    TEST(A_document_invalid_token);
+    TEST(A_document_delete_function);
+    TEST(A_document_deferred);
+    TEST(A_ast_index);
+    TEST(A_compile_server);
+    TEST(A_watch_mode);
+    TEST(A_watch_symlink_loop);
+    TEST(A_watch_rename_dir);
+    TEST(A_watch_overflow);
+    TEST(A_library_api);
+    TEST(A_language_server);
+    TEST(A_streaming_print);
+    TEST(A_json_sexp_output);
+    TEST(A_graph_options);
+    TEST(A_iloc_print);
+    TEST(A_iloc_operands);
+    TEST(A_iloc_run);
+    TEST(A_iloc_pipeline);
+    TEST(A_iloc_stats_print);
+    TEST(A_iloc_cache);
+    TEST(A_iloc_parse_errors);
+    TEST(A_iloc_run_errors);
+    TEST(A_iloc_limit);
+    TEST(A_peephole_default_rules);
+    TEST(A_peephole_same_result);
+    TEST(A_peephole_stats_print);
+    TEST(A_peephole_constant_operand);
+    TEST(A_peephole_custom_rules);
+    TEST(A_schedule_block);
+    TEST(A_schedule_estimates);
+    TEST(A_schedule_serial);
+    TEST(A_schedule_generated);
+    TEST(A_schedule_stats_print);
+    TEST(A_iloc_wraparound);
+    TEST(A_tail_calls);
+    TEST(A_memoization);
+    TEST(A_interp_wraparound);
+#ifdef ALLOC_COUNTING
+    TEST(A_parse_allocations);
+    TEST(A_parse_error_frees);
+#endif
 
     suite_add_tcase (s, tc);
 }
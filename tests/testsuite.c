@@ -2,8 +2,58 @@
 
 jmp_buf decaf_error;
 
+#ifdef ALLOC_COUNTING
+
+_Thread_local size_t alloc_count = 0;
+_Thread_local long live_blocks = 0;
+
+void* __real_malloc (size_t size);
+void* __real_calloc (size_t count, size_t size);
+void* __real_realloc (void* ptr, size_t size);
+void __real_free (void* ptr);
+
+/*
+ * The linker redirects every malloc/calloc/realloc call in the test binary to
+ * these wrappers (see the --wrap flags in the Makefile); they count the call
+ * and forward it to the real allocator. Blocks are only counted as live on the
+ * thread that allocates and frees them, which is all a test needs.
+ */
+
+void* __wrap_malloc (size_t size)
+{
+    alloc_count++;
+    live_blocks++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc (size_t count, size_t size)
+{
+    alloc_count++;
+    live_blocks++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc (void* ptr, size_t size)
+{
+    alloc_count++;
+    live_blocks += (ptr == NULL);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free (void* ptr)
+{
+    live_blocks -= (ptr != NULL);
+    __real_free(ptr);
+}
+
+#endif
+
 void Error_throw_printf (const char* format, ...)
 {
+    va_list args;
+    va_start(args, format);
+    ErrorTrap_throw_va(format, args);   /* only returns if no trap is installed */
+    va_end(args);
     longjmp(decaf_error, 1);
 }
 
@@ -50,6 +100,10 @@ void run_testsuite ()
 int main (void)
 {
     srand((unsigned)time(NULL));
+
+    /* compile the lexer's regexes once, before Check forks a process per test */
+    TokenQueue_free(lex(""));
+
     run_testsuite ();
     return EXIT_SUCCESS;
 }
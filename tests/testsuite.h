@@ -9,11 +9,35 @@
 #include <stdint.h>
 #include <assert.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <check.h>
 
 #include "p1-lexer.h"
 #include "p2-parser.h"
+#include "parlex.h"
+#include "relex.h"
+#include "lineindex.h"
+#include "partrav.h"
+#include "astindex.h"
+#include "document.h"
+#include "server.h"
+#include "watch.h"
+#include "lsp.h"
+#include "stream.h"
+#include "emit.h"
+#include "json.h"
+#include "iloc.h"
+#include "ilocsim.h"
+#include "peephole.h"
+#include "codegen.h"
+#include "schedule.h"
+#include "tailcall.h"
+#include "interp.h"
+#include "decaf.h"
 
 /**
  * @brief Define a test case with a valid program
@@ -107,3 +131,18 @@ bool invalid_program (char* text);
  * @returns True if and only if the text was lexed and parsed successfully
  */
 bool valid_program (char* text);
+
+#ifdef ALLOC_COUNTING
+/**
+ * @brief Number of heap allocations made by the current thread
+ *
+ * Only available when the test suite is linked with the allocation wrappers
+ * (i.e., built with @c -DALLOC_COUNTING and @c --wrap=malloc etc.).
+ */
+extern _Thread_local size_t alloc_count;
+
+/**
+ * @brief Heap blocks allocated minus blocks freed by the current thread
+ */
+extern _Thread_local long live_blocks;
+#endif
@@ -0,0 +1,553 @@
+/**
+ * @file llgen.c
+ * @brief LL(1) parse table generator
+ *
+ * Reads an annotated grammar (see grammar.txt for the notation), computes
+ * FIRST and FOLLOW sets, checks that the grammar is LL(1), and writes the
+ * tables declared in include/lltable.h as a C source file.
+ *
+ * Usage: llgen <grammar-file> <output-file>
+ *
+ * The output file is only written if the grammar has no conflicts, so a bad
+ * edit to the grammar fails the build instead of producing a broken parser.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE        1024
+#define MAX_NAME        64
+#define MAX_TERMINALS   64
+#define MAX_NONTERMS    64
+#define MAX_PRODS       254
+#define MAX_ACTIONS     64
+#define MAX_RHS         8       /* must match LL_MAX_RHS */
+
+/**
+ * @brief Set of terminals (bit @c i is terminal @c i)
+ */
+typedef uint64_t TermSet;
+
+/**
+ * @brief Kinds of grammar symbols
+ */
+typedef enum SymbolType { TERM, NONTERM, ACTION } SymbolType;
+
+/**
+ * @brief Grammar symbol in a production
+ */
+typedef struct Symbol
+{
+    SymbolType type;        /**< @brief Terminal, nonterminal or action */
+    int index;              /**< @brief Index into the matching table */
+    bool keep;              /**< @brief Keep the token (terminals only) */
+} Symbol;
+
+/**
+ * @brief Production
+ */
+typedef struct Production
+{
+    int lhs;                /**< @brief Left-hand side nonterminal */
+    int length;             /**< @brief Number of right-hand side symbols */
+    Symbol rhs[MAX_RHS];    /**< @brief Right-hand side symbols */
+    int source_line;        /**< @brief Line in the grammar file */
+} Production;
+
+/*
+ * grammar (the generator is a short-lived tool, so plain globals are fine)
+ */
+static char terminals[MAX_TERMINALS][MAX_NAME];
+static char terminal_kinds[MAX_TERMINALS][MAX_NAME];
+static int nterminals = 0;
+static char nonterms[MAX_NONTERMS][MAX_NAME];
+static bool defined[MAX_NONTERMS];
+static int nnonterms = 0;
+static char action_names[MAX_ACTIONS][MAX_NAME];
+static char action_args[MAX_ACTIONS][MAX_NAME];
+static int nactions = 0;
+static Production prods[MAX_PRODS + 1];     /* production 0 is unused */
+static int nprods = 0;
+static TermSet start_follow = 0;
+
+/*
+ * analysis results
+ */
+static bool nullable[MAX_NONTERMS];
+static TermSet first[MAX_NONTERMS];
+static TermSet follow[MAX_NONTERMS];
+static int table[MAX_NONTERMS][MAX_TERMINALS];
+
+static const char* grammar_file;
+static int line_no = 0;
+
+static void fail (const char* message, const char* detail)
+{
+    fprintf(stderr, "%s:%d: %s%s%s\n", grammar_file, line_no, message,
+            (detail != NULL ? ": " : ""), (detail != NULL ? detail : ""));
+    exit(EXIT_FAILURE);
+}
+
+static int find_terminal (const char* name)
+{
+    for (int i = 0; i < nterminals; i++) {
+        if (strcmp(terminals[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int find_or_add_nonterm (const char* name)
+{
+    for (int i = 0; i < nnonterms; i++) {
+        if (strcmp(nonterms[i], name) == 0) {
+            return i;
+        }
+    }
+    if (nnonterms == MAX_NONTERMS) {
+        fail("too many nonterminals", name);
+    }
+    snprintf(nonterms[nnonterms], MAX_NAME, "%s", name);
+    return nnonterms++;
+}
+
+static int find_or_add_action (const char* name, const char* arg)
+{
+    for (int i = 0; i < nactions; i++) {
+        if (strcmp(action_names[i], name) == 0 && strcmp(action_args[i], arg) == 0) {
+            return i;
+        }
+    }
+    if (nactions == MAX_ACTIONS) {
+        fail("too many actions", name);
+    }
+    snprintf(action_names[nactions], MAX_NAME, "%s", name);
+    snprintf(action_args[nactions], MAX_NAME, "%s", arg);
+    return nactions++;
+}
+
+/**
+ * @brief Split a line into whitespace-separated words (quotes group)
+ *
+ * @returns Number of words
+ */
+static int split_words (char* line, char** words, int max_words)
+{
+    int n = 0;
+    char* p = line;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            break;
+        }
+        if (n == max_words) {
+            fail("line too long", NULL);
+        }
+        words[n++] = p;
+        bool quoted = false;
+        while (*p != '\0' && (quoted || (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))) {
+            if (*p == '"') {
+                quoted = !quoted;
+            }
+            p++;
+        }
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Parse the right-hand side of a production
+ */
+static void add_production (int lhs, char** words, int nwords)
+{
+    if (nprods == MAX_PRODS) {
+        fail("too many productions", NULL);
+    }
+    Production* prod = &prods[++nprods];
+    prod->lhs = lhs;
+    prod->length = 0;
+    prod->source_line = line_no;
+    defined[lhs] = true;
+
+    for (int i = 0; i < nwords; i++) {
+        char name[MAX_NAME];
+        snprintf(name, MAX_NAME, "%s", words[i]);
+        if (strcmp(name, "e") == 0) {
+            continue;   /* empty string */
+        }
+        if (prod->length == MAX_RHS) {
+            fail("production too long", NULL);
+        }
+        Symbol* sym = &prod->rhs[prod->length++];
+        sym->keep = false;
+
+        if (name[0] == '@') {
+            /* semantic action, possibly with an argument */
+            char arg[MAX_NAME] = "0";
+            char* paren = strchr(name, '(');
+            if (paren != NULL) {
+                char* close = strchr(paren, ')');
+                if (close == NULL) {
+                    fail("missing ')' in action", name);
+                }
+                *close = '\0';
+                snprintf(arg, MAX_NAME, "%s", paren + 1);
+                *paren = '\0';
+            }
+            sym->type = ACTION;
+            sym->index = find_or_add_action(name + 1, arg);
+            continue;
+        }
+
+        size_t len = strlen(name);
+        if (len > 1 && name[len-1] == '$') {
+            sym->keep = true;
+            name[len-1] = '\0';
+        }
+        int t = find_terminal(name);
+        if (t >= 0) {
+            sym->type = TERM;
+            sym->index = t;
+        } else if (name[0] == '"') {
+            fail("undeclared terminal", name);
+        } else if (sym->keep) {
+            fail("only terminals can be kept", name);
+        } else {
+            sym->type = NONTERM;
+            sym->index = find_or_add_nonterm(name);
+        }
+    }
+}
+
+static void read_grammar (FILE* input)
+{
+    char line[MAX_LINE];
+    char* words[MAX_LINE / 2];
+    int current_lhs = -1;
+
+    while (fgets(line, MAX_LINE, input) != NULL) {
+        line_no++;
+        int nwords = split_words(line, words, MAX_LINE / 2);
+        if (nwords == 0) {
+            continue;
+        }
+
+        if (strcmp(words[0], "%token") == 0) {
+            if (nwords != 3) {
+                fail("expected: %token NAME KIND", NULL);
+            }
+            if (nterminals == MAX_TERMINALS) {
+                fail("too many terminals", words[1]);
+            }
+            if (find_terminal(words[1]) >= 0) {
+                fail("duplicate terminal", words[1]);
+            }
+            snprintf(terminals[nterminals], MAX_NAME, "%s", words[1]);
+            snprintf(terminal_kinds[nterminals], MAX_NAME, "%s", words[2]);
+            nterminals++;
+
+        } else if (strcmp(words[0], "%start") == 0) {
+            if (nwords != 2 || nnonterms != 0) {
+                fail("%start must name one symbol and come before the productions", NULL);
+            }
+            find_or_add_nonterm(words[1]);
+
+        } else if (strcmp(words[0], "%follow") == 0) {
+            for (int i = 1; i < nwords; i++) {
+                int t = find_terminal(words[i]);
+                if (t < 0) {
+                    fail("undeclared terminal", words[i]);
+                }
+                start_follow |= (TermSet)1 << t;
+            }
+
+        } else if (strcmp(words[0], "|") == 0) {
+            if (current_lhs < 0) {
+                fail("alternative without a production", NULL);
+            }
+            add_production(current_lhs, words + 1, nwords - 1);
+
+        } else if (nwords >= 2 && strcmp(words[1], "->") == 0) {
+            if (nnonterms == 0) {
+                fail("missing %start", NULL);
+            }
+            if (find_terminal(words[0]) >= 0) {
+                fail("terminal on left-hand side", words[0]);
+            }
+            current_lhs = find_or_add_nonterm(words[0]);
+            add_production(current_lhs, words + 2, nwords - 2);
+
+        } else {
+            fail("syntax error", words[0]);
+        }
+    }
+
+    line_no = 0;
+    for (int i = 0; i < nnonterms; i++) {
+        if (!defined[i]) {
+            fail("nonterminal has no productions", nonterms[i]);
+        }
+    }
+}
+
+/**
+ * @brief Compute FIRST of a symbol sequence
+ *
+ * @param nullable_out Set to true if the whole sequence can derive the empty string
+ */
+static TermSet first_of (const Symbol* syms, int n, bool* nullable_out)
+{
+    TermSet set = 0;
+    for (int i = 0; i < n; i++) {
+        if (syms[i].type == TERM) {
+            *nullable_out = false;
+            return set | ((TermSet)1 << syms[i].index);
+        } else if (syms[i].type == NONTERM) {
+            set |= first[syms[i].index];
+            if (!nullable[syms[i].index]) {
+                *nullable_out = false;
+                return set;
+            }
+        }
+        /* actions derive the empty string */
+    }
+    *nullable_out = true;
+    return set;
+}
+
+static void compute_first_sets ()
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int p = 1; p <= nprods; p++) {
+            bool is_nullable;
+            TermSet set = first_of(prods[p].rhs, prods[p].length, &is_nullable);
+            int lhs = prods[p].lhs;
+            if ((first[lhs] | set) != first[lhs]) {
+                first[lhs] |= set;
+                changed = true;
+            }
+            if (is_nullable && !nullable[lhs]) {
+                nullable[lhs] = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+static void compute_follow_sets ()
+{
+    follow[0] = start_follow;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int p = 1; p <= nprods; p++) {
+            Production* prod = &prods[p];
+            for (int i = 0; i < prod->length; i++) {
+                if (prod->rhs[i].type != NONTERM) {
+                    continue;
+                }
+                int b = prod->rhs[i].index;
+                bool rest_nullable;
+                TermSet set = first_of(prod->rhs + i + 1, prod->length - i - 1, &rest_nullable);
+                if (rest_nullable) {
+                    set |= follow[prod->lhs];
+                }
+                if ((follow[b] | set) != follow[b]) {
+                    follow[b] |= set;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+static void print_production (FILE* output, int p)
+{
+    fprintf(output, "%s ->", nonterms[prods[p].lhs]);
+    if (prods[p].length == 0) {
+        fprintf(output, " e");
+    }
+    for (int i = 0; i < prods[p].length; i++) {
+        Symbol* sym = &prods[p].rhs[i];
+        switch (sym->type) {
+            case TERM:
+                fprintf(output, " %s%s", terminals[sym->index], sym->keep ? "$" : "");
+                break;
+            case NONTERM:
+                fprintf(output, " %s", nonterms[sym->index]);
+                break;
+            case ACTION:
+                fprintf(output, " @%s", action_names[sym->index]);
+                if (strcmp(action_args[sym->index], "0") != 0) {
+                    fprintf(output, "(%s)", action_args[sym->index]);
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Fill in the parse table, reporting every LL(1) conflict
+ *
+ * @returns Number of conflicts
+ */
+static int build_table ()
+{
+    int conflicts = 0;
+    for (int p = 1; p <= nprods; p++) {
+        bool is_nullable;
+        TermSet predict = first_of(prods[p].rhs, prods[p].length, &is_nullable);
+        if (is_nullable) {
+            predict |= follow[prods[p].lhs];
+        }
+        for (int t = 0; t < nterminals; t++) {
+            if (!(predict & ((TermSet)1 << t))) {
+                continue;
+            }
+            int* entry = &table[prods[p].lhs][t];
+            if (*entry != 0) {
+                fprintf(stderr, "%s:%d: LL(1) conflict on %s between\n    ",
+                        grammar_file, prods[p].source_line, terminals[t]);
+                print_production(stderr, *entry);
+                fprintf(stderr, "   (line %d)\n    ", prods[*entry].source_line);
+                print_production(stderr, p);
+                fprintf(stderr, "   (line %d)\n", prods[p].source_line);
+                conflicts++;
+            } else {
+                *entry = p;
+            }
+        }
+    }
+    return conflicts;
+}
+
+static void print_set (FILE* output, TermSet set)
+{
+    fprintf(output, "{");
+    for (int t = 0; t < nterminals; t++) {
+        if (set & ((TermSet)1 << t)) {
+            fprintf(output, " %s", terminals[t]);
+        }
+    }
+    fprintf(output, " }");
+}
+
+static void print_upper (FILE* output, const char* text)
+{
+    for (const char* p = text; *p != '\0'; p++) {
+        fputc((*p >= 'a' && *p <= 'z') ? *p - 'a' + 'A' : *p, output);
+    }
+}
+
+static void write_tables (FILE* output)
+{
+    fprintf(output, "/**\n");
+    fprintf(output, " * @file expr-table.c\n");
+    fprintf(output, " * @brief LL(1) parse table for Decaf expressions\n");
+    fprintf(output, " *\n");
+    fprintf(output, " * GENERATED by tools/llgen from grammar.txt; do not edit by hand.\n");
+    fprintf(output, " */\n\n");
+    fprintf(output, "#include \"lltable.h\"\n\n");
+
+    fprintf(output, "/*\n * FIRST and FOLLOW sets\n *\n");
+    for (int n = 0; n < nnonterms; n++) {
+        fprintf(output, " * %-8s FIRST  ", nonterms[n]);
+        print_set(output, first[n]);
+        fprintf(output, "%s\n", nullable[n] ? " + e" : "");
+        fprintf(output, " * %-8s FOLLOW ", "");
+        print_set(output, follow[n]);
+        fprintf(output, "\n");
+    }
+    fprintf(output, " */\n\n");
+
+    fprintf(output, "const LLProduction ll_productions[] = {\n");
+    fprintf(output, "    { 0, { 0 } },\n");
+    for (int p = 1; p <= nprods; p++) {
+        fprintf(output, "    /* %d: ", p);
+        print_production(output, p);
+        fprintf(output, " */\n    { %d, { ", prods[p].length);
+        for (int i = 0; i < prods[p].length; i++) {
+            Symbol* sym = &prods[p].rhs[i];
+            fprintf(output, "%s", (i > 0 ? ", " : ""));
+            switch (sym->type) {
+                case TERM:
+                    fprintf(output, "%s%s", terminal_kinds[sym->index], sym->keep ? " | LL_KEEP" : "");
+                    break;
+                case NONTERM:
+                    fprintf(output, "LL_NT(%d)", sym->index);
+                    break;
+                case ACTION:
+                    fprintf(output, "LL_ACTION(%d)", sym->index);
+                    break;
+            }
+        }
+        fprintf(output, "%s } },\n", (prods[p].length == 0 ? "0" : ""));
+    }
+    fprintf(output, "};\n\n");
+
+    fprintf(output, "const LLAction ll_actions[] = {\n");
+    for (int a = 0; a < nactions; a++) {
+        fprintf(output, "    { LL_");
+        print_upper(output, action_names[a]);
+        fprintf(output, ", %s },\n", action_args[a]);
+    }
+    fprintf(output, "};\n\n");
+
+    fprintf(output, "const unsigned char ll_table[][NUM_TOKEN_KINDS] = {\n");
+    for (int n = 0; n < nnonterms; n++) {
+        fprintf(output, "    /* %s */ {", nonterms[n]);
+        bool any = false;
+        for (int t = 0; t < nterminals; t++) {
+            if (table[n][t] != 0) {
+                fprintf(output, "%s\n        [%s] = %d", (any ? "," : ""), terminal_kinds[t], table[n][t]);
+                any = true;
+            }
+        }
+        fprintf(output, "\n    },\n");
+    }
+    fprintf(output, "};\n");
+}
+
+int main (int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <grammar-file> <output-file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    grammar_file = argv[1];
+    FILE* input = fopen(grammar_file, "r");
+    if (input == NULL) {
+        fprintf(stderr, "Could not read file: %s\n", grammar_file);
+        return EXIT_FAILURE;
+    }
+    read_grammar(input);
+    fclose(input);
+
+    compute_first_sets();
+    compute_follow_sets();
+    int conflicts = build_table();
+    if (conflicts > 0) {
+        fprintf(stderr, "%s: %d LL(1) conflict(s); table not written\n", grammar_file, conflicts);
+        return EXIT_FAILURE;
+    }
+
+    FILE* output = fopen(argv[2], "w");
+    if (output == NULL) {
+        fprintf(stderr, "Could not write file: %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    write_tables(output);
+    fclose(output);
+    return EXIT_SUCCESS;
+}